@@ -11,6 +11,32 @@ extern "C" {
 #define SLP_BUILD_CORE
 #endif
 
+/*
+ * Per tasklet accounting, see stackless.enable_tasklet_stats().
+ * All times are nanoseconds of the monotonic clock.
+ */
+typedef struct _tasklet_stats {
+    _PyTime_t run_time;             /* time the tasklet was the current tasklet */
+    _PyTime_t blocked_time;         /* time the tasklet was blocked on channels */
+    Py_ssize_t soft_switches;       /* soft switches to the tasklet */
+    Py_ssize_t hard_switches;       /* hard switches to the tasklet */
+    _PyTime_t run_start;            /* private: current since or 0 */
+    _PyTime_t block_start;          /* private: blocked since or 0 */
+} PyTaskletStatsStruc;
+
+/*
+ * The profile and tracing state of a tasklet, that is not current.
+ * Most tasklets never run with a trace or profile function. Therefore
+ * a tasklet allocates this structure on demand, see slp_tasklet_trace_new().
+ */
+typedef struct _tasklet_trace {
+    Py_tracefunc profilefunc;
+    Py_tracefunc tracefunc;
+    PyObject *profileobj;
+    PyObject *traceobj;
+    int tracing;
+} PyTaskletTraceStruc;
+
 #ifdef SLP_BUILD_CORE
 
 #if defined(MS_WIN32) && !defined(MS_WIN64) && defined(_M_IX86)
@@ -121,6 +147,23 @@ typedef struct _tasklet {
     /* bits stuff */
     struct _tasklet_flags flags;
     int recursion_depth;
+    int priority;                   /* tasklets with a higher priority run first */
+    double deadline;                /* earliest deadline first, Py_HUGE_VAL: none */
+    struct _slp_timer *timer;       /* the pending timer of a sleeping tasklet */
+    struct _slp_select *select;     /* the pending select of a tasklet or its proxy */
+    int io_fd;                      /* the file descriptor a tasklet waits for or -1 */
+    int io_events;                  /* SLP_REACTOR_READ or SLP_REACTOR_WRITE */
+    struct _slp_thread_job *job;    /* the pending run_in_thread() call */
+    PyTaskletStatsStruc stats;      /* run time and switch accounting */
+    PyObject *stats_tag;            /* aggregate the stats of ended tasklets by this tag */
+    Py_ssize_t nswitches;           /* switches to the tasklet, always counted */
+    /* A tasklet, that was set up but never ran, has no frame yet. Instead it
+     * holds the callable and its arguments. It creates its initial cframe,
+     * when it runs for the first time. setup_kwargs may be NULL.
+     */
+    PyObject *setup_func;
+    PyObject *setup_args;
+    PyObject *setup_kwargs;
     PyObject *def_globals;
     PyObject *tsk_weakreflist;
     /* If the tasklet is current: NULL. (The context of a current tasklet is
@@ -128,15 +171,12 @@ typedef struct _tasklet {
      * If the tasklet is not current: the context for the tasklet */
     PyObject *context;
 
-    /* If the tasklet is current: NULL. (The profile and tracing state of a
-     *  current tasklet is stored in the thread state.)
-     * If the tasklet is not current: the profile and tracing state for the tasklet.
+    /* If the tasklet is current: NULL or an empty structure. (The profile
+     *  and tracing state of a current tasklet is stored in the thread state.)
+     * If the tasklet is not current: NULL or the profile and tracing state
+     *  for the tasklet. NULL means, that the tasklet neither profiles nor traces.
      */
-    Py_tracefunc profilefunc;
-    Py_tracefunc tracefunc;
-    PyObject *profileobj;
-    PyObject *traceobj;
-    int tracing;
+    PyTaskletTraceStruc *trace;
 } PyTaskletObject;
 
 
@@ -161,6 +201,22 @@ typedef struct _cstack {
          */
     unsigned long exception_list;
 #endif
+    /* Separate stack mode, see slp_transfer.c
+     * region: the separate stack region, that holds the C-state of this
+     *     cstack in place, or NULL. If not NULL, the cstack has no
+     *     stack[] buffer at all and the C-state starts at stackref.
+     * inplace: true, if the C-state is still in place on the stack of
+     *     the thread and has not been copied into stack[] yet.
+     * cstack_root: the value of tstate->st.cstack_root at save time.
+     */
+    struct _slp_stack_region *region;
+    intptr_t *stackref;
+    intptr_t *cstack_root;
+    int inplace;
+    /* The size class of the stack[] buffer in the pool of unused cstacks or
+     * -1, if the cstack does not belong to the pool. See stacklesseval.c.
+     */
+    int size_class;
     /* The end-address (sic!) of the stack stored in the cstack.
      */
     intptr_t *startaddr;
@@ -235,6 +291,12 @@ typedef struct _channel {
     int balance;
     struct _channel_flags flags;
     PyObject *chan_weakreflist;
+    /* the ring buffer of a buffered channel */
+    Py_ssize_t capacity;            /* the maximum number of buffered values */
+    Py_ssize_t count;               /* the number of buffered values */
+    Py_ssize_t first;               /* the index of the oldest value */
+    Py_ssize_t size;                /* the allocated size of the buffer */
+    PyObject **buffer;
 } PyChannelObject;
 
 struct _cframe;
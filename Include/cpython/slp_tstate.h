@@ -4,6 +4,9 @@
 
 /* forward declarations */
 struct _cstack;
+struct _slp_stack_region;
+struct _slp_timer_wheel;
+struct _slp_reactor;
 struct _bomb;
 struct _tasklet;
 struct _ts;
@@ -27,6 +30,12 @@ typedef struct _sts {
     intptr_t *cstack_base;
     /* stack overflow check and init flag */
     intptr_t *cstack_root;
+    /* the separate stack region we are running on or NULL, if we are
+     * running on the stack of the thread */
+    struct _slp_stack_region *cstack_region;
+    /* borrowed ref: the cstack, whose C-state still is in place on the
+     * stack of the thread */
+    struct _cstack *cstack_inplace;
     /* main tasklet */
     struct _tasklet *main;
     /* runnable tasklets */
@@ -36,12 +45,28 @@ typedef struct _sts {
     long tick_counter;
     long tick_watermark;
     long interval;
+    _PyTime_t time_watermark;   /* wallclock mode: deadline of the timeslice */
+    _PyTime_t time_interval;    /* wallclock mode: length of the timeslice */
     PyObject * (*interrupt) (void);    /* the fast scheduler */
     struct {
         PyObject *block_lock;                   /* to block the thread */
         int is_blocked;                         /* waiting to be unblocked */
         int is_idle;                            /* unblocked, but waiting for GIL */
+        int is_idle_worker;                     /* an idle thread of the worker pool */
+        /* work stealing statistics, see scheduling.c */
+        Py_ssize_t steal_attempts;              /* how often this thread tried to steal */
+        Py_ssize_t steals;                      /* how often this thread stole tasklets */
+        Py_ssize_t tasklets_stolen;             /* tasklets stolen by this thread */
+        Py_ssize_t tasklets_lost;               /* tasklets stolen from this thread */
+        Py_ssize_t pending_jobs;                /* tasklets waiting for the worker pool */
     } thread;
+    /* borrowed ref: the tasklet the scheduler is about to switch to. Other
+     * threads must not steal it. */
+    struct _tasklet *switch_target;
+    /* the timers of sleeping tasklets, created on demand */
+    struct _slp_timer_wheel *timers;
+    /* the I/O reactor of tasklets waiting for file descriptors, created on demand */
+    struct _slp_reactor *reactor;
     PyObject *del_post_switch;                  /* To decref after a switch */
     PyObject *interrupted;                      /* The interrupted tasklet in stackles.run() */
     PyObject *watchdogs;                        /* the stack of currently running watchdogs */
@@ -78,11 +103,18 @@ typedef struct _sts {
     tstate->st.serial_last_jump = 0; \
     tstate->st.cstack_base = NULL; \
     tstate->st.cstack_root = NULL; \
+    tstate->st.cstack_region = NULL; \
+    tstate->st.cstack_inplace = NULL; \
     tstate->st.main = NULL; \
     tstate->st.current = NULL; \
+    tstate->st.switch_target = NULL; \
+    tstate->st.timers = NULL; \
+    tstate->st.reactor = NULL; \
     tstate->st.tick_counter = 0; \
     tstate->st.tick_watermark = 0; \
     tstate->st.interval = 0; \
+    tstate->st.time_watermark = 0; \
+    tstate->st.time_interval = 0; \
     tstate->st.interrupt = NULL; \
     tstate->st.del_post_switch = NULL; \
     tstate->st.interrupted = NULL; \
@@ -105,6 +137,8 @@ typedef struct _sts {
 
 
 void slp_kill_tasks_with_stacks(struct _ts *tstate);
+void slp_timer_clear(struct _ts *tstate);
+void slp_reactor_clear(struct _ts *tstate);
 
 #define __STACKLESS_PYSTATE_CLEAR \
     Py_CLEAR(tstate->st.initial_stub); \
@@ -112,13 +146,25 @@ void slp_kill_tasks_with_stacks(struct _ts *tstate);
     Py_CLEAR(tstate->st.interrupted); \
     Py_CLEAR(tstate->st.watchdogs); \
     Py_CLEAR(tstate->st.unwinding_retval); \
+    slp_timer_clear(tstate); \
+    slp_reactor_clear(tstate); \
+    if (tstate->st.cstack_inplace != NULL) { \
+        tstate->st.cstack_inplace->inplace = 0; \
+        tstate->st.cstack_inplace = NULL; \
+    } \
     __STACKLESS_PYSTATE_CLEAR_NEXT_FRAME
 
 #define STACKLESS_PYSTATE_NEW \
     __STACKLESS_PYSTATE_NEW \
     tstate->st.thread.block_lock = NULL; \
     tstate->st.thread.is_blocked = 0;\
-    tstate->st.thread.is_idle = 0;
+    tstate->st.thread.is_idle = 0; \
+    tstate->st.thread.is_idle_worker = 0; \
+    tstate->st.thread.steal_attempts = 0; \
+    tstate->st.thread.steals = 0; \
+    tstate->st.thread.tasklets_stolen = 0; \
+    tstate->st.thread.tasklets_lost = 0; \
+    tstate->st.thread.pending_jobs = 0;
 
 #define STACKLESS_PYSTATE_CLEAR \
     __STACKLESS_PYSTATE_CLEAR \
@@ -62,6 +62,11 @@ PyObject * PyStackless_Pickle_ModuleDict(PyObject *pickler, PyObject *self);
 
 PyObject *slp_init_prickelpit(void);
 
+/* native tasklet snapshots */
+extern PyTypeObject PyCheckpointer_Type;
+PyObject * slp_snapshot(PyObject *tasklets, PyObject *buffer_callback);
+PyObject * slp_restore(PyObject *data, PyObject *previous, PyObject *buffers);
+
 /* pickle with stack spilling */
 int slp_safe_pickling(int(*save)(PyObject *, PyObject *, int),
                       PyObject *self, PyObject *args,
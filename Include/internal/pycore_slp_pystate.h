@@ -16,14 +16,38 @@
 
 /* This include file is included from pycore_pystate.h only */
 
-/* how many cstacks to cache at all */
+/* the default limits of the pool of unused cstacks: the maximum number
+ * of cstacks and the maximum number of bytes. The limits can be changed at
+ * runtime using _stackless.set_cstack_cache_limits(). */
 #ifndef SLP_CSTACK_MAXCACHE
-#define SLP_CSTACK_MAXCACHE     100
+#define SLP_CSTACK_MAXCACHE     1000
 #endif
+#ifndef SLP_CSTACK_MAXCACHEBYTES
+#define SLP_CSTACK_MAXCACHEBYTES (16 * 1024 * 1024)
+#endif
+
+/* cstacks with up to 2**SLP_CSTACK_MAXSIZE_LOG2 stack words are pooled.
+ * There are four size classes per power of two. */
+#ifndef SLP_CSTACK_MAXSIZE_LOG2
+#define SLP_CSTACK_MAXSIZE_LOG2 16
+#endif
+#define SLP_CSTACK_MAXSIZE      ((Py_ssize_t)1 << SLP_CSTACK_MAXSIZE_LOG2)
+#define SLP_CSTACK_CLASSES      (4 * (SLP_CSTACK_MAXSIZE_LOG2 - 3))
 
-/* adjust slots to typical size of a few recursions on your system */
-#ifndef SLP_CSTACK_SLOTS
-#define SLP_CSTACK_SLOTS        1024
+/* the usable size of a separate stack region in bytes. The default matches
+ * the usual size of a thread stack. Only used pages consume memory. */
+#ifndef SLP_SEPARATE_STACK_SIZE
+#define SLP_SEPARATE_STACK_SIZE (8 * 1024 * 1024)
+#endif
+
+/* how many unused separate stack regions to keep */
+#ifndef SLP_SEPARATE_STACK_MAXCACHE
+#define SLP_SEPARATE_STACK_MAXCACHE 16
+#endif
+
+/* the default maximum number of threads of the worker pool */
+#ifndef SLP_THREAD_POOL_SIZE
+#define SLP_THREAD_POOL_SIZE 8
 #endif
 
 typedef struct {
@@ -34,8 +58,16 @@ typedef struct {
     struct _bomb * mem_bomb;                    /* a permanent bomb to use for memory errors */
     PyObject * schedule_hook;                   /* the schedule callback function */
     slp_schedule_hook_func * schedule_fasthook; /* the fast C-only schedule_hook */
+    struct _slp_trace * trace;                  /* the scheduler event ring buffer, see schedtrace.c */
+    PyObject * tasklet_stats_by_tag;            /* the accumulated stats of ended tasklets */
+    _PyTime_t tasklet_stats_since;              /* the time of the last enable_tasklet_stats() */
+    struct _slp_thread_pool * thread_pool;      /* the worker threads of run_in_thread(), see threadpool.c */
+    int thread_pool_size;                       /* the maximum number of worker threads */
     struct _ts * initial_tstate;                /* recording the main thread state */
     uint8_t enable_softswitch;                  /* the flag which decides whether we try to use soft switching */
+    uint8_t enable_separate_stacks;             /* the flag which decides whether hard switching uses separate stacks */
+    uint8_t enable_work_stealing;               /* the flag which decides whether idle threads steal tasklets */
+    uint8_t enable_tasklet_stats;               /* the flag which decides whether tasklets account their run time */
     uint8_t pickleflags;                        /* flags for pickling / unpickling */
 } PyStacklessInterpreterState;
 
@@ -44,8 +76,18 @@ typedef struct {
      assert((tstate)->interp->st.initial_tstate), \
      (tstate)->interp->st.initial_tstate)
 
+void slp_thread_pool_clear(struct _is *interp);
+
 #define SPL_INTERPRETERSTATE_NEW(interp)       \
-    (interp)->st.enable_softswitch = 1;
+    (interp)->st.trace = NULL;                 \
+    (interp)->st.tasklet_stats_by_tag = NULL;  \
+    (interp)->st.tasklet_stats_since = 0;      \
+    (interp)->st.thread_pool = NULL;           \
+    (interp)->st.thread_pool_size = SLP_THREAD_POOL_SIZE; \
+    (interp)->st.enable_softswitch = 1;        \
+    (interp)->st.enable_separate_stacks = 0;   \
+    (interp)->st.enable_work_stealing = 0;     \
+    (interp)->st.enable_tasklet_stats = 0;
 
 #define SPL_INTERPRETERSTATE_CLEAR(interp)     \
     (interp)->st.cstack_chain = NULL; /* uncounted ref */  \
@@ -55,7 +97,14 @@ typedef struct {
     Py_CLEAR((interp)->st.channel_hook);       \
     Py_CLEAR((interp)->st.schedule_hook);      \
     (interp)->st.schedule_fasthook = NULL;     \
+    PyMem_RawFree((interp)->st.trace);         \
+    (interp)->st.trace = NULL;                 \
+    Py_CLEAR((interp)->st.tasklet_stats_by_tag); \
+    slp_thread_pool_clear(interp);             \
     (interp)->st.enable_softswitch = 1;        \
+    (interp)->st.enable_separate_stacks = 0;   \
+    (interp)->st.enable_work_stealing = 0;     \
+    (interp)->st.enable_tasklet_stats = 0;     \
     (interp)->st.pickleflags = 0;
 
 /*
@@ -79,8 +128,19 @@ struct _stackless_runtime_state {
     int try_stackless;
 
     /* Used to manage free C-stack objects, see stacklesseval.c */
-    int cstack_cachecount;
-    struct _cstack *cstack_cache[SLP_CSTACK_SLOTS];
+    struct {
+        /* per size class: most and least recently released cstack */
+        struct _cstack *head[SLP_CSTACK_CLASSES];
+        struct _cstack *tail[SLP_CSTACK_CLASSES];
+        Py_ssize_t count;                       /* number of pooled cstacks */
+        Py_ssize_t bytes;                       /* size of pooled cstacks */
+        Py_ssize_t maxcount;                    /* limits */
+        Py_ssize_t maxbytes;
+        PY_LONG_LONG clock;                     /* release time stamp */
+        PY_LONG_LONG hits;                      /* statistics */
+        PY_LONG_LONG misses;
+        PY_LONG_LONG evictions;
+    } cstack_pool;
 
     /*
      * Used during a hard switch.
@@ -89,7 +149,13 @@ struct _stackless_runtime_state {
         struct _cstack **cstprev;
         struct _cstack *cst;
         struct _tasklet *prev;
+        int separate;                           /* use the separate stack mode */
+        struct _slp_stack_region *release;      /* release after the switch */
     } transfer;
+
+    /* Used to manage unused separate stack regions, see slp_transfer.c */
+    int region_cachecount;
+    struct _slp_stack_region *region_cache;
 };
 
 #ifdef Py_BUILD_CORE
@@ -335,6 +335,12 @@ PyObject * slp_wrap_call_frame(PyFrameObject *frame, int exc, PyObject *retval);
 PyCStackObject * slp_cstack_new(PyCStackObject **cst, intptr_t *stackref, PyTaskletObject *task);
 size_t slp_cstack_save(PyCStackObject *cstprev);
 void slp_cstack_restore(PyCStackObject *cst);
+PyCStackObject * slp_cstack_new_region(PyCStackObject **cst, intptr_t *stackref,
+                                       struct _slp_stack_region *region,
+                                       PyTaskletObject *task);
+PyObject * slp_run_tasklet(void);
+void slp_cstack_pool_trim(Py_ssize_t maxcount, Py_ssize_t maxbytes);
+Py_ssize_t slp_cstack_pool_class_capacity(int size_class);
 
 int slp_transfer(PyCStackObject **cstprev, PyCStackObject *cst, PyTaskletObject *prev);
 
@@ -353,6 +359,7 @@ PyAPI_FUNC(void) _PyStackless_Init(void);
 void slp_stacklesseval_fini(void);
 void slp_scheduling_fini(void);
 void slp_cframe_fini(void);
+void slp_tasklet_fini(void);
 
 void PyStackless_Fini(void);
 
@@ -382,6 +389,9 @@ PyObject * slp_reduce_frame(PyFrameObject * frame);
 struct _frame * slp_clone_frame(struct _frame *f);
 struct _frame * slp_ensure_new_frame(struct _frame *f);
 
+/* frame cloning for tasklet.clone() */
+PyObject * slp_clone_frames(PyObject *frames, PyObject *copy);
+
 
 /* access to the current watchdog tasklet */
 PyTaskletObject * slp_get_watchdog(PyThreadState *ts, int interrupt);
@@ -597,10 +607,183 @@ do { \
     (__task)->__next = (__task)->__prev = NULL; \
 } while(0)
 
+/* The order of the run queue: true, if tasklet a must run before tasklet b.
+ * Tasklets with a higher priority run first. Among tasklets of the same
+ * priority, the tasklet with the earliest deadline runs first. Tasklets
+ * without a deadline keep their FIFO order.
+ */
+#define SLP_TASKLET_PRECEDES(a, b) \
+    ((a)->priority > (b)->priority || \
+     ((a)->priority == (b)->priority && (a)->deadline < (b)->deadline))
+
+/* timers, see timerwheel.c
+ *
+ * Each thread has a hierarchical timer wheel with SLP_TIMER_LEVELS levels of
+ * SLP_TIMER_SLOTS slots. A tick of the wheel is SLP_TIMER_RESOLUTION
+ * nanoseconds of the monotonic clock. A timer wakes up a tasklet, that is
+ * not runnable. A tasklet has at most one timer.
+ */
+#define SLP_TIMER_RESOLUTION    (1000 * 1000)
+#define SLP_TIMER_SLOT_BITS     6
+#define SLP_TIMER_SLOTS         (1 << SLP_TIMER_SLOT_BITS)
+#define SLP_TIMER_LEVELS        4
+
+/* scheduler event tracing, see schedtrace.c
+ *
+ * If the interpreter has a trace buffer, the scheduler records an event
+ * for every tasklet switch and every channel action. */
+#define SLP_TRACE_SWITCH        1
+#define SLP_TRACE_SEND          2
+#define SLP_TRACE_RECEIVE       3
+
+/* event flags */
+#define SLP_TRACE_HARD          1   /* a hard switch */
+#define SLP_TRACE_WILLBLOCK     2   /* the channel action blocks */
+
+void slp_trace_record(PyThreadState *ts, int kind, int flags, void *prev,
+                      void *next, void *channel, Py_ssize_t cstack_size);
+
+#define SLP_TRACE(ts, kind, flags, prev, next, channel, cstack_size) \
+    do { \
+        if ((ts)->interp->st.trace != NULL) \
+            slp_trace_record((ts), (kind), (flags), (prev), (next), \
+                             (channel), (cstack_size)); \
+    } while(0)
+
+/* per tasklet accounting, see taskletobject.c */
+void slp_tasklet_stats_switch(PyTaskletObject *prev, PyTaskletObject *next,
+                              int hard);
+void slp_tasklet_stats_block(PyTaskletObject *task, int blocked);
+void slp_tasklet_stats_end(PyThreadState *ts, PyTaskletObject *task);
+
+#if SLP_WITH_TASKLET_STATS
+#define SLP_TASKLET_STATS_ENABLED(interp) ((interp)->st.enable_tasklet_stats)
+#else
+#define SLP_TASKLET_STATS_ENABLED(interp) 0
+#endif
+
+#define SLP_TASKLET_STATS_SWITCH(ts, prev, next, hard) \
+    do { \
+        if (SLP_TASKLET_STATS_ENABLED((ts)->interp)) \
+            slp_tasklet_stats_switch((prev), (next), (hard)); \
+    } while(0)
+
+#define SLP_TASKLET_STATS_BLOCK(task, blocked) \
+    do { \
+        if (SLP_TASKLET_STATS_ENABLED(_PyInterpreterState_GET_UNSAFE())) \
+            slp_tasklet_stats_block((task), (blocked)); \
+    } while(0)
+
+/* A thread, that blocks because it has no runnable tasklets, polls its
+ * block lock for this many nanoseconds before it sleeps in the kernel,
+ * see schedule_thread_block() in scheduling.c. */
+#define SLP_THREAD_SPIN_TIME    (50 * 1000)
+
+/* If the watchdog measures the timeslice in wall clock time (see
+ * PY_WATCHDOG_WALLCLOCK), the interpreter reads the monotonic clock every
+ * SLP_WALLCLOCK_CHECK_TICKS opcodes only. */
+#define SLP_WALLCLOCK_CHECK_TICKS  16
+
+/* start a new timeslice, see slp_schedule_task_prepared() */
+#define SLP_RESET_TIMESLICE(ts) \
+    do { \
+        (ts)->st.tick_watermark = (ts)->st.tick_counter + (ts)->st.interval; \
+        if ((ts)->st.runflags & PY_WATCHDOG_WALLCLOCK) \
+            (ts)->st.time_watermark = _PyTime_GetMonotonicClock() + \
+                                      (ts)->st.time_interval; \
+    } while(0)
+
+/* The wakeup action of a timer. The function gets the reference to the
+ * tasklet. NULL means: insert the tasklet into the run queue. */
+typedef void (slp_timer_func)(PyThreadState *ts, PyTaskletObject *task);
+
+typedef struct _slp_timer {
+    struct _slp_timer *next;
+    struct _slp_timer *prev;
+    struct _slp_timer **slot;       /* the slot of the wheel */
+    int level;                      /* the level of the slot */
+    _PyTime_t expires;              /* in ticks */
+    PyTaskletObject *task;          /* owned reference */
+    slp_timer_func *func;
+} PyStacklessTimer;
+
+typedef struct _slp_timer_wheel {
+    _PyTime_t tick;                 /* the next tick to process */
+    Py_ssize_t count;               /* the number of timers */
+    Py_ssize_t level_count[SLP_TIMER_LEVELS];
+    PyStacklessTimer *slots[SLP_TIMER_LEVELS][SLP_TIMER_SLOTS];
+} PyStacklessTimerWheel;
+
+#define SLP_TIMERS_PENDING(ts) \
+    ((ts)->st.timers != NULL && (ts)->st.timers->count > 0)
+
+int slp_timer_add(PyThreadState *ts, PyTaskletObject *task, _PyTime_t when,
+                  slp_timer_func *func);
+void slp_timer_cancel(PyTaskletObject *task);
+Py_ssize_t slp_timer_poll(PyThreadState *ts);
+_PyTime_t slp_timer_next(PyThreadState *ts);
+
+/* the I/O reactor, see reactor.c
+ *
+ * A tasklet can wait for a file descriptor to become readable or writable.
+ * Each thread has its own reactor, which is based on epoll. The scheduler
+ * polls the reactor without blocking at most every SLP_REACTOR_POLL_INTERVAL
+ * nanoseconds. If the thread has no runnable tasklet, it waits in
+ * epoll_wait() until a file descriptor is ready or the next timer expires.
+ */
+#if defined(HAVE_EPOLL) && defined(HAVE_SYS_EPOLL_H) && defined(__linux__)
+#define SLP_HAVE_REACTOR 1
+#endif
+
+#define SLP_REACTOR_POLL_INTERVAL   (100 * 1000)
+#define SLP_REACTOR_MAXEVENTS       64
+
+/* the events a tasklet waits for */
+#define SLP_REACTOR_READ        1
+#define SLP_REACTOR_WRITE       2
+
+typedef struct _slp_reactor {
+    int epfd;                       /* the epoll file descriptor */
+    int wakeupfd;                   /* an eventfd, see slp_reactor_wakeup() */
+    int polling;                    /* the thread waits in epoll_wait() */
+    Py_ssize_t count;               /* the number of waiting tasklets */
+    _PyTime_t next_poll;            /* the time of the next non-blocking poll */
+    int size;                       /* the size of entries */
+    struct _slp_reactor_entry *entries;     /* indexed by file descriptor */
+} PyStacklessReactor;
+
+#ifdef SLP_HAVE_REACTOR
+#define SLP_REACTOR_PENDING(ts) \
+    ((ts)->st.reactor != NULL && (ts)->st.reactor->count > 0)
+#define SLP_REACTOR_POLL_DUE(ts) \
+    (SLP_REACTOR_PENDING(ts) && \
+     _PyTime_GetMonotonicClock() >= (ts)->st.reactor->next_poll)
+#else
+#define SLP_REACTOR_PENDING(ts) 0
+#define SLP_REACTOR_POLL_DUE(ts) 0
+#endif
+
+/* the worker thread pool, see threadpool.c */
+void slp_thread_job_abandon(PyTaskletObject *task);
+
+/* True, if tasklets of the thread wait for something, that will wake them
+ * up: a timer, a file descriptor or a call in the worker pool. */
+#define SLP_TASKLETS_WAITING(ts) \
+    (SLP_TIMERS_PENDING(ts) || SLP_REACTOR_PENDING(ts) || \
+     (ts)->st.thread.pending_jobs > 0)
+
+int slp_reactor_register(PyThreadState *ts, PyTaskletObject *task, int fd,
+                         int events, _PyTime_t timeout);
+void slp_reactor_cancel(PyTaskletObject *task);
+int slp_reactor_poll(PyThreadState *ts, _PyTime_t timeout);
+void slp_reactor_wakeup(PyThreadState *ts);
+
 /* operations on chains */
 
 void slp_current_insert(PyTaskletObject *task);
+void slp_current_insert_before(PyTaskletObject *task, PyTaskletObject *pos);
 void slp_current_insert_after(PyTaskletObject *task);
+void slp_current_requeue(PyTaskletObject *task);
 void slp_current_uninsert(PyTaskletObject *task);
 PyTaskletObject * slp_current_remove(void);
 void slp_current_remove_tasklet(PyTaskletObject *task);
@@ -614,6 +797,11 @@ PyTaskletObject * slp_channel_remove(PyChannelObject *channel,
 void slp_channel_remove_slow(PyTaskletObject *task,
                              PyChannelObject **u_chan,
                              int *dir, PyTaskletObject **next);
+/* a tasklet, that is neither scheduled nor waits on channels or in a select */
+#define SLP_TASKLET_FLOATING(task) ((task)->next == NULL && (task)->select == NULL)
+
+/* wait for the first of several channel operations, timeout -1: forever */
+PyObject * slp_channel_select(PyObject *cases, _PyTime_t timeout);
 
 /* protecting soft-switched tasklets in other threads */
 int slp_ensure_linkage(PyTaskletObject *task);
@@ -622,6 +810,18 @@ int slp_ensure_linkage(PyTaskletObject *task);
 PyObject * slp_tasklet_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
 PyObject * slp_tasklet_end(PyObject *retval);
 
+/* a tasklet, that was set up, but didn't run yet */
+#define SLP_TASKLET_UNSTARTED(task) ((task)->setup_func != NULL)
+/* the tasklet has a frame or it will create one, when it runs */
+#define SLP_TASKLET_HAS_FRAME(task) \
+    ((task)->f.frame != NULL || SLP_TASKLET_UNSTARTED(task))
+int slp_tasklet_create_frame(PyTaskletObject *task);
+PyObject * slp_tasklet_reduce(PyTaskletObject *task, int reduce_frames);
+
+/* the profile and tracing state of a tasklet, that is not current */
+int slp_tasklet_trace_new(PyTaskletObject *task);
+void slp_tasklet_trace_clear(PyTaskletObject *task);
+
 int slp_schedule_task(PyObject **result,
                       PyTaskletObject *prev,
                       PyTaskletObject *next,
@@ -708,6 +908,8 @@ PyObject * slp_null_error(void);
 #define VALUE_ERROR(str, ret) return (slp_value_error(str), ret)
 
 int slp_init_cframetype(void);
+PyObject * slp_cframe_cache_info(void);
+Py_ssize_t slp_cframe_cache_set_limit(Py_ssize_t limit);
 PyCFrameObject * slp_cframe_new(PyFrame_ExecFunc *exec,
                                 unsigned int linked);
 PyCFrameObject * slp_cframe_newfunc(PyObject *func,
@@ -749,6 +951,8 @@ int slp_encode_ctrace_functions(Py_tracefunc c_tracefunc, Py_tracefunc c_profile
  * Channel related prototypes
  */
 PyObject * slp_channel_seq_callback(PyCFrameObject *f,  int throwflag, PyObject *retval);
+PyObject * slp_channel_send_many_callback(PyCFrameObject *f,  int throwflag, PyObject *retval);
+PyObject * slp_channel_receive_many_callback(PyCFrameObject *f,  int throwflag, PyObject *retval);
 PyObject * slp_get_channel_callback(void);
 
 /*
@@ -825,6 +1029,19 @@ slp_cstack_set_root(PyThreadState *tstate, const void * pstackvar);
 PyObject *
 slp_cstack_set_base_and_goodgap(PyThreadState *tstate, const void * pstackvar, PyFrameObject *f);
 
+/* A separate stack region. The usable stack is [base - size, base),
+ * below it there is a guard page. */
+struct _slp_stack_region {
+    struct _slp_stack_region *next;     /* link in the region cache */
+    void *mem;                          /* the mapping, starts with the guard page */
+    size_t memsize;                     /* the size of the mapping */
+    intptr_t *base;                     /* the end-address of the usable stack */
+};
+
+int slp_separate_stacks_available(void);
+void slp_region_release(struct _slp_stack_region *region);
+void slp_region_cacheclear(void);
+
 
 
 #endif /* #ifdef SLP_BUILD_CORE */
@@ -82,6 +82,17 @@ extern "C" {
 /* #define SLP_WITH_FRAME_REF_DEBUG 1 */
 /* #define SLP_WITH_FRAME_REF_DEBUG 2 */
 #endif  /* SLP_WITH_FRAME_REF_DEBUG */
+
+#ifndef SLP_WITH_TASKLET_STATS
+/* Control the per tasklet accounting, see stackless.enable_tasklet_stats().
+ *
+ * SLP_WITH_TASKLET_STATS must be either 0 or 1
+ *  0: compile the accounting out of the scheduler. Enabling it fails.
+ *  1: the accounting can be enabled at run time (default). While it is
+ *     disabled, it costs a test of a flag per tasklet switch.
+ */
+#define SLP_WITH_TASKLET_STATS 1
+#endif  /* SLP_WITH_TASKLET_STATS */
 #endif  /* STACKLESS */
 
 #ifdef __cplusplus
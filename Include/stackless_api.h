@@ -59,6 +59,13 @@ PyAPI_FUNC(int) PyTasklet_Setup(PyTaskletObject *task, PyObject *args, PyObject
  */
 PyAPI_FUNC(int) PyTasklet_BindEx(PyTaskletObject *task, PyObject *func, PyObject *args, PyObject *kwargs);
 
+/*
+ * create a tasklet for each argument tuple of iterable, bind it to func and
+ * insert it into the runnables queue. Returns a new list of the tasklets.
+ */
+PyAPI_FUNC(PyObject *) PyTasklet_SpawnMany(PyObject *func, PyObject *iterable);
+/* the list of tasklets  NULL = failure */
+
 /*
  * bind a tasklet function to a thread.
  */
@@ -195,6 +202,13 @@ PyAPI_FUNC(int) PyTasklet_Scheduled(PyTaskletObject *task);
 PyAPI_FUNC(int) PyTasklet_Restorable(PyTaskletObject *task);
 /* 1 if the tasklet can execute after unpickling, else 0 */
 
+PyAPI_FUNC(int) PyTasklet_GetStats(PyTaskletObject *task, PyTaskletStatsStruc *stats);
+/*
+ * Copy the run time and switch accounting of the tasklet into *stats,
+ * including the running timeslice of a current tasklet. Returns 0.
+ * See PyStackless_EnableTaskletStats().
+ */
+
 /******************************************************
 
   channel related functions
@@ -217,6 +231,14 @@ PyAPI_FUNC(int) PyChannel_Send(PyChannelObject *self, PyObject *arg);
 PyAPI_FUNC(int) PyChannel_Send_nr(PyChannelObject *self, PyObject *arg);
 /* 1 = soft switched  0 = hard switched  -1 = failure */
 
+/*
+ * send the values of an iterable over a channel.
+ * waiting receivers and the buffer take the values without a switch,
+ * if the channel is full, you will get blocked and scheduled.
+ */
+PyAPI_FUNC(Py_ssize_t) PyChannel_SendMany(PyChannelObject *self, PyObject *iterable);
+/* number of sent values  -1 = failure */
+
 /*
  * receive data from a channel.
  * if nobody is talking, you will get blocked and scheduled.
@@ -226,6 +248,14 @@ PyAPI_FUNC(PyObject *) PyChannel_Receive(PyChannelObject *self);
 PyAPI_FUNC(PyObject *) PyChannel_Receive_nr(PyChannelObject *self);
 /* Object, Py_UnwindToken or NULL */
 
+/*
+ * receive up to max_n values from a channel.
+ * if nobody is talking, you will get blocked and scheduled for the
+ * first value. The remaining values come without a switch.
+ */
+PyAPI_FUNC(PyObject *) PyChannel_ReceiveMany(PyChannelObject *self, Py_ssize_t max_n);
+/* list or NULL */
+
 /*
  * send an exception over a channel.
  * the exception will explode at the receiver side.
@@ -240,6 +270,14 @@ PyAPI_FUNC(int) PyChannel_SendException(PyChannelObject *self,
  */;
 PyAPI_FUNC(int) PyChannel_SendThrow(PyChannelObject *self, PyObject *exc, PyObject *val, PyObject *tb);
 
+/*
+ * wait for the first of several channel operations to complete.
+ * cases is a sequence of tuples (channel, 'recv') or (channel, 'send', value).
+ * A negative timeout waits forever.
+ */
+PyAPI_FUNC(PyObject *) PyChannel_Select(PyObject *cases, double timeout);
+/* (index, value), Py_None on timeout or NULL */
+
 /* the next tasklet in the queue or None */
 PyAPI_FUNC(PyObject *) PyChannel_GetQueue(PyChannelObject *self);
 
@@ -275,10 +313,18 @@ PyAPI_FUNC(void) PyChannel_SetScheduleAll(PyChannelObject *self, int val);
 
 /*
  *Get the current channel balance. Negative numbers are readers, positive
- * are writers
+ * are writers and buffered values
  */
 PyAPI_FUNC(int) PyChannel_GetBalance(PyChannelObject *self);
 
+/*
+ * the maximum number of values, that a buffered channel holds.
+ * 0 = unbuffered. The capacity can't change while tasklets wait on the channel.
+ */
+PyAPI_FUNC(Py_ssize_t) PyChannel_GetCapacity(PyChannelObject *self);
+PyAPI_FUNC(int) PyChannel_SetCapacity(PyChannelObject *self, Py_ssize_t capacity);
+/* 0 = success  -1 = failure */
+
 /******************************************************
 
   stacklessmodule functions
@@ -299,6 +345,50 @@ PyAPI_FUNC(PyObject *) PyStackless_Schedule_nr(PyObject *retval, int remove);
  * retval == Py_UnwindToken: soft switched
  */
 
+/*
+ * suspend the current tasklet for the given number of seconds.
+ * Other tasklets continue to run meanwhile.
+ */
+PyAPI_FUNC(PyObject *) PyStackless_Sleep(double seconds);
+/*
+ * Py_None = success  NULL = failure
+ */
+PyAPI_FUNC(PyObject *) PyStackless_Sleep_nr(double seconds);
+/*
+ * Py_None = success  NULL = failure
+ * retval == Py_UnwindToken: soft switched
+ */
+
+/*
+ * suspend the current tasklet until the file descriptor fd is readable
+ * (writable) or timeout seconds passed. A negative timeout waits forever.
+ * Other tasklets continue to run meanwhile.
+ */
+PyAPI_FUNC(PyObject *) PyStackless_WaitReadable(int fd, double timeout);
+PyAPI_FUNC(PyObject *) PyStackless_WaitWritable(int fd, double timeout);
+/*
+ * Py_True = ready  Py_False = timeout  NULL = failure
+ * retval == Py_UnwindToken: soft switched
+ */
+
+/*
+ * call func(*args, **kwargs) in a worker thread and suspend the current
+ * tasklet until the call returns. kwargs may be NULL. Other tasklets
+ * continue to run meanwhile.
+ */
+PyAPI_FUNC(PyObject *) PyStackless_RunInThread(PyObject *func, PyObject *args,
+                                               PyObject *kwargs);
+/*
+ * the result of the call  NULL = failure
+ * retval == Py_UnwindToken: soft switched
+ */
+
+/*
+ * set the maximum number of worker threads of PyStackless_RunInThread().
+ * returns the previous size or -1 on error.
+ */
+PyAPI_FUNC(int) PyStackless_SetThreadPoolSize(int size);
+
 /*
  * get the number of runnable tasks, including the current one.
  */
@@ -353,6 +443,9 @@ PyAPI_FUNC(unsigned long) PyStackless_GetCurrentId(void);
  *   interprets 'timeout' as a total timeout, rather than a
  *   timeslice length.  The function will then attempt to
  *   interrupt execution
+ * PY_WATCHDOG_WALLCLOCK:
+ *   interprets 'timeout' as microseconds of wall clock time
+ *   instead of a number of opcodes.
  *
  * Note: the spelling is inconsistent (Py_ versus PY_) since ever.
  *       We won't change it for compatibility reasons.
@@ -361,6 +454,7 @@ PyAPI_FUNC(unsigned long) PyStackless_GetCurrentId(void);
 #define PY_WATCHDOG_SOFT                2
 #define PY_WATCHDOG_IGNORE_NESTING      4
 #define PY_WATCHDOG_TOTALTIMEOUT        8
+#define PY_WATCHDOG_WALLCLOCK           16
 PyAPI_FUNC(PyObject *) PyStackless_RunWatchdog(long timeout);
 PyAPI_FUNC(PyObject *) PyStackless_RunWatchdogEx(long timeout, int flags);
 
@@ -533,6 +627,34 @@ PyAPI_FUNC(int) PyStackless_SetScheduleCallback(PyObject *callable);
  */
 PyAPI_FUNC(void) PyStackless_SetScheduleFastcallback(slp_schedule_hook_func func);
 
+/*
+ * scheduler event tracing.
+ * Record tasklet switches and channel actions in a ring buffer of
+ * size events. Passing 0 stops the recording and releases the buffer.
+ */
+PyAPI_FUNC(int) PyStackless_SetTraceBuffer(Py_ssize_t size);
+/* -1 = failure */
+
+PyAPI_FUNC(Py_ssize_t) PyStackless_GetTraceBufferSize(void);
+/* the size of the ring buffer, 0 = no recording */
+
+/*
+ * Get the recorded events as a bytes object, the oldest event first.
+ * The events are packed with the struct format "=qQQQQqii":
+ * time, thread_id, prev, next, channel, cstack_size, kind, flags
+ */
+PyAPI_FUNC(PyObject *) PyStackless_GetTraceBuffer(void);
+/* bytes or NULL */
+
+/*
+ * per tasklet accounting.
+ * If flag is nonzero, the scheduler accounts the run time, the switches
+ * and the time blocked on channels of each tasklet. A negative flag
+ * only queries the setting.
+ */
+PyAPI_FUNC(int) PyStackless_EnableTaskletStats(int flag);
+/* the previous setting, -1 = failure */
+
 /******************************************************
 
   other functions
@@ -18,6 +18,14 @@ PICKLEFLAGS_PRESERVE_AG_FINALIZER = 2
 PICKLEFLAGS_RESET_AG_FINALIZER = 4
 PICKLEFLAGS_PICKLE_CONTEXT = 8
 
+# scheduler event tracing, see set_trace_buffer()
+TRACE_EVENT_FORMAT = "=qQQQQqii"
+TRACE_SWITCH = 1
+TRACE_SEND = 2
+TRACE_RECEIVE = 3
+TRACE_HARD = 1
+TRACE_WILLBLOCK = 2
+
 # Backwards support for unpickling older pickles, even from 2.7
 from _stackless import _wrap
 sys.modules["stackless._wrap"] = _wrap
@@ -38,10 +46,19 @@ del range
 
 __all__ = ['atomic',
            'channel',
+           'checkpointer',
+           'enable_separate_stacks',
            'enable_softswitch',
+           'enable_tasklet_stats',
+           'enable_work_stealing',
            'get_channel_callback',
+           'get_cframe_cache_info',
+           'get_cstack_cache_info',
            'get_schedule_callback',
+           'get_tasklet_stats_by_tag',
            'get_thread_info',
+           'get_trace_buffer',
+           'get_work_stealing_info',
            'getcurrent',
            'getcurrentid',
            'getdebug',
@@ -49,15 +66,29 @@ __all__ = ['atomic',
            'getruncount',
            'getthreads',
            'getuncollectables',
+           'iter_trace_events',
            'pickle_with_tracing_state',
+           'restore',
            'run',
+           'run_in_thread',
            'schedule',
            'schedule_remove',
+           'select',
            'set_channel_callback',
+           'set_cframe_cache_limit',
+           'set_cstack_cache_limits',
            'set_error_handler',
            'set_schedule_callback',
+           'set_thread_pool_size',
+           'set_trace_buffer',
+           'sleep',
+           'snapshot',
+           'spawn_many',
            'switch_trap',
            'tasklet',
+           'wait_readable',
+           'wait_writable',
+           'write_chrome_trace',
            'stackless',  # ugly
            ]
 
@@ -96,6 +127,63 @@ def _tasklet_get_unpicklable_state(tasklet):
         finally:
             pickle_flags(flags, PICKLEFLAGS_PICKLE_CONTEXT)
 
+def iter_trace_events(data=None):
+    """Iterate over recorded scheduler events
+
+    *data* is the result of get_trace_buffer(). If omitted, the function
+    reads the current trace buffer. Each event is a tuple
+    (time, thread_id, prev, next, channel, cstack_size, kind, flags):
+
+    'time': the monotonic clock in nanoseconds
+    'prev', 'next': the id() of the tasklets of a switch (TRACE_SWITCH) or
+        'prev' is the id() of the tasklet of a channel action
+        (TRACE_SEND, TRACE_RECEIVE). Unused values are 0.
+    'channel': the id() of the channel of a channel action or 0
+    'cstack_size': the number of bytes restored by a hard switch
+    'flags': TRACE_HARD for a hard switch, TRACE_WILLBLOCK for a
+        blocking channel action
+    """
+    import struct
+    if data is None:
+        data = get_trace_buffer()
+    return struct.iter_unpack(TRACE_EVENT_FORMAT, data)
+
+def write_chrome_trace(file, data=None):
+    """Write recorded scheduler events in the Chrome trace event format
+
+    *file* is a text file. *data* is the result of get_trace_buffer().
+    If omitted, the function reads the current trace buffer. The output
+    can be viewed with chrome://tracing or https://ui.perfetto.dev. Each
+    tasklet switch ends the slice of the previous tasklet of a thread and
+    starts a slice of the next tasklet. Channel actions are instant events.
+    """
+    import json
+    import os
+    pid = os.getpid()
+    running = set()
+    events = []
+    for (time, tid, prev, next, channel, cstack_size, kind,
+         flags) in iter_trace_events(data):
+        ts = time / 1000.0
+        if kind == TRACE_SWITCH:
+            if tid in running:
+                events.append({"ph": "E", "pid": pid, "tid": tid, "ts": ts})
+            running.add(tid)
+            events.append({"ph": "B", "pid": pid, "tid": tid, "ts": ts,
+                           "name": "tasklet %#x" % (next,),
+                           "args": {"hard": bool(flags & TRACE_HARD),
+                                    "cstack_size": cstack_size}})
+        elif kind in (TRACE_SEND, TRACE_RECEIVE):
+            events.append({"ph": "i", "s": "t", "pid": pid, "tid": tid,
+                           "ts": ts,
+                           "name": "send" if kind == TRACE_SEND else "receive",
+                           "args": {"tasklet": "%#x" % (prev,),
+                                    "channel": "%#x" % (channel,),
+                                    "willblock": bool(flags & TRACE_WILLBLOCK)}})
+    for tid in running:
+        events.append({"ph": "E", "pid": pid, "tid": tid, "ts": ts})
+    json.dump({"traceEvents": events, "displayTimeUnit": "ns"}, file)
+
 def transmogrify():
     """
     this function creates a subclass of the ModuleType with properties.
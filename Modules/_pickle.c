@@ -31,7 +31,7 @@ class _pickle.UnpicklerMemoProxy "UnpicklerMemoProxyObject *" "&UnpicklerMemoPro
    Bump DEFAULT_PROTOCOL only when the oldest still supported version of Python
    already includes it. */
 enum {
-    HIGHEST_PROTOCOL = 4,
+    HIGHEST_PROTOCOL = 5,
     DEFAULT_PROTOCOL = 4
 };
 
@@ -108,7 +108,12 @@ enum opcode {
     NEWOBJ_EX        = '\x92',
     STACK_GLOBAL     = '\x93',
     MEMOIZE          = '\x94',
-    FRAME            = '\x95'
+    FRAME            = '\x95',
+
+    /* Protocol 5 */
+    BYTEARRAY8       = '\x96',
+    NEXT_BUFFER      = '\x97',
+    READONLY_BUFFER  = '\x98'
 };
 
 enum {
@@ -122,6 +127,14 @@ enum {
        checking for self-referential data-structures. */
     FAST_NESTING_LIMIT = 50,
 
+#ifdef STACKLESS
+    /* Maximum number of entries of the work stack of Pickler, that is the
+       maximum nesting depth of a pickled object. It guards against
+       __reduce__() methods, that return a new object of the same kind
+       for ever. */
+    MAX_WORK_DEPTH = 1000000,
+#endif
+
     /* Initial size of the write buffer of Pickler. */
     WRITE_BUF_SIZE = 4096,
 
@@ -611,6 +624,31 @@ typedef struct {
     PyMemoEntry *mt_table;
 } PyMemoTable;
 
+/* The pickler saves tuples, lists, dicts and the values returned by
+   __reduce__() without recursion. It writes the opcodes, that start such an
+   object, and pushes an entry onto its work stack. The loop in save() then
+   saves the items one by one and writes the closing opcodes. This way
+   arbitrarily deep object graphs pickle at a constant C stack depth. */
+#ifdef STACKLESS
+typedef struct {
+    int kind;                   /* WORK_TUPLE, WORK_LIST, WORK_DICT or
+                                   WORK_REDUCE */
+    int step;                   /* progress within the kind */
+    PyObject *obj;              /* the object to save, can be NULL for
+                                   WORK_REDUCE */
+    PyObject *items[3];         /* WORK_REDUCE: the objects to save before
+                                   the opcode; WORK_DICT: items[0] is the
+                                   value of the current key */
+    PyObject *listitems;        /* WORK_REDUCE: optional parts of the value */
+    PyObject *dictitems;        /* returned by __reduce__() */
+    PyObject *state;
+    Py_ssize_t index;           /* next item, or position for PyDict_Next() */
+    Py_ssize_t size;            /* number of items */
+    Py_ssize_t batch;           /* number of items in the current batch */
+    char opcode;                /* WORK_REDUCE: REDUCE, NEWOBJ or NEWOBJ_EX */
+} PicklerWork;
+#endif
+
 typedef struct PicklerObject {
     PyObject_HEAD
     PyMemoTable *memo;          /* Memo table, keep track of the seen
@@ -644,7 +682,11 @@ typedef struct PicklerObject {
     int fix_imports;            /* Indicate whether Pickler should fix
                                    the name of globals for Python 2.x. */
     PyObject *fast_memo;
+    PyObject *buffer_callback;  /* Callback for out-of-band buffers, or NULL */
 #ifdef STACKLESS
+    PicklerWork *work;          /* The work stack, see PicklerWork. */
+    Py_ssize_t work_len;        /* Number of entries of the work stack. */
+    Py_ssize_t work_allocated;  /* Allocation size of the work stack. */
         PyObject *module_dict_ids;
 #endif
 } PicklerObject;
@@ -672,7 +714,10 @@ typedef struct UnpicklerObject {
 
     PyObject *read;             /* read() method of the input stream. */
     PyObject *readline;         /* readline() method of the input stream. */
+    PyObject *readinto;         /* readinto() method of the input stream,
+                                   or NULL */
     PyObject *peek;             /* peek() method of the input stream, or NULL */
+    PyObject *buffers;          /* iterable of out-of-band buffers, or NULL */
 
     char *encoding;             /* Name of the encoding to be used for
                                    decoding strings pickled using Python
@@ -701,7 +746,13 @@ typedef struct {
 
 /* Forward declarations */
 static int save(PicklerObject *, PyObject *, int);
+#ifdef STACKLESS
+static int save_dispatch(PicklerObject *, PyObject *, int);
+#endif
 static int save_reduce(PicklerObject *, PyObject *, PyObject *);
+#ifdef STACKLESS
+static int save_work(PicklerObject *, Py_ssize_t);
+#endif
 static PyTypeObject Pickler_Type;
 static PyTypeObject Unpickler_Type;
 
@@ -1115,7 +1166,11 @@ _Pickler_New(void)
     self->fast_nesting = 0;
     self->fix_imports = 0;
     self->fast_memo = NULL;
+    self->buffer_callback = NULL;
 #ifdef STACKLESS
+    self->work = NULL;
+    self->work_len = 0;
+    self->work_allocated = 0;
     self->module_dict_ids = NULL;
 #endif
     self->max_output_len = WRITE_BUF_SIZE;
@@ -1159,6 +1214,25 @@ _Pickler_SetProtocol(PicklerObject *self, PyObject *protocol, int fix_imports)
     return 0;
 }
 
+/* Returns -1 (with an exception set) on failure, 0 on success. This may
+   be called once on a freshly created Pickler. */
+static int
+_Pickler_SetBufferCallback(PicklerObject *self, PyObject *buffer_callback)
+{
+    if (buffer_callback == Py_None) {
+        buffer_callback = NULL;
+    }
+    if (buffer_callback != NULL && self->proto < 5) {
+        PyErr_SetString(PyExc_ValueError,
+                        "buffer_callback needs protocol >= 5");
+        return -1;
+    }
+
+    Py_XINCREF(buffer_callback);
+    self->buffer_callback = buffer_callback;
+    return 0;
+}
+
 /* Returns -1 (with an exception set) on failure, 0 on success. This may
    be called once on a freshly created Pickler. */
 static int
@@ -1339,6 +1413,98 @@ _Unpickler_ReadImpl(UnpicklerObject *self, char **s, Py_ssize_t n)
         (n))                                                 \
      : _Unpickler_ReadImpl(self, (s), (n)))
 
+/* Read `n` bytes from the unpickler's data source, storing the result in `buf`.
+ *
+ * This should only be used for non-small data reads where potentially
+ * avoiding a copy is beneficial. This method does not try to prefetch
+ * more data into the input buffer.
+ *
+ * _Unpickler_Read() is recommended in most cases.
+ */
+static Py_ssize_t
+_Unpickler_ReadInto(UnpicklerObject *self, char *buf, Py_ssize_t n)
+{
+    Py_ssize_t in_buffer, to_read, read_size;
+    PyObject *data, *buf_obj, *read_size_obj;
+
+    assert(n != READ_WHOLE_LINE);
+
+    /* Read from available buffer data, if any */
+    in_buffer = self->input_len - self->next_read_idx;
+    if (in_buffer > 0) {
+        to_read = Py_MIN(in_buffer, n);
+        memcpy(buf, self->input_buffer + self->next_read_idx, to_read);
+        self->next_read_idx += to_read;
+        buf += to_read;
+        n -= to_read;
+        if (n == 0) {
+            /* Entire read was satisfied from buffer */
+            return 0;
+        }
+    }
+
+    /* Read from file */
+    if (!self->read) {
+        /* We're unpickling memory, this means the input is truncated */
+        return bad_readline();
+    }
+    if (_Unpickler_SkipConsumed(self) < 0) {
+        return -1;
+    }
+
+    if (!self->readinto) {
+        /* readinto() not supported on file-like object, fall back to read()
+         * and copy into destination buffer */
+        PyObject *len = PyLong_FromSsize_t(n);
+        if (len == NULL) {
+            return -1;
+        }
+        data = _Pickle_FastCall(self->read, len);
+        if (data == NULL) {
+            return -1;
+        }
+        if (!PyBytes_Check(data)) {
+            PyErr_Format(PyExc_ValueError,
+                         "read() returned non-bytes object (%R)",
+                         Py_TYPE(data));
+            Py_DECREF(data);
+            return -1;
+        }
+        read_size = PyBytes_GET_SIZE(data);
+        if (read_size < n) {
+            Py_DECREF(data);
+            return bad_readline();
+        }
+        memcpy(buf, PyBytes_AS_STRING(data), n);
+        Py_DECREF(data);
+        return 0;
+    }
+
+    /* Call readinto() into user buffer */
+    buf_obj = PyMemoryView_FromMemory(buf, n, PyBUF_WRITE);
+    if (buf_obj == NULL) {
+        return -1;
+    }
+    read_size_obj = _Pickle_FastCall(self->readinto, buf_obj);
+    if (read_size_obj == NULL) {
+        return -1;
+    }
+    read_size = PyLong_AsSsize_t(read_size_obj);
+    Py_DECREF(read_size_obj);
+
+    if (read_size < 0) {
+        if (!PyErr_Occurred()) {
+            PyErr_SetString(PyExc_ValueError,
+                            "readinto() returned negative size");
+        }
+        return -1;
+    }
+    if (read_size < n) {
+        return bad_readline();
+    }
+    return 0;
+}
+
 static Py_ssize_t
 _Unpickler_CopyLine(UnpicklerObject *self, char *line, Py_ssize_t len,
                     char **result)
@@ -1487,7 +1653,9 @@ _Unpickler_New(void)
     self->prefetched_idx = 0;
     self->read = NULL;
     self->readline = NULL;
+    self->readinto = NULL;
     self->peek = NULL;
+    self->buffers = NULL;
     self->encoding = NULL;
     self->errors = NULL;
     self->marks = NULL;
@@ -1516,9 +1684,12 @@ _Unpickler_SetInputStream(UnpicklerObject *self, PyObject *file)
 {
     _Py_IDENTIFIER(peek);
     _Py_IDENTIFIER(read);
+    _Py_IDENTIFIER(readinto);
     _Py_IDENTIFIER(readline);
 
-    if (_PyObject_LookupAttrId(file, &PyId_peek, &self->peek) < 0) {
+    if (_PyObject_LookupAttrId(file, &PyId_peek, &self->peek) < 0 ||
+        _PyObject_LookupAttrId(file, &PyId_readinto, &self->readinto) < 0) {
+        Py_CLEAR(self->peek);
         return -1;
     }
     (void)_PyObject_LookupAttrId(file, &PyId_read, &self->read);
@@ -1529,6 +1700,7 @@ _Unpickler_SetInputStream(UnpicklerObject *self, PyObject *file)
                             "file must have 'read' and 'readline' attributes");
         }
         Py_CLEAR(self->read);
+        Py_CLEAR(self->readinto);
         Py_CLEAR(self->readline);
         Py_CLEAR(self->peek);
         return -1;
@@ -1536,6 +1708,23 @@ _Unpickler_SetInputStream(UnpicklerObject *self, PyObject *file)
     return 0;
 }
 
+/* Returns -1 (with an exception set) on failure, 0 on success. This may
+   be called once on a freshly created Unpickler. */
+static int
+_Unpickler_SetBuffers(UnpicklerObject *self, PyObject *buffers)
+{
+    if (buffers == NULL || buffers == Py_None) {
+        self->buffers = NULL;
+    }
+    else {
+        self->buffers = PyObject_GetIter(buffers);
+        if (self->buffers == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
 /* Returns -1 (with an exception set) on failure, 0 on success. This may
    be called once on a freshly created Pickler. */
 static int
@@ -2212,6 +2401,50 @@ _Pickler_write_bytes(PicklerObject *self,
     return 0;
 }
 
+static int
+_save_bytes_data(PicklerObject *self, PyObject *obj, const char *data,
+                 Py_ssize_t size)
+{
+    char header[9];
+    Py_ssize_t len;
+
+    assert(self->proto >= 3);
+    if (size < 0)
+        return -1;
+
+    if (size <= 0xff) {
+        header[0] = SHORT_BINBYTES;
+        header[1] = (unsigned char)size;
+        len = 2;
+    }
+    else if ((size_t)size <= 0xffffffffUL) {
+        header[0] = BINBYTES;
+        header[1] = (unsigned char)(size & 0xff);
+        header[2] = (unsigned char)((size >> 8) & 0xff);
+        header[3] = (unsigned char)((size >> 16) & 0xff);
+        header[4] = (unsigned char)((size >> 24) & 0xff);
+        len = 5;
+    }
+    else if (self->proto >= 4) {
+        header[0] = BINBYTES8;
+        _write_size64(header + 1, size);
+        len = 9;
+    }
+    else {
+        PyErr_SetString(PyExc_OverflowError,
+                        "cannot serialize a bytes object larger than 4 GiB");
+        return -1;          /* string too large */
+    }
+
+    if (_Pickler_write_bytes(self, header, len, data, size, obj) < 0)
+        return -1;
+
+    if (memo_put(self, obj) < 0)
+        return -1;
+
+    return 0;
+}
+
 static int
 save_bytes(PicklerObject *self, PyObject *obj)
 {
@@ -2258,49 +2491,122 @@ save_bytes(PicklerObject *self, PyObject *obj)
         return status;
     }
     else {
-        Py_ssize_t size;
-        char header[9];
-        Py_ssize_t len;
+        return _save_bytes_data(self, obj, PyBytes_AS_STRING(obj),
+                                PyBytes_GET_SIZE(obj));
+    }
+}
 
-        size = PyBytes_GET_SIZE(obj);
-        if (size < 0)
-            return -1;
+static int
+_save_bytearray_data(PicklerObject *self, PyObject *obj, const char *data,
+                     Py_ssize_t size)
+{
+    char header[9];
 
-        if (size <= 0xff) {
-            header[0] = SHORT_BINBYTES;
-            header[1] = (unsigned char)size;
-            len = 2;
-        }
-        else if ((size_t)size <= 0xffffffffUL) {
-            header[0] = BINBYTES;
-            header[1] = (unsigned char)(size & 0xff);
-            header[2] = (unsigned char)((size >> 8) & 0xff);
-            header[3] = (unsigned char)((size >> 16) & 0xff);
-            header[4] = (unsigned char)((size >> 24) & 0xff);
-            len = 5;
-        }
-        else if (self->proto >= 4) {
-            header[0] = BINBYTES8;
-            _write_size64(header + 1, size);
-            len = 9;
+    assert(self->proto >= 5);
+    if (size < 0)
+        return -1;
+
+    header[0] = BYTEARRAY8;
+    _write_size64(header + 1, size);
+
+    if (_Pickler_write_bytes(self, header, 9, data, size, obj) < 0)
+        return -1;
+
+    if (memo_put(self, obj) < 0)
+        return -1;
+
+    return 0;
+}
+
+static int
+save_bytearray(PicklerObject *self, PyObject *obj)
+{
+    if (self->proto < 5) {
+        /* Older pickle protocols do not have an opcode for pickling
+           bytearrays. */
+        PyObject *reduce_value = NULL;
+        int status;
+
+        if (PyByteArray_GET_SIZE(obj) == 0) {
+            reduce_value = Py_BuildValue("(O())",
+                                         (PyObject *) &PyByteArray_Type);
         }
         else {
-            PyErr_SetString(PyExc_OverflowError,
-                            "cannot serialize a bytes object larger than 4 GiB");
-            return -1;          /* string too large */
+            PyObject *bytes_obj = PyBytes_FromObject(obj);
+            if (bytes_obj != NULL) {
+                reduce_value = Py_BuildValue("(O(O))",
+                                             (PyObject *) &PyByteArray_Type,
+                                             bytes_obj);
+                Py_DECREF(bytes_obj);
+            }
         }
-
-        if (_Pickler_write_bytes(self, header, len,
-                                 PyBytes_AS_STRING(obj), size, obj) < 0)
-        {
+        if (reduce_value == NULL)
             return -1;
-        }
 
-        if (memo_put(self, obj) < 0)
-            return -1;
+        /* save_reduce() will memoize the object automatically. */
+        status = save_reduce(self, reduce_value, obj);
+        Py_DECREF(reduce_value);
+        return status;
+    }
+    else {
+        return _save_bytearray_data(self, obj, PyByteArray_AS_STRING(obj),
+                                    PyByteArray_GET_SIZE(obj));
+    }
+}
 
-        return 0;
+static int
+save_picklebuffer(PicklerObject *self, PyObject *obj)
+{
+    const Py_buffer *view;
+    int in_band = 1;
+
+    if (self->proto < 5) {
+        PickleState *st = _Pickle_GetGlobalState();
+        PyErr_SetString(st->PicklingError,
+                        "PickleBuffer can only pickled with protocol >= 5");
+        return -1;
+    }
+    view = PyPickleBuffer_GetBuffer(obj);
+    if (view == NULL)
+        return -1;
+    if (view->suboffsets != NULL || !PyBuffer_IsContiguous(view, 'A')) {
+        PickleState *st = _Pickle_GetGlobalState();
+        PyErr_SetString(st->PicklingError,
+                        "PickleBuffer can not be pickled when "
+                        "pointing to a non-contiguous buffer");
+        return -1;
+    }
+    if (self->buffer_callback != NULL) {
+        PyObject *ret = PyObject_CallFunctionObjArgs(self->buffer_callback,
+                                                     obj, NULL);
+        if (ret == NULL)
+            return -1;
+        in_band = PyObject_IsTrue(ret);
+        Py_DECREF(ret);
+        if (in_band == -1)
+            return -1;
+    }
+    if (in_band) {
+        /* Write data in-band */
+        if (view->readonly)
+            return _save_bytes_data(self, obj, (const char *) view->buf,
+                                    view->len);
+        else
+            return _save_bytearray_data(self, obj, (const char *) view->buf,
+                                        view->len);
+    }
+    else {
+        /* Write data out-of-band */
+        const char next_buffer_op = NEXT_BUFFER;
+        if (_Pickler_Write(self, &next_buffer_op, 1) < 0)
+            return -1;
+        if (view->readonly) {
+            const char readonly_buffer_op = READONLY_BUFFER;
+            if (_Pickler_Write(self, &readonly_buffer_op, 1) < 0)
+                return -1;
+        }
     }
+    return 0;
 }
 
 /* A copy of PyUnicode_EncodeRawUnicodeEscape() that also translates
@@ -2470,24 +2776,84 @@ save_unicode(PicklerObject *self, PyObject *obj)
     return 0;
 }
 
-/* A helper for save_tuple.  Push the len elements in tuple t on the stack. */
-static int
-store_tuple_elements(PicklerObject *self, PyObject *t, Py_ssize_t len)
-{
-    Py_ssize_t i;
+#ifdef STACKLESS
+/* The work stack of the pickler, see PicklerWork. */
 
-    assert(PyTuple_Size(t) == len);
+enum {
+    WORK_TUPLE,
+    WORK_LIST,
+    WORK_DICT,
+    WORK_REDUCE
+};
 
-    for (i = 0; i < len; i++) {
-        PyObject *element = PyTuple_GET_ITEM(t, i);
+/* Push a new entry for obj onto the work stack. Returns NULL on error. */
+static PicklerWork *
+work_push(PicklerObject *self, int kind, PyObject *obj)
+{
+    PicklerWork *w;
 
-        if (element == NULL)
-            return -1;
-        if (save(self, element, 0) < 0)
-            return -1;
+    if (self->work_len >= MAX_WORK_DEPTH) {
+        PyErr_SetString(PyExc_RecursionError,
+                        "maximum recursion depth exceeded while "
+                        "pickling an object");
+        return NULL;
     }
+    if (self->work_len == self->work_allocated) {
+        Py_ssize_t allocated = self->work_allocated * 2 + 16;
 
-    return 0;
+        w = PyMem_Realloc(self->work, allocated * sizeof(PicklerWork));
+        if (w == NULL) {
+            PyErr_NoMemory();
+            return NULL;
+        }
+        self->work = w;
+        self->work_allocated = allocated;
+    }
+    w = &self->work[self->work_len++];
+    memset(w, 0, sizeof(PicklerWork));
+    w->kind = kind;
+    Py_XINCREF(obj);
+    w->obj = obj;
+    return w;
+}
+
+static void
+work_pop(PicklerObject *self)
+{
+    PicklerWork w;
+
+    assert(self->work_len > 0);
+    /* Copy the entry first, releasing the references may run arbitrary
+       code. */
+    w = self->work[--self->work_len];
+    Py_XDECREF(w.obj);
+    Py_XDECREF(w.items[0]);
+    Py_XDECREF(w.items[1]);
+    Py_XDECREF(w.items[2]);
+    Py_XDECREF(w.listitems);
+    Py_XDECREF(w.dictitems);
+    Py_XDECREF(w.state);
+}
+
+/* Drop the entries of the work stack above base. */
+static void
+work_clear(PicklerObject *self, Py_ssize_t base)
+{
+    while (self->work_len > base)
+        work_pop(self);
+}
+
+/* Save an item of the object of the topmost entry. The entry may be
+   reallocated, if the item gets pushed onto the work stack. */
+static int
+work_save(PicklerObject *self, PyObject *item)
+{
+    int status;
+
+    Py_INCREF(item);
+    status = save_dispatch(self, item, 0);
+    Py_DECREF(item);
+    return status;
 }
 
 /* Tuples are ubiquitous in the pickle protocols, so many techniques are
@@ -2495,17 +2861,17 @@ store_tuple_elements(PicklerObject *self, PyObject *t, Py_ssize_t len)
  * Tuples are also the only builtin immutable type that can be recursive
  * (a tuple can be reached from itself), and that requires some subtle
  * magic so that it works in all cases.  IOW, this is a long routine.
+ *
+ * save_tuple() writes the start of the tuple and pushes an entry onto the
+ * work stack, tuple_step() saves the elements and the end of the tuple.
  */
 static int
 save_tuple(PicklerObject *self, PyObject *obj)
 {
-    Py_ssize_t len, i;
+    Py_ssize_t len;
+    PicklerWork *w;
 
     const char mark_op = MARK;
-    const char tuple_op = TUPLE;
-    const char pop_op = POP;
-    const char pop_mark_op = POP_MARK;
-    const char len2opcode[] = {EMPTY_TUPLE, TUPLE1, TUPLE2, TUPLE3};
 
     if ((len = PyTuple_Size(obj)) < 0)
         return -1;
@@ -2527,16 +2893,40 @@ save_tuple(PicklerObject *self, PyObject *obj)
         return 0;
     }
 
-    /* The tuple isn't in the memo now.  If it shows up there after
-     * saving the tuple elements, the tuple must be recursive, in
+    /* For len <= 3 and proto >= 2 use the TUPLE{1,2,3} opcodes. Otherwise
+     * generate MARK e1 e2 ... TUPLE
+     */
+    if ((len > 3 || self->proto < 2) && _Pickler_Write(self, &mark_op, 1) < 0)
+        return -1;
+
+    w = work_push(self, WORK_TUPLE, obj);
+    if (w == NULL)
+        return -1;
+    w->size = len;
+    return 0;
+}
+
+static int
+tuple_step(PicklerObject *self, PicklerWork *w)
+{
+    PyObject *obj = w->obj;
+    Py_ssize_t len = w->size, i;
+
+    const char tuple_op = TUPLE;
+    const char pop_op = POP;
+    const char pop_mark_op = POP_MARK;
+    const char len2opcode[] = {EMPTY_TUPLE, TUPLE1, TUPLE2, TUPLE3};
+
+    assert(PyTuple_GET_SIZE(obj) == len);
+    if (w->index < len)
+        return work_save(self, PyTuple_GET_ITEM(obj, w->index++));
+
+    /* The tuple wasn't in the memo, when we started.  If it shows up there
+     * after saving the tuple elements, the tuple must be recursive, in
      * which case we'll pop everything we put on the stack, and fetch
      * its value from the memo.
      */
     if (len <= 3 && self->proto >= 2) {
-        /* Use TUPLE{1,2,3} opcodes. */
-        if (store_tuple_elements(self, obj, len) < 0)
-            return -1;
-
         if (PyMemoTable_Get(self->memo, obj)) {
             /* pop the len elements */
             for (i = 0; i < len; i++)
@@ -2546,7 +2936,7 @@ save_tuple(PicklerObject *self, PyObject *obj)
             if (memo_get(self, obj) < 0)
                 return -1;
 
-            return 0;
+            goto done;
         }
         else { /* Not recursive. */
             if (_Pickler_Write(self, len2opcode + len, 1) < 0)
@@ -2555,15 +2945,6 @@ save_tuple(PicklerObject *self, PyObject *obj)
         goto memoize;
     }
 
-    /* proto < 2 and len > 0, or proto >= 2 and len > 3.
-     * Generate MARK e1 e2 ... TUPLE
-     */
-    if (_Pickler_Write(self, &mark_op, 1) < 0)
-        return -1;
-
-    if (store_tuple_elements(self, obj, len) < 0)
-        return -1;
-
     if (PyMemoTable_Get(self->memo, obj)) {
         /* pop the stack stuff we pushed */
         if (self->bin) {
@@ -2582,7 +2963,7 @@ save_tuple(PicklerObject *self, PyObject *obj)
         if (memo_get(self, obj) < 0)
             return -1;
 
-        return 0;
+        goto done;
     }
     else { /* Not recursive. */
         if (_Pickler_Write(self, &tuple_op, 1) < 0)
@@ -2593,9 +2974,141 @@ save_tuple(PicklerObject *self, PyObject *obj)
     if (memo_put(self, obj) < 0)
         return -1;
 
+  done:
+    work_pop(self);
     return 0;
 }
 
+#else
+
+/* A helper for save_tuple.  Push the len elements in tuple t on the stack. */
+static int
+store_tuple_elements(PicklerObject *self, PyObject *t, Py_ssize_t len)
+{
+    Py_ssize_t i;
+
+    assert(PyTuple_Size(t) == len);
+
+    for (i = 0; i < len; i++) {
+        PyObject *element = PyTuple_GET_ITEM(t, i);
+
+        if (element == NULL)
+            return -1;
+        if (save(self, element, 0) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/* Tuples are ubiquitous in the pickle protocols, so many techniques are
+ * used across protocols to minimize the space needed to pickle them.
+ * Tuples are also the only builtin immutable type that can be recursive
+ * (a tuple can be reached from itself), and that requires some subtle
+ * magic so that it works in all cases.  IOW, this is a long routine.
+ */
+static int
+save_tuple(PicklerObject *self, PyObject *obj)
+{
+    Py_ssize_t len, i;
+
+    const char mark_op = MARK;
+    const char tuple_op = TUPLE;
+    const char pop_op = POP;
+    const char pop_mark_op = POP_MARK;
+    const char len2opcode[] = {EMPTY_TUPLE, TUPLE1, TUPLE2, TUPLE3};
+
+    if ((len = PyTuple_Size(obj)) < 0)
+        return -1;
+
+    if (len == 0) {
+        char pdata[2];
+
+        if (self->proto) {
+            pdata[0] = EMPTY_TUPLE;
+            len = 1;
+        }
+        else {
+            pdata[0] = MARK;
+            pdata[1] = TUPLE;
+            len = 2;
+        }
+        if (_Pickler_Write(self, pdata, len) < 0)
+            return -1;
+        return 0;
+    }
+
+    /* The tuple isn't in the memo now.  If it shows up there after
+     * saving the tuple elements, the tuple must be recursive, in
+     * which case we'll pop everything we put on the stack, and fetch
+     * its value from the memo.
+     */
+    if (len <= 3 && self->proto >= 2) {
+        /* Use TUPLE{1,2,3} opcodes. */
+        if (store_tuple_elements(self, obj, len) < 0)
+            return -1;
+
+        if (PyMemoTable_Get(self->memo, obj)) {
+            /* pop the len elements */
+            for (i = 0; i < len; i++)
+                if (_Pickler_Write(self, &pop_op, 1) < 0)
+                    return -1;
+            /* fetch from memo */
+            if (memo_get(self, obj) < 0)
+                return -1;
+
+            return 0;
+        }
+        else { /* Not recursive. */
+            if (_Pickler_Write(self, len2opcode + len, 1) < 0)
+                return -1;
+        }
+        goto memoize;
+    }
+
+    /* proto < 2 and len > 0, or proto >= 2 and len > 3.
+     * Generate MARK e1 e2 ... TUPLE
+     */
+    if (_Pickler_Write(self, &mark_op, 1) < 0)
+        return -1;
+
+    if (store_tuple_elements(self, obj, len) < 0)
+        return -1;
+
+    if (PyMemoTable_Get(self->memo, obj)) {
+        /* pop the stack stuff we pushed */
+        if (self->bin) {
+            if (_Pickler_Write(self, &pop_mark_op, 1) < 0)
+                return -1;
+        }
+        else {
+            /* Note that we pop one more than len, to remove
+             * the MARK too.
+             */
+            for (i = 0; i <= len; i++)
+                if (_Pickler_Write(self, &pop_op, 1) < 0)
+                    return -1;
+        }
+        /* fetch from memo */
+        if (memo_get(self, obj) < 0)
+            return -1;
+
+        return 0;
+    }
+    else { /* Not recursive. */
+        if (_Pickler_Write(self, &tuple_op, 1) < 0)
+            return -1;
+    }
+
+  memoize:
+    if (memo_put(self, obj) < 0)
+        return -1;
+
+    return 0;
+}
+
+#endif
+
 /* iter is an iterator giving items, and we batch up chunks of
  *     MARK item item ... item APPENDS
  * opcode sequences.  Calling code should have arranged to first create an
@@ -2763,6 +3276,85 @@ batch_list_exact(PicklerObject *self, PyObject *obj)
     return 0;
 }
 
+#ifdef STACKLESS
+/* The steps of list_step() */
+enum {
+    LIST_START,
+    LIST_MARK,
+    LIST_ITEMS,
+    LIST_ITEM,
+    LIST_APPEND
+};
+
+/* The variant of batch_list_exact() for the work stack. It saves one item
+ * per call. For protocol 0 it writes an APPEND after each item like
+ * batch_list().
+ */
+static int
+list_step(PicklerObject *self, PicklerWork *w)
+{
+    PyObject *obj = w->obj;
+
+    const char append_op = APPEND;
+    const char appends_op = APPENDS;
+    const char mark_op = MARK;
+
+    switch (w->step) {
+    case LIST_START:
+        if (self->proto == 0) {
+            /* APPENDS isn't available; do one at a time. */
+            w->step = LIST_ITEM;
+            return 0;
+        }
+        if (PyList_GET_SIZE(obj) == 1) {
+            w->step = LIST_APPEND;
+            return work_save(self, PyList_GET_ITEM(obj, 0));
+        }
+        w->step = LIST_MARK;
+        return 0;
+
+    case LIST_MARK:
+        /* Write in batches of BATCHSIZE. */
+        if (_Pickler_Write(self, &mark_op, 1) < 0)
+            return -1;
+        w->batch = 0;
+        w->step = LIST_ITEMS;
+        return 0;
+
+    case LIST_ITEMS:
+        if (w->index < PyList_GET_SIZE(obj) && w->batch < BATCHSIZE) {
+            w->batch++;
+            return work_save(self, PyList_GET_ITEM(obj, w->index++));
+        }
+        if (_Pickler_Write(self, &appends_op, 1) < 0)
+            return -1;
+        if (w->index < PyList_GET_SIZE(obj)) {
+            w->step = LIST_MARK;
+            return 0;
+        }
+        break;
+
+    case LIST_ITEM:
+        if (w->index < PyList_GET_SIZE(obj)) {
+            w->step = LIST_APPEND;
+            return work_save(self, PyList_GET_ITEM(obj, w->index++));
+        }
+        break;
+
+    case LIST_APPEND:
+        if (_Pickler_Write(self, &append_op, 1) < 0)
+            return -1;
+        if (self->proto == 0) {
+            w->step = LIST_ITEM;
+            return 0;
+        }
+        break;
+    }
+    work_pop(self);
+    return 0;
+}
+#endif
+
 static int
 save_list(PicklerObject *self, PyObject *obj)
 {
@@ -2796,6 +3388,14 @@ save_list(PicklerObject *self, PyObject *obj)
 
     if (len != 0) {
         /* Materialize the list elements. */
+#ifdef STACKLESS
+        if (PyList_CheckExact(obj) && !self->fast) {
+            /* list_step() saves the elements */
+            if (work_push(self, WORK_LIST, obj) == NULL)
+                goto error;
+        }
+        else
+#endif
         if (PyList_CheckExact(obj) && self->proto > 0) {
             if (Py_EnterRecursiveCall(" while pickling an object"))
                 goto error;
@@ -3022,6 +3622,112 @@ batch_dict_exact(PicklerObject *self, PyObject *obj)
     return 0;
 }
 
+#ifdef STACKLESS
+/* The steps of dict_step() */
+enum {
+    DICT_START,
+    DICT_MARK,
+    DICT_ITEMS,
+    DICT_VALUE,
+    DICT_SETITEM,
+    DICT_SETITEMS
+};
+
+/* The variant of batch_dict_exact() for the work stack. It saves one key or
+ * value per call. For protocol 0 it writes a SETITEM after each item like
+ * batch_dict().
+ */
+static int
+dict_step(PicklerObject *self, PicklerWork *w)
+{
+    PyObject *obj = w->obj;
+    PyObject *key, *value;
+    int status;
+
+    const char mark_op = MARK;
+    const char setitem_op = SETITEM;
+    const char setitems_op = SETITEMS;
+
+    switch (w->step) {
+    case DICT_START:
+        /* SETITEMS isn't available for protocol 0; do one at a time.
+           Special-case len(d) == 1 to save space. */
+        if ((self->proto == 0 || w->size == 1) &&
+                PyDict_Next(obj, &w->index, &key, &value)) {
+            Py_INCREF(value);
+            w->items[0] = value;
+            w->step = DICT_VALUE;
+            w->batch = -1;
+            return work_save(self, key);
+        }
+        if (self->proto == 0)
+            break;
+        w->step = DICT_MARK;
+        return 0;
+
+    case DICT_MARK:
+        /* Write in batches of BATCHSIZE. */
+        if (_Pickler_Write(self, &mark_op, 1) < 0)
+            return -1;
+        w->batch = 0;
+        w->step = DICT_ITEMS;
+        return 0;
+
+    case DICT_ITEMS:
+        if (w->batch < BATCHSIZE && PyDict_Next(obj, &w->index, &key, &value)) {
+            Py_INCREF(value);
+            w->items[0] = value;
+            w->batch++;
+            w->step = DICT_VALUE;
+            return work_save(self, key);
+        }
+        w->step = DICT_SETITEMS;
+        return 0;
+
+    case DICT_VALUE:
+        value = w->items[0];
+        w->items[0] = NULL;
+        /* batch is -1 for the single item of a dict of size 1 */
+        w->step = w->batch < 0 ? DICT_SETITEM : DICT_ITEMS;
+        status = save_dispatch(self, value, 0);
+        Py_DECREF(value);
+        return status;
+
+    case DICT_SETITEM:
+        if (_Pickler_Write(self, &setitem_op, 1) < 0)
+            return -1;
+        if (self->proto == 0) {
+            if (PyDict_GET_SIZE(obj) != w->size) {
+                PyErr_Format(
+                    PyExc_RuntimeError,
+                    "dictionary changed size during iteration");
+                return -1;
+            }
+            w->step = DICT_START;
+            return 0;
+        }
+        break;
+
+    case DICT_SETITEMS:
+        if (_Pickler_Write(self, &setitems_op, 1) < 0)
+            return -1;
+        if (PyDict_GET_SIZE(obj) != w->size) {
+            PyErr_Format(
+                PyExc_RuntimeError,
+                "dictionary changed size during iteration");
+            return -1;
+        }
+        if (w->batch == BATCHSIZE) {
+            w->step = DICT_MARK;
+            return 0;
+        }
+        break;
+    }
+    work_pop(self);
+    return 0;
+}
+#endif
+
 static int
 save_dict(PicklerObject *self, PyObject *obj)
 {
@@ -3053,6 +3759,16 @@ save_dict(PicklerObject *self, PyObject *obj)
 
     if (PyDict_GET_SIZE(obj)) {
         /* Save the dict items. */
+#ifdef STACKLESS
+        if (PyDict_CheckExact(obj) && !self->fast) {
+            /* dict_step() saves the items */
+            PicklerWork *w = work_push(self, WORK_DICT, obj);
+            if (w == NULL)
+                goto error;
+            w->size = PyDict_GET_SIZE(obj);
+        }
+        else
+#endif
         if (PyDict_CheckExact(obj) && self->proto > 0) {
             /* We can take certain shortcuts if we know this is a dict and
                not a dict subclass. */
@@ -3573,91 +4289,470 @@ save_singleton_type(PicklerObject *self, PyObject *obj, PyObject *singleton)
     return status;
 }
 
-static int
-save_type(PicklerObject *self, PyObject *obj)
-{
-    if (obj == (PyObject *)&_PyNone_Type) {
-        return save_singleton_type(self, obj, Py_None);
-    }
-    else if (obj == (PyObject *)&PyEllipsis_Type) {
-        return save_singleton_type(self, obj, Py_Ellipsis);
-    }
-    else if (obj == (PyObject *)&_PyNotImplemented_Type) {
-        return save_singleton_type(self, obj, Py_NotImplemented);
+static int
+save_type(PicklerObject *self, PyObject *obj)
+{
+    if (obj == (PyObject *)&_PyNone_Type) {
+        return save_singleton_type(self, obj, Py_None);
+    }
+    else if (obj == (PyObject *)&PyEllipsis_Type) {
+        return save_singleton_type(self, obj, Py_Ellipsis);
+    }
+    else if (obj == (PyObject *)&_PyNotImplemented_Type) {
+        return save_singleton_type(self, obj, Py_NotImplemented);
+    }
+    return save_global(self, obj, NULL);
+}
+
+static int
+save_pers(PicklerObject *self, PyObject *obj)
+{
+    PyObject *pid = NULL;
+    int status = 0;
+
+    const char persid_op = PERSID;
+    const char binpersid_op = BINPERSID;
+
+    pid = call_method(self->pers_func, self->pers_func_self, obj);
+    if (pid == NULL)
+        return -1;
+
+    if (pid != Py_None) {
+        if (self->bin) {
+            if (save(self, pid, 1) < 0 ||
+                _Pickler_Write(self, &binpersid_op, 1) < 0)
+                goto error;
+        }
+        else {
+            PyObject *pid_str;
+
+            pid_str = PyObject_Str(pid);
+            if (pid_str == NULL)
+                goto error;
+
+            /* XXX: Should it check whether the pid contains embedded
+               newlines? */
+            if (!PyUnicode_IS_ASCII(pid_str)) {
+                PyErr_SetString(_Pickle_GetGlobalState()->PicklingError,
+                                "persistent IDs in protocol 0 must be "
+                                "ASCII strings");
+                Py_DECREF(pid_str);
+                goto error;
+            }
+
+            if (_Pickler_Write(self, &persid_op, 1) < 0 ||
+                _Pickler_Write(self, PyUnicode_DATA(pid_str),
+                               PyUnicode_GET_LENGTH(pid_str)) < 0 ||
+                _Pickler_Write(self, "\n", 1) < 0) {
+                Py_DECREF(pid_str);
+                goto error;
+            }
+            Py_DECREF(pid_str);
+        }
+        status = 1;
+    }
+
+    if (0) {
+  error:
+        status = -1;
+    }
+    Py_XDECREF(pid);
+
+    return status;
+}
+
+static PyObject *
+get_class(PyObject *obj)
+{
+    PyObject *cls;
+    _Py_IDENTIFIER(__class__);
+
+    if (_PyObject_LookupAttrId(obj, &PyId___class__, &cls) == 0) {
+        cls = (PyObject *) Py_TYPE(obj);
+        Py_INCREF(cls);
+    }
+    return cls;
+}
+
+#ifdef STACKLESS
+/* We're saving obj, and args is the 2-thru-5 tuple returned by the
+ * appropriate __reduce__ method for obj. Check args and push an entry onto
+ * the work stack, reduce_step() saves the parts of args.
+ */
+static int
+save_reduce_value(PicklerObject *self, PyObject *args, PyObject *obj)
+{
+    PyObject *callable;
+    PyObject *argtup;
+    PyObject *state = NULL;
+    PyObject *listitems = Py_None;
+    PyObject *dictitems = Py_None;
+    PyObject *items[3] = {NULL, NULL, NULL};
+    PickleState *st = _Pickle_GetGlobalState();
+    PicklerWork *w;
+    Py_ssize_t size;
+    int use_newobj = 0, use_newobj_ex = 0;
+    char opcode;
+
+    size = PyTuple_Size(args);
+    if (size < 2 || size > 5) {
+        PyErr_SetString(st->PicklingError, "tuple returned by "
+                        "__reduce__ must contain 2 through 5 elements");
+        return -1;
+    }
+
+    if (!PyArg_UnpackTuple(args, "save_reduce", 2, 5,
+                           &callable, &argtup, &state, &listitems, &dictitems))
+        return -1;
+
+    if (!PyCallable_Check(callable)) {
+        PyErr_SetString(st->PicklingError, "first item of the tuple "
+                        "returned by __reduce__ must be callable");
+        return -1;
+    }
+    if (!PyTuple_Check(argtup)) {
+        PyErr_SetString(st->PicklingError, "second item of the tuple "
+                        "returned by __reduce__ must be a tuple");
+        return -1;
+    }
+
+    if (state == Py_None)
+        state = NULL;
+
+    if (listitems == Py_None)
+        listitems = NULL;
+    else if (!PyIter_Check(listitems)) {
+        PyErr_Format(st->PicklingError, "fourth element of the tuple "
+                     "returned by __reduce__ must be an iterator, not %s",
+                     Py_TYPE(listitems)->tp_name);
+        return -1;
+    }
+
+    if (dictitems == Py_None)
+        dictitems = NULL;
+    else if (!PyIter_Check(dictitems)) {
+        PyErr_Format(st->PicklingError, "fifth element of the tuple "
+                     "returned by __reduce__ must be an iterator, not %s",
+                     Py_TYPE(dictitems)->tp_name);
+        return -1;
+    }
+
+    if (self->proto >= 2) {
+        PyObject *name;
+        _Py_IDENTIFIER(__name__);
+
+        if (_PyObject_LookupAttrId(callable, &PyId___name__, &name) < 0) {
+            return -1;
+        }
+        if (name != NULL && PyUnicode_Check(name)) {
+            _Py_IDENTIFIER(__newobj_ex__);
+            use_newobj_ex = _PyUnicode_EqualToASCIIId(
+                    name, &PyId___newobj_ex__);
+            if (!use_newobj_ex) {
+                _Py_IDENTIFIER(__newobj__);
+                use_newobj = _PyUnicode_EqualToASCIIId(name, &PyId___newobj__);
+            }
+        }
+        Py_XDECREF(name);
+    }
+
+    if (use_newobj_ex) {
+        PyObject *cls;
+        PyObject *args;
+        PyObject *kwargs;
+
+        if (PyTuple_GET_SIZE(argtup) != 3) {
+            PyErr_Format(st->PicklingError,
+                         "length of the NEWOBJ_EX argument tuple must be "
+                         "exactly 3, not %zd", PyTuple_GET_SIZE(argtup));
+            return -1;
+        }
+
+        cls = PyTuple_GET_ITEM(argtup, 0);
+        if (!PyType_Check(cls)) {
+            PyErr_Format(st->PicklingError,
+                         "first item from NEWOBJ_EX argument tuple must "
+                         "be a class, not %.200s", Py_TYPE(cls)->tp_name);
+            return -1;
+        }
+        args = PyTuple_GET_ITEM(argtup, 1);
+        if (!PyTuple_Check(args)) {
+            PyErr_Format(st->PicklingError,
+                         "second item from NEWOBJ_EX argument tuple must "
+                         "be a tuple, not %.200s", Py_TYPE(args)->tp_name);
+            return -1;
+        }
+        kwargs = PyTuple_GET_ITEM(argtup, 2);
+        if (!PyDict_Check(kwargs)) {
+            PyErr_Format(st->PicklingError,
+                         "third item from NEWOBJ_EX argument tuple must "
+                         "be a dict, not %.200s", Py_TYPE(kwargs)->tp_name);
+            return -1;
+        }
+
+        if (self->proto >= 4) {
+            Py_INCREF(cls);
+            items[0] = cls;
+            Py_INCREF(args);
+            items[1] = args;
+            Py_INCREF(kwargs);
+            items[2] = kwargs;
+            opcode = NEWOBJ_EX;
+        }
+        else {
+            PyObject *newargs;
+            PyObject *cls_new;
+            Py_ssize_t i;
+            _Py_IDENTIFIER(__new__);
+
+            newargs = PyTuple_New(PyTuple_GET_SIZE(args) + 2);
+            if (newargs == NULL)
+                return -1;
+
+            cls_new = _PyObject_GetAttrId(cls, &PyId___new__);
+            if (cls_new == NULL) {
+                Py_DECREF(newargs);
+                return -1;
+            }
+            PyTuple_SET_ITEM(newargs, 0, cls_new);
+            Py_INCREF(cls);
+            PyTuple_SET_ITEM(newargs, 1, cls);
+            for (i = 0; i < PyTuple_GET_SIZE(args); i++) {
+                PyObject *item = PyTuple_GET_ITEM(args, i);
+                Py_INCREF(item);
+                PyTuple_SET_ITEM(newargs, i + 2, item);
+            }
+
+            callable = PyObject_Call(st->partial, newargs, kwargs);
+            Py_DECREF(newargs);
+            if (callable == NULL)
+                return -1;
+
+            newargs = PyTuple_New(0);
+            if (newargs == NULL) {
+                Py_DECREF(callable);
+                return -1;
+            }
+
+            items[0] = callable;
+            items[1] = newargs;
+            opcode = REDUCE;
+        }
+    }
+    else if (use_newobj) {
+        PyObject *cls;
+        PyObject *newargtup;
+        PyObject *obj_class;
+        int p;
+
+        /* Sanity checks. */
+        if (PyTuple_GET_SIZE(argtup) < 1) {
+            PyErr_SetString(st->PicklingError, "__newobj__ arglist is empty");
+            return -1;
+        }
+
+        cls = PyTuple_GET_ITEM(argtup, 0);
+        if (!PyType_Check(cls)) {
+            PyErr_SetString(st->PicklingError, "args[0] from "
+                            "__newobj__ args is not a type");
+            return -1;
+        }
+
+        if (obj != NULL) {
+            obj_class = get_class(obj);
+            if (obj_class == NULL) {
+                return -1;
+            }
+            p = obj_class != cls;
+            Py_DECREF(obj_class);
+            if (p) {
+                PyErr_SetString(st->PicklingError, "args[0] from "
+                                "__newobj__ args has the wrong class");
+                return -1;
+            }
+        }
+        /* XXX: Saving these is prone to infinite recursion. Imagine
+           what happen if the value returned by the __reduce__() method of
+           some extension type contains another object of the same type. Ouch!
+
+           Here is a quick example, that I ran into, to illustrate what I
+           mean:
+
+             >>> import pickle, copyreg
+             >>> copyreg.dispatch_table.pop(complex)
+             >>> pickle.dumps(1+2j)
+             Traceback (most recent call last):
+               ...
+             RecursionError: maximum recursion depth exceeded
+
+           Removing the complex class from copyreg.dispatch_table made the
+           __reduce_ex__() method emit another complex object:
+
+             >>> (1+1j).__reduce_ex__(2)
+             (<function __newobj__ at 0xb7b71c3c>,
+               (<class 'complex'>, (1+1j)), None, None, None)
+
+           Thus when save() was called on newargstup (the 2nd item) recursion
+           ensued. Of course, the bug was in the complex class which had a
+           broken __getnewargs__() that emitted another complex object. But,
+           the point, here, is it is quite easy to end up with a broken reduce
+           function. */
+
+        /* Save the class and its __new__ arguments. */
+        newargtup = PyTuple_GetSlice(argtup, 1, PyTuple_GET_SIZE(argtup));
+        if (newargtup == NULL)
+            return -1;
+
+        Py_INCREF(cls);
+        items[0] = cls;
+        items[1] = newargtup;
+        opcode = NEWOBJ;
     }
-    return save_global(self, obj, NULL);
+    else { /* Not using NEWOBJ. */
+        Py_INCREF(callable);
+        items[0] = callable;
+        Py_INCREF(argtup);
+        items[1] = argtup;
+        opcode = REDUCE;
+    }
+
+    w = work_push(self, WORK_REDUCE, obj);
+    if (w == NULL) {
+        Py_XDECREF(items[0]);
+        Py_XDECREF(items[1]);
+        Py_XDECREF(items[2]);
+        return -1;
+    }
+    memcpy(w->items, items, sizeof(items));
+    w->opcode = opcode;
+    Py_XINCREF(listitems);
+    w->listitems = listitems;
+    Py_XINCREF(dictitems);
+    w->dictitems = dictitems;
+    Py_XINCREF(state);
+    w->state = state;
+    return 0;
 }
 
+/* The steps of reduce_step() */
+enum {
+    REDUCE_ITEMS,
+    REDUCE_BUILD
+};
+
 static int
-save_pers(PicklerObject *self, PyObject *obj)
+reduce_step(PicklerObject *self, PicklerWork *w)
 {
-    PyObject *pid = NULL;
+    PyObject *obj = w->obj;
+    PyObject *listitems, *dictitems;
     int status = 0;
 
-    const char persid_op = PERSID;
-    const char binpersid_op = BINPERSID;
+    const char build_op = BUILD;
 
-    pid = call_method(self->pers_func, self->pers_func_self, obj);
-    if (pid == NULL)
-        return -1;
+    if (w->step == REDUCE_BUILD) {
+        if (_Pickler_Write(self, &build_op, 1) < 0)
+            return -1;
+        work_pop(self);
+        return 0;
+    }
 
-    if (pid != Py_None) {
-        if (self->bin) {
-            if (save(self, pid, 1) < 0 ||
-                _Pickler_Write(self, &binpersid_op, 1) < 0)
-                goto error;
-        }
-        else {
-            PyObject *pid_str;
+    while (w->index < 3) {
+        PyObject *item = w->items[w->index++];
+        if (item != NULL)
+            return work_save(self, item);
+    }
+    if (_Pickler_Write(self, &w->opcode, 1) < 0)
+        return -1;
 
-            pid_str = PyObject_Str(pid);
-            if (pid_str == NULL)
-                goto error;
+    /* obj can be NULL when save_reduce() is used directly. A NULL obj means
+       the caller do not want to memoize the object. Not particularly useful,
+       but that is to mimic the behavior save_reduce() in pickle.py when
+       obj is None. */
+    if (obj != NULL) {
+        /* If the object is already in the memo, this means it is
+           recursive. In this case, throw away everything we put on the
+           stack, and fetch the object back from the memo. */
+        if (PyMemoTable_Get(self->memo, obj)) {
+            const char pop_op = POP;
 
-            /* XXX: Should it check whether the pid contains embedded
-               newlines? */
-            if (!PyUnicode_IS_ASCII(pid_str)) {
-                PyErr_SetString(_Pickle_GetGlobalState()->PicklingError,
-                                "persistent IDs in protocol 0 must be "
-                                "ASCII strings");
-                Py_DECREF(pid_str);
-                goto error;
-            }
+            if (_Pickler_Write(self, &pop_op, 1) < 0)
+                return -1;
+            if (memo_get(self, obj) < 0)
+                return -1;
 
-            if (_Pickler_Write(self, &persid_op, 1) < 0 ||
-                _Pickler_Write(self, PyUnicode_DATA(pid_str),
-                               PyUnicode_GET_LENGTH(pid_str)) < 0 ||
-                _Pickler_Write(self, "\n", 1) < 0) {
-                Py_DECREF(pid_str);
-                goto error;
-            }
-            Py_DECREF(pid_str);
+            work_pop(self);
+            return 0;
         }
-        status = 1;
+        else if (memo_put(self, obj) < 0)
+            return -1;
     }
 
-    if (0) {
-  error:
-        status = -1;
+    listitems = w->listitems;
+    dictitems = w->dictitems;
+    if (listitems != NULL || dictitems != NULL) {
+        w->listitems = w->dictitems = NULL;
+        if (listitems && batch_list(self, listitems) < 0)
+            status = -1;
+        if (status == 0 && dictitems && batch_dict(self, dictitems) < 0)
+            status = -1;
+        Py_XDECREF(listitems);
+        Py_XDECREF(dictitems);
+        if (status < 0)
+            return -1;
+        /* batch_list() and batch_dict() may have reallocated the stack */
+        w = &self->work[self->work_len - 1];
     }
-    Py_XDECREF(pid);
 
-    return status;
+    if (w->state) {
+        w->step = REDUCE_BUILD;
+        return work_save(self, w->state);
+    }
+    work_pop(self);
+    return 0;
 }
 
-static PyObject *
-get_class(PyObject *obj)
+static int
+save_reduce(PicklerObject *self, PyObject *args, PyObject *obj)
 {
-    PyObject *cls;
-    _Py_IDENTIFIER(__class__);
+    Py_ssize_t base = self->work_len;
 
-    if (_PyObject_LookupAttrId(obj, &PyId___class__, &cls) == 0) {
-        cls = (PyObject *) Py_TYPE(obj);
-        Py_INCREF(cls);
+    if (save_reduce_value(self, args, obj) < 0)
+        return -1;
+    return save_work(self, base);
+}
+
+/* Process the entries of the work stack above base. */
+static int
+save_work(PicklerObject *self, Py_ssize_t base)
+{
+    while (self->work_len > base) {
+        PicklerWork *w = &self->work[self->work_len - 1];
+        int status = -1;
+
+        switch (w->kind) {
+        case WORK_TUPLE:
+            status = tuple_step(self, w);
+            break;
+        case WORK_LIST:
+            status = list_step(self, w);
+            break;
+        case WORK_DICT:
+            status = dict_step(self, w);
+            break;
+        case WORK_REDUCE:
+            status = reduce_step(self, w);
+            break;
+        }
+        if (status < 0) {
+            work_clear(self, base);
+            return -1;
+        }
     }
-    return cls;
+    return 0;
 }
 
+#else
+
 /* We're saving obj, and args is the 2-thru-5 tuple returned by the
  * appropriate __reduce__ method for obj.
  */
@@ -3948,8 +5043,19 @@ save_reduce(PicklerObject *self, PyObject *args, PyObject *obj)
     return 0;
 }
 
+#endif
+
+#ifdef STACKLESS
+/* Save obj or start to save it, if it is a tuple, a list, a dict or an object
+ * with a __reduce__() method. In this case the caller must process the new
+ * entries of the work stack, see save_work().
+ */
+static int
+save_dispatch(PicklerObject *self, PyObject *obj, int pers_save)
+#else
 static int
 save(PicklerObject *self, PyObject *obj, int pers_save)
+#endif
 {
     PyTypeObject *type;
     PyObject *reduce_func = NULL;
@@ -3959,22 +5065,6 @@ save(PicklerObject *self, PyObject *obj, int pers_save)
     if (_Pickler_OpcodeBoundary(self) < 0)
         return -1;
 
-#ifdef STACKLESS
-    /* but we save the stack after a fixed watermark */
-    {
-        /* use a variable, because SLP_CSTACK_SAVE_NOW may evaluate ts several times. */
-        PyThreadState *ts = PyThreadState_GET();
-        if (SLP_CSTACK_SAVE_NOW(ts, self)) {
-            int res;
-            if (Py_EnterRecursiveCall(" while pickling an object"))
-                return -1;
-            res = slp_safe_pickling((void *)&save, (PyObject *)self, obj, pers_save);
-            Py_LeaveRecursiveCall();
-            return res;
-        }
-    }
-#endif
-
     /* The extra pers_save argument is necessary to avoid calling save_pers()
        on its returned object. */
     if (!pers_save && self->pers_func) {
@@ -4035,7 +5125,11 @@ save(PicklerObject *self, PyObject *obj, int pers_save)
 
         if (ret == NULL) return -1;
         if (ret != Py_None) {
+#ifdef STACKLESS
+            status = save_reduce_value(self, ret, obj);
+#else
             status = save_reduce(self, ret, obj);
+#endif
             Py_DECREF(ret);
             goto done;
         }
@@ -4060,6 +5154,14 @@ save(PicklerObject *self, PyObject *obj, int pers_save)
         status = save_tuple(self, obj);
         goto done;
     }
+    else if (type == &PyByteArray_Type) {
+        status = save_bytearray(self, obj);
+        goto done;
+    }
+    else if (type == &PyPickleBuffer_Type) {
+        status = save_picklebuffer(self, obj);
+        goto done;
+    }
     else if (type == &PyType_Type) {
         status = save_type(self, obj);
         goto done;
@@ -4171,7 +5273,11 @@ save(PicklerObject *self, PyObject *obj, int pers_save)
         goto error;
     }
 
+#ifdef STACKLESS
+    status = save_reduce_value(self, reduce_value, obj);
+#else
     status = save_reduce(self, reduce_value, obj);
+#endif
 
     if (0) {
   error:
@@ -4186,6 +5292,38 @@ save(PicklerObject *self, PyObject *obj, int pers_save)
     return status;
 }
 
+#ifdef STACKLESS
+static int
+save(PicklerObject *self, PyObject *obj, int pers_save)
+{
+    Py_ssize_t base = self->work_len;
+
+#ifdef STACKLESS
+    /* Tuples, lists, dicts and reduce values don't need C stack, but other
+       objects, e.g. sets, still call save() recursively. Therefore we save
+       the stack after a fixed watermark */
+    {
+        /* use a variable, because SLP_CSTACK_SAVE_NOW may evaluate ts several times. */
+        PyThreadState *ts = PyThreadState_GET();
+        if (SLP_CSTACK_SAVE_NOW(ts, self)) {
+            int res;
+            if (Py_EnterRecursiveCall(" while pickling an object"))
+                return -1;
+            res = slp_safe_pickling((void *)&save, (PyObject *)self, obj, pers_save);
+            Py_LeaveRecursiveCall();
+            return res;
+        }
+    }
+#endif
+
+    if (save_dispatch(self, obj, pers_save) < 0) {
+        work_clear(self, base);
+        return -1;
+    }
+    return save_work(self, base);
+}
+#endif
+
 static int
 dump(PicklerObject *self, PyObject *obj)
 {
@@ -4288,6 +5426,9 @@ _pickle_Pickler___sizeof___impl(PicklerObject *self)
         res += sizeof(PyMemoTable);
         res += self->memo->mt_allocated * sizeof(PyMemoEntry);
     }
+#ifdef STACKLESS
+    res += self->work_allocated * sizeof(PicklerWork);
+#endif
     if (self->output_buffer != NULL) {
         s = _PySys_GetSizeOf(self->output_buffer);
         if (s == -1)
@@ -4314,8 +5455,11 @@ Pickler_dealloc(PicklerObject *self)
     Py_XDECREF(self->pers_func);
     Py_XDECREF(self->dispatch_table);
     Py_XDECREF(self->fast_memo);
+    Py_XDECREF(self->buffer_callback);
 #ifdef STACKLESS
         Py_XDECREF(self->module_dict_ids);
+    work_clear(self, 0);
+    PyMem_Free(self->work);
 #endif
 
     PyMemoTable_Del(self->memo);
@@ -4326,11 +5470,26 @@ Pickler_dealloc(PicklerObject *self)
 static int
 Pickler_traverse(PicklerObject *self, visitproc visit, void *arg)
 {
+#ifdef STACKLESS
+    Py_ssize_t i;
+#endif
+
     Py_VISIT(self->write);
     Py_VISIT(self->pers_func);
     Py_VISIT(self->dispatch_table);
     Py_VISIT(self->fast_memo);
+    Py_VISIT(self->buffer_callback);
 #ifdef STACKLESS
+    for (i = 0; i < self->work_len; i++) {
+        PicklerWork *w = &self->work[i];
+        Py_VISIT(w->obj);
+        Py_VISIT(w->items[0]);
+        Py_VISIT(w->items[1]);
+        Py_VISIT(w->items[2]);
+        Py_VISIT(w->listitems);
+        Py_VISIT(w->dictitems);
+        Py_VISIT(w->state);
+    }
         Py_VISIT(self->module_dict_ids);
 #endif
     return 0;
@@ -4344,8 +5503,10 @@ Pickler_clear(PicklerObject *self)
     Py_CLEAR(self->pers_func);
     Py_CLEAR(self->dispatch_table);
     Py_CLEAR(self->fast_memo);
+    Py_CLEAR(self->buffer_callback);
 #ifdef STACKLESS
         Py_CLEAR(self->module_dict_ids);
+    work_clear(self, 0);
 #endif
 
     if (self->memo != NULL) {
@@ -4364,11 +5525,12 @@ _pickle.Pickler.__init__
   file: object
   protocol: object = NULL
   fix_imports: bool = True
+  buffer_callback: object = None
 
 This takes a binary file for writing a pickle data stream.
 
 The optional *protocol* argument tells the pickler to use the given
-protocol; supported protocols are 0, 1, 2, 3 and 4.  The default
+protocol; supported protocols are 0, 1, 2, 3, 4 and 5.  The default
 protocol is 3; a backward-incompatible protocol designed for Python 3.
 
 Specifying a negative protocol version selects the highest protocol
@@ -4383,12 +5545,24 @@ this interface.
 If *fix_imports* is True and protocol is less than 3, pickle will try
 to map the new Python 3 names to the old module names used in Python
 2, so that the pickle data stream is readable with Python 2.
+
+If *buffer_callback* is None (the default), buffer views are
+serialized into *file* as part of the pickle stream.
+
+If *buffer_callback* is not None, then it can be called any number
+of times with a buffer view.  If the callback returns a false value
+(such as None), the given buffer is out-of-band; otherwise the
+buffer is serialized in-band, i.e. inside the pickle stream.
+
+It is an error if *buffer_callback* is not None and *protocol*
+is None or smaller than 5.
 [clinic start generated code]*/
 
 static int
 _pickle_Pickler___init___impl(PicklerObject *self, PyObject *file,
-                              PyObject *protocol, int fix_imports)
-/*[clinic end generated code: output=b5f31078dab17fb0 input=4faabdbc763c2389]*/
+                              PyObject *protocol, int fix_imports,
+                              PyObject *buffer_callback)
+/*[clinic end generated code: output=0abedc50590d259b input=292b430edbe4825f]*/
 {
     _Py_IDENTIFIER(persistent_id);
     _Py_IDENTIFIER(dispatch_table);
@@ -4403,6 +5577,9 @@ _pickle_Pickler___init___impl(PicklerObject *self, PyObject *file,
     if (_Pickler_SetOutputStream(self, file) < 0)
         return -1;
 
+    if (_Pickler_SetBufferCallback(self, buffer_callback) < 0)
+        return -1;
+
     /* memo and output_buffer may have already been created in _Pickler_New */
     if (self->memo == NULL) {
         self->memo = PyMemoTable_New();
@@ -5228,17 +6405,100 @@ load_counted_binbytes(UnpicklerObject *self, int nbytes)
         return -1;
     }
 
-    if (_Unpickler_Read(self, &s, size) < 0)
-        return -1;
-
-    bytes = PyBytes_FromStringAndSize(s, size);
+    bytes = PyBytes_FromStringAndSize(NULL, size);
     if (bytes == NULL)
         return -1;
+    if (_Unpickler_ReadInto(self, PyBytes_AS_STRING(bytes), size) < 0) {
+        Py_DECREF(bytes);
+        return -1;
+    }
 
     PDATA_PUSH(self->stack, bytes, -1);
     return 0;
 }
 
+static int
+load_counted_bytearray(UnpicklerObject *self)
+{
+    PyObject *bytearray;
+    Py_ssize_t size;
+    char *s;
+
+    if (_Unpickler_Read(self, &s, 8) < 0)
+        return -1;
+
+    size = calc_binsize(s, 8);
+    if (size < 0) {
+        PyErr_Format(PyExc_OverflowError,
+                     "BYTEARRAY8 exceeds system's maximum size of %zd bytes",
+                     PY_SSIZE_T_MAX);
+        return -1;
+    }
+
+    bytearray = PyByteArray_FromStringAndSize(NULL, size);
+    if (bytearray == NULL)
+        return -1;
+    if (_Unpickler_ReadInto(self, PyByteArray_AS_STRING(bytearray), size) < 0) {
+        Py_DECREF(bytearray);
+        return -1;
+    }
+
+    PDATA_PUSH(self->stack, bytearray, -1);
+    return 0;
+}
+
+static int
+load_next_buffer(UnpicklerObject *self)
+{
+    PyObject *buf;
+
+    if (self->buffers == NULL) {
+        PickleState *st = _Pickle_GetGlobalState();
+        PyErr_SetString(st->UnpicklingError,
+                        "pickle stream refers to out-of-band data "
+                        "but no *buffers* argument was given");
+        return -1;
+    }
+    buf = PyIter_Next(self->buffers);
+    if (buf == NULL) {
+        if (!PyErr_Occurred()) {
+            PickleState *st = _Pickle_GetGlobalState();
+            PyErr_SetString(st->UnpicklingError,
+                            "not enough out-of-band buffers");
+        }
+        return -1;
+    }
+
+    PDATA_PUSH(self->stack, buf, -1);
+    return 0;
+}
+
+static int
+load_readonly_buffer(UnpicklerObject *self)
+{
+    Py_ssize_t len = Py_SIZE(self->stack);
+    PyObject *obj, *view;
+
+    if (len <= self->stack->fence)
+        return Pdata_stack_underflow(self->stack);
+
+    obj = self->stack->data[len - 1];
+    view = PyMemoryView_FromObject(obj);
+    if (view == NULL)
+        return -1;
+    if (!PyMemoryView_GET_BUFFER(view)->readonly) {
+        /* Original object is writable */
+        PyMemoryView_GET_BUFFER(view)->readonly = 1;
+        self->stack->data[len - 1] = view;
+        Py_DECREF(obj);
+    }
+    else {
+        /* Original object is read-only, no need to replace it */
+        Py_DECREF(view);
+    }
+    return 0;
+}
+
 static int
 load_unicode(UnpicklerObject *self)
 {
@@ -6527,6 +7787,9 @@ load(UnpicklerObject *self)
         OP_ARG(SHORT_BINBYTES, load_counted_binbytes, 1)
         OP_ARG(BINBYTES, load_counted_binbytes, 4)
         OP_ARG(BINBYTES8, load_counted_binbytes, 8)
+        OP(BYTEARRAY8, load_counted_bytearray)
+        OP(NEXT_BUFFER, load_next_buffer)
+        OP(READONLY_BUFFER, load_readonly_buffer)
         OP_ARG(SHORT_BINSTRING, load_counted_binstring, 1)
         OP_ARG(BINSTRING, load_counted_binstring, 4)
         OP(STRING, load_string)
@@ -6783,9 +8046,11 @@ Unpickler_dealloc(UnpicklerObject *self)
     PyObject_GC_UnTrack((PyObject *)self);
     Py_XDECREF(self->readline);
     Py_XDECREF(self->read);
+    Py_XDECREF(self->readinto);
     Py_XDECREF(self->peek);
     Py_XDECREF(self->stack);
     Py_XDECREF(self->pers_func);
+    Py_XDECREF(self->buffers);
     if (self->buffer.buf != NULL) {
         PyBuffer_Release(&self->buffer);
         self->buffer.buf = NULL;
@@ -6805,9 +8070,11 @@ Unpickler_traverse(UnpicklerObject *self, visitproc visit, void *arg)
 {
     Py_VISIT(self->readline);
     Py_VISIT(self->read);
+    Py_VISIT(self->readinto);
     Py_VISIT(self->peek);
     Py_VISIT(self->stack);
     Py_VISIT(self->pers_func);
+    Py_VISIT(self->buffers);
     return 0;
 }
 
@@ -6816,9 +8083,11 @@ Unpickler_clear(UnpicklerObject *self)
 {
     Py_CLEAR(self->readline);
     Py_CLEAR(self->read);
+    Py_CLEAR(self->readinto);
     Py_CLEAR(self->peek);
     Py_CLEAR(self->stack);
     Py_CLEAR(self->pers_func);
+    Py_CLEAR(self->buffers);
     if (self->buffer.buf != NULL) {
         PyBuffer_Release(&self->buffer);
         self->buffer.buf = NULL;
@@ -6846,6 +8115,7 @@ _pickle.Unpickler.__init__
   fix_imports: bool = True
   encoding: str = 'ASCII'
   errors: str = 'strict'
+  buffers: object = None
 
 This takes a binary file for reading a pickle data stream.
 
@@ -6867,13 +8137,18 @@ map the old Python 2 names to the new names used in Python 3.  The
 instances pickled by Python 2; these default to 'ASCII' and 'strict',
 respectively.  The *encoding* can be 'bytes' to read these 8-bit
 string instances as bytes objects.
+
+If *buffers* is not None, it should be an iterable of buffer-enabled
+objects that is consumed each time the pickle stream references an
+out-of-band buffer view.  Such buffers have been given in order to the
+*buffer_callback* of a Pickler object.
 [clinic start generated code]*/
 
 static int
 _pickle_Unpickler___init___impl(UnpicklerObject *self, PyObject *file,
                                 int fix_imports, const char *encoding,
-                                const char *errors)
-/*[clinic end generated code: output=e2c8ce748edc57b0 input=f9b7da04f5f4f335]*/
+                                const char *errors, PyObject *buffers)
+/*[clinic end generated code: output=09f0192649ea3f85 input=8fb0d0b81e51fe23]*/
 {
     _Py_IDENTIFIER(persistent_load);
 
@@ -6887,6 +8162,9 @@ _pickle_Unpickler___init___impl(UnpicklerObject *self, PyObject *file,
     if (_Unpickler_SetInputEncoding(self, encoding, errors) < 0)
         return -1;
 
+    if (_Unpickler_SetBuffers(self, buffers) < 0)
+        return -1;
+
     self->fix_imports = fix_imports;
 
     if (init_method_ref((PyObject *)self, &PyId_persistent_load,
@@ -7265,6 +8543,7 @@ _pickle.dump
   protocol: object = NULL
   *
   fix_imports: bool = True
+  buffer_callback: object = None
 
 Write a pickled representation of obj to the open file object file.
 
@@ -7272,7 +8551,7 @@ This is equivalent to ``Pickler(file, protocol).dump(obj)``, but may
 be more efficient.
 
 The optional *protocol* argument tells the pickler to use the given
-protocol; supported protocols are 0, 1, 2, 3 and 4.  The default
+protocol; supported protocols are 0, 1, 2, 3, 4 and 5.  The default
 protocol is 4. It was introduced in Python 3.4, it is incompatible
 with previous versions.
 
@@ -7288,12 +8567,17 @@ this interface.
 If *fix_imports* is True and protocol is less than 3, pickle will try
 to map the new Python 3 names to the old module names used in Python
 2, so that the pickle data stream is readable with Python 2.
+
+If *buffer_callback* is None (the default), buffer views are serialized
+into *file* as part of the pickle stream.  It is an error if
+*buffer_callback* is not None and *protocol* is None or smaller than 5.
 [clinic start generated code]*/
 
 static PyObject *
 _pickle_dump_impl(PyObject *module, PyObject *obj, PyObject *file,
-                  PyObject *protocol, int fix_imports)
-/*[clinic end generated code: output=a4774d5fde7d34de input=93f1408489a87472]*/
+                  PyObject *protocol, int fix_imports,
+                  PyObject *buffer_callback)
+/*[clinic end generated code: output=706186dba996490c input=4d3350c490434112]*/
 {
     PicklerObject *pickler = _Pickler_New();
 
@@ -7306,6 +8590,9 @@ _pickle_dump_impl(PyObject *module, PyObject *obj, PyObject *file,
     if (_Pickler_SetOutputStream(pickler, file) < 0)
         goto error;
 
+    if (_Pickler_SetBufferCallback(pickler, buffer_callback) < 0)
+        goto error;
+
     if (dump(pickler, obj) < 0)
         goto error;
 
@@ -7328,11 +8615,12 @@ _pickle.dumps
   protocol: object = NULL
   *
   fix_imports: bool = True
+  buffer_callback: object = None
 
 Return the pickled representation of the object as a bytes object.
 
 The optional *protocol* argument tells the pickler to use the given
-protocol; supported protocols are 0, 1, 2, 3 and 4.  The default
+protocol; supported protocols are 0, 1, 2, 3, 4 and 5.  The default
 protocol is 4. It was introduced in Python 3.4, it is incompatible
 with previous versions.
 
@@ -7343,12 +8631,16 @@ version of Python needed to read the pickle produced.
 If *fix_imports* is True and *protocol* is less than 3, pickle will
 try to map the new Python 3 names to the old module names used in
 Python 2, so that the pickle data stream is readable with Python 2.
+
+If *buffer_callback* is None (the default), buffer views are serialized
+as part of the pickle stream.  It is an error if
+*buffer_callback* is not None and *protocol* is None or smaller than 5.
 [clinic start generated code]*/
 
 static PyObject *
 _pickle_dumps_impl(PyObject *module, PyObject *obj, PyObject *protocol,
-                   int fix_imports)
-/*[clinic end generated code: output=d75d5cda456fd261 input=b6efb45a7d19b5ab]*/
+                   int fix_imports, PyObject *buffer_callback)
+/*[clinic end generated code: output=fbab0093a5580fdf input=aea1d3f668c3e2f9]*/
 {
     PyObject *result;
     PicklerObject *pickler = _Pickler_New();
@@ -7359,6 +8651,9 @@ _pickle_dumps_impl(PyObject *module, PyObject *obj, PyObject *protocol,
     if (_Pickler_SetProtocol(pickler, protocol, fix_imports) < 0)
         goto error;
 
+    if (_Pickler_SetBufferCallback(pickler, buffer_callback) < 0)
+        goto error;
+
     if (dump(pickler, obj) < 0)
         goto error;
 
@@ -7380,6 +8675,7 @@ _pickle.load
   fix_imports: bool = True
   encoding: str = 'ASCII'
   errors: str = 'strict'
+  buffers: object = None
 
 Read and return an object from the pickle data stored in a file.
 
@@ -7404,12 +8700,18 @@ map the old Python 2 names to the new names used in Python 3.  The
 instances pickled by Python 2; these default to 'ASCII' and 'strict',
 respectively.  The *encoding* can be 'bytes' to read these 8-bit
 string instances as bytes objects.
+
+If *buffers* is not None, it should be an iterable of buffer-enabled
+objects that is consumed each time the pickle stream references an
+out-of-band buffer view.  Such buffers have been given in order to the
+*buffer_callback* of a Pickler object.
 [clinic start generated code]*/
 
 static PyObject *
 _pickle_load_impl(PyObject *module, PyObject *file, int fix_imports,
-                  const char *encoding, const char *errors)
-/*[clinic end generated code: output=69e298160285199e input=01b44dd3fc07afa7]*/
+                  const char *encoding, const char *errors,
+                  PyObject *buffers)
+/*[clinic end generated code: output=250452d141c23e76 input=4cb8ec5e937d8fd3]*/
 {
     PyObject *result;
     UnpicklerObject *unpickler = _Unpickler_New();
@@ -7423,6 +8725,9 @@ _pickle_load_impl(PyObject *module, PyObject *file, int fix_imports,
     if (_Unpickler_SetInputEncoding(unpickler, encoding, errors) < 0)
         goto error;
 
+    if (_Unpickler_SetBuffers(unpickler, buffers) < 0)
+        goto error;
+
     unpickler->fix_imports = fix_imports;
 
     result = load(unpickler);
@@ -7443,6 +8748,7 @@ _pickle.loads
   fix_imports: bool = True
   encoding: str = 'ASCII'
   errors: str = 'strict'
+  buffers: object = None
 
 Read and return an object from the given pickle data.
 
@@ -7458,12 +8764,18 @@ map the old Python 2 names to the new names used in Python 3.  The
 instances pickled by Python 2; these default to 'ASCII' and 'strict',
 respectively.  The *encoding* can be 'bytes' to read these 8-bit
 string instances as bytes objects.
+
+If *buffers* is not None, it should be an iterable of buffer-enabled
+objects that is consumed each time the pickle stream references an
+out-of-band buffer view.  Such buffers have been given in order to the
+*buffer_callback* of a Pickler object.
 [clinic start generated code]*/
 
 static PyObject *
 _pickle_loads_impl(PyObject *module, PyObject *data, int fix_imports,
-                   const char *encoding, const char *errors)
-/*[clinic end generated code: output=1e7cb2343f2c440f input=70605948a719feb9]*/
+                   const char *encoding, const char *errors,
+                   PyObject *buffers)
+/*[clinic end generated code: output=82ac1e6b588e6d02 input=a5b93d0efa62aa2c]*/
 {
     PyObject *result;
     UnpicklerObject *unpickler = _Unpickler_New();
@@ -7477,6 +8789,9 @@ _pickle_loads_impl(PyObject *module, PyObject *data, int fix_imports,
     if (_Unpickler_SetInputEncoding(unpickler, encoding, errors) < 0)
         goto error;
 
+    if (_Unpickler_SetBuffers(unpickler, buffers) < 0)
+        goto error;
+
     unpickler->fix_imports = fix_imports;
 
     result = load(unpickler);
@@ -7575,6 +8890,10 @@ PyInit__pickle(void)
     Py_INCREF(&Unpickler_Type);
     if (PyModule_AddObject(m, "Unpickler", (PyObject *)&Unpickler_Type) < 0)
         return NULL;
+    Py_INCREF(&PyPickleBuffer_Type);
+    if (PyModule_AddObject(m, "PickleBuffer",
+                           (PyObject *)&PyPickleBuffer_Type) < 0)
+        return NULL;
 
     st = _Pickle_GetState(m);
 
@@ -101,6 +101,9 @@ Local naming conventions:
 
 #include "Python.h"
 #include "structmember.h"
+#ifdef STACKLESS
+#include "stackless_api.h"
+#endif
 
 #ifdef _Py_MEMORY_SANITIZER
 # include <sanitizer/msan_interface.h>
@@ -802,6 +805,118 @@ internal_select(PySocketSockObject *s, int writing, _PyTime_t interval,
 
    sock_call_ex() must be called with the GIL held. The socket function is
    called with the GIL released. */
+#ifdef STACKLESS
+
+/* If tasklet blocking is enabled, a blocking socket or a socket with a
+   timeout parks the calling tasklet instead of the thread. */
+static int tasklet_blocking = 0;
+
+/* Return 1, if the socket operation should park the calling tasklet, 0, if
+   it should block the thread or -1 on error. Switch the FD of a blocking
+   socket to non-blocking mode and back as required. */
+static int
+sock_tasklet_mode(PySocketSockObject *s)
+{
+    if (tasklet_blocking && s->sock_timeout != 0 && IS_SELECTABLE(s)) {
+        if (s->sock_timeout < 0 && !s->sock_tasklet_nonblock) {
+            if (internal_setblocking(s, 0) == -1)
+                return -1;
+            s->sock_tasklet_nonblock = 1;
+        }
+        return 1;
+    }
+    if (s->sock_tasklet_nonblock) {
+        /* tasklet blocking was disabled meanwhile */
+        if (internal_setblocking(s, 1) == -1)
+            return -1;
+        s->sock_tasklet_nonblock = 0;
+    }
+    return 0;
+}
+
+/* The counterpart of sock_call_ex() for tasklet blocking: call the socket
+   function with the FD in non-blocking mode and, if the function would
+   block, wait for the FD with stackless.wait_readable() or wait_writable().
+   The scheduler enforces the timeout. The socket function doesn't block,
+   therefore sock_call_tasklet() keeps the GIL. */
+static int
+sock_call_tasklet(PySocketSockObject *s,
+                  int writing,
+                  int (*sock_func) (PySocketSockObject *s, void *data),
+                  void *data,
+                  int connect,
+                  int *err,
+                  _PyTime_t timeout)
+{
+    _PyTime_t deadline = 0, interval = -1;
+    PyObject *ready;
+    int res, wait = connect;
+
+    if (timeout > 0)
+        deadline = _PyTime_GetMonotonicClock() + timeout;
+    while (1) {
+        /* connect() already runs asynchronously: wait first */
+        if (wait) {
+            if (timeout > 0) {
+                interval = deadline - _PyTime_GetMonotonicClock();
+                if (interval < 0)
+                    goto timed_out;
+            }
+            ready = (writing ? PyStackless_WaitWritable : PyStackless_WaitReadable)
+                (s->sock_fd, interval < 0 ? -1.0 : _PyTime_AsSecondsDouble(interval));
+            if (ready == NULL) {
+                if (err)
+                    *err = -1;
+                return -1;
+            }
+            res = (ready == Py_False);
+            Py_DECREF(ready);
+            if (res)
+                goto timed_out;
+        }
+        wait = 1;
+
+        res = sock_func(s, data);
+        if (res) {
+            /* sock_func() succeeded */
+            if (err)
+                *err = 0;
+            return 0;
+        }
+
+        if (err)
+            *err = GET_SOCK_ERROR;
+
+        if (CHECK_ERRNO(EINTR)) {
+            /* sock_func() was interrupted by a signal */
+            if (PyErr_CheckSignals()) {
+                if (err)
+                    *err = -1;
+                return -1;
+            }
+            /* retry sock_func() */
+            wait = 0;
+            continue;
+        }
+
+        if (!CHECK_ERRNO(EWOULDBLOCK) && !CHECK_ERRNO(EAGAIN)) {
+            /* sock_func() failed */
+            if (!err)
+                s->errorhandler();
+            /* else: err was already set before */
+            return -1;
+        }
+    }
+
+timed_out:
+    if (err)
+        *err = SOCK_TIMEOUT_ERR;
+    else
+        PyErr_SetString(socket_timeout, "timed out");
+    return -1;
+}
+#endif
+
 static int
 sock_call_ex(PySocketSockObject *s,
              int writing,
@@ -819,6 +934,18 @@ sock_call_ex(PySocketSockObject *s,
     /* sock_call() must be called with the GIL held. */
     assert(PyGILState_Check());
 
+#ifdef STACKLESS
+    res = sock_tasklet_mode(s);
+    if (res < 0) {
+        if (err)
+            *err = -1;
+        return -1;
+    }
+    if (res)
+        return sock_call_tasklet(s, writing, sock_func, data,
+                                 connect, err, timeout);
+#endif
+
     /* outer loop to retry select() when select() is interrupted by a signal
        or to retry select()+sock_func() on false positive (see above) */
     while (1) {
@@ -969,6 +1096,9 @@ init_sockobject(PySocketSockObject *s,
     s->sock_proto = proto;
 
     s->errorhandler = &set_error;
+#ifdef STACKLESS
+    s->sock_tasklet_nonblock = 0;
+#endif
 #ifdef SOCK_NONBLOCK
     if (type & SOCK_NONBLOCK)
         s->sock_timeout = 0;
@@ -2698,6 +2828,9 @@ sock_setblocking(PySocketSockObject *s, PyObject *arg)
     if (internal_setblocking(s, block) == -1) {
         return NULL;
     }
+#ifdef STACKLESS
+    s->sock_tasklet_nonblock = 0;
+#endif
     Py_RETURN_NONE;
 }
 
@@ -2811,6 +2944,9 @@ sock_settimeout(PySocketSockObject *s, PyObject *arg)
     if (internal_setblocking(s, block) == -1) {
         return NULL;
     }
+#ifdef STACKLESS
+    s->sock_tasklet_nonblock = 0;
+#endif
     Py_RETURN_NONE;
 }
 
@@ -3109,7 +3245,14 @@ static int
 internal_connect(PySocketSockObject *s, struct sockaddr *addr, int addrlen,
                  int raise)
 {
-    int res, err, wait_connect;
+    int res, err, wait_connect, tasklet = 0;
+
+#ifdef STACKLESS
+    /* a blocking socket connects asynchronously in tasklet blocking mode */
+    tasklet = sock_tasklet_mode(s);
+    if (tasklet < 0)
+        return -1;
+#endif
 
     Py_BEGIN_ALLOW_THREADS
     res = connect(s->sock_fd, addr, addrlen);
@@ -3141,8 +3284,8 @@ internal_connect(PySocketSockObject *s, struct sockaddr *addr, int addrlen,
         wait_connect = (s->sock_timeout != 0 && IS_SELECTABLE(s));
     }
     else {
-        wait_connect = (s->sock_timeout > 0 && err == SOCK_INPROGRESS_ERR
-                        && IS_SELECTABLE(s));
+        wait_connect = ((s->sock_timeout > 0 || tasklet)
+                        && err == SOCK_INPROGRESS_ERR && IS_SELECTABLE(s));
     }
 
     if (!wait_connect) {
@@ -6553,6 +6696,42 @@ Set the default timeout in seconds (float) for new socket objects.\n\
 A value of None indicates that new socket objects have no timeout.\n\
 When the socket module is first imported, the default is None.");
 
+#ifdef STACKLESS
+/* Python API to getting and setting tasklet blocking. */
+
+static PyObject *
+socket_gettaskletblocking(PyObject *self, PyObject *Py_UNUSED(ignored))
+{
+    return PyBool_FromLong(tasklet_blocking);
+}
+
+PyDoc_STRVAR(gettaskletblocking_doc,
+"gettaskletblocking() -> bool\n\
+\n\
+Returns True, if blocking socket operations block the calling tasklet\n\
+instead of the thread.");
+
+static PyObject *
+socket_settaskletblocking(PyObject *self, PyObject *arg)
+{
+    int flag = PyObject_IsTrue(arg);
+
+    if (flag < 0)
+        return NULL;
+    tasklet_blocking = flag;
+    Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(settaskletblocking_doc,
+"settaskletblocking(flag)\n\
+\n\
+If flag is true, an operation on a blocking socket or a socket with a\n\
+timeout blocks only the calling tasklet. The socket module puts the file\n\
+descriptor into non-blocking mode and waits for it with\n\
+stackless.wait_readable() or stackless.wait_writable(). Other tasklets\n\
+of the thread continue to run. The default is False.");
+#endif
+
 #ifdef HAVE_IF_NAMEINDEX
 /* Python API for getting interface indices and names */
 
@@ -6784,6 +6963,12 @@ static PyMethodDef socket_methods[] = {
      METH_NOARGS, getdefaulttimeout_doc},
     {"setdefaulttimeout",       socket_setdefaulttimeout,
      METH_O, setdefaulttimeout_doc},
+#ifdef STACKLESS
+    {"gettaskletblocking",      socket_gettaskletblocking,
+     METH_NOARGS, gettaskletblocking_doc},
+    {"settaskletblocking",      socket_settaskletblocking,
+     METH_O, settaskletblocking_doc},
+#endif
 #ifdef HAVE_IF_NAMEINDEX
     {"if_nameindex", socket_if_nameindex,
      METH_NOARGS, if_nameindex_doc},
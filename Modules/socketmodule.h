@@ -235,6 +235,10 @@ typedef struct {
                                         sets a Python exception */
     _PyTime_t sock_timeout;     /* Operation timeout in seconds;
                                         0.0 means non-blocking */
+#ifdef STACKLESS
+    int sock_tasklet_nonblock;  /* the FD of a blocking socket is
+                                   non-blocking, see settaskletblocking() */
+#endif
 } PySocketSockObject;
 
 /* --- C API ----------------------------------------------------*/
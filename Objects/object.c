@@ -1793,6 +1793,7 @@ _PyTypes_Init(void)
     INIT_TYPE(&PySeqIter_Type, "sequence iterator");
     INIT_TYPE(&PyCoro_Type, "coroutine");
     INIT_TYPE(&_PyCoroWrapper_Type, "coroutine wrapper");
+    INIT_TYPE(&PyPickleBuffer_Type, "pickle.PickleBuffer");
     return _Py_INIT_OK();
 
 #undef INIT_TYPE
@@ -1073,6 +1073,7 @@ Py_FinalizeEx(void)
     call_py_exitfuncs(interp);
 #ifdef STACKLESS
     PyStackless_kill_tasks_with_stacks(1);
+    slp_thread_pool_clear(interp);
 #endif
 
     /* Copy the core config, PyInterpreterState_Delete() free
@@ -1499,6 +1500,9 @@ Py_EndInterpreter(PyThreadState *tstate)
     }
 
     call_py_exitfuncs(interp);
+#ifdef STACKLESS
+    slp_thread_pool_clear(interp);
+#endif
 
     if (tstate != interp->tstate_head || tstate->next != NULL)
         Py_FatalError("Py_EndInterpreter: not the last thread");
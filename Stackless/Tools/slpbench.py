@@ -0,0 +1,405 @@
+#!/usr/bin/env python
+################################################################
+#
+# slpbench.py
+#
+# A reproducible benchmark suite for Stackless Python.
+#
+# Usage:
+#   python slpbench.py                      run all benchmarks
+#   python slpbench.py -b channel_pingpong  run selected benchmarks
+#   python slpbench.py -o result.json       save the results as JSON
+#   python slpbench.py --compare a.json b.json
+#                                           compare two result files
+#   python slpbench.py --pyperf [pyperf options]
+#                                           run with pyperf, e.g. to
+#                                           get pyperformance results
+#
+# Each benchmark is a function, that runs a given number of loops
+# and returns the elapsed time in seconds. This is the protocol of
+# pyperf.Runner.bench_time_func(). Without pyperf, a simple runner
+# calibrates the number of loops, takes a few values and writes
+# them together with the Python build to a JSON file.
+#
+# On a C-Python or a Stackless built with STACKLESS_OFF, only the
+# benchmarks, that don't need the stackless module, run. Compare
+# the result files to see the costs and benefits of Stackless.
+#
+################################################################
+
+import argparse
+import json
+import math
+import pickle
+import platform
+import sys
+import threading
+import time
+
+try:
+    import stackless
+except ImportError:
+    stackless = None
+
+BENCHMARKS = []
+
+
+def benchmark(needs_stackless=True):
+    def register(func):
+        func.needs_stackless = needs_stackless
+        BENCHMARKS.append(func)
+        return func
+    return register
+
+
+def clock():
+    return time.perf_counter()
+
+
+class softswitch(object):
+    """Context manager to run a benchmark with soft or hard switching."""
+
+    def __init__(self, enabled):
+        self.enabled = enabled
+
+    def __enter__(self):
+        self.old = stackless.enable_softswitch(self.enabled)
+
+    def __exit__(self, *exc_info):
+        stackless.enable_softswitch(self.old)
+
+
+def _switch(loops):
+    def task():
+        for i in range(loops):
+            stackless.schedule()
+    stackless.tasklet(task)()
+    stackless.tasklet(task)()
+    t0 = clock()
+    stackless.run()
+    return clock() - t0
+
+
+@benchmark()
+def switch_soft(loops):
+    """Two tasklets switch with stackless.schedule(), soft switching."""
+    with softswitch(True):
+        return _switch(loops)
+
+
+@benchmark()
+def switch_hard(loops):
+    """Two tasklets switch with stackless.schedule(), hard switching."""
+    with softswitch(False):
+        return _switch(loops)
+
+
+@benchmark(needs_stackless=False)
+def switch_generator(loops):
+    """Two generators switch in a round robin loop (baseline)."""
+    def task():
+        for i in range(loops):
+            yield
+    tasks = [task(), task()]
+    t0 = clock()
+    while tasks:
+        for g in tasks[:]:
+            try:
+                next(g)
+            except StopIteration:
+                tasks.remove(g)
+    return clock() - t0
+
+
+@benchmark()
+def channel_pingpong(loops):
+    """Two tasklets send a value back and forth over two channels."""
+    ping, pong = stackless.channel(), stackless.channel()
+
+    def ponger():
+        for i in range(loops):
+            pong.send(ping.receive())
+    stackless.tasklet(ponger)()
+    stackless.run()
+    t0 = clock()
+    for i in range(loops):
+        ping.send(i)
+        pong.receive()
+    return clock() - t0
+
+
+@benchmark()
+def channel_fanout_fanin(loops, workers=16):
+    """A tasklet distributes values to 16 workers and collects the results."""
+    jobs, results = stackless.channel(), stackless.channel()
+    jobs.preference = results.preference = 0
+
+    def worker():
+        for value in jobs:
+            results.send(value)
+
+    def producer():
+        for i in range(loops):
+            jobs.send(i)
+        jobs.close()
+    for i in range(workers):
+        stackless.tasklet(worker)()
+    stackless.tasklet(producer)()
+    t0 = clock()
+    for i in range(loops):
+        results.receive()
+    stackless.run()
+    return clock() - t0
+
+
+@benchmark()
+def channel_cross_thread(loops):
+    """A tasklet of another thread sends values to the main tasklet."""
+    channel = stackless.channel()
+
+    def sender():
+        for i in range(loops):
+            channel.send(i)
+    thread = threading.Thread(target=sender)
+    t0 = clock()
+    thread.start()
+    for i in range(loops):
+        channel.receive()
+    thread.join()
+    return clock() - t0
+
+
+def _busy(loops, timeout, ntasks=4):
+    def task(n):
+        x = 0
+        for i in range(n):
+            x += i
+    for i in range(ntasks):
+        stackless.tasklet(task)(loops // ntasks)
+    t0 = clock()
+    if timeout:
+        while stackless.getruncount() > 1:
+            interrupted = stackless.run(timeout)
+            if interrupted is not None:
+                interrupted.insert()
+    else:
+        stackless.run()
+    return clock() - t0
+
+
+@benchmark()
+def watchdog_off(loops):
+    """Busy tasklets run cooperatively (baseline for watchdog_on)."""
+    return _busy(loops, 0)
+
+
+@benchmark()
+def watchdog_on(loops):
+    """Busy tasklets run under the watchdog with a timeout of 1000."""
+    return _busy(loops, 1000)
+
+
+def _nop():
+    pass
+
+
+@benchmark()
+def tasklet_spawn(loops):
+    """Create, run and tear down tasklets, that do nothing."""
+    t0 = clock()
+    for i in range(loops):
+        stackless.tasklet(_nop)()
+    stackless.run()
+    return clock() - t0
+
+
+def _recurse(depth):
+    if depth:
+        return _recurse(depth - 1)
+    stackless.schedule_remove()
+
+
+def _deep_tasklet(depth):
+    task = stackless.tasklet(_recurse)(depth)
+    task.run()
+    assert task.paused
+    return task
+
+
+@benchmark()
+def tasklet_pickle_deep(loops, depth=100):
+    """Pickle a tasklet, that is paused in a recursion of depth 100."""
+    with softswitch(True):
+        task = _deep_tasklet(depth)
+        try:
+            t0 = clock()
+            for i in range(loops):
+                pickle.dumps(task, -1)
+            return clock() - t0
+        finally:
+            task.kill()
+
+
+@benchmark()
+def tasklet_unpickle_deep(loops, depth=100):
+    """Unpickle a tasklet, that is paused in a recursion of depth 100."""
+    with softswitch(True):
+        task = _deep_tasklet(depth)
+        try:
+            data = pickle.dumps(task, -1)
+        finally:
+            task.kill()
+        dt = 0
+        for i in range(loops):
+            t0 = clock()
+            task = pickle.loads(data)
+            dt += clock() - t0
+            task.kill()
+        return dt
+
+
+@benchmark()
+def tasklet_clone_deep(loops, depth=100):
+    """Clone a tasklet, that is paused in a recursion of depth 100."""
+    with softswitch(True):
+        task = _deep_tasklet(depth)
+        try:
+            dt = 0
+            for i in range(loops):
+                t0 = clock()
+                clone = task.clone()
+                dt += clock() - t0
+                clone.kill()
+            return dt
+        finally:
+            task.kill()
+
+
+def available_benchmarks():
+    return [b for b in BENCHMARKS if stackless is not None or not b.needs_stackless]
+
+
+def select_benchmarks(names):
+    available = {b.__name__: b for b in available_benchmarks()}
+    if not names:
+        return list(available.values())
+    selected = []
+    for name in names:
+        if name not in available:
+            sys.exit("unknown or unavailable benchmark: %s" % name)
+        selected.append(available[name])
+    return selected
+
+
+def calibrate(func, min_time):
+    """Return the number of loops, that takes at least min_time seconds."""
+    loops = 1
+    while True:
+        if func(loops) >= min_time or loops >= 1 << 24:
+            return loops
+        loops *= 2
+
+
+def run_benchmark(func, values, min_time, loops=None):
+    if loops is None:
+        loops = calibrate(func, min_time)
+    func(loops)     # warm up
+    timings = [func(loops) / loops for i in range(values)]
+    mean = sum(timings) / len(timings)
+    if len(timings) > 1:
+        stdev = math.sqrt(sum((t - mean) ** 2 for t in timings) / (len(timings) - 1))
+    else:
+        stdev = 0.0
+    return {"loops": loops, "values": timings, "mean": mean, "stdev": stdev}
+
+
+def metadata():
+    return {
+        "python_version": sys.version,
+        "python_implementation": platform.python_implementation(),
+        "stackless": stackless is not None,
+        "debug_build": hasattr(sys, "gettotalrefcount"),
+        "platform": platform.platform(),
+        "date": time.strftime("%Y-%m-%d %H:%M:%S"),
+    }
+
+
+def format_time(seconds):
+    for unit, factor in (("s", 1), ("ms", 1e3), ("us", 1e6)):
+        if seconds * factor >= 1:
+            return "%.2f %s" % (seconds * factor, unit)
+    return "%.1f ns" % (seconds * 1e9)
+
+
+def compare(file1, file2):
+    with open(file1) as f:
+        result1 = json.load(f)
+    with open(file2) as f:
+        result2 = json.load(f)
+    bench1, bench2 = result1["benchmarks"], result2["benchmarks"]
+    print("%-24s %12s %12s %8s" % ("benchmark", file1[-12:], file2[-12:], "change"))
+    for name in sorted(set(bench1) | set(bench2)):
+        if name not in bench1 or name not in bench2:
+            mean = (bench1.get(name) or bench2.get(name))["mean"]
+            print("%-24s %12s %12s %8s" % (
+                name, format_time(mean) if name in bench1 else "-",
+                format_time(mean) if name in bench2 else "-", ""))
+            continue
+        mean1, mean2 = bench1[name]["mean"], bench2[name]["mean"]
+        print("%-24s %12s %12s %7.2fx" % (name, format_time(mean1),
+                                          format_time(mean2), mean2 / mean1))
+
+
+def run_pyperf():
+    import pyperf
+    runner = pyperf.Runner(program_args=[sys.argv[0], "--pyperf"])
+    runner.metadata["stackless"] = str(stackless is not None)
+    for func in available_benchmarks():
+        runner.bench_time_func("stackless_" + func.__name__, func)
+
+
+def main(argv=None):
+    if argv is None:
+        argv = sys.argv[1:]
+    if "--pyperf" in argv:
+        argv.remove("--pyperf")
+        sys.argv[1:] = argv
+        return run_pyperf()
+    parser = argparse.ArgumentParser(description="Stackless benchmark suite")
+    parser.add_argument("-b", "--benchmarks", nargs="+", metavar="NAME",
+                        help="run only the given benchmarks")
+    parser.add_argument("-l", "--list", action="store_true",
+                        help="list the available benchmarks")
+    parser.add_argument("-o", "--output", metavar="FILE",
+                        help="write the results as JSON to FILE")
+    parser.add_argument("-n", "--values", type=int, default=5,
+                        help="number of values per benchmark (default 5)")
+    parser.add_argument("--loops", type=int,
+                        help="fixed number of loops instead of calibration")
+    parser.add_argument("--min-time", type=float, default=0.1,
+                        help="minimum duration of a value in seconds "
+                        "(default 0.1)")
+    parser.add_argument("--compare", nargs=2, metavar="FILE",
+                        help="compare two JSON result files")
+    args = parser.parse_args(argv)
+
+    if args.compare:
+        return compare(*args.compare)
+    if args.list:
+        for func in available_benchmarks():
+            print("%-24s %s" % (func.__name__, func.__doc__))
+        return
+    results = {"metadata": metadata(), "benchmarks": {}}
+    for func in select_benchmarks(args.benchmarks):
+        result = run_benchmark(func, args.values, args.min_time, args.loops)
+        results["benchmarks"][func.__name__] = result
+        print("%-24s %12s +- %s" % (func.__name__, format_time(result["mean"]),
+                                    format_time(result["stdev"])))
+        sys.stdout.flush()
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+
+
+if __name__ == "__main__":
+    main()
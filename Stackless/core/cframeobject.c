@@ -33,9 +33,18 @@
 #include "pycore_stackless.h"
 #include "pycore_slp_prickelpit.h"
 
+/*
+ * Soft switching creates and releases cframes all the time. All cframes have
+ * the same size, therefore a single free list is sufficient. See
+ * stackless.get_cframe_cache_info() and stackless.set_cframe_cache_limit().
+ */
 static PyCFrameObject *free_list = NULL;
-static int numfree = 0;         /* number of cframes currently in free_list */
-#define MAXFREELIST 200         /* max value for numfree */
+static Py_ssize_t numfree = 0;  /* number of cframes currently in free_list */
+#define MAXFREELIST 200         /* default value for maxfree */
+static Py_ssize_t maxfree = MAXFREELIST;    /* max value for numfree */
+static PY_LONG_LONG hits = 0;               /* statistics */
+static PY_LONG_LONG misses = 0;
+static PY_LONG_LONG evictions = 0;
 
 static void
 cframe_dealloc(PyCFrameObject *cf)
@@ -45,13 +54,15 @@ cframe_dealloc(PyCFrameObject *cf)
     Py_XDECREF(cf->ob1);
     Py_XDECREF(cf->ob2);
     Py_XDECREF(cf->ob3);
-    if (numfree < MAXFREELIST) {
+    if (numfree < maxfree) {
         ++numfree;
         cf->f_back = (PyFrameObject *) free_list;
         free_list = cf;
     }
-    else
+    else {
+        ++evictions;
         Py_TYPE(cf)->tp_free((PyObject*)cf);
+    }
 }
 
 static int
@@ -98,12 +109,14 @@ slp_cframe_new(PyFrame_ExecFunc *exec, unsigned int linked)
     PyFrameObject *back;
 
     if (free_list == NULL) {
+        ++misses;
         cf = PyObject_GC_NewVar(PyCFrameObject, &PyCFrame_Type, 0);
         if (cf == NULL)
             return NULL;
     }
     else {
         assert(numfree > 0);
+        ++hits;
         --numfree;
         cf = free_list;
         free_list = (PyCFrameObject *) free_list->f_back;
@@ -372,18 +385,49 @@ int slp_init_cframetype(void)
                                 run_cframe, SLP_REF_INVALID_EXEC(run_cframe));
 }
 
-/* Clear out the free list */
+/* Shrink the free list to at most limit cframes */
 
-void
-slp_cframe_fini(void)
+static void
+cframe_cache_trim(Py_ssize_t limit)
 {
-    while (free_list != NULL) {
+    while (numfree > limit) {
         PyCFrameObject *cf = free_list;
         free_list = (PyCFrameObject *) free_list->f_back;
         PyObject_GC_Del(cf);
         --numfree;
+        ++evictions;
     }
-    assert(numfree == 0);
+}
+
+PyObject *
+slp_cframe_cache_info(void)
+{
+    return Py_BuildValue("{s:n,s:n,s:L,s:L,s:L}",
+        "count", numfree,
+        "maxcount", maxfree,
+        "hits", hits,
+        "misses", misses,
+        "evictions", evictions);
+}
+
+Py_ssize_t
+slp_cframe_cache_set_limit(Py_ssize_t limit)
+{
+    Py_ssize_t old = maxfree;
+
+    assert(limit >= 0);
+    maxfree = limit;
+    cframe_cache_trim(limit);
+    return old;
+}
+
+/* Clear out the free list */
+
+void
+slp_cframe_fini(void)
+{
+    cframe_cache_trim(0);
+    assert(free_list == NULL);
 }
 
 
@@ -10,6 +10,8 @@ void
 slp_initialize(struct _stackless_runtime_state * state) {
     /* initialize all fields to zero */
     memset(state, 0, sizeof(*state));
+    state->cstack_pool.maxcount = SLP_CSTACK_MAXCACHE;
+    state->cstack_pool.maxbytes = SLP_CSTACK_MAXCACHEBYTES;
 }
 
 /* Shorthands to return certain errors */
@@ -19,42 +19,139 @@
 
 
 
-/* this function will get called by PyStacklessEval_Fini */
-static void slp_cstack_cacheclear(void)
+/* The pool of unused cstacks
+
+   Unused cstack objects are kept in size classes. The capacity of the
+   classes grows geometrically, with four classes per power of two. A
+   cstack from the pool therefore wastes at most a quarter of its stack
+   buffer. Py_SIZE() of a cstack is the number of used stack words, the
+   capacity of the buffer is given by its size class.
+
+   Each size class is a doubly linked list (using the fields next and prev)
+   ordered from the most recently to the least recently released cstack.
+   If the pool exceeds its limits, the least recently released cstacks of
+   all classes are freed one at a time. The field serial holds the release
+   time stamp of a pooled cstack.
+ */
+
+#define CSTACK_POOL (_PyRuntime.st.cstack_pool)
+
+Py_ssize_t
+slp_cstack_pool_class_capacity(int size_class)
+{
+    int e;
+
+    assert(size_class >= 0 && size_class < SLP_CSTACK_CLASSES);
+    if (size_class < 4)
+        return (size_class + 1) * 4;
+    e = size_class / 4 + 3;
+    return ((Py_ssize_t)1 << e) + (size_class % 4 + 1) * ((Py_ssize_t)1 << (e - 2));
+}
+
+static int
+cstack_size_class(Py_ssize_t size)
 {
-    int i;
+    int e = 4;
+
+    if (size <= 16)
+        return size <= 4 ? 0 : (int)((size + 3) / 4) - 1;
+    if (size > SLP_CSTACK_MAXSIZE)
+        return -1;
+    /* find e with 2**e < size <= 2**(e+1) */
+    while (((Py_ssize_t)1 << (e + 1)) < size)
+        ++e;
+    return (e - 3) * 4 + (int)((size - ((Py_ssize_t)1 << e) - 1) >> (e - 2));
+}
+
+static Py_ssize_t
+cstack_class_bytes(int size_class)
+{
+    return PyCStack_Type.tp_basicsize +
+        slp_cstack_pool_class_capacity(size_class) * PyCStack_Type.tp_itemsize;
+}
+
+static void
+cstack_pool_unlink(PyCStackObject *cst)
+{
+    int c = cst->size_class;
+
+    if (cst->prev != NULL)
+        cst->prev->next = cst->next;
+    else
+        CSTACK_POOL.head[c] = cst->next;
+    if (cst->next != NULL)
+        cst->next->prev = cst->prev;
+    else
+        CSTACK_POOL.tail[c] = cst->prev;
+    cst->next = cst->prev = NULL;
+    --CSTACK_POOL.count;
+    CSTACK_POOL.bytes -= cstack_class_bytes(c);
+}
+
+/* Free the least recently released cstacks, until the pool fits into
+ * the given limits. This function will also get called by
+ * PyStacklessEval_Fini */
+void
+slp_cstack_pool_trim(Py_ssize_t maxcount, Py_ssize_t maxbytes)
+{
+    int i, oldest;
     PyCStackObject *stack;
 
-    for (i=0; i < SLP_CSTACK_SLOTS; i++) {
-        while ((_PyRuntime.st.cstack_cache)[i] != NULL) {
-            stack = (_PyRuntime.st.cstack_cache)[i];
-            (_PyRuntime.st.cstack_cache)[i] = (PyCStackObject *) stack->startaddr;
-            PyObject_Del(stack);
+    while (CSTACK_POOL.count > maxcount || CSTACK_POOL.bytes > maxbytes) {
+        oldest = -1;
+        for (i=0; i < SLP_CSTACK_CLASSES; i++) {
+            stack = CSTACK_POOL.tail[i];
+            if (stack != NULL && (oldest < 0 ||
+                    stack->serial < CSTACK_POOL.tail[oldest]->serial))
+                oldest = i;
         }
+        assert(oldest >= 0);
+        stack = CSTACK_POOL.tail[oldest];
+        cstack_pool_unlink(stack);
+        ++CSTACK_POOL.evictions;
+        PyObject_Del(stack);
     }
-    (_PyRuntime.st.cstack_cachecount) = 0;
 }
 
 static void
 cstack_dealloc(PyCStackObject *cst)
 {
     PyThreadState * ts = _PyThreadState_GET();
+
     ts->interp->st.cstack_chain = cst;
     SLP_CHAIN_REMOVE(PyCStackObject, &ts->interp->st.cstack_chain, cst, next,
                      prev);
+    if (cst->region != NULL) {
+        /* the C-state is lost, release the stack region */
+        slp_region_release(cst->region);
+        cst->region = NULL;
+        Py_SIZE(cst) = 0;  /* there is no stack buffer */
+    }
+    if (cst->inplace) {
+        if (cst->tstate != NULL && cst->tstate->st.cstack_inplace == cst)
+            cst->tstate->st.cstack_inplace = NULL;
+        cst->inplace = 0;
+    }
 #ifdef Py_REF_DEBUG
     PyObject_Del(cst);
 #else
-    if (Py_SIZE(cst) >= SLP_CSTACK_SLOTS) {
+    if (cst->size_class < 0) {
         PyObject_Del(cst);
+        return;
     }
-    else {
-        if ((_PyRuntime.st.cstack_cachecount) >= SLP_CSTACK_MAXCACHE)
-            slp_cstack_cacheclear();
-        cst->startaddr = (intptr_t *) (_PyRuntime.st.cstack_cache)[Py_SIZE(cst)];
-        (_PyRuntime.st.cstack_cache)[Py_SIZE(cst)] = cst;
-        ++(_PyRuntime.st.cstack_cachecount);
-    }
+    cst->serial = ++CSTACK_POOL.clock;
+    cst->prev = NULL;
+    cst->next = CSTACK_POOL.head[cst->size_class];
+    if (cst->next != NULL)
+        cst->next->prev = cst;
+    else
+        CSTACK_POOL.tail[cst->size_class] = cst;
+    CSTACK_POOL.head[cst->size_class] = cst;
+    ++CSTACK_POOL.count;
+    CSTACK_POOL.bytes += cstack_class_bytes(cst->size_class);
+    if (CSTACK_POOL.count > CSTACK_POOL.maxcount ||
+            CSTACK_POOL.bytes > CSTACK_POOL.maxbytes)
+        slp_cstack_pool_trim(CSTACK_POOL.maxcount, CSTACK_POOL.maxbytes);
 #endif
 }
 
@@ -65,6 +162,7 @@ slp_cstack_new(PyCStackObject **cst, intptr_t *stackref, PyTaskletObject *task)
     PyThreadState *ts;
     intptr_t *stackbase;
     ptrdiff_t size;
+    int size_class;
 
     ts = NULL;
     if (task && task->cstate) {
@@ -88,15 +186,22 @@ slp_cstack_new(PyCStackObject **cst, intptr_t *stackref, PyTaskletObject *task)
             (*cst)->task = NULL;
         Py_DECREF(*cst);
     }
-    if (size < SLP_CSTACK_SLOTS && ((*cst) = (_PyRuntime.st.cstack_cache)[size])) {
-        /* take stack from cache */
-        (_PyRuntime.st.cstack_cache)[size] = (PyCStackObject *) (*cst)->startaddr;
-        --(_PyRuntime.st.cstack_cachecount);
+    size_class = cstack_size_class(size);
+    if (size_class >= 0 && (*cst = CSTACK_POOL.head[size_class]) != NULL) {
+        /* take stack from the pool */
+        cstack_pool_unlink(*cst);
+        ++CSTACK_POOL.hits;
         _Py_NewReference((PyObject *)(*cst));
     }
-    else
-        *cst = PyObject_NewVar(PyCStackObject, &PyCStack_Type, size);
-    if (*cst == NULL) return NULL;
+    else {
+        if (size_class >= 0)
+            ++CSTACK_POOL.misses;
+        *cst = PyObject_NewVar(PyCStackObject, &PyCStack_Type, size_class >= 0 ?
+                               slp_cstack_pool_class_capacity(size_class) : size);
+        if (*cst == NULL) return NULL;
+        (*cst)->size_class = size_class;
+    }
+    Py_SIZE(*cst) = size;
 
     (*cst)->startaddr = stackbase;
     (*cst)->next = (*cst)->prev = NULL;
@@ -109,6 +214,47 @@ slp_cstack_new(PyCStackObject **cst, intptr_t *stackref, PyTaskletObject *task)
     //save the SEH handler
     (*cst)->exception_list = 0;
 #endif
+    (*cst)->region = NULL;
+    (*cst)->stackref = stackref;
+    (*cst)->cstack_root = ts->st.cstack_root;
+    (*cst)->inplace = 0;
+    return *cst;
+}
+
+PyCStackObject *
+slp_cstack_new_region(PyCStackObject **cst, intptr_t *stackref,
+                      struct _slp_stack_region *region, PyTaskletObject *task)
+{
+    /* Create a cstack for a C-state, that stays in place on the
+     * separate stack region. The cstack has no stack buffer, therefore
+     * it does not come from the pool.
+     */
+    PyThreadState *ts = _PyThreadState_GET();
+
+    assert(region != NULL);
+    assert(stackref <= region->base);
+
+    if (*cst != NULL) {
+        if ((*cst)->task == task)
+            (*cst)->task = NULL;
+        Py_DECREF(*cst);
+    }
+    *cst = PyObject_NewVar(PyCStackObject, &PyCStack_Type, 0);
+    if (*cst == NULL) return NULL;
+    (*cst)->size_class = -1;
+    Py_SIZE(*cst) = region->base - stackref;
+
+    (*cst)->startaddr = region->base;
+    (*cst)->next = (*cst)->prev = NULL;
+    SLP_CHAIN_INSERT(PyCStackObject, &ts->interp->st.cstack_chain, *cst, next, prev);
+    (*cst)->serial = ts->st.serial_last_jump;
+    (*cst)->task = task;
+    (*cst)->tstate = ts;
+    (*cst)->nesting_level = ts->st.nesting_level;
+    (*cst)->region = region;
+    (*cst)->stackref = stackref;
+    (*cst)->cstack_root = ts->st.cstack_root;
+    (*cst)->inplace = 0;
     return *cst;
 }
 
@@ -179,6 +325,11 @@ static PyObject *
 cstack_str(PyObject *o)
 {
     PyCStackObject *cst = (PyCStackObject*)o;
+    if (cst->region != NULL || cst->inplace)
+        /* the C-state has not been copied, it is still in place */
+        return PyUnicode_Decode((char*)(cst->startaddr - Py_SIZE(cst)),
+            Py_SIZE(cst)*sizeof(cst->stack[0]),
+            "latin_1", "strict");
     return PyUnicode_Decode((char*)&cst->stack,
         Py_SIZE(cst)*sizeof(cst->stack[0]),
         "latin_1", "strict");
@@ -242,7 +393,7 @@ make_initial_stub(void)
 
 static PyObject * slp_frame_dispatch_top(PyObject *retval);
 
-static PyObject *
+PyObject *
 slp_run_tasklet(void)
 {
     /* Note: this function does not return, if a sub-function
@@ -351,7 +502,8 @@ slp_eval_frame(PyFrameObject *f)
             for (cst = initial_stub->next; cst != initial_stub; cst = cst->next) {
                 if (Py_SIZE(cst) != 0 && cst->task != NULL &&
                         cst->tstate == ts) {
-                    assert(cst->startaddr == ts->st.cstack_base);
+                    assert(cst->startaddr == ts->st.cstack_base ||
+                           cst->region != NULL);
                     found = 1;  /* Initial stub is still in use. */
                     break;
                 }
@@ -413,6 +565,17 @@ get_current_main_and_watchdogs(PyThreadState *ts, PyObject *list)
     }
 }
 
+static void
+cstack_clear_tstate(PyCStackObject *cs)
+{
+    /* A C-state in place on the stack of the thread can't be restored
+     * anymore. Make sure, the thread state does not keep a dangling ref. */
+    if (cs->inplace && cs->tstate != NULL && cs->tstate->st.cstack_inplace == cs)
+        cs->tstate->st.cstack_inplace = NULL;
+    cs->inplace = 0;
+    cs->tstate = NULL;
+}
+
 static void
 kill_pending(PyObject *list)
 {
@@ -539,7 +702,7 @@ void slp_kill_tasks_with_stacks(PyThreadState *target_ts)
             assert(cs == t->cstate);
 
             /* Is tasklet t already dead? */
-            if (t->f.frame != NULL) {
+            if (SLP_TASKLET_HAS_FRAME(t)) {
                 /* If a thread ends, the thread no longer has a main tasklet and
                  * the thread is not in a valid state. tstate->st.current is
                  * undefined. It may point to a tasklet, but the other fields in
@@ -582,7 +745,7 @@ void slp_kill_tasks_with_stacks(PyThreadState *target_ts)
                     in_loop = 1;
                     if (cs->task == t) {
                         assert(cs->tstate == cts);
-                        cs->tstate = NULL;
+                        cstack_clear_tstate(cs);
                     }
                 }
             }
@@ -754,7 +917,7 @@ other_threads:
                     PyErr_Clear();
                 }
                 if (target_ts != NULL) {
-                    cs->tstate = NULL;
+                    cstack_clear_tstate(cs);
                 }
                 Py_DECREF(cs);
             }
@@ -792,7 +955,7 @@ current_main:
             in_loop = 1;
             /* has tstate already been cleared or is it a foreign thread? */
             if (target_ts == NULL || cs->tstate == cts) {
-                cs->tstate = NULL;
+                cstack_clear_tstate(cs);
             }
         } /* for(...) */
     } /* if(...) */
@@ -1067,7 +1230,8 @@ slp_frame_dispatch_top(PyObject *retval)
 void
 slp_stacklesseval_fini(void)
 {
-    slp_cstack_cacheclear();
+    slp_cstack_pool_trim(0, 0);
+    slp_region_cacheclear();
 }
 
 #endif /* STACKLESS */
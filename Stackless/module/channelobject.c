@@ -50,12 +50,79 @@ static int
 channel_traverse(PyChannelObject *ch, visitproc visit, void *arg)
 {
     PyTaskletObject *p;
+    Py_ssize_t i;
     for (p = ch->head; p != (PyTaskletObject *) ch; p = p->next) {
         Py_VISIT(p);
     }
+    for (i = 0; i < ch->count; i++) {
+        Py_VISIT(ch->buffer[(ch->first + i) % ch->size]);
+    }
     return 0;
 }
 
+/* the ring buffer of buffered channels */
+
+/* append a value, there must be space for it */
+static void
+channel_buffer_push(PyChannelObject *ch, PyObject *value)
+{
+    assert(ch->count < ch->size);
+    ch->buffer[(ch->first + ch->count) % ch->size] = value;
+    ch->count++;
+}
+
+/* remove the oldest value */
+static PyObject *
+channel_buffer_pop(PyChannelObject *ch)
+{
+    PyObject *value = ch->buffer[ch->first];
+
+    assert(ch->count > 0);
+    ch->first = (ch->first + 1) % ch->size;
+    if (--ch->count == 0)
+        ch->first = 0;
+    return value;
+}
+
+/* make room for one more value. The buffer grows on demand up to the
+ * capacity of the channel. */
+static int
+channel_buffer_reserve(PyChannelObject *ch)
+{
+    PyObject **buffer;
+    Py_ssize_t size, i;
+
+    if (ch->count < ch->size)
+        return 0;
+    size = Py_MIN(Py_MAX(2 * ch->size, 8), ch->capacity);
+    assert(size > ch->count);
+    buffer = PyMem_New(PyObject *, size);
+    if (buffer == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    for (i = 0; i < ch->count; i++)
+        buffer[i] = ch->buffer[(ch->first + i) % ch->size];
+    PyMem_Free(ch->buffer);
+    ch->buffer = buffer;
+    ch->size = size;
+    ch->first = 0;
+    return 0;
+}
+
+static void
+channel_buffer_clear(PyChannelObject *ch)
+{
+    PyObject **buffer = ch->buffer;
+    Py_ssize_t count = ch->count, first = ch->first, size = ch->size, i;
+
+    ch->buffer = NULL;
+    ch->count = ch->first = ch->size = 0;
+    for (i = 0; i < count; i++)
+        Py_DECREF(buffer[(first + i) % size]);
+    PyMem_Free(buffer);
+}
+
 static int
 channel_clear(PyObject *ob)
 {
@@ -74,6 +141,7 @@ channel_clear(PyObject *ob)
         ob = (PyObject *) slp_channel_remove(ch, NULL, NULL, NULL);
         Py_DECREF(ob);
     }
+    channel_buffer_clear(ch);
     return 0;
 }
 
@@ -118,6 +186,7 @@ slp_channel_insert(PyChannelObject *channel, PyTaskletObject *task, int dir, PyT
     assert(dir * channel->balance >= 0); /* we are going the right way */
     channel->balance += dir;
     task->flags.blocked = dir;
+    SLP_TASKLET_STATS_BLOCK(task, 1);
 }
 
 /* the special case to remove a specific tasklet */
@@ -144,6 +213,7 @@ slp_channel_remove(PyChannelObject *channel,
     channel->balance -= dir;
     SLP_HEADCHAIN_REMOVE(task, next, prev);
     task->flags.blocked = 0;
+    SLP_TASKLET_STATS_BLOCK(task, 0);
     return task;
 }
 
@@ -185,14 +255,29 @@ PyChannel_New(PyTypeObject *type)
         c->chan_weakreflist = NULL;
         memset(&c->flags, 0, sizeof(c->flags));
         c->flags.preference = -1; /* default fast receive */
+        c->capacity = c->count = c->first = c->size = 0;
+        c->buffer = NULL;
     }
     return c;
 }
 
+static int
+channel_set_capacity(PyChannelObject *self, PyObject *value, void *closure);
+
 static PyObject *
 channel_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 {
-    return (PyObject *)PyChannel_New(type);
+    PyChannelObject *c = PyChannel_New(type);
+    PyObject *capacity;
+
+    /* other arguments belong to the __init__ method of subclasses */
+    if (c != NULL && kwds != NULL &&
+            (capacity = PyDict_GetItemString(kwds, "capacity")) != NULL &&
+            channel_set_capacity(c, capacity, NULL)) {
+        Py_DECREF(c);
+        return NULL;
+    }
+    return (PyObject *)c;
 }
 
 static PyObject *
@@ -227,13 +312,13 @@ PyChannel_GetClosing(PyChannelObject *self)
 static PyObject *
 channel_get_closed(PyChannelObject *self, void *closure)
 {
-    return PyBool_FromLong(self->flags.closing && self->balance == 0);
+    return PyBool_FromLong(PyChannel_GetClosed(self));
 }
 
 int
 PyChannel_GetClosed(PyChannelObject *self)
 {
-    return self->flags.closing && self->balance == 0;
+    return self->flags.closing && self->balance == 0 && self->count == 0;
 }
 
 
@@ -297,12 +382,68 @@ PyChannel_SetScheduleAll(PyChannelObject *self, int val)
 int
 PyChannel_GetBalance(PyChannelObject *self)
 {
-    return self->balance;
+    /* buffered values count like waiting senders */
+    return self->balance + (int)self->count;
+}
+
+static PyObject *
+channel_get_balance(PyChannelObject *self, void *closure)
+{
+    return PyLong_FromLong(PyChannel_GetBalance(self));
+}
+
+static PyObject *
+channel_get_capacity(PyChannelObject *self, void *closure)
+{
+    return PyLong_FromSsize_t(self->capacity);
+}
+
+static int
+channel_set_capacity(PyChannelObject *self, PyObject *value, void *closure)
+{
+    Py_ssize_t val;
+
+    if (value == NULL)
+        TYPE_ERROR("can't delete the capacity", -1);
+    if (!PyLong_Check(value))
+        TYPE_ERROR("capacity must be set to an integer", -1);
+    val = PyLong_AsSsize_t(value);
+    if (val == -1 && PyErr_Occurred())
+        return -1;
+    if (val < 0)
+        VALUE_ERROR("capacity must not be negative", -1);
+    if (val > INT_MAX)
+        VALUE_ERROR("capacity is too large", -1);
+    return PyChannel_SetCapacity(self, val);
+}
+
+Py_ssize_t
+PyChannel_GetCapacity(PyChannelObject *self)
+{
+    return self->capacity;
+}
+
+int
+PyChannel_SetCapacity(PyChannelObject *self, Py_ssize_t capacity)
+{
+    assert(capacity >= 0);
+    if (self->balance != 0 && capacity != self->capacity)
+        RUNTIME_ERROR("can't change the capacity of a channel with waiting tasklets", -1);
+    /* a smaller capacity keeps the buffered values */
+    self->capacity = capacity;
+    return 0;
 }
 
 static PyGetSetDef channel_getsetlist[] = {
     {"queue",                   (getter)channel_get_queue, NULL,
      PyDoc_STR("the chain of waiting tasklets.")},
+    {"balance",                 (getter)channel_get_balance, NULL,
+     PyDoc_STR("the number of tasklets waiting to send and buffered values (>0)\n"
+     "or the number of tasklets waiting to receive (<0).")},
+    {"capacity",                (getter)channel_get_capacity,
+                            (setter)channel_set_capacity,
+     PyDoc_STR("the maximum number of values, that the channel buffers.\n"
+     "0 (default) means that senders and receivers rendezvous.")},
     {"closing",                 (getter)channel_get_closing, NULL,
      PyDoc_STR("True when close was called.")},
     {"closed",                  (getter)channel_get_closed, NULL,
@@ -319,11 +460,6 @@ static PyGetSetDef channel_getsetlist[] = {
 };
 
 
-static PyMemberDef channel_members[] = {
-    {"balance", T_INT, offsetof(PyChannelObject, balance), READONLY,
-     PyDoc_STR("the number of tasklets waiting to send (>0) or receive (<0).")},
-    {0}
-};
 
 /**********************************************************
 
@@ -388,6 +524,8 @@ channel_callback(PyObject *channel_hook, PyChannelObject *channel, PyTaskletObje
 #define NOTIFY_CHANNEL(channel, task, dir, cando, res) \
     do { \
         PyObject * channel_hook = ts->interp->st.channel_hook; \
+        SLP_TRACE(ts, dir > 0 ? SLP_TRACE_SEND : SLP_TRACE_RECEIVE, \
+                  cando ? 0 : SLP_TRACE_WILLBLOCK, task, NULL, channel, 0); \
         if(channel_hook != NULL) { \
             if (ts->st.schedlock) {  \
                 RUNTIME_ERROR("Recursive channel call due to callbacks!", res); \
@@ -440,6 +578,164 @@ static int
 generic_channel_cando(PyThreadState *ts, PyObject **result, PyChannelObject *self, int dir, int stackless);
 static int
 generic_channel_block(PyThreadState *ts, PyObject **result, PyChannelObject *self, int dir, int stackless);
+static int
+select_cando(PyThreadState *ts, PyObject **result, PyChannelObject *self,
+             PyTaskletObject *proxy, int stackless);
+static PyObject *
+generic_channel_action(PyChannelObject *self, PyObject *arg, int dir, int stackless);
+static PyTaskletObject *
+select_complete(PyTaskletObject *proxy);
+
+/* Make a tasklet runnable, that a channel action woke up, without switching
+ * to it. Steals the reference. */
+static void
+channel_wakeup(PyThreadState *ts, PyTaskletObject *task)
+{
+    PyThreadState *nts = task->cstate->tstate;
+
+    if (nts == NULL) {
+        /* the thread of the tasklet is gone */
+        Py_DECREF(task);
+        return;
+    }
+    slp_current_insert(task);
+    if (nts != ts)
+        slp_thread_unblock(nts);
+}
+
+/* A receive took a value from the buffer: move the value of the first
+ * waiting sender into the buffer and wake up the sender. */
+static void
+channel_buffer_refill(PyThreadState *ts, PyChannelObject *self)
+{
+    PyTaskletObject *sender;
+    PyObject *value;
+
+    if (self->balance <= 0)
+        return;
+    sender = slp_channel_remove(self, NULL, NULL, NULL);
+    TASKLET_CLAIMVAL(sender, &value);
+    channel_buffer_push(self, value);
+    if (sender->select != NULL)
+        sender = select_complete(sender);
+    if (sender != NULL)
+        channel_wakeup(ts, sender);
+}
+
+/*
+ * Buffered channels: a sender appends its value to the buffer, a receiver
+ * takes the oldest value. Neither blocks or switches. Receivers wait only,
+ * if the buffer is empty, and senders wait only, if it is full. If a
+ * receiver takes a value from a full buffer, the value of the first waiting
+ * sender moves into the buffer and the sender becomes runnable.
+ */
+static PyObject *
+channel_buffer_action(PyThreadState *ts, PyChannelObject *self, PyObject *arg, int dir,
+                      int stackless)
+{
+    PyObject *value;
+
+    /* note that notify might release the GIL. */
+    NOTIFY_CHANNEL(self, ts->st.current, dir, 1, NULL);
+    if (dir > 0 ? self->balance < 0 || self->count >= self->capacity : self->count == 0)
+        /* another thread changed the channel meanwhile */
+        return generic_channel_action(self, arg, dir, stackless);
+    if (dir > 0) {
+        if (channel_buffer_reserve(self))
+            return NULL;
+        Py_INCREF(arg);
+        channel_buffer_push(self, arg);
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+    value = channel_buffer_pop(self);
+    channel_buffer_refill(ts, self);
+    if (PyBomb_Check(value))
+        /* send_exception() or send_throw() */
+        value = slp_bomb_explode(value);
+    return value;
+}
+
+/*
+ * Bulk transfers: send_many() and receive_many() move values without
+ * switching, as long as a channel action doesn't need to block. The
+ * woken up tasklets become runnable, but the current tasklet keeps
+ * running until it blocks or returns.
+ */
+
+/* Send a value without blocking. Returns 1 on success, 0 if the send
+ * would block and -1 on error. */
+static int
+channel_deliver(PyThreadState *ts, PyChannelObject *self, PyObject *arg)
+{
+    PyTaskletObject *target;
+
+    if (ts->st.main == NULL ||
+        (self->balance >= 0 && self->count >= self->capacity))
+        return 0;
+    /* note that notify might release the GIL. */
+    NOTIFY_CHANNEL(self, ts->st.current, 1, 1, -1);
+    if (self->balance < 0) {
+        target = slp_channel_remove(self, NULL, NULL, NULL);
+        TASKLET_SETVAL(target, arg);
+        if (target->select != NULL)
+            target = select_complete(target);
+        if (target != NULL)
+            channel_wakeup(ts, target);
+        return 1;
+    }
+    if (self->count < self->capacity) {
+        if (channel_buffer_reserve(self))
+            return -1;
+        Py_INCREF(arg);
+        channel_buffer_push(self, arg);
+        return 1;
+    }
+    /* another thread changed the channel meanwhile */
+    return 0;
+}
+
+/* the value, that the next receive gets, if it doesn't block */
+static PyObject *
+channel_peek(PyChannelObject *self)
+{
+    if (self->count > 0)
+        return self->buffer[self->first];
+    if (self->balance > 0)
+        return self->head->tempval;
+    return NULL;
+}
+
+/* Receive a value without blocking. Returns 1 and a new reference in
+ * *result on success, 0 if the receive would block or would raise an
+ * exception and -1 on error. */
+static int
+channel_take(PyThreadState *ts, PyChannelObject *self, PyObject **result)
+{
+    PyTaskletObject *sender;
+    PyObject *value = channel_peek(self);
+
+    if (ts->st.main == NULL || value == NULL || PyBomb_Check(value))
+        return 0;
+    /* note that notify might release the GIL. */
+    NOTIFY_CHANNEL(self, ts->st.current, -1, 1, -1);
+    value = channel_peek(self);
+    if (value == NULL || PyBomb_Check(value))
+        /* another thread changed the channel meanwhile */
+        return 0;
+    if (self->count > 0) {
+        *result = channel_buffer_pop(self);
+        channel_buffer_refill(ts, self);
+        return 1;
+    }
+    sender = slp_channel_remove(self, NULL, NULL, NULL);
+    TASKLET_CLAIMVAL(sender, result);
+    if (sender->select != NULL)
+        sender = select_complete(sender);
+    if (sender != NULL)
+        channel_wakeup(ts, sender);
+    return 1;
+}
 
 /*
  * This generic function exchanges values over a channel.
@@ -461,6 +757,10 @@ generic_channel_action(PyChannelObject *self, PyObject *arg, int dir, int stackl
 
     assert(abs(dir) == 1);
 
+    if (dir > 0 ? !cando && self->count < self->capacity : self->count > 0)
+        /* a buffered channel with space or with values */
+        return channel_buffer_action(ts, self, arg, dir, stackless);
+
     /* set the channel tmpval here, for the callback */
     TASKLET_CLAIMVAL(source, &tmpval);
     TASKLET_SETVAL(source, arg);
@@ -491,41 +791,55 @@ generic_channel_cando(PyThreadState *ts, PyObject **result, PyChannelObject *sel
 {
     PyTaskletObject *source = ts->st.current;
     PyTaskletObject *switchto, *target, *next;
-    int interthread;
     uint8_t oldflags, runflags = 0;
     int switched, fail;
 
     /* swap data and perform necessary scheduling */
 
     switchto = target = slp_channel_remove(self, NULL, NULL, &next);
-    interthread = target->cstate->tstate != ts;
+    if (target->select != NULL)
+        /* the proxy of a select */
+        return select_cando(ts, result, self, target, stackless);
+    if (target->cstate->tstate != ts) {
+        /* The target is merely made runnable in its thread. The current
+         * tasklet continues without going through the scheduler. */
+        if (target->cstate->tstate == NULL) {
+            slp_channel_insert(self, target, -dir, next);
+            RUNTIME_ERROR("tasklet has no thread", -1);
+        }
+        TASKLET_SWAPVAL(source, target);
+        channel_wakeup(ts, target);
+        TASKLET_CLAIMVAL(source, result);
+        if (PyBomb_Check(*result))
+            *result = slp_bomb_explode(*result);
+        return 0;
+    }
     /* exchange data */
     TASKLET_SWAPVAL(source, target);
 
-    if (interthread) {
-        ; /* nothing happens, the target is merely made runnable */
-    } else {
-        if (self->flags.schedule_all) {
-            /* target goes last */
-            slp_current_insert(target);
-            /* always schedule away from source */
-            switchto = source->next;
-        }
-        else if (self->flags.preference == -dir) {
-            /* move target after source */
-            ts->st.current = source->next;
-            slp_current_insert(target);
-            ts->st.current = source;
-            /* don't mess with this scheduling behaviour: */
-            runflags = PY_WATCHDOG_NO_SOFT_IRQ;
-        }
-        else {
-            /* otherwise we return to the caller */
-            slp_current_insert(target);
+    if (self->flags.schedule_all) {
+        /* target goes last */
+        slp_current_insert(target);
+        /* always schedule away from source, unless source precedes
+         * all other runnable tasklets */
+        switchto = source->next;
+        if (SLP_TASKLET_PRECEDES(source, switchto))
             switchto = source;
-            /* don't mess with this scheduling behaviour: */
-            runflags = PY_WATCHDOG_NO_SOFT_IRQ;
-        }
+    }
+    else if (SLP_TASKLET_PRECEDES(target, source) ||
+             (self->flags.preference == -dir &&
+              !SLP_TASKLET_PRECEDES(source, target))) {
+        /* move target after source */
+        slp_current_insert_after(target);
+        /* don't mess with this scheduling behaviour: */
+        runflags = PY_WATCHDOG_NO_SOFT_IRQ;
+    }
+    else {
+        /* otherwise we return to the caller */
+        slp_current_insert(target);
+        switchto = source;
+        /* don't mess with this scheduling behaviour: */
+        runflags = PY_WATCHDOG_NO_SOFT_IRQ;
     }
 
     /* Make sure that the channel will exist past the actual switch, if
@@ -545,15 +859,10 @@ generic_channel_cando(PyThreadState *ts, PyObject **result, PyChannelObject *sel
         Py_CLEAR(ts->st.del_post_switch);
     if (fail) {
         ts->st.runflags = oldflags;
-        if (!interthread) {
-            slp_current_uninsert(target);
-            ts->st.current = source;
-        }
+        slp_current_uninsert(target);
+        ts->st.current = source;
         slp_channel_insert(self, target, -dir, next);
         TASKLET_SWAPVAL(source, target);
-    } else {
-        if (interthread)
-            Py_DECREF(target);
     }
     return fail;
 }
@@ -882,7 +1191,7 @@ channel_iternext(PyChannelObject *self)
 {
     STACKLESS_GETARG();
 
-    if (self->flags.closing && self->balance <= 0) {
+    if (self->flags.closing && self->balance <= 0 && self->count == 0) {
         /* signal the end of the iteration */
         PyErr_SetNone(PyExc_StopIteration);
         return NULL;
@@ -917,10 +1226,11 @@ a very efficient way to build fast pipes.");
  */
 
 static PyObject *
-_channel_send_sequence(PyChannelObject *self, PyObject *v)
+_channel_send_sequence(PyChannelObject *self, PyObject *v, int bulk)
 {
+    PyThreadState *ts = _PyThreadState_GET();
     PyObject *it;
-    int i;
+    int i, fail;
     PyObject *ret;
 
     it = PyObject_GetIter(v);
@@ -935,6 +1245,15 @@ _channel_send_sequence(PyChannelObject *self, PyObject *v)
                 goto error;
             break;
         }
+        if (bulk) {
+            fail = channel_deliver(ts, self, item);
+            if (fail) {
+                Py_DECREF(item);
+                if (fail < 0)
+                    goto error;
+                continue;
+            }
+        }
         ret = impl_channel_send(self, item);
         Py_DECREF(item);
         if (ret == NULL)
@@ -957,13 +1276,13 @@ _channel_send_sequence(PyChannelObject *self, PyObject *v)
  * the loop all the time. Hopefully the idea is still visible.
  */
 
-PyObject *
-slp_channel_seq_callback(PyCFrameObject *f, int exc, PyObject *retval)
+static PyObject *
+channel_seq_loop(PyCFrameObject *f, PyObject *retval, int bulk)
 {
     PyThreadState *ts = _PyThreadState_GET();
     PyChannelObject *ch;
     PyObject *item;
-    int stage = f->n;
+    int stage = f->n, fail;
 
     /* prolog to re-enter the loop */
     if (stage == 1) {
@@ -1005,6 +1324,15 @@ back_with_data:
 
         /* send the data */
         ch = (PyChannelObject *) f->ob2;
+        if (bulk) {
+            fail = channel_deliver(ts, ch, item);
+            if (fail) {
+                Py_DECREF(item);
+                if (fail < 0)
+                    goto exit_frame;
+                continue;
+            }
+        }
         STACKLESS_PROPOSE_ALL(ts);
         retval = impl_channel_send(ch, item);
         Py_DECREF(item);
@@ -1028,22 +1356,35 @@ exit_frame:
     return retval;
 }
 
+PyObject *
+slp_channel_seq_callback(PyCFrameObject *f, int exc, PyObject *retval)
+{
+    return channel_seq_loop(f, retval, 0);
+}
+
+PyObject *
+slp_channel_send_many_callback(PyCFrameObject *f, int exc, PyObject *retval)
+{
+    return channel_seq_loop(f, retval, 1);
+}
+
 static PyObject *
-channel_send_sequence(PyChannelObject *self, PyObject *v)
+generic_channel_send_sequence(PyChannelObject *self, PyObject *v, int bulk,
+                              int stackless)
 {
-    STACKLESS_GETARG();
     PyThreadState *ts = _PyThreadState_GET();
     PyObject *it;
     PyCFrameObject *f;
 
     if (!stackless)
-        return _channel_send_sequence(self, v);
+        return _channel_send_sequence(self, v, bulk);
 
     it = PyObject_GetIter(v);
     if (it == NULL)
         return NULL;
 
-    f = slp_cframe_new(slp_channel_seq_callback, 1);
+    f = slp_cframe_new(bulk ? slp_channel_send_many_callback :
+                              slp_channel_seq_callback, 1);
     if (f == NULL)
         goto error;
 
@@ -1060,6 +1401,483 @@ error:
     return NULL;
 }
 
+static PyObject *
+channel_send_sequence(PyChannelObject *self, PyObject *v)
+{
+    STACKLESS_GETARG();
+    return generic_channel_send_sequence(self, v, 0, stackless);
+}
+
+PyDoc_STRVAR(channel_send_many__doc__,
+"channel.send_many(iterable) -- send the values of iterable over the channel.\n\
+Returns the number of sent values. Unlike send_sequence(), the values go\n\
+to the waiting receivers and into the buffer without switching. The\n\
+receivers become runnable, but the sender continues, until the\n\
+channel blocks it.");
+
+static PyObject *
+channel_send_many(PyChannelObject *self, PyObject *v)
+{
+    STACKLESS_GETARG();
+    return generic_channel_send_sequence(self, v, 1, stackless);
+}
+
+Py_ssize_t
+PyChannel_SendMany(PyChannelObject *self, PyObject *iterable)
+{
+    PyObject *ret = _channel_send_sequence(self, iterable, 1);
+    Py_ssize_t count;
+
+    if (ret == NULL)
+        return -1;
+    count = PyLong_AsSsize_t(ret);
+    Py_DECREF(ret);
+    return count;
+}
+
+PyDoc_STRVAR(channel_receive_many__doc__,
+"channel.receive_many(max_n) -- receive up to max_n values as a list.\n\
+If no value is available, the receiver blocks for the first value.\n\
+Then it takes the values of the buffer and of the waiting senders\n\
+without switching. The senders become runnable. An exception sent with\n\
+send_exception() ends the list, the next receive raises it.");
+
+/* Complete a receive_many(): append the first value and take the available
+ * values. Steals the reference to the list and to the value. */
+static PyObject *
+channel_receive_rest(PyChannelObject *self, PyObject *list, PyObject *value,
+                     Py_ssize_t max_n)
+{
+    PyThreadState *ts = _PyThreadState_GET();
+    int fail;
+
+    if (value == NULL)
+        goto error;
+    fail = PyList_Append(list, value);
+    Py_DECREF(value);
+    if (fail)
+        goto error;
+    while (PyList_GET_SIZE(list) < max_n) {
+        fail = channel_take(ts, self, &value);
+        if (fail <= 0) {
+            if (fail < 0)
+                goto error;
+            break;
+        }
+        fail = PyList_Append(list, value);
+        Py_DECREF(value);
+        if (fail)
+            goto error;
+    }
+    return list;
+error:
+    Py_DECREF(list);
+    return NULL;
+}
+
+PyObject *
+slp_channel_receive_many_callback(PyCFrameObject *f, int exc, PyObject *retval)
+{
+    PyThreadState *ts = _PyThreadState_GET();
+    PyObject *list;
+
+    if (f->n == 0 && retval != NULL) {
+        /* block for the first value */
+        Py_DECREF(retval);
+        STACKLESS_PROPOSE_ALL(ts);
+        retval = impl_channel_receive((PyChannelObject *) f->ob2);
+        if (STACKLESS_UNWINDING(retval)) {
+            f->n = 1;
+            return retval;
+        }
+    }
+    list = f->ob1;
+    f->ob1 = NULL;
+    retval = channel_receive_rest((PyChannelObject *) f->ob2, list, retval, f->i);
+
+    /* epilog to return from the frame */
+    SLP_STORE_NEXT_FRAME(ts, f->f_back);
+    Py_DECREF(f);
+    return retval;
+}
+
+static PyObject *
+generic_channel_receive_many(PyChannelObject *self, Py_ssize_t max_n, int stackless)
+{
+    PyThreadState *ts = _PyThreadState_GET();
+    PyObject *list, *value;
+    PyCFrameObject *f;
+    int fail;
+
+    if (max_n < 1)
+        VALUE_ERROR("max_n must be positive", NULL);
+    list = PyList_New(0);
+    if (list == NULL)
+        return NULL;
+    fail = channel_take(ts, self, &value);
+    if (fail < 0) {
+        Py_DECREF(list);
+        return NULL;
+    }
+    if (fail)
+        return channel_receive_rest(self, list, value, max_n);
+    if (!stackless)
+        return channel_receive_rest(self, list, impl_channel_receive(self), max_n);
+
+    f = slp_cframe_new(slp_channel_receive_many_callback, 1);
+    if (f == NULL) {
+        Py_DECREF(list);
+        return NULL;
+    }
+    f->ob1 = list;
+    Py_INCREF(self);
+    f->ob2 = (PyObject *) self;
+    f->i = (long) Py_MIN(max_n, LONG_MAX);
+    f->n = 0;
+    SLP_STORE_NEXT_FRAME(ts, (PyFrameObject *) f);
+    Py_INCREF(Py_None);
+    return STACKLESS_PACK(ts, Py_None);
+}
+
+static PyObject *
+channel_receive_many(PyChannelObject *self, PyObject *arg)
+{
+    STACKLESS_GETARG();
+    Py_ssize_t max_n = PyNumber_AsSsize_t(arg, PyExc_OverflowError);
+
+    if (max_n == -1 && PyErr_Occurred())
+        return NULL;
+    return generic_channel_receive_many(self, max_n, stackless);
+}
+
+PyObject *
+PyChannel_ReceiveMany(PyChannelObject *self, Py_ssize_t max_n)
+{
+    return generic_channel_receive_many(self, max_n, 0);
+}
+
+
+/*
+ * select support.
+ * A tasklet, that waits for several channel operations, queues a proxy
+ * tasklet on each channel. The proxies are ordinary tasklets without a
+ * frame, that point to the shared select structure. The first channel
+ * operation, that finds a proxy, completes the select: it removes the
+ * other proxies and wakes up the waiting tasklet (the owner) instead of
+ * the proxy.
+ */
+
+typedef struct _slp_select {
+    PyTaskletObject *owner;         /* the waiting tasklet, owned while it waits */
+    Py_ssize_t index;               /* the completed operation or -1 */
+    Py_ssize_t count;
+    PyTaskletObject *proxies[1];
+} PyStacklessSelect;
+
+/* Stop waiting: remove the remaining proxies from their channels and
+ * cancel the timeout. Returns the reference to the owner or NULL, if
+ * the select was already complete.
+ */
+static PyTaskletObject *
+select_finish(PyStacklessSelect *sel, Py_ssize_t index)
+{
+    PyTaskletObject *owner = sel->owner, *proxy;
+    Py_ssize_t i;
+
+    if (owner == NULL)
+        return NULL;
+    sel->owner = NULL;
+    sel->index = index;
+    owner->select = NULL;
+    for (i = 0; i < sel->count; i++) {
+        proxy = sel->proxies[i];
+        if (proxy == NULL)
+            continue;
+        proxy->select = NULL;
+        if (proxy->flags.blocked) {
+            slp_channel_remove_slow(proxy, NULL, NULL, NULL);
+            Py_DECREF(proxy); /* the reference of the channel */
+        }
+    }
+    if (owner->timer != NULL)
+        slp_timer_cancel(owner);
+    return owner;
+}
+
+/* A channel action completed the select of a proxy, that the action
+ * removed from the channel. Returns the reference to the owner or NULL,
+ * if the owner is already runnable. */
+static PyTaskletObject *
+select_complete(PyTaskletObject *proxy)
+{
+    PyStacklessSelect *sel = proxy->select;
+    PyTaskletObject *owner;
+    Py_ssize_t i;
+
+    for (i = 0; sel->proxies[i] != proxy; i++)
+        ;
+    owner = select_finish(sel, i);
+    assert(owner != NULL);
+    Py_DECREF(proxy); /* the reference of the channel */
+    if (owner->next != NULL) {
+        /* somebody else inserted the owner meanwhile */
+        Py_DECREF(owner);
+        return NULL;
+    }
+    return owner;
+}
+
+/* the timeout of a select expired */
+static void
+select_timeout(PyThreadState *ts, PyTaskletObject *task)
+{
+    PyTaskletObject *owner = NULL;
+
+    if (task->select != NULL)
+        owner = select_finish(task->select, -1);
+    if (owner != NULL && owner->next == NULL)
+        slp_current_insert(owner);  /* steals the reference */
+    else
+        Py_XDECREF(owner);
+    Py_DECREF(task);                /* the reference of the timer */
+}
+
+/* A channel operation found a proxy: exchange the values with the
+ * proxy and wake up the owner. The current tasklet keeps running,
+ * unless the owner precedes it.
+ */
+static int
+select_cando(PyThreadState *ts, PyObject **result, PyChannelObject *self,
+             PyTaskletObject *proxy, int stackless)
+{
+    PyTaskletObject *source = ts->st.current;
+    PyTaskletObject *switchto = source, *owner;
+    int switched, fail;
+
+    TASKLET_SWAPVAL(source, proxy);
+    owner = select_complete(proxy);
+    if (owner == NULL)
+        ;
+    else if (owner->cstate->tstate != ts) {
+        channel_wakeup(ts, owner);
+        owner = NULL;
+    }
+    else {
+        slp_current_insert(owner);  /* steals the reference */
+        if (SLP_TASKLET_PRECEDES(owner, source))
+            switchto = owner;
+        owner = NULL;
+    }
+
+    /* see generic_channel_cando() */
+    assert(ts->st.del_post_switch == NULL);
+    if (switchto != source && Py_REFCNT(self)) {
+        ts->st.del_post_switch = (PyObject*)self;
+        Py_INCREF(self);
+    }
+    fail = slp_schedule_task(result, source, switchto, stackless, &switched);
+    if (fail || !switched)
+        Py_CLEAR(ts->st.del_post_switch);
+    /* The select is complete, even if the switch failed. */
+    Py_XDECREF(owner);
+    return fail;
+}
+
+static PyObject *
+select_main(PyObject *self, PyObject *args)
+{
+    PyObject *cases;
+    long long timeout;
+
+    if (!PyArg_ParseTuple(args, "OL:select", &cases, &timeout))
+        return NULL;
+    return slp_channel_select(cases, (_PyTime_t)timeout);
+}
+
+/* parse a case of a select: (channel, 'recv') or (channel, 'send', value) */
+static int
+select_parse_case(PyObject *item, PyChannelObject **channel, int *dir, PyObject **value)
+{
+    const char *op;
+
+    if (!PyTuple_Check(item) || PyTuple_GET_SIZE(item) < 2 ||
+        !PyChannel_Check(PyTuple_GET_ITEM(item, 0)) ||
+        !PyUnicode_Check(PyTuple_GET_ITEM(item, 1)))
+        TYPE_ERROR("select() expects tuples (channel, 'recv') or "
+                   "(channel, 'send', value)", -1);
+    *channel = (PyChannelObject *)PyTuple_GET_ITEM(item, 0);
+    op = PyUnicode_AsUTF8(PyTuple_GET_ITEM(item, 1));
+    if (op == NULL)
+        return -1;
+    if (strcmp(op, "recv") == 0 && PyTuple_GET_SIZE(item) == 2) {
+        *dir = -1;
+        *value = Py_None;
+    }
+    else if (strcmp(op, "send") == 0 && PyTuple_GET_SIZE(item) == 3) {
+        *dir = 1;
+        *value = PyTuple_GET_ITEM(item, 2);
+    }
+    else
+        VALUE_ERROR("select() expects tuples (channel, 'recv') or "
+                    "(channel, 'send', value)", -1);
+    return 0;
+}
+
+PyObject *
+slp_channel_select(PyObject *cases, _PyTime_t timeout)
+{
+    PyThreadState *ts = _PyThreadState_GET();
+    PyTaskletObject *current = ts->st.current, *owner;
+    PyStacklessSelect *sel = NULL;
+    PyChannelObject *channel;
+    PyObject *seq, *item, *other, *value, *ret = NULL;
+    Py_ssize_t i, j, n;
+    int dir;
+
+    if (ts->st.main == NULL) {
+        PyMethodDef def = {"select", (PyCFunction)select_main, METH_VARARGS};
+        return PyStackless_CallCMethod_Main(&def, NULL, "OL", cases, (long long)timeout);
+    }
+    seq = PySequence_Fast(cases, "select() expects a sequence of channel operations");
+    if (seq == NULL)
+        return NULL;
+    n = PySequence_Fast_GET_SIZE(seq);
+    if (n == 0) {
+        PyErr_SetString(PyExc_ValueError, "select() needs at least one channel operation");
+        goto exit;
+    }
+    for (i = 0; i < n; i++) {
+        item = PySequence_Fast_GET_ITEM(seq, i);
+        if (select_parse_case(item, &channel, &dir, &value))
+            goto exit;
+        for (j = 0; j < i; j++) {
+            /* the size of a case tells its direction */
+            other = PySequence_Fast_GET_ITEM(seq, j);
+            if (PyTuple_GET_ITEM(other, 0) == (PyObject *)channel &&
+                PyTuple_GET_SIZE(other) != PyTuple_GET_SIZE(item)) {
+                PyErr_SetString(PyExc_ValueError,
+                    "select() can't send and receive on the same channel");
+                goto exit;
+            }
+        }
+    }
+
+retry:
+    /* the first operation, that can proceed immediately, wins */
+    for (i = 0; i < n; i++) {
+        select_parse_case(PySequence_Fast_GET_ITEM(seq, i), &channel, &dir, &value);
+        if (dir > 0 ? channel->balance < 0 || channel->count < channel->capacity :
+                      channel->balance > 0 || channel->count > 0) {
+            value = generic_channel_action(channel, value, dir, 0);
+            if (value != NULL) {
+                ret = Py_BuildValue("(nO)", i, value);
+                Py_DECREF(value);
+            }
+            goto exit;
+        }
+    }
+    if (timeout == 0) {
+        Py_INCREF(Py_None);
+        ret = Py_None;
+        goto exit;
+    }
+    if (current->flags.block_trap) {
+        slp_runtime_error("this tasklet does not like to be blocked.");
+        goto exit;
+    }
+    for (i = 0; i < n; i++) {
+        select_parse_case(PySequence_Fast_GET_ITEM(seq, i), &channel, &dir, &value);
+        if (channel->flags.closing) {
+            PyErr_SetString(PyExc_ValueError, "Send/receive operation on a closed channel");
+            goto exit;
+        }
+    }
+
+    if (sel == NULL) {
+        /* create the proxies */
+        sel = PyMem_Calloc(1, sizeof(PyStacklessSelect) + (n - 1) * sizeof(PyTaskletObject *));
+        if (sel == NULL) {
+            PyErr_NoMemory();
+            goto exit;
+        }
+        sel->index = -1;
+        sel->count = n;
+        for (i = 0; i < n; i++) {
+            sel->proxies[i] = PyTasklet_New(NULL, NULL);
+            if (sel->proxies[i] == NULL)
+                goto exit;
+        }
+        /* this may have run Python code, that changed the channels */
+        goto retry;
+    }
+
+    /* wait on all channels */
+    for (i = 0; i < n; i++) {
+        PyTaskletObject *proxy = sel->proxies[i];
+        select_parse_case(PySequence_Fast_GET_ITEM(seq, i), &channel, &dir, &value);
+        TASKLET_SETVAL(proxy, value);
+        proxy->select = sel;
+        Py_INCREF(proxy);
+        slp_channel_insert(channel, proxy, dir, NULL);
+    }
+    Py_INCREF(current);
+    sel->owner = current;
+    current->select = sel;
+    if (timeout > 0 && slp_timer_add(ts, current,
+            _PyTime_GetMonotonicClock() + timeout, select_timeout)) {
+        Py_DECREF(select_finish(sel, -1));
+        goto exit;
+    }
+    ret = PyStackless_Schedule(Py_None, 1);
+
+    /* woken up by an insert, kill, ... or an error */
+    owner = select_finish(sel, -1);
+    Py_XDECREF(owner);
+    if (ret == NULL)
+        goto exit;
+    Py_DECREF(ret);
+    if (sel->index < 0) {
+        Py_INCREF(Py_None);
+        ret = Py_None;
+    }
+    else {
+        value = sel->proxies[sel->index]->tempval;
+        if (PyBomb_Check(value)) {
+            /* send_exception() or send_throw() */
+            Py_INCREF(value);
+            ret = slp_bomb_explode(value);
+        }
+        else
+            ret = Py_BuildValue("(nO)", sel->index, value);
+    }
+
+exit:
+    if (sel != NULL) {
+        for (i = 0; i < sel->count; i++)
+            Py_XDECREF(sel->proxies[i]);
+        PyMem_Free(sel);
+    }
+    Py_DECREF(seq);
+    return ret;
+}
+
+PyObject *
+PyChannel_Select(PyObject *cases, double timeout)
+{
+    _PyTime_t t = -1;
+    PyObject *obj;
+    int fail;
+
+    if (timeout >= 0.0) {
+        if ((obj = PyFloat_FromDouble(timeout)) == NULL)
+            return NULL;
+        fail = _PyTime_FromSecondsObject(&t, obj, _PyTime_ROUND_CEILING);
+        Py_DECREF(obj);
+        if (fail)
+            return NULL;
+    }
+    return slp_channel_select(cases, t);
+}
 
 PyDoc_STRVAR(channel_close__doc__,
 "channel.close() -- stops the channel from enlarging its queue.\n\
@@ -1106,7 +1924,7 @@ PyDoc_STRVAR(channel_reduce__doc__,
 static PyObject *
 channel_reduce(PyChannelObject * ch, PyObject *value)
 {
-    PyObject *tup = NULL, *lis = NULL;
+    PyObject *tup = NULL, *lis = NULL, *values = NULL;
     PyTaskletObject *t;
     int i, n;
 
@@ -1120,42 +1938,85 @@ channel_reduce(PyChannelObject * ch, PyObject *value)
     t = ch->head;
     n = abs(ch->balance);
     for (i = 0; i < n; i++) {
+        if (t->select != NULL) {
+            PyErr_SetString(PyExc_RuntimeError,
+                            "can't pickle a channel with a pending select");
+            goto err_exit;
+        }
         if (PyList_Append(lis, (PyObject *) t)) goto err_exit;
         t = t->next;
     }
-    tup = Py_BuildValue("(O()(iiO))",
+    if (ch->capacity == 0 && ch->count == 0) {
+        tup = Py_BuildValue("(O()(iiO))",
+                            Py_TYPE(ch),
+                            ch->balance,
+                            channel_flags_as_integer(ch->flags),
+                            lis
+                            );
+        goto err_exit;
+    }
+    /* a buffered channel */
+    values = PyList_New(ch->count);
+    if (values == NULL) goto err_exit;
+    for (i = 0; i < ch->count; i++) {
+        PyObject *v = ch->buffer[(ch->first + i) % ch->size];
+        Py_INCREF(v);
+        PyList_SET_ITEM(values, i, v);
+    }
+    tup = Py_BuildValue("(O()(iiOnO))",
                         Py_TYPE(ch),
                         ch->balance,
                         channel_flags_as_integer(ch->flags),
-                        lis
+                        lis,
+                        ch->capacity,
+                        values
                         );
 err_exit:
     Py_XDECREF(lis);
+    Py_XDECREF(values);
     return tup;
 }
 
 PyDoc_STRVAR(channel_setstate__doc__,
-"channel.__setstate__(balance, flags, [tasklets]) -- currently does not distinguish threads.");
+"channel.__setstate__(balance, flags, [tasklets], capacity=0, [values]) --\n\
+currently does not distinguish threads.");
 
 static PyObject *
 channel_setstate(PyObject *self, PyObject *args)
 {
     PyChannelObject *ch = (PyChannelObject *) self;
     PyTaskletObject *t;
-    PyObject *lis;
+    PyObject *lis, *values = NULL;
     int flags, balance;
     int dir;
-    Py_ssize_t i, n;
+    Py_ssize_t i, n, capacity = 0;
 
-    if (!PyArg_ParseTuple(args, "iiO!:channel",
+    if (!PyArg_ParseTuple(args, "iiO!|nO!:channel",
                           &balance,
                           &flags,
-                          &PyList_Type, &lis))
+                          &PyList_Type, &lis,
+                          &capacity,
+                          &PyList_Type, &values))
         return NULL;
+    if (capacity < 0 || capacity > INT_MAX)
+        VALUE_ERROR("invalid channel capacity", NULL);
 
     channel_clear((PyObject *) ch);
     n = PyList_GET_SIZE(lis);
     ch->flags = channel_flags_from_integer(flags);
+    ch->capacity = capacity;
+    if (values != NULL && PyList_GET_SIZE(values) > 0) {
+        n = PyList_GET_SIZE(values);
+        ch->buffer = PyMem_New(PyObject *, n);
+        if (ch->buffer == NULL)
+            return PyErr_NoMemory();
+        ch->size = n;
+        for (i = 0; i < n; i++) {
+            Py_INCREF(PyList_GET_ITEM(values, i));
+            channel_buffer_push(ch, PyList_GET_ITEM(values, i));
+        }
+        n = PyList_GET_SIZE(lis);
+    }
     dir = balance > 0 ? 1 : -1;
 
     for (i = 0; i < n; i++) {
@@ -1199,6 +2060,10 @@ channel_methods[] = {
      channel_setstate__doc__},
     {"send_sequence",   (PCF)channel_send_sequence,       METH_OS,
      channel_send_sequence__doc__},
+    {"send_many",       (PCF)channel_send_many,           METH_OS,
+     channel_send_many__doc__},
+    {"receive_many",    (PCF)channel_receive_many,        METH_OS,
+     channel_receive_many__doc__},
     {NULL,                  NULL}             /* sentinel */
 };
 
@@ -1248,7 +2113,7 @@ PyTypeObject PyChannel_Type = {
     (getiterfunc)channel_getiter,               /* tp_iter */
     (iternextfunc)channel_iternext,             /* tp_iternext */
     channel_methods,                            /* tp_methods */
-    channel_members,                            /* tp_members */
+    0,                                          /* tp_members */
     channel_getsetlist,                         /* tp_getset */
     0,                                          /* tp_base */
     0,                                          /* tp_dict */
@@ -0,0 +1,377 @@
+/******************************************************
+
+  The I/O Reactor
+
+ ******************************************************/
+
+#include "Python.h"
+
+#ifdef STACKLESS
+#include "pycore_stackless.h"
+
+#ifdef SLP_HAVE_REACTOR
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+/*
+ * The reactor parks tasklets, that wait for a file descriptor. Each thread
+ * has its own reactor, created on demand. A waiting tasklet is not runnable.
+ * The reactor owns a reference to it, until the file descriptor is ready,
+ * the timeout of the wait expires or the tasklet runs for some other reason
+ * (see set_current() in scheduling.c).
+ *
+ * At most one tasklet can wait for reading and one for writing a file
+ * descriptor. The reactor registers the union of the wanted events with
+ * epoll and modifies the registration whenever a waiter comes or goes.
+ *
+ * The scheduler polls the reactor. If the thread has no runnable tasklet,
+ * it waits in epoll_wait(). A thread, that inserts a tasklet into the run
+ * queue of such a thread, writes to an eventfd to wake the thread up.
+ *
+ * The reactor uses the epoll system calls directly, because the core can't
+ * depend on the select module.
+ */
+
+typedef struct _slp_reactor_entry {
+    PyTaskletObject *reader;        /* owned references or NULL */
+    PyTaskletObject *writer;
+    uint32_t events;                /* the events registered with epoll */
+} PyStacklessReactorEntry;
+
+static PyStacklessReactor *
+reactor_get(PyThreadState *ts)
+{
+    PyStacklessReactor *reactor = ts->st.reactor;
+    struct epoll_event ev;
+
+    if (reactor != NULL)
+        return reactor;
+    reactor = PyMem_Malloc(sizeof(PyStacklessReactor));
+    if (reactor == NULL) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    reactor->polling = 0;
+    reactor->count = 0;
+    reactor->next_poll = 0;
+    reactor->size = 0;
+    reactor->entries = NULL;
+    reactor->wakeupfd = -1;
+    reactor->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (reactor->epfd < 0)
+        goto error;
+    reactor->wakeupfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reactor->wakeupfd < 0)
+        goto error;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = reactor->wakeupfd;
+    if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, reactor->wakeupfd, &ev) < 0)
+        goto error;
+    ts->st.reactor = reactor;
+    return reactor;
+
+error:
+    PyErr_SetFromErrno(PyExc_OSError);
+    if (reactor->wakeupfd >= 0)
+        close(reactor->wakeupfd);
+    if (reactor->epfd >= 0)
+        close(reactor->epfd);
+    PyMem_Free(reactor);
+    return NULL;
+}
+
+/* Make the epoll registration of fd match its waiters. */
+static int
+reactor_update(PyStacklessReactor *reactor, int fd)
+{
+    PyStacklessReactorEntry *entry = &reactor->entries[fd];
+    struct epoll_event ev;
+    int op;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = (entry->reader != NULL ? EPOLLIN : 0) |
+                (entry->writer != NULL ? EPOLLOUT : 0);
+    ev.data.fd = fd;
+    if (ev.events == entry->events)
+        return 0;
+    if (entry->events == 0)
+        op = EPOLL_CTL_ADD;
+    else if (ev.events == 0)
+        op = EPOLL_CTL_DEL;
+    else
+        op = EPOLL_CTL_MOD;
+    if (epoll_ctl(reactor->epfd, op, fd, &ev) < 0) {
+        /* Closing a file descriptor silently removes its registration and
+         * a new file may reuse the number. */
+        if (op == EPOLL_CTL_MOD && errno == ENOENT)
+            op = EPOLL_CTL_ADD;
+        else if (op == EPOLL_CTL_ADD && errno == EEXIST)
+            op = EPOLL_CTL_MOD;
+        else if (op == EPOLL_CTL_DEL)
+            op = 0;
+        else
+            return -1;
+        if (op != 0 && epoll_ctl(reactor->epfd, op, fd, &ev) < 0)
+            return -1;
+    }
+    entry->events = ev.events;
+    return 0;
+}
+
+/* Remove a waiting tasklet. Returns the reference of the reactor. */
+static PyTaskletObject *
+reactor_remove(PyStacklessReactor *reactor, PyTaskletObject *task)
+{
+    PyStacklessReactorEntry *entry;
+    int fd = task->io_fd;
+
+    assert(fd >= 0 && fd < reactor->size);
+    entry = &reactor->entries[fd];
+    if (task->io_events == SLP_REACTOR_READ) {
+        assert(entry->reader == task);
+        entry->reader = NULL;
+    }
+    else {
+        assert(entry->writer == task);
+        entry->writer = NULL;
+    }
+    task->io_fd = -1;
+    task->io_events = 0;
+    reactor->count--;
+    /* removing an event doesn't fail, unless the file is gone */
+    (void)reactor_update(reactor, fd);
+    return task;
+}
+
+/* The timeout of a wait expired. */
+static void
+reactor_timeout(PyThreadState *ts, PyTaskletObject *task)
+{
+    if (task->io_fd >= 0) {
+        Py_DECREF(reactor_remove(ts->st.reactor, task));
+        if (task->next == NULL) {
+            TASKLET_SETVAL(task, Py_False);
+            slp_current_insert(task);   /* steals the reference of the timer */
+            return;
+        }
+    }
+    Py_DECREF(task);                    /* the reference of the timer */
+}
+
+/* The file descriptor of a waiting tasklet is ready. */
+static void
+reactor_fire(PyStacklessReactor *reactor, PyTaskletObject *task)
+{
+    reactor_remove(reactor, task);
+    if (task->timer != NULL)
+        slp_timer_cancel(task);
+    if (task->next != NULL) {
+        /* somebody else inserted the tasklet meanwhile */
+        Py_DECREF(task);
+        return;
+    }
+    TASKLET_SETVAL(task, Py_True);
+    slp_current_insert(task);           /* steals the reference */
+}
+
+/* Register the tasklet task of thread ts as waiting for the events of fd.
+ * A timeout >= 0 limits the wait (in nanoseconds). The caller must
+ * schedule_remove the tasklet afterwards.
+ */
+int
+slp_reactor_register(PyThreadState *ts, PyTaskletObject *task, int fd,
+                     int events, _PyTime_t timeout)
+{
+    PyStacklessReactor *reactor;
+    PyTaskletObject **waiter;
+
+    assert(task->io_fd < 0);
+    if (fd < 0)
+        VALUE_ERROR("file descriptor cannot be a negative integer", -1);
+    if ((reactor = reactor_get(ts)) == NULL)
+        return -1;
+    if (fd >= reactor->size) {
+        PyStacklessReactorEntry *entries;
+        int size = Py_MAX(fd + 1, 2 * reactor->size);
+
+        entries = PyMem_Realloc(reactor->entries,
+                                size * sizeof(PyStacklessReactorEntry));
+        if (entries == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        memset(entries + reactor->size, 0,
+               (size - reactor->size) * sizeof(PyStacklessReactorEntry));
+        reactor->entries = entries;
+        reactor->size = size;
+    }
+    waiter = events == SLP_REACTOR_READ ? &reactor->entries[fd].reader :
+                                          &reactor->entries[fd].writer;
+    if (*waiter != NULL)
+        RUNTIME_ERROR("another tasklet already waits for this file descriptor",
+                      -1);
+    *waiter = task;
+    if (reactor_update(reactor, fd)) {
+        *waiter = NULL;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+    Py_INCREF(task);
+    task->io_fd = fd;
+    task->io_events = events;
+    reactor->count++;
+    if (timeout >= 0 && slp_timer_add(ts, task,
+            _PyTime_GetMonotonicClock() + timeout, reactor_timeout)) {
+        Py_DECREF(reactor_remove(reactor, task));
+        return -1;
+    }
+    return 0;
+}
+
+/* The waiting tasklet task runs for some other reason. */
+void
+slp_reactor_cancel(PyTaskletObject *task)
+{
+    PyThreadState *ts = task->cstate->tstate;
+
+    assert(task->io_fd >= 0);
+    assert(ts != NULL && ts->st.reactor != NULL);
+    Py_DECREF(reactor_remove(ts->st.reactor, task));
+}
+
+/* Make the tasklets with ready file descriptors runnable. A timeout > 0
+ * (in nanoseconds) or < 0 (no limit) waits for the first ready file
+ * descriptor without the GIL. Another thread can interrupt the wait with
+ * slp_reactor_wakeup(). Returns the number of woken tasklets or -1 on error.
+ */
+int
+slp_reactor_poll(PyThreadState *ts, _PyTime_t timeout)
+{
+    PyStacklessReactor *reactor = ts->st.reactor;
+    struct epoll_event events[SLP_REACTOR_MAXEVENTS];
+    PyStacklessReactorEntry *entry;
+    int n, i, fd, ms = 0, woken = 0;
+    uint32_t ev;
+    uint64_t value;
+
+    if (reactor == NULL)
+        return 0;
+    if (timeout != 0) {
+        ms = -1;
+        if (timeout > 0) {
+            _PyTime_t t = _PyTime_AsMilliseconds(timeout, _PyTime_ROUND_CEILING);
+            ms = (int)Py_MIN(t, INT_MAX);
+        }
+        reactor->polling = 1;
+        Py_BEGIN_ALLOW_THREADS
+        n = epoll_wait(reactor->epfd, events, SLP_REACTOR_MAXEVENTS, ms);
+        Py_END_ALLOW_THREADS
+        reactor->polling = 0;
+    }
+    else
+        n = epoll_wait(reactor->epfd, events, SLP_REACTOR_MAXEVENTS, 0);
+    reactor->next_poll = _PyTime_GetMonotonicClock() + SLP_REACTOR_POLL_INTERVAL;
+    if (n < 0) {
+        if (errno == EINTR)
+            return 0;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        fd = events[i].data.fd;
+        ev = events[i].events;
+        if (fd == reactor->wakeupfd) {
+            if (read(fd, &value, sizeof(value)) < 0) {
+                /* EAGAIN: somebody else consumed the wakeup */
+            }
+            continue;
+        }
+        if (fd >= reactor->size)
+            continue;
+        entry = &reactor->entries[fd];
+        if (entry->reader != NULL && (ev & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+            reactor_fire(reactor, entry->reader);
+            woken++;
+        }
+        if (entry->writer != NULL && (ev & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+            reactor_fire(reactor, entry->writer);
+            woken++;
+        }
+    }
+    return woken;
+}
+
+/* Interrupt the epoll_wait() of thread ts. The caller holds the GIL. */
+void
+slp_reactor_wakeup(PyThreadState *ts)
+{
+    PyStacklessReactor *reactor = ts->st.reactor;
+    uint64_t value = 1;
+
+    assert(reactor != NULL);
+    if (write(reactor->wakeupfd, &value, sizeof(value)) < 0) {
+        /* EAGAIN: the counter is full, the thread wakes up anyway */
+    }
+}
+
+void
+slp_reactor_clear(PyThreadState *ts)
+{
+    PyStacklessReactor *reactor = ts->st.reactor;
+    PyStacklessReactorEntry *entry;
+    int fd;
+
+    if (reactor == NULL)
+        return;
+    for (fd = 0; fd < reactor->size; fd++) {
+        entry = &reactor->entries[fd];
+        if (entry->reader != NULL)
+            Py_DECREF(reactor_remove(reactor, entry->reader));
+        if (entry->writer != NULL)
+            Py_DECREF(reactor_remove(reactor, entry->writer));
+    }
+    assert(reactor->count == 0);
+    ts->st.reactor = NULL;
+    close(reactor->wakeupfd);
+    close(reactor->epfd);
+    PyMem_Free(reactor->entries);
+    PyMem_Free(reactor);
+}
+
+#else
+
+/* Without epoll, there is no reactor. */
+
+int
+slp_reactor_register(PyThreadState *ts, PyTaskletObject *task, int fd,
+                     int events, _PyTime_t timeout)
+{
+    RUNTIME_ERROR("waiting for file descriptors is not supported on this "
+                  "platform", -1);
+}
+
+void
+slp_reactor_cancel(PyTaskletObject *task)
+{
+}
+
+int
+slp_reactor_poll(PyThreadState *ts, _PyTime_t timeout)
+{
+    return 0;
+}
+
+void
+slp_reactor_wakeup(PyThreadState *ts)
+{
+}
+
+void
+slp_reactor_clear(PyThreadState *ts)
+{
+}
+
+#endif
+#endif
@@ -0,0 +1,119 @@
+/******************************************************
+
+  Scheduler Event Tracing
+
+ ******************************************************/
+
+#include "Python.h"
+
+#ifdef STACKLESS
+#include "pycore_stackless.h"
+
+/*
+ * The trace buffer records scheduler events without calling Python code.
+ * It is a ring buffer of fixed size events, shared by all threads of an
+ * interpreter. If the buffer is full, new events overwrite the oldest ones.
+ *
+ * The layout of an event is part of the API: PyStackless_GetTraceBuffer()
+ * returns the events as an array of PyStacklessTraceEvent and the stackless
+ * module decodes them with the struct format "=qQQQQqii".
+ */
+
+typedef struct _slp_trace_event {
+    int64_t time;                   /* monotonic clock in nanoseconds */
+    uint64_t thread_id;
+    uint64_t prev;                  /* id() of the tasklets or 0 */
+    uint64_t next;
+    uint64_t channel;               /* id() of the channel or 0 */
+    int64_t cstack_size;            /* bytes of the restored C-stack */
+    int32_t kind;                   /* SLP_TRACE_SWITCH, ... */
+    int32_t flags;                  /* SLP_TRACE_HARD, ... */
+} PyStacklessTraceEvent;
+
+typedef struct _slp_trace {
+    Py_ssize_t size;                /* capacity in events */
+    Py_ssize_t count;               /* number of recorded events */
+    PyStacklessTraceEvent events[1];
+} PyStacklessTrace;
+
+void
+slp_trace_record(PyThreadState *ts, int kind, int flags, void *prev,
+                 void *next, void *channel, Py_ssize_t cstack_size)
+{
+    PyStacklessTrace *trace = ts->interp->st.trace;
+    PyStacklessTraceEvent *event;
+
+    assert(trace != NULL);
+    event = &trace->events[trace->count++ % trace->size];
+    event->time = _PyTime_GetMonotonicClock();
+    event->thread_id = ts->thread_id;
+    event->prev = (uint64_t)(uintptr_t)prev;
+    event->next = (uint64_t)(uintptr_t)next;
+    event->channel = (uint64_t)(uintptr_t)channel;
+    event->cstack_size = cstack_size;
+    event->kind = kind;
+    event->flags = flags;
+}
+
+int
+PyStackless_SetTraceBuffer(Py_ssize_t size)
+{
+    PyInterpreterState *interp = _PyInterpreterState_Get();
+    PyStacklessTrace *trace = NULL;
+
+    Py_BUILD_ASSERT(sizeof(PyStacklessTraceEvent) == 56);
+    if (size < 0)
+        VALUE_ERROR("the size of the trace buffer must not be negative", -1);
+    if (size > 0) {
+        if ((size_t)size > (PY_SSIZE_T_MAX - sizeof(PyStacklessTrace)) /
+                           sizeof(PyStacklessTraceEvent)) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        trace = PyMem_RawMalloc(sizeof(PyStacklessTrace) +
+                                (size - 1) * sizeof(PyStacklessTraceEvent));
+        if (trace == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        trace->size = size;
+        trace->count = 0;
+    }
+    PyMem_RawFree(interp->st.trace);
+    interp->st.trace = trace;
+    return 0;
+}
+
+Py_ssize_t
+PyStackless_GetTraceBufferSize(void)
+{
+    PyStacklessTrace *trace = _PyInterpreterState_Get()->st.trace;
+
+    return trace == NULL ? 0 : trace->size;
+}
+
+PyObject *
+PyStackless_GetTraceBuffer(void)
+{
+    PyStacklessTrace *trace = _PyInterpreterState_Get()->st.trace;
+    Py_ssize_t n, first;
+    PyObject *result;
+    char *p;
+
+    if (trace == NULL)
+        return PyBytes_FromStringAndSize(NULL, 0);
+    /* the oldest event comes first */
+    n = Py_MIN(trace->count, trace->size);
+    first = trace->count > trace->size ? trace->count % trace->size : 0;
+    result = PyBytes_FromStringAndSize(NULL, n * sizeof(PyStacklessTraceEvent));
+    if (result == NULL)
+        return NULL;
+    p = PyBytes_AS_STRING(result);
+    memcpy(p, &trace->events[first],
+           (n - first) * sizeof(PyStacklessTraceEvent));
+    memcpy(p + (n - first) * sizeof(PyStacklessTraceEvent), &trace->events[0],
+           first * sizeof(PyStacklessTraceEvent));
+    return result;
+}
+
+#endif
@@ -1,6 +1,9 @@
 #include "Python.h"
 #include "structmember.h"
 #include "pythread.h"
+#ifdef HAVE_SCHED_H
+#include <sched.h>
+#endif
 #include "pycore_object.h"
 
 #ifdef STACKLESS
@@ -511,7 +514,8 @@ is_thread_runnable(PyThreadState *ts)
 {
     if (ts == _PyThreadState_GET())
         return 0;
-    return !ts->st.thread.is_blocked;
+    /* an idle worker waits for a job, see threadpool.c */
+    return !ts->st.thread.is_blocked && !ts->st.thread.is_idle_worker;
 }
 
 static int
@@ -540,6 +544,88 @@ make_deadlock_bomb(void)
     return slp_curexc_to_bomb();
 }
 
+/*
+ * Work stealing
+ *
+ * If enabled, a thread that runs out of runnable tasklets takes about half
+ * of the runnable tasklets of the busiest other thread of the interpreter,
+ * before it blocks or returns from stackless.run(). Only tasklets without
+ * C-state, i.e. tasklets whose cstate is the initial stub of their thread,
+ * can move to another thread.
+ *
+ * All of this happens with the GIL held. But the victim may have released
+ * the GIL at an inconvenient moment: during a schedule or channel callback
+ * (schedlock is set) or between choosing and running the next tasklet
+ * (switch_target). We leave those tasklets alone.
+ */
+
+static int
+is_tasklet_stealable(PyThreadState *victim, PyTaskletObject *t)
+{
+    return t != victim->st.current && t != victim->st.main &&
+        t != victim->st.switch_target &&
+        (PyObject *)t != victim->st.interrupted &&
+        t->cstate == victim->st.initial_stub && SLP_TASKLET_HAS_FRAME(t);
+}
+
+static int
+steal_tasklets(PyThreadState *ts)
+{
+    PyThreadState *victim = NULL, *t;
+    PyTaskletObject *task, *first = NULL;
+    PyCStackObject *old;
+    int i, n = 0, want;
+
+    if (!ts->interp->st.enable_work_stealing || ts->st.runcount != 0 ||
+            ts->st.initial_stub == NULL)
+        return 0;
+    ++ts->st.thread.steal_attempts;
+
+    /* find the busiest thread */
+    SLP_HEAD_LOCK();
+    for (t = ts->interp->tstate_head; t != NULL; t = t->next) {
+        if (t == ts || t->st.schedlock || t->st.main == NULL ||
+                t->st.initial_stub == NULL)
+            continue;
+        if (t->st.runcount > 1 &&
+                (victim == NULL || t->st.runcount > victim->st.runcount))
+            victim = t;
+    }
+    SLP_HEAD_UNLOCK();
+    if (victim == NULL)
+        return 0;
+
+    /* find the start of the batch, counting from the end of the queue */
+    want = (victim->st.runcount + 1) / 2;
+    task = victim->st.current->prev;
+    for (i = victim->st.runcount; i > 0 && n < want; i--, task = task->prev) {
+        if (is_tasklet_stealable(victim, task)) {
+            first = task;
+            n++;
+        }
+    }
+    if (n == 0)
+        return 0;
+
+    /* move the batch in queue order */
+    for (task = first, i = n; i > 0; task = first) {
+        first = task->next;
+        if (!is_tasklet_stealable(victim, task))
+            continue;
+        slp_current_remove_tasklet(task);   /* we keep the reference */
+        old = task->cstate;
+        task->cstate = ts->st.initial_stub;
+        Py_INCREF(task->cstate);
+        Py_DECREF(old);
+        slp_current_insert(task);           /* steals the reference */
+        i--;
+    }
+    ++ts->st.thread.steals;
+    ts->st.thread.tasklets_stolen += n;
+    victim->st.thread.tasklets_lost += n;
+    return n;
+}
+
 /* make sure that locks live longer than their threads */
 
 static void
@@ -634,50 +720,66 @@ Py_LOCAL_INLINE(void) SLP_UPDATE_TSTATE_ON_SWITCH(PyThreadState *tstate, PyTaskl
     /* And now the same for the trace and profile state:
      * - save the state form tstate to prev
      * - move the state from next to tstate
+     * A tasklet without a trace structure neither profiles nor traces.
+     * slp_schedule_task() allocated prev->trace, if tstate profiles or traces.
      */
-    assert(prev->profilefunc == NULL);
-    assert(prev->tracefunc == NULL);
-    assert(prev->profileobj == NULL);
-    assert(prev->traceobj == NULL);
-    assert(prev->tracing == 0);
-    if (tstate->c_profilefunc || next->profilefunc) {
-        prev->profilefunc = tstate->c_profilefunc;
-        prev->profileobj = tstate->c_profileobj;
-        Py_XINCREF(prev->profileobj);
-        if (prev->profileobj)
-            assert(Py_REFCNT(prev->profileobj) >= 2);  /* won't drop to zero in PyEval_SetProfile */
-        PyEval_SetProfile(next->profilefunc, next->profileobj);
-        next->profilefunc = NULL;
-        if (next->profileobj)
-            assert(Py_REFCNT(next->profileobj) >= 2);  /* won't drop to zero */
-        Py_CLEAR(next->profileobj);
+    assert(prev->trace == NULL || prev->trace->profilefunc == NULL);
+    assert(prev->trace == NULL || prev->trace->tracefunc == NULL);
+    assert(prev->trace == NULL || prev->trace->profileobj == NULL);
+    assert(prev->trace == NULL || prev->trace->traceobj == NULL);
+    assert(prev->trace == NULL || prev->trace->tracing == 0);
+    assert(prev->trace != NULL || (tstate->c_profilefunc == NULL && tstate->c_tracefunc == NULL));
+    if (tstate->c_profilefunc || (next->trace && next->trace->profilefunc)) {
+        if (prev->trace) {
+            prev->trace->profilefunc = tstate->c_profilefunc;
+            prev->trace->profileobj = tstate->c_profileobj;
+            Py_XINCREF(prev->trace->profileobj);
+            if (prev->trace->profileobj)
+                assert(Py_REFCNT(prev->trace->profileobj) >= 2);  /* won't drop to zero in PyEval_SetProfile */
+        }
+        if (next->trace) {
+            PyEval_SetProfile(next->trace->profilefunc, next->trace->profileobj);
+            next->trace->profilefunc = NULL;
+            if (next->trace->profileobj)
+                assert(Py_REFCNT(next->trace->profileobj) >= 2);  /* won't drop to zero */
+            Py_CLEAR(next->trace->profileobj);
+        } else {
+            PyEval_SetProfile(NULL, NULL);
+        }
     } else {
         /* If you use a Python profileobj, profilefunc is sysmodule.c profile_trampoline().
          * Therefore, if profilefunc is NULL, profileobj must be NULL too.
          */
         assert(tstate->c_profileobj == NULL);
-        assert(next->profileobj == NULL);
-    }
-    if (tstate->c_tracefunc || next->tracefunc) {
-        prev->tracefunc = tstate->c_tracefunc;
-        prev->traceobj = tstate->c_traceobj;
-        Py_XINCREF(prev->traceobj);
-        if (prev->traceobj)
-            assert(Py_REFCNT(prev->traceobj) >= 2);  /* won't drop to zero in PyEval_SetTrace */
-        prev->tracing = tstate->tracing;
-        tstate->tracing = next->tracing;
-        PyEval_SetTrace(next->tracefunc, next->traceobj);
-        next->tracefunc = NULL;
-        if (next->traceobj)
-            assert(Py_REFCNT(next->traceobj) >= 2);  /* won't drop to zero */
-        Py_CLEAR(next->traceobj);
-        next->tracing = 0;
+        assert(next->trace == NULL || next->trace->profileobj == NULL);
+    }
+    if (tstate->c_tracefunc || (next->trace && next->trace->tracefunc)) {
+        if (prev->trace) {
+            prev->trace->tracefunc = tstate->c_tracefunc;
+            prev->trace->traceobj = tstate->c_traceobj;
+            Py_XINCREF(prev->trace->traceobj);
+            if (prev->trace->traceobj)
+                assert(Py_REFCNT(prev->trace->traceobj) >= 2);  /* won't drop to zero in PyEval_SetTrace */
+            prev->trace->tracing = tstate->tracing;
+        }
+        if (next->trace) {
+            tstate->tracing = next->trace->tracing;
+            PyEval_SetTrace(next->trace->tracefunc, next->trace->traceobj);
+            next->trace->tracefunc = NULL;
+            if (next->trace->traceobj)
+                assert(Py_REFCNT(next->trace->traceobj) >= 2);  /* won't drop to zero */
+            Py_CLEAR(next->trace->traceobj);
+            next->trace->tracing = 0;
+        } else {
+            tstate->tracing = 0;
+            PyEval_SetTrace(NULL, NULL);
+        }
     } else {
         /* If you use a Python traceobj, tracefunc is sysmodule.c trace_trampoline().
          * Therefore, if tracefunc is NULL, traceobj must be NULL too.
          */
         assert(tstate->c_traceobj == NULL);
-        assert(next->traceobj == NULL);
+        assert(next->trace == NULL || next->trace->traceobj == NULL);
     }
 }
 #else
@@ -695,70 +797,142 @@ Py_LOCAL_INLINE(void) SLP_UPDATE_TSTATE_ON_SWITCH(PyThreadState *tstate, PyTaskl
         /* And now the same for the trace and profile state: */ \
         /* - save the state form tstate to prev */ \
         /* - move the state from next to tstate */ \
-        assert(prev__->profilefunc == NULL); \
-        assert(prev__->tracefunc == NULL); \
-        assert(prev__->profileobj == NULL); \
-        assert(prev__->traceobj == NULL); \
-        assert(prev__->tracing == 0); \
-        if (ts__->c_profilefunc || next__->profilefunc) { \
-            prev__->profilefunc = ts__->c_profilefunc; \
-            prev__->profileobj = ts__->c_profileobj; \
-            Py_XINCREF(prev__->profileobj); \
-            if (prev__->profileobj) \
-                assert(Py_REFCNT(prev__->profileobj) >= 2);  /* won't drop to zero in PyEval_SetProfile */ \
-            PyEval_SetProfile(next__->profilefunc, next__->profileobj); \
-            next__->profilefunc = NULL; \
-            if (next__->profileobj) \
-                assert(Py_REFCNT(next__->profileobj) >= 2);  /* won't drop to zero */ \
-            Py_CLEAR(next__->profileobj); \
+        PyTaskletTraceStruc *ptr__ = prev__->trace; \
+        PyTaskletTraceStruc *ntr__ = next__->trace; \
+        assert(ptr__ == NULL || ptr__->profilefunc == NULL); \
+        assert(ptr__ == NULL || ptr__->tracefunc == NULL); \
+        assert(ptr__ == NULL || ptr__->profileobj == NULL); \
+        assert(ptr__ == NULL || ptr__->traceobj == NULL); \
+        assert(ptr__ == NULL || ptr__->tracing == 0); \
+        assert(ptr__ != NULL || (ts__->c_profilefunc == NULL && ts__->c_tracefunc == NULL)); \
+        if (ts__->c_profilefunc || (ntr__ && ntr__->profilefunc)) { \
+            if (ptr__) { \
+                ptr__->profilefunc = ts__->c_profilefunc; \
+                ptr__->profileobj = ts__->c_profileobj; \
+                Py_XINCREF(ptr__->profileobj); \
+                if (ptr__->profileobj) \
+                    assert(Py_REFCNT(ptr__->profileobj) >= 2);  /* won't drop to zero in PyEval_SetProfile */ \
+            } \
+            if (ntr__) { \
+                PyEval_SetProfile(ntr__->profilefunc, ntr__->profileobj); \
+                ntr__->profilefunc = NULL; \
+                if (ntr__->profileobj) \
+                    assert(Py_REFCNT(ntr__->profileobj) >= 2);  /* won't drop to zero */ \
+                Py_CLEAR(ntr__->profileobj); \
+            } else { \
+                PyEval_SetProfile(NULL, NULL); \
+            } \
         } else { \
             /* If you use a Python profileobj, profilefunc is sysmodule.c profile_trampoline(). */ \
             /* Therefore, if profilefunc is NULL, profileobj must be NULL too. */ \
             assert(ts__->c_profileobj == NULL); \
-            assert(next__->profileobj == NULL); \
+            assert(ntr__ == NULL || ntr__->profileobj == NULL); \
         } \
-        if (ts__->c_tracefunc || next__->tracefunc) { \
-            prev__->tracefunc = ts__->c_tracefunc; \
-            prev__->traceobj = ts__->c_traceobj; \
-            Py_XINCREF(prev__->traceobj); \
-            if (prev__->traceobj) \
-                assert(Py_REFCNT(prev__->traceobj) >= 2);  /* won't drop to zero in PyEval_SetTrace */ \
-            prev__->tracing = ts__->tracing; \
-            ts__->tracing = next__->tracing; \
-            PyEval_SetTrace(next__->tracefunc, next__->traceobj); \
-            next__->tracefunc = NULL; \
-            if (next__->traceobj) \
-                assert(Py_REFCNT(next__->traceobj) >= 2);  /* won't drop to zero */ \
-            Py_CLEAR(next__->traceobj); \
-            next__->tracing = 0; \
+        if (ts__->c_tracefunc || (ntr__ && ntr__->tracefunc)) { \
+            if (ptr__) { \
+                ptr__->tracefunc = ts__->c_tracefunc; \
+                ptr__->traceobj = ts__->c_traceobj; \
+                Py_XINCREF(ptr__->traceobj); \
+                if (ptr__->traceobj) \
+                    assert(Py_REFCNT(ptr__->traceobj) >= 2);  /* won't drop to zero in PyEval_SetTrace */ \
+                ptr__->tracing = ts__->tracing; \
+            } \
+            if (ntr__) { \
+                ts__->tracing = ntr__->tracing; \
+                PyEval_SetTrace(ntr__->tracefunc, ntr__->traceobj); \
+                ntr__->tracefunc = NULL; \
+                if (ntr__->traceobj) \
+                    assert(Py_REFCNT(ntr__->traceobj) >= 2);  /* won't drop to zero */ \
+                Py_CLEAR(ntr__->traceobj); \
+                ntr__->tracing = 0; \
+            } else { \
+                ts__->tracing = 0; \
+                PyEval_SetTrace(NULL, NULL); \
+            } \
         } else { \
             /* If you use a Python traceobj, tracefunc is sysmodule.c trace_trampoline(). */ \
             /* Therefore, if tracefunc is NULL, traceobj must be NULL too. */ \
             assert(ts__->c_traceobj == NULL); \
-            assert(next__->traceobj == NULL); \
+            assert(ntr__ == NULL || ntr__->traceobj == NULL); \
         } \
     } while(0)
 #endif
 
-static int schedule_thread_block(PyThreadState *ts)
+/* Before a blocked thread goes to sleep in the kernel, it polls its lock
+ * for SLP_THREAD_SPIN_TIME nanoseconds without the GIL. A thread, that gets
+ * unblocked quickly (e.g. the reply of a cross-thread channel operation),
+ * avoids the latency of the kernel wakeup. Polling the lock is a single
+ * atomic operation for the common lock implementations.
+ */
+static PyLockStatus
+thread_block_spin(PyThread_type_lock lock, _PyTime_t timeout)
 {
+    _PyTime_t deadline = _PyTime_GetMonotonicClock();
+
+    if (timeout >= 0)
+        deadline += Py_MIN(timeout, SLP_THREAD_SPIN_TIME);
+    else
+        deadline += SLP_THREAD_SPIN_TIME;
+    do {
+        if (PyThread_acquire_lock_timed(lock, 0, 0) == PY_LOCK_ACQUIRED)
+            return PY_LOCK_ACQUIRED;
+#ifdef HAVE_SCHED_H
+        sched_yield();
+#endif
+    } while (_PyTime_GetMonotonicClock() < deadline);
+    return PY_LOCK_FAILURE;
+}
+
+/* Block the thread until another thread unblocks it. A timeout >= 0 limits
+ * the time to wait (in nanoseconds). Such a wait can be interrupted by a
+ * signal. */
+static int schedule_thread_block(PyThreadState *ts, _PyTime_t timeout)
+{
+    PyLockStatus r;
+    PY_TIMEOUT_T microseconds = -1;
+
     assert(!ts->st.thread.is_blocked);
     assert(ts->st.runcount == 0);
+    if (SLP_REACTOR_PENDING(ts)) {
+        /* wait for the file descriptors, see schedule_thread_unblock() */
+        int n;
+
+        ts->st.thread.is_blocked = 1;
+        ts->st.thread.is_idle = 1;
+        n = slp_reactor_poll(ts, timeout);
+        ts->st.thread.is_idle = 0;
+        ts->st.thread.is_blocked = 0;
+        return n < 0 ? -1 : 0;
+    }
     /* create on demand the lock we use to block */
     if (ts->st.thread.block_lock == NULL) {
         if (!(ts->st.thread.block_lock = new_lock()))
             return -1;
         acquire_lock(ts->st.thread.block_lock, 1);
     }
+    if (timeout >= 0) {
+        microseconds = _PyTime_AsMicroseconds(timeout, _PyTime_ROUND_CEILING);
+        if (microseconds > PY_TIMEOUT_MAX)
+            microseconds = PY_TIMEOUT_MAX;
+    }
 
     /* block */
     ts->st.thread.is_blocked = 1;
     ts->st.thread.is_idle = 1;
     Py_BEGIN_ALLOW_THREADS
-    acquire_lock(ts->st.thread.block_lock, 1);
+    r = thread_block_spin(get_lock(ts->st.thread.block_lock), timeout);
+    if (r != PY_LOCK_ACQUIRED && timeout != 0)
+        r = PyThread_acquire_lock_timed(get_lock(ts->st.thread.block_lock),
+                                        microseconds, timeout >= 0);
     Py_END_ALLOW_THREADS
     ts->st.thread.is_idle = 0;
-
+    if (r != PY_LOCK_ACQUIRED) {
+        if (ts->st.thread.is_blocked)
+            ts->st.thread.is_blocked = 0;
+        else
+            /* unblocked after the timeout: consume the release */
+            acquire_lock(ts->st.thread.block_lock, 0);
+    }
 
     return 0;
 }
@@ -767,7 +941,10 @@ static void schedule_thread_unblock(PyThreadState *nts)
 {
     if (nts->st.thread.is_blocked) {
         nts->st.thread.is_blocked = 0;
-        release_lock(nts->st.thread.block_lock);
+        if (nts->st.reactor != NULL && nts->st.reactor->polling)
+            slp_reactor_wakeup(nts);
+        else
+            release_lock(nts->st.thread.block_lock);
     }
 }
 
@@ -776,6 +953,36 @@ void slp_thread_unblock(PyThreadState *nts)
     schedule_thread_unblock(nts);
 }
 
+/* Wait for waiting tasklets of this thread (see SLP_TASKLETS_WAITING()) to
+ * wake up, unless there is a runnable tasklet. Another thread can insert a
+ * tasklet meanwhile. Return 1, if there is a runnable tasklet, 0, if no
+ * tasklet waits and -1 on error (e.g. KeyboardInterrupt).
+ */
+static int
+wait_for_timers(PyThreadState *ts, PyTaskletObject *prev)
+{
+    _PyTime_t next, timeout;
+    int fail;
+
+    while (ts->st.current == NULL && SLP_TASKLETS_WAITING(ts)) {
+        if (slp_timer_poll(ts))
+            break;
+        next = slp_timer_next(ts);
+        timeout = next < 0 ? -1 : Py_MAX(next - _PyTime_GetMonotonicClock(), 0);
+        /* see schedule_task_block() */
+        if (prev != NULL && prev->f.frame == NULL) {
+            prev->f.frame = ts->frame;
+            Py_XINCREF(prev->f.frame);
+            fail = schedule_thread_block(ts, timeout);
+            Py_CLEAR(prev->f.frame);
+        } else
+            fail = schedule_thread_block(ts, timeout);
+        if (fail || PyErr_CheckSignals())
+            return -1;
+    }
+    return ts->st.current != NULL;
+}
+
 static int
 schedule_task_block(PyObject **result, PyTaskletObject *prev, int stackless, int *did_switch)
 {
@@ -788,13 +995,28 @@ schedule_task_block(PyObject **result, PyTaskletObject *prev, int stackless, int
     /* which "main" do we awaken if we are blocking? */
     wakeup = slp_get_watchdog(ts, 0);
 
-    if ( !(ts->st.runflags & Py_WATCHDOG_THREADBLOCK) && wakeup->next == NULL)
+    if ( !(ts->st.runflags & Py_WATCHDOG_THREADBLOCK) && SLP_TASKLET_FLOATING(wakeup))
         /* we also must never block if watchdog is running not in threadblocking mode */
         revive_main = 1;
 
     if (revive_main)
         assert(wakeup->next == NULL); /* target must be floating */
 
+    if (steal_tasklets(ts)) {
+        /* we are not idle any longer */
+        next = ts->st.current;
+        Py_INCREF(next);
+        goto run_next;
+    }
+    /* sleeping tasklets wake up later, this is no deadlock */
+    fail = wait_for_timers(ts, prev);
+    if (fail < 0)
+        return fail;
+    if (fail) {
+        next = ts->st.current;
+        Py_INCREF(next);
+        goto run_next;
+    }
     if (revive_main || check_for_deadlock()) {
         goto cantblock;
     }
@@ -805,16 +1027,18 @@ schedule_task_block(PyObject **result, PyTaskletObject *prev, int stackless, int
         if (prev->f.frame == 0) {
             prev->f.frame = ts->frame;
             Py_XINCREF(prev->f.frame);
-            fail = schedule_thread_block(ts);
+            fail = schedule_thread_block(ts, -1);
             Py_CLEAR(prev->f.frame);
         } else
-            fail = schedule_thread_block(ts);
+            fail = schedule_thread_block(ts, -1);
         if (fail)
             return fail;
 
         /* We should have a "current" tasklet, but it could have been removed
          * by the other thread in the time this thread reacquired the gil.
          */
+        if (ts->st.current == NULL)
+            steal_tasklets(ts);
         next = ts->st.current;
         if (next) {
             /* don't "remove" it because that will make another tasklet "current" */
@@ -824,6 +1048,7 @@ schedule_task_block(PyObject **result, PyTaskletObject *prev, int stackless, int
         if (check_for_deadlock())
             goto cantblock;
     }
+run_next:
     /* this must be after releasing the locks because of hard switching */
     fail = slp_schedule_task(result, prev, next, stackless, did_switch);
     Py_DECREF(next);
@@ -842,7 +1067,7 @@ schedule_task_block(PyObject **result, PyTaskletObject *prev, int stackless, int
 
 cantblock:
     /* cannot block */
-    if (revive_main || (ts == SLP_INITIAL_TSTATE(ts) && wakeup->next == NULL)) {
+    if (revive_main || (ts == SLP_INITIAL_TSTATE(ts) && SLP_TASKLET_FLOATING(wakeup))) {
         /* emulate old revive_main behavior:
          * passing a value only if it is an exception
          */
@@ -912,7 +1137,6 @@ schedule_task_interthread(PyObject **result,
 static void slp_schedule_soft_irq(PyThreadState *ts, PyTaskletObject *prev,
                                                    PyTaskletObject **next, int not_now)
 {
-    PyTaskletObject *tmp;
     PyTaskletObject *watchdog;
     assert(*next);
     if(!prev->flags.pending_irq || !(ts->st.runflags & PY_WATCHDOG_SOFT) )
@@ -944,11 +1168,8 @@ static void slp_schedule_soft_irq(PyThreadState *ts, PyTaskletObject *prev,
     /* restore main.  insert it before the old next, so that the old next get
      * run after it
      */
-    tmp = ts->st.current;
-    ts->st.current = *next;
-    slp_current_insert(watchdog);
+    slp_current_insert_before(watchdog, *next);
     Py_INCREF(watchdog);
-    ts->st.current = tmp;
 
     *next = watchdog;
 }
@@ -975,6 +1196,13 @@ slp_schedule_task(PyObject **result, PyTaskletObject *prev, PyTaskletObject *nex
     if (did_switch)
         *did_switch = 0; /* only set this if an actual switch occurs */
 
+    /* wake up sleeping tasklets */
+    if (SLP_TIMERS_PENDING(ts))
+        slp_timer_poll(ts);
+    /* wake up tasklets with ready file descriptors */
+    if (SLP_REACTOR_POLL_DUE(ts) && slp_reactor_poll(ts, 0) < 0)
+        return -1;
+
     if (next == NULL)
         return schedule_task_block(result, prev, stackless, did_switch);
 
@@ -996,6 +1224,12 @@ slp_schedule_task(PyObject **result, PyTaskletObject *prev, PyTaskletObject *nex
         }
     }
 
+    /* make room to save the profile and tracing state of prev */
+    if (prev != next && prev->trace == NULL &&
+            (ts->c_profilefunc != NULL || ts->c_tracefunc != NULL) &&
+            slp_tasklet_trace_new(prev))
+        return -1;
+
     /* prepare the new tasklet */
     if (next->flags.blocked) {
         /* unblock from channel */
@@ -1025,6 +1259,63 @@ slp_schedule_task(PyObject **result, PyTaskletObject *prev, PyTaskletObject *nex
     return fail;
 }
 
+/* Make next the current tasklet and keep the run queue sorted.
+ *
+ * Switching to a tasklet, that is not the first one of the queue, rotates
+ * the chain. Unless all queued tasklets are equal with respect to
+ * SLP_TASKLET_PRECEDES(), we move next to the front of the queue first.
+ * If prev stays runnable, it then leaves the head of the chain and goes to
+ * its place in the queue.
+ */
+static void
+set_current(PyThreadState *ts, PyTaskletObject *prev, PyTaskletObject *next)
+{
+    PyTaskletObject *head = ts->st.current, *first, *last;
+
+    if (head != NULL && next->next != NULL && !next->flags.blocked &&
+            next->cstate->tstate == ts) {
+        first = head == prev ? head->next : head;
+        last = head->prev;
+        if (next != first && SLP_TASKLET_PRECEDES(first, last)) {
+            slp_current_remove_tasklet(next);   /* we keep the reference */
+            if (head == prev)
+                slp_current_insert_after(next);
+            else
+                slp_current_insert_before(next, head);
+        }
+    }
+    ts->st.current = next;
+    ts->st.switch_target = NULL;
+    /* snapshot.c tells by this count, whether a tasklet ran */
+    next->nswitches++;
+    /* a sleeping tasklet, that runs for some other reason, is awake */
+    if (next->timer != NULL)
+        slp_timer_cancel(next);
+    if (next->io_fd >= 0)
+        slp_reactor_cancel(next);
+    if (next->job != NULL)
+        slp_thread_job_abandon(next);
+    if (prev->next != NULL && !prev->flags.blocked &&
+            prev->cstate != NULL && prev->cstate->tstate == ts)
+        slp_current_requeue(prev);
+}
+
+/* The number of bytes of C-stack, that slp_transfer() copies back to
+ * resume the C-state cst, or 0, if unknown. In the separate stack mode a
+ * C-state usually gets resumed in place, see slp_transfer.c. */
+static Py_ssize_t
+hard_switch_cstack_size(PyThreadState *ts, PyCStackObject *cst)
+{
+    if (ts->interp->st.enable_separate_stacks ||
+            ts->st.cstack_region != NULL || ts->st.cstack_inplace != NULL)
+        return 0;
+    if (cst == NULL || Py_SIZE(cst) == 0)
+        cst = ts->st.initial_stub;
+    if (cst == NULL || cst->region != NULL || cst->inplace)
+        return 0;
+    return Py_SIZE(cst) * (Py_ssize_t)sizeof(intptr_t);
+}
+
 static int
 slp_schedule_task_prepared(PyThreadState *ts, PyObject **result, PyTaskletObject *prev, PyTaskletObject *next, int stackless,
                   int *did_switch)
@@ -1047,10 +1338,16 @@ slp_schedule_task_prepared(PyThreadState *ts, PyObject **result, PyTaskletObject
         return 0;
     }
 
+    /* a tasklet creates its initial frame, when it runs for the first time */
+    if (SLP_TASKLET_UNSTARTED(next) && slp_tasklet_create_frame(next))
+        return -1;
+
+    /* code below may release the GIL, protect next from work stealing */
+    ts->st.switch_target = next;
     NOTIFY_SCHEDULE(ts, prev, next, -1);
 
     if (!(ts->st.runflags & PY_WATCHDOG_TOTALTIMEOUT))
-        ts->st.tick_watermark = ts->st.tick_counter + ts->st.interval; /* reset timeslice */
+        SLP_RESET_TIMESLICE(ts);
     prev->recursion_depth = ts->recursion_depth;
     /* avoid a ref leak of the old value of prev->f.frame */
     assert(prev->f.frame == NULL);
@@ -1118,9 +1415,11 @@ slp_schedule_task_prepared(PyThreadState *ts, PyObject **result, PyTaskletObject
             retval = slp_bomb_explode(retval);
     }
     /* no failure possible from here on */
+    SLP_TRACE(ts, SLP_TRACE_SWITCH, 0, prev, next, NULL, 0);
+    SLP_TASKLET_STATS_SWITCH(ts, prev, next, 0);
     SLP_UPDATE_TSTATE_ON_SWITCH(ts, prev, next);
     ts->recursion_depth = next->recursion_depth;
-    ts->st.current = next;
+    set_current(ts, prev, next);
     if (did_switch)
         *did_switch = 1;
     *result = STACKLESS_PACK(ts, retval);
@@ -1133,7 +1432,11 @@ hard_switching:
     /* note: nesting_level is handled in cstack_new */
     cstprev = &prev->cstate;
 
-    ts->st.current = next;
+    SLP_TRACE(ts, SLP_TRACE_SWITCH, SLP_TRACE_HARD, prev, next, NULL,
+              hard_switch_cstack_size(ts, next->cstate));
+    SLP_TASKLET_STATS_SWITCH(ts, prev, next, 1);
+
+    set_current(ts, prev, next);
 
     ts->recursion_depth = next->recursion_depth;
     SLP_STORE_NEXT_FRAME(ts, next->f.frame);
@@ -1292,10 +1595,7 @@ schedule_task_destruct(PyObject **retval, PyTaskletObject *prev, PyTaskletObject
         if (!fail) {
             assert(switched);
             /* clear tracing and profiling state for compatibility with Stackless versions < 3.8 */
-            prev->profilefunc = prev->tracefunc = NULL;
-            prev->tracing = 0;
-            Py_CLEAR(prev->profileobj);
-            Py_CLEAR(prev->traceobj);
+            slp_tasklet_trace_clear(prev);
         }
         if (fail) {
             /* something happened, cancel our decref manipulations. */
@@ -1383,6 +1683,9 @@ slp_tasklet_end(PyObject *retval)
         }
     }
 
+    if (!ismain && SLP_TASKLET_STATS_ENABLED(ts->interp))
+        slp_tasklet_stats_end(ts, task);
+
     /*
      * put the result back into the dead tasklet, to be retrieved
      * by schedule_task_destruct(), or cleared there
@@ -1444,6 +1747,19 @@ slp_tasklet_end(PyObject *retval)
     }
 
     next = ts->st.current;
+    if (next == NULL && !PyBomb_Check(retval) && steal_tasklets(ts))
+        next = ts->st.current;
+    if (next == NULL && !PyBomb_Check(retval) && SLP_TASKLETS_WAITING(ts)) {
+        if (wait_for_timers(ts, NULL) < 0) {
+            /* wake up the watchdog with the error */
+            PyObject *bomb = slp_curexc_to_bomb();
+            if (bomb == NULL)
+                bomb = slp_nomemory_bomb();
+            Py_SETREF(retval, bomb);
+            TASKLET_SETVAL(task, retval);
+        }
+        next = ts->st.current;
+    }
     if (next == NULL) {
         /* there is no current tasklet to wakeup.  Must wakeup watchdog or main */
         PyTaskletObject *wakeup = slp_get_watchdog(ts, 0);
@@ -248,6 +248,9 @@ PyStackless_Schedule(PyObject *retval, int remove)
 
     assert(prev);
     next = prev->next;
+    /* a tasklet that precedes all other runnable tasklets keeps running */
+    if (!remove && SLP_TASKLET_PRECEDES(prev, next))
+        next = prev;
     /* make sure we hold a reference to the previous tasklet.
      * this will be decrefed after the switch is complete
      */
@@ -320,6 +323,332 @@ schedule_remove(PyObject *self, PyObject *args, PyObject *kwds)
     return PyStackless_Schedule(retval, 1);
 }
 
+static PyObject *
+sleep_main(PyObject *self, PyObject *args);
+
+/* suspend the current tasklet for timeout nanoseconds */
+static PyObject *
+impl_sleep(_PyTime_t timeout)
+{
+    STACKLESS_GETARG();
+    PyThreadState *ts = _PyThreadState_GET();
+    PyTaskletObject *current = ts->st.current;
+    PyObject *ret;
+
+    if (ts->st.main == NULL) {
+        PyMethodDef def = {"sleep", (PyCFunction)sleep_main, METH_VARARGS};
+        return PyStackless_CallCMethod_Main(&def, NULL, "L", (long long)timeout);
+    }
+    if (timeout == 0) {
+        /* just give the other tasklets a chance */
+        STACKLESS_PROMOTE_ALL();
+        return PyStackless_Schedule(Py_None, 0);
+    }
+    if (current->flags.block_trap)
+        RUNTIME_ERROR("this tasklet does not like to be blocked.", NULL);
+    if (slp_timer_add(ts, current, _PyTime_GetMonotonicClock() + timeout, NULL))
+        return NULL;
+    STACKLESS_PROMOTE_ALL();
+    ret = PyStackless_Schedule(Py_None, 1);
+    if (ret == NULL && current->timer != NULL)
+        slp_timer_cancel(current);
+    return ret;
+}
+
+static PyObject *
+sleep_main(PyObject *self, PyObject *args)
+{
+    long long timeout;
+
+    if (!PyArg_ParseTuple(args, "L:sleep", &timeout))
+        return NULL;
+    return impl_sleep((_PyTime_t)timeout);
+}
+
+PyObject *
+PyStackless_Sleep(double seconds)
+{
+    STACKLESS_GETARG();
+    _PyTime_t timeout;
+
+    PyObject *obj;
+    int fail;
+
+    if (!(seconds >= 0.0)) {
+        PyErr_SetString(PyExc_ValueError, "sleep length must be non-negative");
+        return NULL;
+    }
+    if ((obj = PyFloat_FromDouble(seconds)) == NULL)
+        return NULL;
+    fail = _PyTime_FromSecondsObject(&timeout, obj, _PyTime_ROUND_CEILING);
+    Py_DECREF(obj);
+    if (fail)
+        return NULL;
+    STACKLESS_PROMOTE_ALL();
+    return impl_sleep(timeout);
+}
+
+PyObject *
+PyStackless_Sleep_nr(double seconds)
+{
+    PyThreadState *ts = _PyThreadState_GET();
+    STACKLESS_PROPOSE_ALL(ts);
+    return PyStackless_Sleep(seconds);
+}
+
+PyDoc_STRVAR(sleep__doc__,
+"sleep(seconds) -- suspend the current tasklet for the given number of seconds.\n\
+The other tasklets of the thread continue to run. If there is no other\n\
+runnable tasklet, the thread sleeps until the next tasklet wakes up.\n\
+sleep(0) is the same as schedule().");
+
+static PyObject *
+stackless_sleep(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    STACKLESS_GETARG();
+    PyObject *seconds;
+    _PyTime_t timeout;
+    static char *argnames[] = {"seconds", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O:sleep",
+        argnames, &seconds))
+    {
+        return NULL;
+    }
+    if (_PyTime_FromSecondsObject(&timeout, seconds, _PyTime_ROUND_CEILING))
+        return NULL;
+    if (timeout < 0) {
+        PyErr_SetString(PyExc_ValueError, "sleep length must be non-negative");
+        return NULL;
+    }
+    STACKLESS_PROMOTE_ALL();
+    return impl_sleep(timeout);
+}
+
+static PyObject *
+wait_fd_main(PyObject *self, PyObject *args);
+
+/* suspend the current tasklet until fd is ready or timeout nanoseconds
+ * passed */
+static PyObject *
+impl_wait_fd(int fd, int events, _PyTime_t timeout)
+{
+    STACKLESS_GETARG();
+    PyThreadState *ts = _PyThreadState_GET();
+    PyTaskletObject *current = ts->st.current;
+    PyObject *ret;
+
+    if (ts->st.main == NULL) {
+        PyMethodDef def = {"wait_fd", (PyCFunction)wait_fd_main, METH_VARARGS};
+        return PyStackless_CallCMethod_Main(&def, NULL, "iiL", fd, events,
+                                            (long long)timeout);
+    }
+    if (current->flags.block_trap)
+        RUNTIME_ERROR("this tasklet does not like to be blocked.", NULL);
+    if (slp_reactor_register(ts, current, fd, events, timeout))
+        return NULL;
+    STACKLESS_PROMOTE_ALL();
+    ret = PyStackless_Schedule(Py_None, 1);
+    if (ret == NULL) {
+        if (current->io_fd >= 0)
+            slp_reactor_cancel(current);
+        if (current->timer != NULL)
+            slp_timer_cancel(current);
+    }
+    return ret;
+}
+
+static PyObject *
+wait_fd_main(PyObject *self, PyObject *args)
+{
+    int fd, events;
+    long long timeout;
+
+    if (!PyArg_ParseTuple(args, "iiL:wait_fd", &fd, &events, &timeout))
+        return NULL;
+    return impl_wait_fd(fd, events, (_PyTime_t)timeout);
+}
+
+static PyObject *
+wait_fd_seconds(int fd, int events, double seconds)
+{
+    STACKLESS_GETARG();
+    _PyTime_t timeout = -1;
+    PyObject *obj;
+    int fail;
+
+    if (seconds >= 0.0) {
+        if ((obj = PyFloat_FromDouble(seconds)) == NULL)
+            return NULL;
+        fail = _PyTime_FromSecondsObject(&timeout, obj, _PyTime_ROUND_CEILING);
+        Py_DECREF(obj);
+        if (fail)
+            return NULL;
+    }
+    STACKLESS_PROMOTE_ALL();
+    return impl_wait_fd(fd, events, timeout);
+}
+
+PyObject *
+PyStackless_WaitReadable(int fd, double timeout)
+{
+    STACKLESS_GETARG();
+    STACKLESS_PROMOTE_ALL();
+    return wait_fd_seconds(fd, SLP_REACTOR_READ, timeout);
+}
+
+PyObject *
+PyStackless_WaitWritable(int fd, double timeout)
+{
+    STACKLESS_GETARG();
+    STACKLESS_PROMOTE_ALL();
+    return wait_fd_seconds(fd, SLP_REACTOR_WRITE, timeout);
+}
+
+static PyObject *
+stackless_wait_fd(PyObject *args, PyObject *kwds, int events,
+                  const char *format)
+{
+    STACKLESS_GETARG();
+    PyObject *file, *seconds = Py_None;
+    _PyTime_t timeout = -1;
+    int fd;
+    static char *argnames[] = {"fd", "timeout", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, format,
+        argnames, &file, &seconds))
+    {
+        return NULL;
+    }
+    if ((fd = PyObject_AsFileDescriptor(file)) < 0)
+        return NULL;
+    if (seconds != Py_None) {
+        if (_PyTime_FromSecondsObject(&timeout, seconds, _PyTime_ROUND_CEILING))
+            return NULL;
+        if (timeout < 0) {
+            PyErr_SetString(PyExc_ValueError, "timeout must be non-negative");
+            return NULL;
+        }
+    }
+    STACKLESS_PROMOTE_ALL();
+    return impl_wait_fd(fd, events, timeout);
+}
+
+PyDoc_STRVAR(wait_readable__doc__,
+"wait_readable(fd, timeout=None) -- suspend the current tasklet until the file\n\
+descriptor fd is readable. fd is an integer or an object with a fileno()\n\
+method. Returns True, if fd is ready, or False, if timeout seconds passed.\n\
+The other tasklets of the thread continue to run. If there is no other\n\
+runnable tasklet, the thread waits for its file descriptors and timers.");
+
+static PyObject *
+stackless_wait_readable(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    STACKLESS_GETARG();
+    STACKLESS_PROMOTE_ALL();
+    return stackless_wait_fd(args, kwds, SLP_REACTOR_READ, "O|O:wait_readable");
+}
+
+PyDoc_STRVAR(wait_writable__doc__,
+"wait_writable(fd, timeout=None) -- suspend the current tasklet until the file\n\
+descriptor fd is writable. See wait_readable().");
+
+static PyObject *
+stackless_wait_writable(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    STACKLESS_GETARG();
+    STACKLESS_PROMOTE_ALL();
+    return stackless_wait_fd(args, kwds, SLP_REACTOR_WRITE, "O|O:wait_writable");
+}
+
+PyDoc_STRVAR(run_in_thread__doc__,
+"run_in_thread(func, *args, **kwargs) -- call func(*args, **kwargs) in a\n\
+worker thread and return the result. The current tasklet waits for the\n\
+call, the other tasklets of the thread continue to run. Exceptions of the\n\
+call propagate to the caller. See set_thread_pool_size().");
+
+static PyObject *
+stackless_run_in_thread(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    STACKLESS_GETARG();
+    PyObject *func, *fargs, *ret;
+
+    if (PyTuple_GET_SIZE(args) < 1)
+        TYPE_ERROR("run_in_thread() needs a callable argument", NULL);
+    func = PyTuple_GET_ITEM(args, 0);
+    if ((fargs = PyTuple_GetSlice(args, 1, PyTuple_GET_SIZE(args))) == NULL)
+        return NULL;
+    STACKLESS_PROMOTE_ALL();
+    ret = PyStackless_RunInThread(func, fargs, kwds);
+    STACKLESS_ASSERT();
+    Py_DECREF(fargs);
+    return ret;
+}
+
+PyDoc_STRVAR(set_thread_pool_size__doc__,
+"set_thread_pool_size(size) -- set the maximum number of worker threads of\n\
+run_in_thread() and return the previous size. Calls wait for a free worker,\n\
+if all workers are busy. Surplus workers exit, when they become idle.");
+
+static PyObject *
+set_thread_pool_size(PyObject *self, PyObject *arg)
+{
+    int size = _PyLong_AsInt(arg);
+
+    if (size == -1 && PyErr_Occurred())
+        return NULL;
+    size = PyStackless_SetThreadPoolSize(size);
+    if (size == -1)
+        return NULL;
+    return PyLong_FromLong(size);
+}
+
+PyDoc_STRVAR(spawn_many__doc__,
+"spawn_many(func, iterable) -- create a tasklet for each item of iterable,\n\
+bind it to func with the item as arguments and schedule it. Returns the list\n\
+of the new tasklets. Equivalent to [tasklet(func)(*args) for args in iterable],\n\
+but faster. If an error occurs, no tasklet gets scheduled.");
+
+static PyObject *
+spawn_many(PyObject *self, PyObject *args)
+{
+    PyObject *func, *iterable;
+
+    if (!PyArg_ParseTuple(args, "OO:spawn_many", &func, &iterable))
+        return NULL;
+    return PyTasklet_SpawnMany(func, iterable);
+}
+
+PyDoc_STRVAR(select__doc__,
+"select(cases, timeout=None) -- wait for the first of several channel operations.\n\
+cases is a sequence of tuples (channel, 'recv') or (channel, 'send', value).\n\
+Returns a tuple (index, value) for the completed operation: the index of the\n\
+case and the received value or None. If timeout is not None, returns None\n\
+after timeout seconds without a completed operation.");
+
+static PyObject *
+stackless_select(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *cases, *seconds = Py_None;
+    _PyTime_t timeout = -1;
+    static char *argnames[] = {"cases", "timeout", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O:select",
+        argnames, &cases, &seconds))
+    {
+        return NULL;
+    }
+    if (seconds != Py_None) {
+        if (_PyTime_FromSecondsObject(&timeout, seconds, _PyTime_ROUND_CEILING))
+            return NULL;
+        if (timeout < 0) {
+            PyErr_SetString(PyExc_ValueError, "timeout must be non-negative");
+            return NULL;
+        }
+    }
+    return slp_channel_select(cases, timeout);
+}
+
 
 PyDoc_STRVAR(getruncount__doc__,
 "getruncount() -- return the number of runnable tasklets.");
@@ -440,9 +769,379 @@ enable_softswitch(PyObject *self, PyObject *flag)
 }
 
 
+PyDoc_STRVAR(enable_separate_stacks__doc__,
+"enable_separate_stacks(flag) -- control the hard switching behavior.\n"
+"If enabled, a tasklet that gets hard switched keeps its C stack in place\n"
+"on a separate stack region, instead of copying the C stack slice\n"
+"around. Switching back to the tasklet only exchanges the stack pointer.\n"
+"This flag exists once for each interpreter.\n"
+"For inquiry only, use 'None' as the flag.\n"
+"By default, separate stacks are disabled. Enabling them raises\n"
+"RuntimeError, if the platform does not support separate stacks.");
+
+static PyObject *
+enable_separate_stacks(PyObject *self, PyObject *flag)
+{
+    PyThreadState *ts = _PyThreadState_GET();
+    PyObject *ret;
+    int newflag;
+    if (!flag || flag == Py_None)
+        return PyBool_FromLong(ts->interp->st.enable_separate_stacks);
+    newflag = PyObject_IsTrue(flag);
+    if (newflag == -1 && PyErr_Occurred())
+        return NULL;
+    if (newflag && !slp_separate_stacks_available())
+        RUNTIME_ERROR("separate stacks are not supported on this platform",
+                      NULL);
+    ret = PyBool_FromLong(ts->interp->st.enable_separate_stacks);
+    ts->interp->st.enable_separate_stacks = !!newflag;
+    return ret;
+}
+
+
+PyDoc_STRVAR(enable_work_stealing__doc__,
+"enable_work_stealing(flag) -- control the scheduling across threads.\n"
+"If enabled, a thread that runs out of runnable tasklets takes runnable\n"
+"tasklets from the run queue of the busiest other thread, before it blocks\n"
+"or returns from stackless.run(). Only tasklets without C state move to\n"
+"another thread.\n"
+"This flag exists once for each interpreter.\n"
+"For inquiry only, use 'None' as the flag.\n"
+"By default, work stealing is disabled.");
+
+static PyObject *
+enable_work_stealing(PyObject *self, PyObject *flag)
+{
+    PyThreadState *ts = _PyThreadState_GET();
+    PyObject *ret;
+    int newflag;
+    if (!flag || flag == Py_None)
+        return PyBool_FromLong(ts->interp->st.enable_work_stealing);
+    newflag = PyObject_IsTrue(flag);
+    if (newflag == -1 && PyErr_Occurred())
+        return NULL;
+    ret = PyBool_FromLong(ts->interp->st.enable_work_stealing);
+    ts->interp->st.enable_work_stealing = !!newflag;
+    return ret;
+}
+
+
+PyDoc_STRVAR(get_work_stealing_info__doc__,
+"get_work_stealing_info(thread_id) -- return a dictionary with the work\n"
+"stealing statistics of a thread. The keys are:\n"
+"'attempts': how often the thread looked for tasklets to steal\n"
+"'steals': how often the thread actually stole tasklets\n"
+"'stolen': the number of tasklets the thread stole from other threads\n"
+"'lost': the number of tasklets other threads stole from this thread\n"
+"If thread_id is omitted, return the statistics of the current thread.");
+
+static PyObject *
+get_work_stealing_info(PyObject *self, PyObject *args)
+{
+    PyThreadState *ts = _PyThreadState_GET();
+    PyInterpreterState *interp = ts->interp;
+    PyObject *thread_id = NULL;
+    unsigned long id = 0;
+    long id_is_valid;
+
+    if (!PyArg_ParseTuple(args, "|O!:get_work_stealing_info", &PyLong_Type, &thread_id))
+        return NULL;
+    id_is_valid = slp_parse_thread_id(thread_id, &id);
+    if (!id_is_valid)
+        return NULL;
+    if (id_is_valid == 1 && thread_id != NULL) {
+        SLP_HEAD_LOCK();
+        for (ts = interp->tstate_head; ts != NULL; ts = ts->next) {
+            if (ts->thread_id == id)
+                break;
+        }
+        SLP_HEAD_UNLOCK();
+        if (ts == NULL)
+            RUNTIME_ERROR("Thread id not found", NULL);
+    }
+    return Py_BuildValue("{s:n,s:n,s:n,s:n}",
+        "attempts", ts->st.thread.steal_attempts,
+        "steals", ts->st.thread.steals,
+        "stolen", ts->st.thread.tasklets_stolen,
+        "lost", ts->st.thread.tasklets_lost);
+}
+
+
+int
+PyStackless_EnableTaskletStats(int flag)
+{
+    PyInterpreterState *interp = _PyInterpreterState_Get();
+    int old = interp->st.enable_tasklet_stats;
+#if SLP_WITH_TASKLET_STATS
+    PyThreadState *ts;
+    _PyTime_t now;
+
+    if (flag < 0 || !flag == !old)
+        return old;
+    /* start or end the timeslices of the current tasklets */
+    now = _PyTime_GetMonotonicClock();
+    SLP_HEAD_LOCK();
+    for (ts = interp->tstate_head; ts != NULL; ts = ts->next) {
+        PyTaskletObject *current = ts->st.current;
+        if (current == NULL)
+            continue;
+        if (flag)
+            current->stats.run_start = now;
+        else if (current->stats.run_start != 0) {
+            current->stats.run_time += now - current->stats.run_start;
+            current->stats.run_start = 0;
+        }
+    }
+    SLP_HEAD_UNLOCK();
+    if (flag)
+        interp->st.tasklet_stats_since = now;
+    interp->st.enable_tasklet_stats = !!flag;
+#else
+    if (flag > 0)
+        RUNTIME_ERROR("tasklet stats are not supported by this build", -1);
+#endif
+    return old;
+}
+
+
+PyDoc_STRVAR(enable_tasklet_stats__doc__,
+"enable_tasklet_stats(flag) -- control the per tasklet accounting.\n"
+"If enabled, each tasklet accounts its run time, the number of switches\n"
+"to the tasklet and the time the tasklet is blocked on channels, see the\n"
+"attributes tasklet.stats and tasklet.stats_tag.\n"
+"This flag exists once for each interpreter.\n"
+"For inquiry only, use 'None' as the flag.\n"
+"By default, the accounting is disabled.");
+
+static PyObject *
+enable_tasklet_stats(PyObject *self, PyObject *flag)
+{
+    int newflag = -1;
+    int ret;
+    if (flag && flag != Py_None) {
+        newflag = PyObject_IsTrue(flag);
+        if (newflag == -1 && PyErr_Occurred())
+            return NULL;
+    }
+    ret = PyStackless_EnableTaskletStats(newflag);
+    if (ret == -1)
+        return NULL;
+    return PyBool_FromLong(ret);
+}
+
+
+PyDoc_STRVAR(get_tasklet_stats_by_tag__doc__,
+"get_tasklet_stats_by_tag(clear=False) -- return a dictionary, that maps the\n"
+"stats_tag of ended tasklets to their aggregated stats. The stats have the\n"
+"keys of tasklet.stats and the key 'tasklets', the number of tasklets.\n"
+"If clear is true, the aggregated stats are reset.");
+
+static PyObject *
+get_tasklet_stats_by_tag(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"clear", NULL};
+    PyInterpreterState *interp = _PyInterpreterState_Get();
+    PyObject *result, *tag, *value;
+    Py_ssize_t pos = 0;
+    int clear = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|p:get_tasklet_stats_by_tag",
+                                     kwlist, &clear))
+        return NULL;
+    result = PyDict_New();
+    if (result == NULL || interp->st.tasklet_stats_by_tag == NULL)
+        return result;
+    while (PyDict_Next(interp->st.tasklet_stats_by_tag, &pos, &tag, &value)) {
+        long long run_time, blocked_time;
+        Py_ssize_t soft_switches, hard_switches, count;
+        PyObject *stats;
+        int res;
+
+        if (!PyArg_ParseTuple(value, "LLnnn", &run_time, &blocked_time,
+                              &soft_switches, &hard_switches, &count))
+            goto error;
+        stats = Py_BuildValue("{s:d,s:d,s:n,s:n,s:n,s:n}",
+            "run_time", _PyTime_AsSecondsDouble(run_time),
+            "blocked_time", _PyTime_AsSecondsDouble(blocked_time),
+            "switches", soft_switches + hard_switches,
+            "soft_switches", soft_switches,
+            "hard_switches", hard_switches,
+            "tasklets", count);
+        if (stats == NULL)
+            goto error;
+        res = PyDict_SetItem(result, tag, stats);
+        Py_DECREF(stats);
+        if (res)
+            goto error;
+    }
+    if (clear)
+        Py_CLEAR(interp->st.tasklet_stats_by_tag);
+    return result;
+error:
+    Py_DECREF(result);
+    return NULL;
+}
+
+
+PyDoc_STRVAR(get_cstack_cache_info__doc__,
+"get_cstack_cache_info() -- return a dictionary with the state of the pool\n"
+"of unused C stack objects. The keys are:\n"
+"'count', 'bytes': the number and the total size of pooled objects\n"
+"'maxcount', 'maxbytes': the current limits of the pool\n"
+"'hits', 'misses': the number of allocations served or not served by the pool\n"
+"'evictions': the number of pooled objects freed to stay within the limits\n"
+"'classes': a dictionary mapping the capacity of a size class in stack words\n"
+"to the number of pooled objects of this class.");
+
+static PyObject *
+get_cstack_cache_info(PyObject *self, PyObject *unused)
+{
+    PyObject *classes, *ret;
+    PyCStackObject *cst;
+    Py_ssize_t n;
+    int i;
+
+    classes = PyDict_New();
+    if (classes == NULL)
+        return NULL;
+    for (i = 0; i < SLP_CSTACK_CLASSES; i++) {
+        n = 0;
+        for (cst = _PyRuntime.st.cstack_pool.head[i]; cst != NULL; cst = cst->next)
+            n++;
+        if (n) {
+            PyObject *key = PyLong_FromSsize_t(slp_cstack_pool_class_capacity(i));
+            PyObject *value = PyLong_FromSsize_t(n);
+            int res = -1;
+            if (key != NULL && value != NULL)
+                res = PyDict_SetItem(classes, key, value);
+            Py_XDECREF(key);
+            Py_XDECREF(value);
+            if (res) {
+                Py_DECREF(classes);
+                return NULL;
+            }
+        }
+    }
+    ret = Py_BuildValue("{s:n,s:n,s:n,s:n,s:L,s:L,s:L,s:O}",
+        "count", _PyRuntime.st.cstack_pool.count,
+        "bytes", _PyRuntime.st.cstack_pool.bytes,
+        "maxcount", _PyRuntime.st.cstack_pool.maxcount,
+        "maxbytes", _PyRuntime.st.cstack_pool.maxbytes,
+        "hits", _PyRuntime.st.cstack_pool.hits,
+        "misses", _PyRuntime.st.cstack_pool.misses,
+        "evictions", _PyRuntime.st.cstack_pool.evictions,
+        "classes", classes);
+    Py_DECREF(classes);
+    return ret;
+}
+
+
+PyDoc_STRVAR(set_cstack_cache_limits__doc__,
+"set_cstack_cache_limits(maxcount, maxbytes) -- set the limits of the pool\n"
+"of unused C stack objects and return the previous limits as a tuple.\n"
+"If the pool exceeds a limit, the least recently released objects get freed.\n"
+"Use 0, 0 to clear the pool. The limits exist once for the whole process.");
+
+static PyObject *
+set_cstack_cache_limits(PyObject *self, PyObject *args)
+{
+    Py_ssize_t maxcount, maxbytes;
+    PyObject *ret;
+
+    if (!PyArg_ParseTuple(args, "nn:set_cstack_cache_limits", &maxcount, &maxbytes))
+        return NULL;
+    if (maxcount < 0 || maxbytes < 0)
+        VALUE_ERROR("limits must not be negative", NULL);
+    ret = Py_BuildValue("(nn)", _PyRuntime.st.cstack_pool.maxcount,
+                        _PyRuntime.st.cstack_pool.maxbytes);
+    if (ret == NULL)
+        return NULL;
+    _PyRuntime.st.cstack_pool.maxcount = maxcount;
+    _PyRuntime.st.cstack_pool.maxbytes = maxbytes;
+    slp_cstack_pool_trim(maxcount, maxbytes);
+    return ret;
+}
+
+
+PyDoc_STRVAR(get_cframe_cache_info__doc__,
+"get_cframe_cache_info() -- return a dictionary with the state of the free\n"
+"list of C frames. The keys are:\n"
+"'count': the number of cached C frames\n"
+"'maxcount': the current limit of the free list\n"
+"'hits', 'misses': the number of allocations served or not served by the list\n"
+"'evictions': the number of C frames freed, because the list was full.");
+
+static PyObject *
+get_cframe_cache_info(PyObject *self, PyObject *unused)
+{
+    return slp_cframe_cache_info();
+}
+
+
+PyDoc_STRVAR(set_cframe_cache_limit__doc__,
+"set_cframe_cache_limit(maxcount) -- set the limit of the free list of\n"
+"C frames and return the previous limit. Use 0 to clear the list.");
+
+static PyObject *
+set_cframe_cache_limit(PyObject *self, PyObject *args)
+{
+    Py_ssize_t maxcount;
+
+    if (!PyArg_ParseTuple(args, "n:set_cframe_cache_limit", &maxcount))
+        return NULL;
+    if (maxcount < 0)
+        VALUE_ERROR("limit must not be negative", NULL);
+    return PyLong_FromSsize_t(slp_cframe_cache_set_limit(maxcount));
+}
+
+
+PyDoc_STRVAR(snapshot__doc__,
+"snapshot(tasklets, buffer_callback=None) -- serialize the given tasklets\n"
+"into a compact binary snapshot and return it as bytes. The frames are\n"
+"written directly, code objects get shared and only the other objects get\n"
+"pickled. If buffer_callback is not None, the data of bytes, bytearray,\n"
+"array.array and memoryview objects is passed to it as pickle.PickleBuffer\n"
+"like pickle.Pickler does with protocol 5.\n"
+"Use restore() to re-animate the tasklets.");
+
+static PyObject *
+snapshot(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"tasklets", "buffer_callback", NULL};
+    PyObject *tasklets, *buffer_callback = Py_None;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O:snapshot", kwlist,
+                                     &tasklets, &buffer_callback))
+        return NULL;
+    return slp_snapshot(tasklets, buffer_callback);
+}
+
+
+PyDoc_STRVAR(restore__doc__,
+"restore(data, previous=None, buffers=None) -- create the tasklets of a\n"
+"snapshot made by snapshot() or checkpointer.snapshot() and return them as\n"
+"a list in the order of the snapshot. To restore a delta snapshot of a\n"
+"checkpointer, pass the earlier snapshots of its chain as previous.\n"
+"buffers are the out-of-band buffers of the snapshots, the buffers of the\n"
+"oldest snapshot of the chain first.");
+
+static PyObject *
+restore(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"data", "previous", "buffers", NULL};
+    PyObject *data, *previous = Py_None, *buffers = Py_None;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OO:restore", kwlist,
+                                     &data, &previous, &buffers))
+        return NULL;
+    return slp_restore(data, previous, buffers);
+}
+
+
 PyDoc_STRVAR(run_watchdog__doc__,
 "run_watchdog(timeout=0, threadblock=False, soft=False,\n\
-              ignore_nesting=False, totaltimeout=False) -- \n\
+              ignore_nesting=False, totaltimeout=False,\n\
+              wallclock=False) -- \n\
 run tasklets until they are all\n\
 done, or timeout instructions have passed, if timeout is not 0.\n\
 Tasklets must provide cooperative schedule() calls.\n\
@@ -462,7 +1161,9 @@ ignore_nesting: Allow interrupts at any interpreter nesting level,\n\
 ignoring the tasklets' own ignore_nesting attribute.\n\
 totaltimeout: The 'timeout' argument is the total timeout for run(),\n\
 rather than a maximum timeslice for a single tasklet.  This for run()\n\
-to return after a certain time.");
+to return after a certain time.\n\
+wallclock: The 'timeout' argument is a number of microseconds of wall\n\
+clock time rather than a number of instructions.");
 
 static PyObject *
 interrupt_timeout_return(void)
@@ -472,6 +1173,14 @@ interrupt_timeout_return(void)
     PyTaskletObject *watchdog;
     PyObject *ret;
 
+    /* In wallclock mode the tick counter only limits the rate of clock reads */
+    if ((ts->st.runflags & PY_WATCHDOG_WALLCLOCK) &&
+        _PyTime_GetMonotonicClock() < ts->st.time_watermark)
+    {
+        ts->st.tick_watermark = ts->st.tick_counter + ts->st.interval;
+        Py_RETURN_NONE;
+    }
+
     /*
      * we mark the IRQ as pending if
      * a) we are in soft interrupt mode
@@ -510,14 +1219,15 @@ static PyObject *
 PyStackless_RunWatchdog_M(long timeout, long flags)
 {
     PyMethodDef def = {"run", (PyCFunction)(void(*)(void))run_watchdog, METH_VARARGS | METH_KEYWORDS};
-    int threadblock, soft, ignore_nesting, totaltimeout;
+    int threadblock, soft, ignore_nesting, totaltimeout, wallclock;
     threadblock = (flags & Py_WATCHDOG_THREADBLOCK) ? 1 : 0;
     soft =        (flags & PY_WATCHDOG_SOFT) ? 1 : 0;
     ignore_nesting=(flags & PY_WATCHDOG_IGNORE_NESTING) ? 1 : 0;
     totaltimeout =(flags & PY_WATCHDOG_TOTALTIMEOUT) ? 1 : 0;
+    wallclock =   (flags & PY_WATCHDOG_WALLCLOCK) ? 1 : 0;
 
-    return PyStackless_CallCMethod_Main(&def, NULL, "liii",
-        timeout, threadblock, soft, ignore_nesting, totaltimeout);
+    return PyStackless_CallCMethod_Main(&def, NULL, "liiiii",
+        timeout, threadblock, soft, ignore_nesting, totaltimeout, wallclock);
 }
 
 
@@ -545,6 +1255,7 @@ PyStackless_RunWatchdogEx(long timeout, int flags)
     PyObject* (*old_interrupt)(void) = NULL;
     int old_runflags = 0;
     long old_watermark = 0, old_interval = 0;
+    _PyTime_t old_time_watermark = 0, old_time_interval = 0;
     int interrupt;
 
     if (flags < 0 || flags >= (1 << (sizeof(ts->st.runflags) * CHAR_BIT))) {
@@ -569,14 +1280,22 @@ PyStackless_RunWatchdogEx(long timeout, int flags)
         old_runflags = ts->st.runflags;
         old_watermark = ts->st.tick_watermark;
         old_interval = ts->st.interval;
+        old_time_watermark = ts->st.time_watermark;
+        old_time_interval = ts->st.time_interval;
 
         if (timeout <= 0)
             ts->st.interrupt = NULL;
         else
             ts->st.interrupt = interrupt_timeout_return;
-        ts->st.interval = timeout;
-        ts->st.tick_watermark = ts->st.tick_counter + timeout;
+        if (flags & PY_WATCHDOG_WALLCLOCK) {
+            /* timeout is in microseconds, check the clock every few ticks */
+            ts->st.interval = SLP_WALLCLOCK_CHECK_TICKS;
+            ts->st.time_interval = _PyTime_FromNanoseconds((_PyTime_t)timeout * 1000);
+        }
+        else
+            ts->st.interval = timeout;
         ts->st.runflags = flags;
+        SLP_RESET_TIMESLICE(ts);
     }
 
     /* run the watchdog */
@@ -622,6 +1341,8 @@ PyStackless_RunWatchdogEx(long timeout, int flags)
             ts->st.runflags = old_runflags;
             ts->st.tick_watermark = old_watermark;
             ts->st.interval = old_interval;
+            ts->st.time_watermark = old_time_watermark;
+            ts->st.time_interval = old_time_interval;
         }
     }
 
@@ -751,22 +1472,24 @@ run_watchdog(PyObject *self, PyObject *args, PyObject *kwds)
 {
     static char *argnames[] = {"timeout", "threadblock", "soft",
                                                             "ignore_nesting", "totaltimeout",
-                                                            NULL};
+                                                            "wallclock", NULL};
     long timeout = 0;
     int threadblock = 0;
     int soft = 0;
     int ignore_nesting = 0;
     int totaltimeout = 0;
+    int wallclock = 0;
     int flags;
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|liiii:run_watchdog",
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|liiiii:run_watchdog",
                                      argnames, &timeout, &threadblock, &soft,
-                                     &ignore_nesting, &totaltimeout))
+                                     &ignore_nesting, &totaltimeout, &wallclock))
         return NULL;
     flags = threadblock ? Py_WATCHDOG_THREADBLOCK : 0;
     flags |= soft ? PY_WATCHDOG_SOFT : 0;
     flags |= ignore_nesting ? PY_WATCHDOG_IGNORE_NESTING : 0;
     flags |= totaltimeout ? PY_WATCHDOG_TOTALTIMEOUT : 0;
+    flags |= wallclock ? PY_WATCHDOG_WALLCLOCK : 0;
     return PyStackless_RunWatchdogEx(timeout, flags);
 }
 
@@ -1386,6 +2109,37 @@ get_schedule_callback(PyObject *self, PyObject *unused)
     return temp;
 }
 
+PyDoc_STRVAR(set_trace_buffer__doc__,
+"set_trace_buffer(size) -- record scheduler events in a ring buffer.\n\
+The buffer keeps the last size events. Every tasklet switch and every\n\
+channel action adds an event without calling Python code. Setting a new\n\
+size discards the recorded events, 0 switches the recording off.\n\
+Returns the previous size.");
+
+static PyObject *
+set_trace_buffer(PyObject *self, PyObject *arg)
+{
+    Py_ssize_t size = PyNumber_AsSsize_t(arg, PyExc_OverflowError);
+    Py_ssize_t old = PyStackless_GetTraceBufferSize();
+
+    if (size == -1 && PyErr_Occurred())
+        return NULL;
+    if (PyStackless_SetTraceBuffer(size))
+        return NULL;
+    return PyLong_FromSsize_t(old);
+}
+
+PyDoc_STRVAR(get_trace_buffer__doc__,
+"get_trace_buffer() -- return the recorded scheduler events as bytes.\n\
+The oldest event comes first. Use stackless.iter_trace_events() to decode\n\
+the events.");
+
+static PyObject *
+get_trace_buffer(PyObject *self, PyObject *unused)
+{
+    return PyStackless_GetTraceBuffer();
+}
+
 PyDoc_STRVAR(set_channel_callback__doc__,
 "set_channel_callback(callable) -- install a callback for channels.\n\
 Every send/receive action will call the callback function.\n\
@@ -1614,6 +2368,20 @@ static PyMethodDef stackless_methods[] = {
      schedule__doc__},
     {"schedule_remove",    (PCF)(void(*)(void))schedule_remove, METH_KS,
      schedule__doc__},
+    {"sleep",                     (PCF)(void(*)(void))stackless_sleep, METH_KS,
+     sleep__doc__},
+    {"select",                    (PCF)(void(*)(void))stackless_select, METH_VARARGS | METH_KEYWORDS,
+     select__doc__},
+    {"run_in_thread",             (PCF)(void(*)(void))stackless_run_in_thread, METH_KS,
+     run_in_thread__doc__},
+    {"set_thread_pool_size",      (PCF)set_thread_pool_size,  METH_O,
+     set_thread_pool_size__doc__},
+    {"spawn_many",                (PCF)spawn_many,            METH_VARARGS,
+     spawn_many__doc__},
+    {"wait_readable",             (PCF)(void(*)(void))stackless_wait_readable, METH_KS,
+     wait_readable__doc__},
+    {"wait_writable",             (PCF)(void(*)(void))stackless_wait_writable, METH_KS,
+     wait_writable__doc__},
     {"run",                   (PCF)(void(*)(void))run_watchdog, METH_VARARGS | METH_KEYWORDS,
      run_watchdog__doc__},
     {"getruncount",                 (PCF)getruncount,           METH_NOARGS,
@@ -1626,6 +2394,28 @@ static PyMethodDef stackless_methods[] = {
      getmain__doc__},
     {"enable_softswitch",           (PCF)enable_softswitch,     METH_O,
      enable_soft__doc__},
+    {"enable_separate_stacks",      (PCF)enable_separate_stacks, METH_O,
+     enable_separate_stacks__doc__},
+    {"enable_work_stealing",        (PCF)enable_work_stealing,  METH_O,
+     enable_work_stealing__doc__},
+    {"enable_tasklet_stats",        (PCF)enable_tasklet_stats,  METH_O,
+     enable_tasklet_stats__doc__},
+    {"get_tasklet_stats_by_tag",    (PCF)(void(*)(void))get_tasklet_stats_by_tag,
+     METH_VARARGS | METH_KEYWORDS, get_tasklet_stats_by_tag__doc__},
+    {"get_work_stealing_info",      (PCF)get_work_stealing_info, METH_VARARGS,
+     get_work_stealing_info__doc__},
+    {"get_cstack_cache_info",       (PCF)get_cstack_cache_info, METH_NOARGS,
+     get_cstack_cache_info__doc__},
+    {"set_cstack_cache_limits",     (PCF)set_cstack_cache_limits, METH_VARARGS,
+     set_cstack_cache_limits__doc__},
+    {"get_cframe_cache_info",       (PCF)get_cframe_cache_info, METH_NOARGS,
+     get_cframe_cache_info__doc__},
+    {"set_cframe_cache_limit",      (PCF)set_cframe_cache_limit, METH_VARARGS,
+     set_cframe_cache_limit__doc__},
+    {"snapshot",                    (PCF)(void(*)(void))snapshot, METH_VARARGS | METH_KEYWORDS,
+     snapshot__doc__},
+    {"restore",                     (PCF)(void(*)(void))restore, METH_VARARGS | METH_KEYWORDS,
+     restore__doc__},
     {"_test_cframe_nr",    (PCF)(void(*)(void))_test_cframe_nr, METH_VARARGS | METH_KEYWORDS,
     _test_cframe_nr__doc__},
     {"_test_outside",                (PCF)_test_outside,        METH_NOARGS,
@@ -1636,6 +2426,10 @@ static PyMethodDef stackless_methods[] = {
      get_channel_callback__doc__},
     {"set_schedule_callback",       (PCF)set_schedule_callback, METH_O,
      set_schedule_callback__doc__},
+    {"set_trace_buffer",            (PCF)set_trace_buffer, METH_O,
+     set_trace_buffer__doc__},
+    {"get_trace_buffer",            (PCF)get_trace_buffer, METH_NOARGS,
+     get_trace_buffer__doc__},
     {"get_schedule_callback",       (PCF)get_schedule_callback, METH_NOARGS,
      get_schedule_callback__doc__},
     {"_pickle_moduledict",          (PCF)slp_pickle_moduledict, METH_VARARGS,
@@ -1738,6 +2532,7 @@ PyStackless_Fini(void)
 {
     slp_scheduling_fini();
     slp_cframe_fini();
+    slp_tasklet_fini();
     slp_stacklesseval_fini();
 }
 
@@ -1756,6 +2551,7 @@ PyInit__stackless(void)
     if (0
         || PyType_Ready(&PyChannel_Type)
         || PyType_Ready(&PyAtomic_Type)
+        || PyType_Ready(&PyCheckpointer_Type)
         )
         return NULL;
 
@@ -1775,6 +2571,7 @@ PyInit__stackless(void)
     INSERT("tasklet",   &PyTasklet_Type);
     INSERT("channel",   &PyChannel_Type);
     INSERT("atomic",    &PyAtomic_Type);
+    INSERT("checkpointer", &PyCheckpointer_Type);
     INSERT("pickle_with_tracing_state", Py_False);
 #if PY_VERSION_HEX < SLP_END_OF_OLD_CYTHON_HACK_VERSION
     INSERT("_with_old_cython_hack", Py_True);
@@ -6,6 +6,7 @@
 
 #include "Python.h"
 #include "structmember.h"
+#include "pycore_object.h"
 
 #ifdef STACKLESS
 #include "pycore_stackless.h"
@@ -61,12 +62,34 @@ tasklet_flags_as_integer(PyTaskletFlagStruc flags) {
     return f;
 }
 
+/*
+ * The run queue is the chain of runnable tasklets, that starts with the
+ * current tasklet. Apart from the current tasklet, the queue is sorted
+ * according to SLP_TASKLET_PRECEDES(). As long as all tasklets share the
+ * same priority and have no deadline, the queue is a plain FIFO ring.
+ */
+
 void
 slp_current_insert(PyTaskletObject *task)
 {
     PyThreadState *ts = task->cstate->tstate;
-    PyTaskletObject **chain = &ts->st.current;
+    PyTaskletObject *pos = ts->st.current;
+    assert(ts);
+
+    /* find the place of task, starting at the end of the queue */
+    if (pos != NULL)
+        while (pos->prev != ts->st.current && SLP_TASKLET_PRECEDES(task, pos->prev))
+            pos = pos->prev;
+    slp_current_insert_before(task, pos);
+}
+
+void
+slp_current_insert_before(PyTaskletObject *task, PyTaskletObject *pos)
+{
+    PyThreadState *ts = task->cstate->tstate;
+    PyTaskletObject **chain = pos != NULL ? &pos : &ts->st.current;
     assert(ts);
+    assert(pos == NULL || ts->st.current != NULL);
 
     SLP_CHAIN_INSERT(PyTaskletObject, chain, task, next, prev);
     ++ts->st.runcount;
@@ -86,6 +109,27 @@ slp_current_insert_after(PyTaskletObject *task)
     ++ts->st.runcount;
 }
 
+/* Move a runnable tasklet, that is not current, to its place in the run
+ * queue. Called after a switch away from the tasklet and after a change of
+ * its priority or deadline. */
+void
+slp_current_requeue(PyTaskletObject *task)
+{
+    PyThreadState *ts = task->cstate->tstate;
+    PyTaskletObject *head;
+    assert(ts);
+    assert(task->next != NULL && !task->flags.blocked);
+
+    head = ts->st.current;
+    if (task == head)
+        return;
+    if ((task->prev != head && SLP_TASKLET_PRECEDES(task, task->prev)) ||
+        (task->next != head && SLP_TASKLET_PRECEDES(task->next, task))) {
+        slp_current_remove_tasklet(task);   /* we keep the reference */
+        slp_current_insert(task);           /* steals the reference */
+    }
+}
+
 void
 slp_current_uninsert(PyTaskletObject *task)
 {
@@ -139,7 +183,7 @@ void
 slp_current_unremove(PyTaskletObject* task)
 {
     PyThreadState *ts = task->cstate->tstate;
-    slp_current_insert(task);
+    slp_current_insert_before(task, ts->st.current);
     ts->st.current = task;
 }
 
@@ -166,14 +210,20 @@ static int
 tasklet_traverse(PyTaskletObject *t, visitproc visit, void *arg)
 {
     Py_VISIT(t->f.frame);
+    Py_VISIT(t->setup_func);
+    Py_VISIT(t->setup_args);
+    Py_VISIT(t->setup_kwargs);
     Py_VISIT(t->tempval);
     Py_VISIT(t->cstate);
     Py_VISIT(t->exc_state.exc_type);
     Py_VISIT(t->exc_state.exc_value);
     Py_VISIT(t->exc_state.exc_traceback);
     Py_VISIT(t->context);
-    Py_VISIT(t->profileobj);
-    Py_VISIT(t->traceobj);
+    if (t->trace != NULL) {
+        Py_VISIT(t->trace->profileobj);
+        Py_VISIT(t->trace->traceobj);
+    }
+    Py_VISIT(t->stats_tag);
     return 0;
 }
 
@@ -182,6 +232,9 @@ tasklet_clear_frames(PyTaskletObject *t)
 {
     /* release frame chain */
     Py_CLEAR(t->f.frame);
+    Py_CLEAR(t->setup_func);
+    Py_CLEAR(t->setup_args);
+    Py_CLEAR(t->setup_kwargs);
 }
 
 static inline void
@@ -206,10 +259,8 @@ tasklet_clear(PyTaskletObject *t)
     Py_CLEAR(t->tempval);
     Py_CLEAR(t->def_globals);
     Py_CLEAR(t->context);
-    t->profilefunc = t->tracefunc = NULL;
-    t->tracing = 0;
-    Py_CLEAR(t->profileobj);
-    Py_CLEAR(t->traceobj);
+    slp_tasklet_trace_clear(t);
+    Py_CLEAR(t->stats_tag);
 
     /* unlink task from cstate */
     if (t->cstate != NULL && t->cstate->task == t)
@@ -307,6 +358,15 @@ tasklet_finalize(PyObject *self)
     PyErr_Restore(error_type, error_value, error_traceback);
 }
 
+/*
+ * A free list of tasklets of the exact type stackless.tasklet.
+ * Applications, that spawn many short lived tasklets, save the
+ * allocation.
+ */
+static PyTaskletObject *free_list = NULL;
+static int numfree = 0;         /* number of tasklets currently in free_list */
+#define MAXFREELIST 100         /* max value for numfree */
+
 static void
 tasklet_dealloc(PyTaskletObject *t)
 {
@@ -327,7 +387,55 @@ tasklet_dealloc(PyTaskletObject *t)
 
     tasklet_clear(t);
 
-    Py_TYPE(t)->tp_free((PyObject*)t);
+    if (PyTasklet_CheckExact(t) && numfree < MAXFREELIST) {
+        ++numfree;
+        t->next = free_list;
+        free_list = t;
+    }
+    else
+        Py_TYPE(t)->tp_free((PyObject*)t);
+}
+
+/* Clear out the free list */
+
+void
+slp_tasklet_fini(void)
+{
+    while (free_list != NULL) {
+        PyTaskletObject *t = free_list;
+        free_list = free_list->next;
+        PyObject_GC_Del(t);
+        --numfree;
+    }
+    assert(numfree == 0);
+}
+
+/* Allocate the structure for the profile and tracing state of a
+ * tasklet, if the tasklet has none. */
+int
+slp_tasklet_trace_new(PyTaskletObject *task)
+{
+    if (task->trace == NULL) {
+        task->trace = PyMem_Calloc(1, sizeof(PyTaskletTraceStruc));
+        if (task->trace == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void
+slp_tasklet_trace_clear(PyTaskletObject *task)
+{
+    PyTaskletTraceStruc *trace = task->trace;
+
+    if (trace != NULL) {
+        task->trace = NULL;
+        Py_XDECREF(trace->profileobj);
+        Py_XDECREF(trace->traceobj);
+        PyMem_Free(trace);
+    }
 }
 
 PyTaskletObject *
@@ -567,20 +675,44 @@ tasklet_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     }
     if (type == NULL)
         type = &PyTasklet_Type;
-    t = (PyTaskletObject *) type->tp_alloc(type, 0);
-    if (t == NULL)
-        return NULL;
+    if (type == &PyTasklet_Type && free_list != NULL) {
+        assert(numfree > 0);
+        --numfree;
+        t = free_list;
+        free_list = free_list->next;
+        _Py_NewReference((PyObject *) t);
+        /* tasklet_dealloc() called the finalizer, the new tasklet needs it again */
+        _Py_AS_GC(t)->_gc_prev = 0;
+        _PyObject_GC_TRACK(t);
+    }
+    else {
+        t = (PyTaskletObject *) type->tp_alloc(type, 0);
+        if (t == NULL)
+            return NULL;
+    }
     memset(&t->flags, 0, sizeof(t->flags));
     memset(&t->exc_state, 0, sizeof(t->exc_state));
     t->exc_info = &t->exc_state;
     t->recursion_depth = 0;
+    t->priority = 0;
+    t->deadline = Py_HUGE_VAL;
+    t->timer = NULL;
+    t->select = NULL;
+    t->io_fd = -1;
+    t->io_events = 0;
+    t->job = NULL;
+    memset(&t->stats, 0, sizeof(t->stats));
+    t->stats_tag = NULL;
+    t->nswitches = 0;
     t->next = NULL;
     t->prev = NULL;
     t->f.frame = NULL;
+    t->setup_func = t->setup_args = t->setup_kwargs = NULL;
     Py_INCREF(Py_None);
     t->tempval = Py_None;
     t->tsk_weakreflist = NULL;
     t->context = NULL;
+    t->trace = NULL;
     Py_INCREF(ts->st.initial_stub);
     t->cstate = ts->st.initial_stub;
     t->def_globals = PyEval_GetGlobals();
@@ -631,8 +763,11 @@ The easiest solution was to just use an empty tuple, which causes
 simply the tasklet() call without parameters.
 */
 
-static PyObject *
-tasklet_reduce(PyTaskletObject * t, PyObject *value)
+/* Reduce the tasklet t. If reduce_frames is zero, the list of frames
+ * contains the frames itself instead of the results of slp_reduce_frame().
+ * The native snapshots in snapshot.c use this to bypass the frame reducer. */
+PyObject *
+slp_tasklet_reduce(PyTaskletObject * t, int reduce_frames)
 {
     PyObject *tup = NULL, *lis = NULL;
     PyFrameObject *f;
@@ -642,20 +777,23 @@ tasklet_reduce(PyTaskletObject * t, PyObject *value)
     int tracing, c_functions;
     PyObject *profileobj, *traceobj;
 
-    if (value && !PyLong_Check(value)) {
-        PyErr_SetString(PyExc_TypeError, "__reduce_ex__ argument should be an integer");
-        return NULL;
-    }
-
     if (ts && t == ts->st.current)
         RUNTIME_ERROR("You cannot __reduce__ the tasklet which is"
                       " current.", NULL);
+    if (SLP_TASKLET_UNSTARTED(t) && slp_tasklet_create_frame(t))
+        return NULL;
     lis = PyList_New(0);
     if (lis == NULL) goto err_exit;
     f = t->f.frame;
     while (f != NULL) {
         int ret;
-        PyObject * frame_reducer = slp_reduce_frame(f);
+        PyObject * frame_reducer;
+        if (reduce_frames)
+            frame_reducer = slp_reduce_frame(f);
+        else {
+            Py_INCREF(f);
+            frame_reducer = (PyObject *)f;
+        }
         if (frame_reducer == NULL)
             goto err_exit;
         ret = PyList_Append(lis, frame_reducer);
@@ -676,15 +814,17 @@ tasklet_reduce(PyTaskletObject * t, PyObject *value)
     if (NULL == context)
         goto err_exit;
 
-    if (ts && ts->st.pickleflags & SLP_PICKLEFLAGS_PRESERVE_TRACING_STATE) {
-        c_functions = slp_encode_ctrace_functions(t->tracefunc, t->profilefunc);
+    if (ts && ts->st.pickleflags & SLP_PICKLEFLAGS_PRESERVE_TRACING_STATE &&
+            t->trace != NULL) {
+        c_functions = slp_encode_ctrace_functions(t->trace->tracefunc,
+                                                  t->trace->profilefunc);
         if (-1 == c_functions)
             goto err_exit;
-        tracing = t->tracing;
-        profileobj = t->profileobj;
+        tracing = t->trace->tracing;
+        profileobj = t->trace->profileobj;
         if (NULL == profileobj)
             profileobj = Py_None;
-        traceobj = t->traceobj;
+        traceobj = t->trace->traceobj;
         if (NULL == traceobj)
             traceobj = Py_None;
     } else {
@@ -749,6 +889,16 @@ err_exit:
     return tup;
 }
 
+static PyObject *
+tasklet_reduce(PyTaskletObject * t, PyObject *value)
+{
+    if (value && !PyLong_Check(value)) {
+        PyErr_SetString(PyExc_TypeError, "__reduce_ex__ argument should be an integer");
+        return NULL;
+    }
+    return slp_tasklet_reduce(t, 1);
+}
+
 
 PyDoc_STRVAR(tasklet_setstate__doc__,
 "Tasklets are first created without parameters, and then __setstate__\n\
@@ -853,35 +1003,41 @@ tasklet_setstate(PyObject *self, PyObject *args)
     }
 
     /* profile and tracing */
-    if (c_functions & 1) {
-        Py_tracefunc func = slp_get_sys_trace_func();
-        if (NULL == func)
-            return NULL;
-        t->tracefunc = func;
-    } else {
-        t->tracefunc = NULL;
+    if ((c_functions & 3) == 0 && Py_None == profileobj &&
+            Py_None == traceobj && tracing == 0) {
+        slp_tasklet_trace_clear(t);
     }
-    if (c_functions & 2) {
-        Py_tracefunc func = slp_get_sys_profile_func();
-        if (NULL == func)
+    else {
+        Py_tracefunc tracefunc = NULL, profilefunc = NULL;
+
+        if (c_functions & 1) {
+            tracefunc = slp_get_sys_trace_func();
+            if (NULL == tracefunc)
+                return NULL;
+        }
+        if (c_functions & 2) {
+            profilefunc = slp_get_sys_profile_func();
+            if (NULL == profilefunc)
+                return NULL;
+        }
+        if (slp_tasklet_trace_new(t))
             return NULL;
-        t->profilefunc = func;
-    } else {
-        t->profilefunc = NULL;
-    }
-    if (Py_None != profileobj) {
-        Py_INCREF(profileobj);
-        Py_XSETREF(t->profileobj, profileobj);
-    } else {
-        Py_CLEAR(t->profileobj);
-    }
-    if (Py_None != traceobj) {
-        Py_INCREF(traceobj);
-        Py_XSETREF(t->traceobj, traceobj);
-    } else {
-        Py_CLEAR(t->traceobj);
+        t->trace->tracefunc = tracefunc;
+        t->trace->profilefunc = profilefunc;
+        if (Py_None != profileobj) {
+            Py_INCREF(profileobj);
+            Py_XSETREF(t->trace->profileobj, profileobj);
+        } else {
+            Py_CLEAR(t->trace->profileobj);
+        }
+        if (Py_None != traceobj) {
+            Py_INCREF(traceobj);
+            Py_XSETREF(t->trace->traceobj, traceobj);
+        } else {
+            Py_CLEAR(t->trace->traceobj);
+        }
+        t->trace->tracing = tracing;
     }
-    t->tracing = tracing;
 
     /* context */
     if (context) {
@@ -950,6 +1106,80 @@ tasklet_setstate(PyObject *self, PyObject *args)
     return self;
 }
 
+PyDoc_STRVAR(tasklet_clone__doc__,
+"clone(copy=None) -- create a new tasklet, that continues from the\n\
+current state of this tasklet.\n\
+The frames are copied directly, without pickling. The clone shares code,\n\
+globals, cells and the values of the local variables with this tasklet,\n\
+except for the iterators of running for-loops, which get copied.\n\
+If copy is given, it is called once for every object referenced by a\n\
+local variable and the clone gets the result, e.g. copy.deepcopy.\n\
+The clone is paused and runs in a copy of the context of this tasklet.\n\
+It is not possible to clone the current tasklet or a tasklet, that\n\
+executes a generator.\
+");
+
+static PyObject *
+tasklet_clone(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    PyTaskletObject *t = (PyTaskletObject *) self;
+    PyObject *copy = Py_None;
+    PyObject *reduced, *state, *clone_state = NULL, *clone = NULL;
+    PyObject *context, *tmp;
+    char *kwds[] = {"copy", NULL};
+    Py_ssize_t i;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O:clone", kwds, &copy))
+        return NULL;
+    if (copy == Py_None)
+        copy = NULL;
+    else if (!PyCallable_Check(copy))
+        TYPE_ERROR("copy must be a callable or None", NULL);
+
+    /* the state of t with the frames itself, see slp_tasklet_reduce() */
+    reduced = slp_tasklet_reduce(t, 0);
+    if (reduced == NULL)
+        return NULL;
+    state = PyTuple_GET_ITEM(reduced, 2);
+    assert(PyTuple_GET_SIZE(state) >= 12);
+    clone_state = PyTuple_New(13);
+    if (clone_state == NULL)
+        goto err_exit;
+    for (i = 0; i < 12; i++) {
+        if (i == 3)
+            tmp = slp_clone_frames(PyTuple_GET_ITEM(state, i), copy);
+        else {
+            tmp = PyTuple_GET_ITEM(state, i);
+            Py_INCREF(tmp);
+        }
+        if (tmp == NULL)
+            goto err_exit;
+        PyTuple_SET_ITEM(clone_state, i, tmp);
+    }
+    context = _get_tasklet_context(t);
+    if (context == NULL)
+        goto err_exit;
+    tmp = PyContext_Copy(context);
+    Py_DECREF(context);
+    if (tmp == NULL)
+        goto err_exit;
+    PyTuple_SET_ITEM(clone_state, 12, tmp);
+
+    clone = PyObject_CallObject((PyObject *) Py_TYPE(t), NULL);
+    if (clone == NULL)
+        goto err_exit;
+    tmp = tasklet_setstate(clone, clone_state);
+    if (tmp == NULL) {
+        Py_CLEAR(clone);
+        goto err_exit;
+    }
+    Py_DECREF(tmp);
+err_exit:
+    Py_XDECREF(clone_state);
+    Py_DECREF(reduced);
+    return clone;
+}
+
 PyDoc_STRVAR(tasklet_bind_thread__doc__,
 "Attempts to re-bind the tasklet to the current thread.\n\
 If the tasklet has non-trivial c state, a RuntimeError is\n\
@@ -1104,7 +1334,7 @@ impl_tasklet_insert(PyTaskletObject *task)
         assert(task->cstate);
         if (task->cstate->tstate == NULL || task->cstate->tstate->st.main == NULL)
             RUNTIME_ERROR("Target thread isn't initialized", -1);
-        if (task->f.frame == NULL && task != task->cstate->tstate->st.current)
+        if (!SLP_TASKLET_HAS_FRAME(task) && task != task->cstate->tstate->st.current)
             RUNTIME_ERROR("You cannot run an unbound(dead) tasklet", -1);
         Py_INCREF(task);
         slp_current_insert(task);
@@ -1367,15 +1597,21 @@ tasklet_set_ignore_nesting(PyObject *self, PyObject *flag)
 }
 
 
+/* Bind a tasklet to the call func(*args, **kwds). The tasklet creates its
+ * initial frame, when it runs for the first time, see
+ * slp_tasklet_create_frame(). Tasklets, that get killed before they run,
+ * never allocate a frame.
+ */
 static int
-bind_tasklet_to_frame(PyTaskletObject *task, PyFrameObject *frame)
+bind_tasklet_to_call(PyTaskletObject *task, PyObject *func, PyObject *args, PyObject *kwds)
 {
     PyThreadState *ts = task->cstate->tstate;
     if (ts == NULL)
         RUNTIME_ERROR("tasklet has no thread", -1);
-    if (task->f.frame != NULL)
+    if (SLP_TASKLET_HAS_FRAME(task))
         RUNTIME_ERROR("tasklet is already bound to a frame", -1);
-    task->f.frame = frame;
+    if (func == NULL || !PyCallable_Check(func))
+        TYPE_ERROR("cframe function must be a callable", -1);
     if (task->cstate != ts->st.initial_stub) {
         PyCStackObject *hold = task->cstate;
         task->cstate = ts->st.initial_stub;
@@ -1385,8 +1621,31 @@ bind_tasklet_to_frame(PyTaskletObject *task, PyFrameObject *frame)
             if (slp_ensure_linkage(task))
                 return -1;
     }
+    Py_INCREF(func);
+    task->setup_func = func;
+    Py_INCREF(args);
+    task->setup_args = args;
+    Py_XINCREF(kwds);
+    task->setup_kwargs = kwds;
+    return 0;
+}
+
+int
+slp_tasklet_create_frame(PyTaskletObject *task)
+{
+    PyCFrameObject *cf;
+
+    assert(SLP_TASKLET_UNSTARTED(task));
+    assert(task->f.frame == NULL);
+    cf = slp_cframe_newfunc(task->setup_func, task->setup_args,
+                            task->setup_kwargs, 0);
+    if (cf == NULL)
+        return -1;
+    task->f.cframe = cf;
+    Py_CLEAR(task->setup_func);
+    Py_CLEAR(task->setup_args);
+    Py_CLEAR(task->setup_kwargs);
     return 0;
-    /* note: We expect that f_back is NULL, or will be adjusted immediately */
 }
 
 /* this is also the setup method */
@@ -1412,7 +1671,6 @@ static int
 impl_tasklet_setup(PyTaskletObject *task, PyObject *args, PyObject *kwds, int insert)
 {
     PyThreadState *ts = _PyThreadState_GET();
-    PyFrameObject *frame;
     PyObject *func;
 
     assert(PyTasklet_Check(task));
@@ -1427,15 +1685,8 @@ impl_tasklet_setup(PyTaskletObject *task, PyObject *args, PyObject *kwds, int in
     func = task->tempval;
     if (func == NULL || func == Py_None)
         RUNTIME_ERROR("the tasklet was not bound to a function", -1);
-    if ((frame = (PyFrameObject *)
-                 slp_cframe_newfunc(func, args, kwds, 0)) == NULL) {
-        return -1;
-    }
-    if (bind_tasklet_to_frame(task, frame)) {
-        /* bind_tasklet_to_frame steals one ref to frame on success */
-        Py_DECREF(frame);
+    if (bind_tasklet_to_call(task, func, args, kwds))
         return -1;
-    }
     TASKLET_SETVAL(task, Py_None);
     if (insert) {
         Py_INCREF(task);
@@ -1444,6 +1695,90 @@ impl_tasklet_setup(PyTaskletObject *task, PyObject *args, PyObject *kwds, int in
     return 0;
 }
 
+static PyObject *
+spawn_many_main(PyObject *self, PyObject *args);
+
+/*
+ * [tasklet(func)(*args) for args in iterable] without the Python level
+ * calls: the tasklets share one context. Like a plain tasklet, a spawned
+ * tasklet creates its frame, when it runs for the first time. The tasklets
+ * get inserted, after all of them were created successfully.
+ */
+PyObject *
+PyTasklet_SpawnMany(PyObject *func, PyObject *iterable)
+{
+    PyThreadState *ts = _PyThreadState_GET();
+    PyObject *it, *item, *args, *ctx, *list;
+    PyTaskletObject *task;
+    Py_ssize_t i;
+
+    if (ts->st.main == NULL) {
+        PyMethodDef def = {"spawn_many", (PyCFunction)spawn_many_main,
+                           METH_VARARGS};
+        return PyStackless_CallCMethod_Main(&def, NULL, "OO", func, iterable);
+    }
+    if (!PyCallable_Check(func))
+        TYPE_ERROR("tasklet function must be a callable", NULL);
+    if ((it = PyObject_GetIter(iterable)) == NULL)
+        return NULL;
+    if ((ctx = _get_tasklet_context(ts->st.current)) == NULL) {
+        Py_DECREF(it);
+        return NULL;
+    }
+    if ((list = PyList_New(0)) == NULL)
+        goto error;
+    while ((item = PyIter_Next(it)) != NULL) {
+        args = PySequence_Tuple(item);
+        Py_DECREF(item);
+        if (args == NULL)
+            goto error;
+        task = (PyTaskletObject *)tasklet_new(&PyTasklet_Type, NULL, NULL);
+        if (task == NULL) {
+            Py_DECREF(args);
+            goto error;
+        }
+        i = PyList_Append(list, (PyObject *)task);
+        Py_DECREF(task);
+        if (i) {
+            Py_DECREF(args);
+            goto error;
+        }
+        Py_INCREF(ctx);
+        task->context = ctx;
+        i = bind_tasklet_to_call(task, func, args, NULL);
+        Py_DECREF(args);
+        if (i)
+            goto error;
+    }
+    if (PyErr_Occurred())
+        goto error;
+    Py_DECREF(it);
+    Py_DECREF(ctx);
+
+    /* no failure possible from here on */
+    for (i = 0; i < PyList_GET_SIZE(list); i++) {
+        task = (PyTaskletObject *)PyList_GET_ITEM(list, i);
+        Py_INCREF(task);
+        slp_current_insert(task);
+    }
+    return list;
+error:
+    Py_DECREF(it);
+    Py_DECREF(ctx);
+    Py_XDECREF(list);
+    return NULL;
+}
+
+static PyObject *
+spawn_many_main(PyObject *self, PyObject *args)
+{
+    PyObject *func, *iterable;
+
+    if (!PyArg_ParseTuple(args, "OO:spawn_many", &func, &iterable))
+        return NULL;
+    return PyTasklet_SpawnMany(func, iterable);
+}
+
 static PyObject *
 tasklet_setup(PyObject *self, PyObject *args, PyObject *kwds)
 {
@@ -1524,7 +1859,7 @@ _impl_tasklet_throw_bomb(PyTaskletObject *self, int pending, PyObject *bomb)
 
     /* Handle new or dead tasklets.
      */
-    if (slp_get_frame(self) == NULL) {
+    if (!PyTasklet_Alive(self)) {
         /* The tasklet is not alive.
          * There are a few special cases:
          *  - The purpose of raising exception TaskletExit is to end the tasklet. Therefore
@@ -1532,7 +1867,7 @@ _impl_tasklet_throw_bomb(PyTaskletObject *self, int pending, PyObject *bomb)
          *  - Otherwise we have to raise a RuntimeError.
          */
         if (!PyObject_IsSubclass(((PyBombObject*)bomb)->curexc_type, PyExc_TaskletExit) ||
-            (self->cstate->tstate == NULL && self->f.frame != NULL)) {
+            (self->cstate->tstate == NULL && SLP_TASKLET_HAS_FRAME(self))) {
             /* Error: the exception is not TaskletExit or the tasklet did not run to its end. */
 #ifdef SLP_IMPL_THROW_BOMB_WITH_BOE
             if (bomb_on_error)
@@ -1786,7 +2121,7 @@ impl_tasklet_kill(PyTaskletObject *task, int pending)
          * the current thread or drop its frames.
          * Either action prevents an error in impl_tasklet_throw().
          */
-        if (task->cstate->nesting_level == 0 && task->f.frame) {
+        if (task->cstate->nesting_level == 0 && SLP_TASKLET_HAS_FRAME(task)) {
             /* rebind to the current thread */
             PyObject *arg = PyTuple_New(0);
             if (arg == NULL)
@@ -1798,11 +2133,11 @@ impl_tasklet_kill(PyTaskletObject *task, int pending)
                 return NULL;
             Py_DECREF(ret);
         } else {
-            Py_CLEAR(task->f.frame);  /* or better tasklet_clear_frames(task) ? */
+            tasklet_clear_frames(task);
         }
 #else
         /* drop the frame */
-        Py_CLEAR(task->f.frame);  /* or better tasklet_clear_frames(task) ? */
+        tasklet_clear_frames(task);
 #endif
     }
 
@@ -1935,6 +2270,184 @@ void PyTasklet_SetBlockTrap(PyTaskletObject *task, int value)
 }
 
 
+static PyObject *
+tasklet_get_priority(PyTaskletObject *task, void *closure)
+{
+    return PyLong_FromLong(task->priority);
+}
+
+static int
+tasklet_set_priority(PyTaskletObject *task, PyObject *value, void *closure)
+{
+    int priority;
+
+    if (value == NULL)
+        TYPE_ERROR("can't delete the priority", -1);
+    if (!PyLong_Check(value))
+        TYPE_ERROR("priority must be set to an integer", -1);
+    priority = _PyLong_AsInt(value);
+    if (priority == -1 && PyErr_Occurred())
+        return -1;
+    task->priority = priority;
+    if (task->next != NULL && !task->flags.blocked && task->cstate->tstate)
+        slp_current_requeue(task);
+    return 0;
+}
+
+static PyObject *
+tasklet_get_deadline(PyTaskletObject *task, void *closure)
+{
+    if (task->deadline == Py_HUGE_VAL)
+        Py_RETURN_NONE;
+    return PyFloat_FromDouble(task->deadline);
+}
+
+static int
+tasklet_set_deadline(PyTaskletObject *task, PyObject *value, void *closure)
+{
+    double deadline;
+
+    if (value == NULL)
+        TYPE_ERROR("can't delete the deadline", -1);
+    if (value == Py_None)
+        deadline = Py_HUGE_VAL;
+    else {
+        deadline = PyFloat_AsDouble(value);
+        if (deadline == -1.0 && PyErr_Occurred())
+            return -1;
+        if (Py_IS_NAN(deadline))
+            VALUE_ERROR("the deadline must not be NaN", -1);
+    }
+    task->deadline = deadline;
+    if (task->next != NULL && !task->flags.blocked && task->cstate->tstate)
+        slp_current_requeue(task);
+    return 0;
+}
+
+
+/* per tasklet accounting */
+
+void
+slp_tasklet_stats_switch(PyTaskletObject *prev, PyTaskletObject *next,
+                         int hard)
+{
+    _PyTime_t now = _PyTime_GetMonotonicClock();
+
+    if (prev->stats.run_start != 0) {
+        prev->stats.run_time += now - prev->stats.run_start;
+        prev->stats.run_start = 0;
+    }
+    next->stats.run_start = now;
+    if (hard)
+        next->stats.hard_switches++;
+    else
+        next->stats.soft_switches++;
+}
+
+void
+slp_tasklet_stats_block(PyTaskletObject *task, int blocked)
+{
+    _PyTime_t now = _PyTime_GetMonotonicClock();
+
+    if (blocked)
+        task->stats.block_start = now;
+    else if (task->stats.block_start != 0) {
+        /* don't count the time, the accounting was disabled */
+        _PyTime_t since = _PyInterpreterState_GET_UNSAFE()->st.tasklet_stats_since;
+        if (task->stats.block_start < since)
+            task->stats.block_start = since;
+        task->stats.blocked_time += now - task->stats.block_start;
+        task->stats.block_start = 0;
+    }
+}
+
+int
+PyTasklet_GetStats(PyTaskletObject *task, PyTaskletStatsStruc *stats)
+{
+    _PyTime_t now = _PyTime_GetMonotonicClock();
+
+    *stats = task->stats;
+    /* include the running timeslice or block */
+    if (stats->run_start != 0)
+        stats->run_time += now - stats->run_start;
+    if (stats->block_start != 0)
+        stats->blocked_time += now - stats->block_start;
+    return 0;
+}
+
+/* add the stats of an ending tasklet to the stats of its tag */
+void
+slp_tasklet_stats_end(PyThreadState *ts, PyTaskletObject *task)
+{
+    PyObject *tag = task->stats_tag;
+    PyObject **table = &ts->interp->st.tasklet_stats_by_tag;
+    PyTaskletStatsStruc stats;
+    PyObject *old, *new;
+    _PyTime_t run_time, blocked_time;
+    Py_ssize_t soft_switches, hard_switches, count;
+
+    /* the final switch doesn't count */
+    PyTasklet_GetStats(task, &stats);
+    task->stats = stats;
+    task->stats.run_start = task->stats.block_start = 0;
+    if (tag == NULL || tag == Py_None)
+        return;
+    if (*table == NULL && (*table = PyDict_New()) == NULL)
+        goto error;
+    Py_INCREF(tag);
+    old = PyDict_GetItemWithError(*table, tag);
+    if (old == NULL && PyErr_Occurred())
+        goto error_tag;
+    run_time = stats.run_time;
+    blocked_time = stats.blocked_time;
+    soft_switches = stats.soft_switches;
+    hard_switches = stats.hard_switches;
+    count = 1;
+    if (old != NULL) {
+        long long old_run_time, old_blocked_time;
+        Py_ssize_t old_soft_switches, old_hard_switches, old_count;
+        if (!PyArg_ParseTuple(old, "LLnnn", &old_run_time, &old_blocked_time,
+                              &old_soft_switches, &old_hard_switches,
+                              &old_count))
+            goto error_tag;
+        run_time += old_run_time;
+        blocked_time += old_blocked_time;
+        soft_switches += old_soft_switches;
+        hard_switches += old_hard_switches;
+        count += old_count;
+    }
+    new = Py_BuildValue("(LLnnn)", (long long)run_time,
+                        (long long)blocked_time, soft_switches,
+                        hard_switches, count);
+    if (new == NULL || PyDict_SetItem(*table, tag, new)) {
+        Py_XDECREF(new);
+        goto error_tag;
+    }
+    Py_DECREF(new);
+    Py_DECREF(tag);
+    return;
+error_tag:
+    Py_DECREF(tag);
+error:
+    /* a tasklet can't fail to end */
+    PyErr_WriteUnraisable((PyObject *)task);
+}
+
+static PyObject *
+tasklet_get_stats(PyTaskletObject *task, void *closure)
+{
+    PyTaskletStatsStruc stats;
+
+    PyTasklet_GetStats(task, &stats);
+    return Py_BuildValue("{s:d,s:d,s:n,s:n,s:n}",
+        "run_time", _PyTime_AsSecondsDouble(stats.run_time),
+        "blocked_time", _PyTime_AsSecondsDouble(stats.blocked_time),
+        "switches", stats.soft_switches + stats.hard_switches,
+        "soft_switches", stats.soft_switches,
+        "hard_switches", stats.hard_switches);
+}
+
+
 static PyObject *
 tasklet_is_main(PyTaskletObject *task, void *closure)
 {
@@ -2017,27 +2530,28 @@ PyTasklet_GetNestingLevel(PyTaskletObject *task)
 static PyObject *
 tasklet_alive(PyTaskletObject *task, void *closure)
 {
-    return PyBool_FromLong(slp_get_frame(task) != NULL);
+    return PyBool_FromLong(PyTasklet_Alive(task));
 }
 
 int
 PyTasklet_Alive(PyTaskletObject *task)
 {
-    return slp_get_frame(task) != NULL;
+    /* an unstarted tasklet is never current */
+    return slp_get_frame(task) != NULL ||
+        (SLP_TASKLET_UNSTARTED(task) && task->cstate->tstate != NULL);
 }
 
 
 static PyObject *
 tasklet_paused(PyTaskletObject *task, void *closure)
 {
-    return PyBool_FromLong(
-        slp_get_frame(task) != NULL && task->next == NULL);
+    return PyBool_FromLong(PyTasklet_Paused(task));
 }
 
 int
 PyTasklet_Paused(PyTaskletObject *task)
 {
-    return slp_get_frame(task) != NULL && task->next == NULL;
+    return PyTasklet_Alive(task) && task->next == NULL;
 }
 
 
@@ -2128,7 +2642,10 @@ tasklet_get_trace_function(PyTaskletObject *task, void *closure)
     PyThreadState *ts = task->cstate->tstate;
     PyObject *retval;
 
-    retval = (ts && ts->st.current == task) ? ts->c_traceobj : task->traceobj;
+    if (ts && ts->st.current == task)
+        retval = ts->c_traceobj;
+    else
+        retval = task->trace != NULL ? task->trace->traceobj : NULL;
     if (retval == NULL)
         retval = Py_None;
     Py_INCREF(retval);
@@ -2157,9 +2674,13 @@ tasklet_set_trace_function(PyTaskletObject *task, PyObject *value, void *closure
     }
 
     /* tasklet is not current */
-    task->tracefunc = tf;
+    if (value == NULL && task->trace == NULL)
+        return 0;
+    if (slp_tasklet_trace_new(task))
+        return -1;
+    task->trace->tracefunc = tf;
     Py_XINCREF(value);
-    Py_XSETREF(task->traceobj, value);
+    Py_XSETREF(task->trace->traceobj, value);
     return 0;
 }
 
@@ -2169,7 +2690,10 @@ tasklet_get_profile_function(PyTaskletObject *task, void *closure)
     PyThreadState *ts = task->cstate->tstate;
     PyObject *retval;
 
-    retval = (ts && ts->st.current == task) ? ts->c_profileobj : task->profileobj;
+    if (ts && ts->st.current == task)
+        retval = ts->c_profileobj;
+    else
+        retval = task->trace != NULL ? task->trace->profileobj : NULL;
     if (retval == NULL)
         retval = Py_None;
     Py_INCREF(retval);
@@ -2198,9 +2722,13 @@ tasklet_set_profile_function(PyTaskletObject *task, PyObject *value, void *closu
     }
 
     /* tasklet is not current */
-    task->profilefunc = tf;
+    if (value == NULL && task->trace == NULL)
+        return 0;
+    if (slp_tasklet_trace_new(task))
+        return -1;
+    task->trace->profilefunc = tf;
     Py_XINCREF(value);
-    Py_XSETREF(task->profileobj, value);
+    Py_XSETREF(task->trace->profileobj, value);
     return 0;
 }
 
@@ -2347,6 +2875,10 @@ static PyMemberDef tasklet_members[] = {
      Every tasklet has a cstate, even if it is a trivial one.\n\
      Please see the cstate doc and the stackless documentation.")},
     {"tempval", T_OBJECT, offsetof(PyTaskletObject, tempval), 0},
+    {"stats_tag", T_OBJECT, offsetof(PyTaskletObject, stats_tag), 0,
+     PyDoc_STR("None or an object, that aggregates the stats of this tasklet\n\
+     with the stats of other ended tasklets with an equal tag.\n\
+     See stackless.get_tasklet_stats_by_tag().")},
     /* blocked, slicing_lock, atomic and such are treated by tp_getset */
     {0}
 };
@@ -2387,6 +2919,17 @@ static PyGetSetDef tasklet_getsetlist[] = {
      "This is used as a debugging aid to find out undesired blocking.\n"
      "Instead of trying to block, an exception is raised.")},
 
+    {"priority", (getter)tasklet_get_priority,
+                 (setter)tasklet_set_priority,
+     PyDoc_STR("The scheduling priority of this tasklet, 0 by default.\n"
+     "Runnable tasklets with a higher priority run first.")},
+
+    {"deadline", (getter)tasklet_get_deadline,
+                 (setter)tasklet_set_deadline,
+     PyDoc_STR("The deadline of this tasklet or None. Among runnable tasklets\n"
+     "of the same priority, the tasklet with the earliest deadline runs first.\n"
+     "Usually the deadline is a value of time.monotonic().")},
+
     {"is_main", (getter)tasklet_is_main, NULL,
      PyDoc_STR("There always exists exactly one tasklet per thread which acts as\n"
      "main. It receives all uncaught exceptions and can act as a watchdog.\n"
@@ -2443,6 +2986,14 @@ static PyGetSetDef tasklet_getsetlist[] = {
      {"context_id", (getter)tasklet_context_id, NULL,
       PyDoc_STR("The id of the context object of this tasklet.")},
 
+    {"stats", (getter)tasklet_get_stats, NULL,
+     PyDoc_STR("A dictionary with the accounting of this tasklet. The keys are:\n"
+     "'run_time': seconds the tasklet was the current tasklet\n"
+     "'blocked_time': seconds the tasklet was blocked on channels\n"
+     "'switches': how often the tasklet became the current tasklet\n"
+     "'soft_switches', 'hard_switches': the switches by kind\n"
+     "The accounting is active while stackless.enable_tasklet_stats() is set.")},
+
     {0},
 };
 
@@ -2480,6 +3031,8 @@ static PyMethodDef tasklet_methods[] = {
      tasklet_reduce__doc__},
     {"__setstate__",            (PCF)tasklet_setstate,      METH_O,
      tasklet_setstate__doc__},
+    {"clone",             (PCF)(void(*)(void))tasklet_clone, METH_VARARGS | METH_KEYWORDS,
+     tasklet_clone__doc__},
     {"bind_thread",              (PCF)tasklet_bind_thread,  METH_VARARGS,
     tasklet_bind_thread__doc__},
     {"context_run", (PCF)(void(*)(void))tasklet_context_run, METH_FASTCALL | METH_KEYWORDS | METH_STACKLESS,
@@ -0,0 +1,386 @@
+/******************************************************
+
+  The Worker Thread Pool
+
+ ******************************************************/
+
+#include "Python.h"
+
+#ifdef STACKLESS
+#include "pycore_stackless.h"
+#include "pythread.h"
+
+/*
+ * run_in_thread() calls a callable in a worker thread, while the calling
+ * tasklet waits. The other tasklets of the calling thread continue to run.
+ * This pays off for calls, that release the GIL and block, e.g. file I/O,
+ * getaddrinfo() or compression.
+ *
+ * Each interpreter has a pool of at most thread_pool_size worker threads,
+ * created on demand. An idle worker waits on its own lock. The queue of
+ * jobs and the list of idle workers are protected by the GIL.
+ *
+ * A finished job wakes up the waiting tasklet like a channel action of
+ * another thread: the worker stores the result (or a bomb) as tempval of
+ * the tasklet, inserts the tasklet into the run queue of its thread and
+ * unblocks the thread. If the waiting tasklet runs for some other reason,
+ * e.g. it gets killed, it abandons the job (see set_current() in
+ * scheduling.c) and the worker drops the result.
+ *
+ * A worker exits, if the pool has more workers than thread_pool_size and
+ * no waiting jobs, or if the pool shuts down. On shutdown the interpreter
+ * wakes up the idle workers and waits until the last worker is gone (see
+ * slp_thread_pool_clear()).
+ */
+
+typedef struct _slp_thread_job {
+    struct _slp_thread_job *next;
+    PyTaskletObject *task;          /* owned reference or NULL, if abandoned */
+    PyObject *func;
+    PyObject *args;
+    PyObject *kwargs;               /* or NULL */
+} PyStacklessThreadJob;
+
+typedef struct _slp_worker {
+    struct _slp_worker *next;
+    PyThread_type_lock lock;        /* an idle worker waits here */
+    struct _slp_thread_pool *pool;
+    PyThreadState *tstate;
+} PyStacklessWorker;
+
+typedef struct _slp_thread_pool {
+    PyStacklessThreadJob *head;     /* the queue of waiting jobs */
+    PyStacklessThreadJob *tail;
+    PyStacklessWorker *idle;        /* the idle workers */
+    int count;                      /* the number of worker threads */
+    int shutdown;                   /* the workers must exit */
+    PyThread_type_lock done;        /* released by the last exiting worker */
+} PyStacklessThreadPool;
+
+static void
+job_free(PyStacklessThreadJob *job)
+{
+    Py_XDECREF(job->task);
+    Py_DECREF(job->func);
+    Py_DECREF(job->args);
+    Py_XDECREF(job->kwargs);
+    PyMem_Free(job);
+}
+
+/* Wake up the waiting tasklet of a finished job. Steals the reference to
+ * result. */
+static void
+job_done(PyStacklessThreadJob *job, PyObject *result)
+{
+    PyTaskletObject *task = job->task;
+    PyThreadState *nts;
+
+    if (task == NULL) {
+        /* abandoned */
+        Py_DECREF(result);
+        return;
+    }
+    job->task = NULL;
+    assert(task->job == job);
+    task->job = NULL;
+    nts = task->cstate->tstate;
+    if (nts != NULL)
+        nts->st.thread.pending_jobs--;
+    if (nts == NULL || task->next != NULL) {
+        /* the thread of the tasklet is gone or somebody else inserted the
+         * tasklet meanwhile */
+        Py_DECREF(result);
+        Py_DECREF(task);
+        return;
+    }
+    TASKLET_SETVAL_OWN(task, result);
+    slp_current_insert(task);       /* steals the reference */
+    slp_thread_unblock(nts);
+}
+
+static void
+worker_main(void *arg)
+{
+    PyStacklessWorker *worker = (PyStacklessWorker *)arg;
+    PyStacklessThreadPool *pool = worker->pool;
+    PyThreadState *tstate = worker->tstate;
+    PyStacklessThreadJob *job;
+    PyObject *result;
+
+    tstate->thread_id = PyThread_get_thread_ident();
+    _PyThreadState_Init(tstate);
+    PyEval_AcquireThread(tstate);
+    for (;;) {
+        job = pool->head;
+        if (job == NULL) {
+            if (pool->shutdown ||
+                    pool->count > tstate->interp->st.thread_pool_size)
+                break;
+            /* wait for the next job, see thread_pool_submit() */
+            worker->next = pool->idle;
+            pool->idle = worker;
+            tstate->st.thread.is_idle_worker = 1;
+            Py_BEGIN_ALLOW_THREADS
+            PyThread_acquire_lock(worker->lock, WAIT_LOCK);
+            Py_END_ALLOW_THREADS
+            continue;
+        }
+        pool->head = job->next;
+        if (pool->head == NULL)
+            pool->tail = NULL;
+        if (job->task != NULL) {
+            result = PyObject_Call(job->func, job->args, job->kwargs);
+            if (result == NULL) {
+                result = slp_curexc_to_bomb();
+                if (result == NULL)
+                    result = slp_nomemory_bomb();
+            }
+            job_done(job, result);
+        }
+        job_free(job);
+    }
+
+    /* the GIL protects the pool until PyThreadState_DeleteCurrent() */
+    PyThreadState_Clear(tstate);
+    PyThread_free_lock(worker->lock);
+    PyMem_Free(worker);
+    if (--pool->count == 0 && pool->shutdown)
+        PyThread_release_lock(pool->done);
+    PyThreadState_DeleteCurrent();
+}
+
+static PyStacklessThreadPool *
+thread_pool_get(PyInterpreterState *interp)
+{
+    PyStacklessThreadPool *pool = interp->st.thread_pool;
+
+    if (pool != NULL)
+        return pool;
+    pool = PyMem_Malloc(sizeof(PyStacklessThreadPool));
+    if (pool == NULL) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    pool->done = PyThread_allocate_lock();
+    if (pool->done == NULL) {
+        PyMem_Free(pool);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    PyThread_acquire_lock(pool->done, WAIT_LOCK);
+    pool->head = pool->tail = NULL;
+    pool->idle = NULL;
+    pool->count = 0;
+    pool->shutdown = 0;
+    interp->st.thread_pool = pool;
+    return pool;
+}
+
+static int
+thread_pool_start_worker(PyInterpreterState *interp, PyStacklessThreadPool *pool)
+{
+    PyStacklessWorker *worker;
+
+    worker = PyMem_Malloc(sizeof(PyStacklessWorker));
+    if (worker == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    worker->next = NULL;
+    worker->pool = pool;
+    worker->lock = PyThread_allocate_lock();
+    if (worker->lock == NULL) {
+        PyMem_Free(worker);
+        PyErr_NoMemory();
+        return -1;
+    }
+    /* an idle worker blocks on its locked lock */
+    PyThread_acquire_lock(worker->lock, WAIT_LOCK);
+    worker->tstate = _PyThreadState_Prealloc(interp);
+    if (worker->tstate == NULL) {
+        PyThread_free_lock(worker->lock);
+        PyMem_Free(worker);
+        PyErr_NoMemory();
+        return -1;
+    }
+    PyEval_InitThreads();
+    if (PyThread_start_new_thread(worker_main, worker) == PYTHREAD_INVALID_THREAD_ID) {
+        PyThreadState_Clear(worker->tstate);
+        PyThreadState_Delete(worker->tstate);
+        PyThread_free_lock(worker->lock);
+        PyMem_Free(worker);
+        RUNTIME_ERROR("can't start a worker thread", -1);
+    }
+    pool->count++;
+    return 0;
+}
+
+/* Wake up an idle worker. Returns 0, if there is none. */
+static int
+thread_pool_wake_worker(PyStacklessThreadPool *pool)
+{
+    PyStacklessWorker *worker = pool->idle;
+
+    if (worker == NULL)
+        return 0;
+    pool->idle = worker->next;
+    worker->tstate->st.thread.is_idle_worker = 0;
+    PyThread_release_lock(worker->lock);
+    return 1;
+}
+
+/* Queue a job for the tasklet task. Wake up an idle worker or start a new
+ * one, if the pool isn't full. */
+static int
+thread_pool_submit(PyThreadState *ts, PyTaskletObject *task, PyObject *func,
+                   PyObject *args, PyObject *kwargs)
+{
+    PyStacklessThreadPool *pool;
+    PyStacklessThreadJob *job;
+
+    if ((pool = thread_pool_get(ts->interp)) == NULL)
+        return -1;
+    if (pool->idle == NULL && pool->count < ts->interp->st.thread_pool_size &&
+            thread_pool_start_worker(ts->interp, pool))
+        return -1;
+    job = PyMem_Malloc(sizeof(PyStacklessThreadJob));
+    if (job == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    Py_INCREF(task);
+    Py_INCREF(func);
+    Py_INCREF(args);
+    Py_XINCREF(kwargs);
+    job->next = NULL;
+    job->task = task;
+    job->func = func;
+    job->args = args;
+    job->kwargs = kwargs;
+    if (pool->tail == NULL)
+        pool->head = job;
+    else
+        pool->tail->next = job;
+    pool->tail = job;
+    task->job = job;
+    ts->st.thread.pending_jobs++;
+    thread_pool_wake_worker(pool);
+    return 0;
+}
+
+/* The waiting tasklet task runs for some other reason. */
+void
+slp_thread_job_abandon(PyTaskletObject *task)
+{
+    PyStacklessThreadJob *job = task->job;
+    PyThreadState *ts = task->cstate->tstate;
+
+    assert(job != NULL && job->task == task);
+    assert(ts != NULL);
+    task->job = NULL;
+    job->task = NULL;
+    ts->st.thread.pending_jobs--;
+    Py_DECREF(task);
+}
+
+static PyObject *
+run_in_thread_main(PyObject *self, PyObject *args);
+
+PyObject *
+PyStackless_RunInThread(PyObject *func, PyObject *args, PyObject *kwargs)
+{
+    STACKLESS_GETARG();
+    PyThreadState *ts = _PyThreadState_GET();
+    PyTaskletObject *current = ts->st.current;
+    PyObject *ret;
+
+    if (ts->st.main == NULL) {
+        PyMethodDef def = {"run_in_thread", (PyCFunction)run_in_thread_main,
+                           METH_VARARGS};
+        return PyStackless_CallCMethod_Main(&def, NULL, "OOO", func, args,
+                                            kwargs != NULL ? kwargs : Py_None);
+    }
+    if (!PyCallable_Check(func))
+        TYPE_ERROR("run_in_thread() argument must be callable", NULL);
+    if (!PyTuple_Check(args))
+        TYPE_ERROR("run_in_thread() arguments must be a tuple", NULL);
+    if (kwargs != NULL && !PyDict_Check(kwargs))
+        TYPE_ERROR("run_in_thread() keyword arguments must be a dict", NULL);
+    if (current->flags.block_trap)
+        RUNTIME_ERROR("this tasklet does not like to be blocked.", NULL);
+    if (thread_pool_submit(ts, current, func, args, kwargs))
+        return NULL;
+    STACKLESS_PROMOTE_ALL();
+    ret = PyStackless_Schedule(Py_None, 1);
+    if (ret == NULL && current->job != NULL)
+        slp_thread_job_abandon(current);
+    return ret;
+}
+
+static PyObject *
+run_in_thread_main(PyObject *self, PyObject *args)
+{
+    PyObject *func, *fargs, *kwargs;
+
+    if (!PyArg_ParseTuple(args, "OOO:run_in_thread", &func, &fargs, &kwargs))
+        return NULL;
+    return PyStackless_RunInThread(func, fargs, kwargs != Py_None ? kwargs : NULL);
+}
+
+int
+PyStackless_SetThreadPoolSize(int size)
+{
+    PyInterpreterState *interp = _PyInterpreterState_Get();
+    PyStacklessThreadPool *pool = interp->st.thread_pool;
+    int old = interp->st.thread_pool_size;
+    int surplus;
+
+    if (size < 1)
+        VALUE_ERROR("the size of the thread pool must be positive", -1);
+    interp->st.thread_pool_size = size;
+    /* the woken up workers exit, see worker_main() */
+    if (pool != NULL)
+        for (surplus = pool->count - size; surplus > 0; surplus--)
+            if (!thread_pool_wake_worker(pool))
+                break;
+    return old;
+}
+
+/* Shut down the pool. Drop the waiting jobs, wake up the idle workers and
+ * wait until all workers are gone. A worker exits, after it finished its
+ * current call. Called with the GIL held by Py_EndInterpreter() and
+ * Py_FinalizeEx() before they check for remaining threads and again by
+ * PyInterpreterState_Clear(). */
+void
+slp_thread_pool_clear(PyInterpreterState *interp)
+{
+    PyStacklessThreadPool *pool = interp->st.thread_pool;
+    PyStacklessThreadJob *job;
+    PyTaskletObject *task;
+
+    if (pool == NULL)
+        return;
+    interp->st.thread_pool = NULL;
+    while ((job = pool->head) != NULL) {
+        pool->head = job->next;
+        if ((task = job->task) != NULL) {
+            task->job = NULL;
+            if (task->cstate->tstate != NULL)
+                task->cstate->tstate->st.thread.pending_jobs--;
+        }
+        job_free(job);
+    }
+    pool->tail = NULL;
+    pool->shutdown = 1;
+    if (pool->count > 0) {
+        while (thread_pool_wake_worker(pool))
+            ;
+        Py_BEGIN_ALLOW_THREADS
+        PyThread_acquire_lock(pool->done, WAIT_LOCK);
+        Py_END_ALLOW_THREADS
+    }
+    PyThread_free_lock(pool->done);
+    PyMem_Free(pool);
+}
+
+#endif
@@ -0,0 +1,279 @@
+/******************************************************
+
+  The Timer Wheel
+
+ ******************************************************/
+
+#include "Python.h"
+
+#ifdef STACKLESS
+#include "pycore_stackless.h"
+
+/*
+ * Timers wake up sleeping tasklets. Each thread has its own hierarchical
+ * timer wheel, similar to the classic timer wheel of the Linux kernel.
+ *
+ * A timer, that expires in less than SLP_TIMER_SLOTS ** (L+1) ticks, goes
+ * to level L. Its slot is given by the bits of the expiry tick, that belong
+ * to level L. Whenever the tick of the wheel passes a multiple of
+ * SLP_TIMER_SLOTS ** L, the timers of the next slot of level L get
+ * redistributed to the lower levels ("cascade"). The timers of a slot of
+ * level 0 expire at the same tick.
+ *
+ * Adding and cancelling a timer takes constant time. The wheel skips
+ * stretches of ticks without timers.
+ */
+
+#define SLOT_MASK (SLP_TIMER_SLOTS - 1)
+#define LEVEL_SHIFT(level) (SLP_TIMER_SLOT_BITS * (level))
+#define LEVEL_SPAN(level) ((_PyTime_t)1 << LEVEL_SHIFT(level))
+
+static _PyTime_t
+current_tick(void)
+{
+    return _PyTime_GetMonotonicClock() / SLP_TIMER_RESOLUTION;
+}
+
+static void
+wheel_insert(PyStacklessTimerWheel *wheel, PyStacklessTimer *timer)
+{
+    _PyTime_t expires = timer->expires;
+    _PyTime_t delta = expires - wheel->tick;
+    PyStacklessTimer **slot;
+    int level = 0;
+
+    if (delta < 0) {
+        /* already expired, fire at the next tick */
+        expires = wheel->tick;
+        delta = 0;
+    }
+    else if (delta >= LEVEL_SPAN(SLP_TIMER_LEVELS)) {
+        /* beyond the range of the wheel, cascade again later */
+        expires = wheel->tick + LEVEL_SPAN(SLP_TIMER_LEVELS) - 1;
+        delta = LEVEL_SPAN(SLP_TIMER_LEVELS) - 1;
+    }
+    while (delta >= LEVEL_SPAN(level + 1))
+        level++;
+    slot = &wheel->slots[level][(expires >> LEVEL_SHIFT(level)) & SLOT_MASK];
+    SLP_CHAIN_INSERT(PyStacklessTimer, slot, timer, next, prev);
+    timer->slot = slot;
+    timer->level = level;
+    wheel->level_count[level]++;
+}
+
+static void
+wheel_remove(PyStacklessTimerWheel *wheel, PyStacklessTimer *timer)
+{
+    PyStacklessTimer *hold = *timer->slot, *ret;
+    PyStacklessTimer **slot = timer->slot;
+
+    /* SLP_CHAIN_REMOVE removes the head of the chain */
+    *slot = timer;
+    SLP_CHAIN_REMOVE(PyStacklessTimer, slot, ret, next, prev);
+    assert(ret == timer);
+    if (hold != timer)
+        *slot = hold;
+    wheel->level_count[timer->level]--;
+    timer->slot = NULL;
+}
+
+/* fire a timer, that has been removed from the wheel */
+static void
+timer_fire(PyThreadState *ts, PyStacklessTimer *timer)
+{
+    PyTaskletObject *task = timer->task;
+    slp_timer_func *func = timer->func;
+
+    assert(task->timer == timer);
+    task->timer = NULL;
+    PyMem_Free(timer);
+    if (func != NULL) {
+        func(ts, task);
+        return;
+    }
+    if (task->next != NULL) {
+        /* somebody else inserted the tasklet meanwhile */
+        Py_DECREF(task);
+        return;
+    }
+    slp_current_insert(task);   /* steals the reference */
+}
+
+/* move the timers of a slot to lower levels */
+static void
+wheel_cascade(PyStacklessTimerWheel *wheel, int level, int index)
+{
+    PyStacklessTimer *chain = wheel->slots[level][index], *timer;
+
+    wheel->slots[level][index] = NULL;
+    while (chain != NULL) {
+        SLP_CHAIN_REMOVE(PyStacklessTimer, &chain, timer, next, prev);
+        wheel->level_count[level]--;
+        wheel_insert(wheel, timer);
+    }
+}
+
+int
+slp_timer_add(PyThreadState *ts, PyTaskletObject *task, _PyTime_t when,
+              slp_timer_func *func)
+{
+    PyStacklessTimerWheel *wheel = ts->st.timers;
+    PyStacklessTimer *timer;
+
+    assert(task->timer == NULL);
+    if (wheel == NULL) {
+        wheel = PyMem_Calloc(1, sizeof(PyStacklessTimerWheel));
+        if (wheel == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        wheel->tick = current_tick();
+        ts->st.timers = wheel;
+    }
+    else if (wheel->count == 0) {
+        /* nothing to process, skip the idle ticks */
+        wheel->tick = current_tick();
+    }
+    timer = PyMem_Malloc(sizeof(PyStacklessTimer));
+    if (timer == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    timer->next = timer->prev = NULL;
+    /* round up, a timer never fires early */
+    timer->expires = (when + SLP_TIMER_RESOLUTION - 1) / SLP_TIMER_RESOLUTION;
+    Py_INCREF(task);
+    timer->task = task;
+    timer->func = func;
+    wheel_insert(wheel, timer);
+    wheel->count++;
+    task->timer = timer;
+    return 0;
+}
+
+void
+slp_timer_cancel(PyTaskletObject *task)
+{
+    PyStacklessTimer *timer = task->timer;
+    PyThreadState *ts = task->cstate->tstate;
+
+    assert(timer != NULL);
+    assert(ts != NULL && ts->st.timers != NULL);
+    wheel_remove(ts->st.timers, timer);
+    ts->st.timers->count--;
+    task->timer = NULL;
+    PyMem_Free(timer);
+    Py_DECREF(task);
+}
+
+/* Fire all expired timers. Returns the number of fired timers. */
+Py_ssize_t
+slp_timer_poll(PyThreadState *ts)
+{
+    PyStacklessTimerWheel *wheel = ts->st.timers;
+    Py_ssize_t fired = 0;
+    _PyTime_t now, tick;
+    int level, index;
+
+    if (wheel == NULL || wheel->count == 0)
+        return 0;
+    now = current_tick();
+    while (wheel->tick <= now && wheel->count > 0) {
+        tick = wheel->tick;
+        if ((tick & SLOT_MASK) == 0) {
+            for (level = 1; level < SLP_TIMER_LEVELS; level++) {
+                index = (tick >> LEVEL_SHIFT(level)) & SLOT_MASK;
+                wheel_cascade(wheel, level, index);
+                if (index != 0)
+                    break;
+            }
+        }
+        index = tick & SLOT_MASK;
+        while (wheel->slots[0][index] != NULL) {
+            PyStacklessTimer *timer = wheel->slots[0][index];
+            wheel_remove(wheel, timer);
+            wheel->count--;
+            timer_fire(ts, timer);
+            fired++;
+        }
+        wheel->tick = ++tick;
+
+        /* skip ticks, until the next cascade of a level with timers */
+        if (wheel->level_count[0] == 0) {
+            for (level = 1; level < SLP_TIMER_LEVELS; level++)
+                if (wheel->level_count[level] != 0)
+                    break;
+            tick = (tick + LEVEL_SPAN(level) - 1) & ~(LEVEL_SPAN(level) - 1);
+            wheel->tick = Py_MIN(tick, now + 1);
+        }
+    }
+    if (wheel->count == 0)
+        wheel->tick = now + 1;
+    return fired;
+}
+
+/* Return the expiry time of the next timer on the monotonic clock or -1,
+ * if there are no timers. The result may be early, but never late. */
+_PyTime_t
+slp_timer_next(PyThreadState *ts)
+{
+    PyStacklessTimerWheel *wheel = ts->st.timers;
+    _PyTime_t next = -1, window;
+    PyStacklessTimer *chain, *timer;
+    int level, i;
+
+    if (wheel == NULL || wheel->count == 0)
+        return -1;
+    for (level = 0; level < SLP_TIMER_LEVELS; level++) {
+        if (wheel->level_count[level] == 0)
+            continue;
+        /* the timers of the first used slot of a level expire first */
+        window = (wheel->tick + LEVEL_SPAN(level) - 1) >> LEVEL_SHIFT(level);
+        for (i = 0; i < SLP_TIMER_SLOTS; i++) {
+            chain = wheel->slots[level][(window + i) & SLOT_MASK];
+            if (chain == NULL)
+                continue;
+            timer = chain;
+            do {
+                if (next == -1 || timer->expires < next)
+                    next = timer->expires;
+                timer = timer->next;
+            } while (timer != chain);
+            break;
+        }
+    }
+    assert(next != -1);
+    /* a timer, that got clamped to the range of the wheel, needs a cascade */
+    next = Py_MIN(next, wheel->tick + LEVEL_SPAN(SLP_TIMER_LEVELS) - 1);
+    return Py_MAX(next, wheel->tick) * SLP_TIMER_RESOLUTION;
+}
+
+/* Release all timers of a thread state. The tasklets don't wake up. */
+void
+slp_timer_clear(PyThreadState *ts)
+{
+    PyStacklessTimerWheel *wheel = ts->st.timers;
+    PyStacklessTimer *timer;
+    PyTaskletObject *task;
+    int level, index;
+
+    if (wheel == NULL)
+        return;
+    ts->st.timers = NULL;
+    for (level = 0; level < SLP_TIMER_LEVELS; level++) {
+        for (index = 0; index < SLP_TIMER_SLOTS; index++) {
+            while ((timer = wheel->slots[level][index]) != NULL) {
+                wheel_remove(wheel, timer);
+                wheel->count--;
+                task = timer->task;
+                task->timer = NULL;
+                PyMem_Free(timer);
+                Py_DECREF(task);
+            }
+        }
+    }
+    assert(wheel->count == 0);
+    PyMem_Free(wheel);
+}
+
+#endif
@@ -983,6 +983,8 @@ static int init_functype(PyObject * mod)
 #define frametuplefmt "O)(OibOiOOiiOO"
 
 SLP_DEF_INVALID_EXEC(slp_channel_seq_callback)
+SLP_DEF_INVALID_EXEC(slp_channel_send_many_callback)
+SLP_DEF_INVALID_EXEC(slp_channel_receive_many_callback)
 SLP_DEF_INVALID_EXEC(slp_tp_init_callback)
 
 static PyTypeObject wrap_PyFrame_Type;
@@ -1246,6 +1248,129 @@ err_exit:
     return NULL;
 }
 
+/*
+ * Return a copy of a local variable for frame_clone(). Objects get copied
+ * only once, the memo maps the id of an original object to its copy.
+ * Without a memo entry and without the callable copy, the object is shared.
+ */
+static PyObject *
+frame_clone_value(PyObject *v, PyObject *memo, PyObject *copy)
+{
+    PyObject *key, *res;
+
+    if (v == NULL || memo == NULL) {
+        Py_XINCREF(v);
+        return v;
+    }
+    key = PyLong_FromVoidPtr(v);
+    if (key == NULL)
+        return NULL;
+    res = PyDict_GetItemWithError(memo, key);
+    if (res != NULL)
+        Py_INCREF(res);
+    else if (!PyErr_Occurred()) {
+        if (copy == NULL) {
+            Py_INCREF(v);
+            res = v;
+        }
+        else if ((res = PyObject_CallFunctionObjArgs(copy, v, NULL)) != NULL &&
+                 PyDict_SetItem(memo, key, res)) {
+            Py_CLEAR(res);
+        }
+    }
+    Py_DECREF(key);
+    return res;
+}
+
+/*
+ * Clone a frame without the round-trip through frameobject_reduce() and
+ * frame_setstate(). The result is the same: the clone shares the code,
+ * the globals, the locals mapping and the cells with f, and f_back is
+ * Py_None to mark the frame as coming from unpickling.
+ *
+ * If memo is not NULL, the fast locals are copied with frame_clone_value()
+ * and the objects on the value stack are replaced by their copy in memo.
+ */
+static PyFrameObject *
+frame_clone(PyFrameObject *f, PyObject *memo, PyObject *copy)
+{
+    PyThreadState *ts = _PyThreadState_GET();
+    PyCodeObject *co = f->f_code;
+    PyFrameObject *fnew;
+    PyObject **f_stacktop, *v;
+    Py_ssize_t i, n, nlocals, nstack;
+    char *pcode;
+    int valid = 1;
+
+    f_stacktop = f->f_stacktop;
+    if (f_stacktop == NULL) {
+        /* frames without a stacktop cannot be run */
+        f_stacktop = f->f_valuestack;
+        valid = 0;
+    }
+    else if (f_stacktop < f->f_valuestack) {
+        PyErr_SetString(PyExc_ValueError, "stack underflow");
+        return NULL;
+    }
+    pcode = PyBytes_AsString(co->co_code);
+    if (NULL == pcode)
+        return NULL;
+    if (*pcode == CODE_INVALID_OPCODE)
+        valid = 0;
+
+    fnew = PyFrame_New(ts, co, f->f_globals, f->f_globals);
+    if (fnew == NULL)
+        return NULL;
+    Py_XINCREF(f->f_locals);
+    Py_XSETREF(fnew->f_locals, f->f_locals);
+    if (f->f_trace != NULL && f->f_trace != Py_None &&
+            ts->st.pickleflags & SLP_PICKLEFLAGS_PRESERVE_TRACING_STATE) {
+        Py_INCREF(f->f_trace);
+        fnew->f_trace = f->f_trace;
+    }
+
+    nlocals = co->co_nlocals;
+    nstack = f->f_valuestack - f->f_localsplus;
+    n = f_stacktop - f->f_localsplus;
+    for (i = 0; i < n; i++) {
+        v = f->f_localsplus[i];
+        if (i < nlocals || i >= nstack) {
+            /* cells and free variables are always shared */
+            v = frame_clone_value(v, memo, i < nlocals ? copy : NULL);
+            if (v == NULL && PyErr_Occurred())
+                goto err_exit;
+        }
+        else
+            Py_XINCREF(v);
+        fnew->f_localsplus[i] = v;
+    }
+    fnew->f_stacktop = fnew->f_localsplus + n;
+
+    /* mark this frame as coming from unpickling */
+    Py_INCREF(Py_None);
+    Py_CLEAR(fnew->f_back);
+    fnew->f_back = (PyFrameObject *) Py_None;
+
+    fnew->f_lasti = f->f_lasti;
+    fnew->f_lineno = f->f_lineno;
+    fnew->f_iblock = f->f_iblock;
+    for (i = 0; i < CO_MAXBLOCKS; i++) {
+        if (i < f->f_iblock)
+            fnew->f_blockstack[i] = f->f_blockstack[i];
+        else {
+            fnew->f_blockstack[i].b_type =
+            fnew->f_blockstack[i].b_handler =
+            fnew->f_blockstack[i].b_level = 0;
+        }
+    }
+    fnew->f_executing = valid ? f->f_executing : SLP_FRAME_EXECUTING_INVALID;
+    return fnew;
+err_exit:
+    fnew->f_stacktop = fnew->f_localsplus + i;
+    Py_DECREF(fnew);
+    return NULL;
+}
+
 PyFrameObject *
 slp_clone_frame(PyFrameObject *f)
 {
@@ -1253,9 +1378,8 @@ slp_clone_frame(PyFrameObject *f)
     PyFrameObject *fnew;
 
     if (PyFrame_Check(f))
-        tup = frameobject_reduce(f, NULL);
-    else
-        tup = PyObject_CallMethod((PyObject *) f, "__reduce__", "");
+        return frame_clone(f, NULL, NULL);
+    tup = PyObject_CallMethod((PyObject *) f, "__reduce__", "");
     if (tup == NULL)
         return NULL;
     if (!PyTuple_Check(tup)) {
@@ -1318,12 +1442,118 @@ slp_ensure_new_frame(PyFrameObject *f)
     return f;
 }
 
+/*
+ * Clone the frames of a tasklet for tasklet.clone(). The list frames holds
+ * the frames from the outermost to the innermost one, as returned by
+ * slp_tasklet_reduce(t, 0). The result is a new list of cloned frames.
+ *
+ * The iterators on the value stacks, i.e. the iterators of running for-loops,
+ * get copied with copy.copy(), because otherwise the clone and the original
+ * would consume the same iterator. Iterators, that can't be copied, are
+ * shared. If copy is not NULL, it is called once for every object referenced
+ * by a fast local variable and the clone gets the result. All other objects
+ * are shared.
+ */
+PyObject *
+slp_clone_frames(PyObject *frames, PyObject *copy)
+{
+    PyObject *memo, *res = NULL, *shallow_copy = NULL;
+    PyFrameObject *f, *fnew;
+    Py_ssize_t i, n;
+
+    assert(PyList_Check(frames));
+    memo = PyDict_New();
+    if (memo == NULL)
+        return NULL;
+    n = PyList_GET_SIZE(frames);
+    for (i = 0; i < n; i++) {
+        PyObject **p;
+
+        f = (PyFrameObject *) PyList_GET_ITEM(frames, i);
+        if (!PyFrame_Check(f))
+            continue;
+        if (f->f_gen != NULL) {
+            PyErr_SetString(PyExc_RuntimeError,
+                            "cannot clone a tasklet, that executes a "
+                            "generator or coroutine");
+            goto err_exit;
+        }
+        if (f->f_stacktop == NULL)
+            continue;
+        for (p = f->f_valuestack; p < f->f_stacktop; p++) {
+            PyObject *v = *p, *key, *c;
+            iternextfunc next;
+            int ret;
+
+            if (v == NULL)
+                continue;
+            next = Py_TYPE(v)->tp_iternext;
+            if (next == NULL || next == &_PyObject_NextNotImplemented ||
+                    PyGen_Check(v) || PyChannel_Check(v))
+                continue;
+            if (shallow_copy == NULL) {
+                PyObject *module = PyImport_ImportModule("copy");
+                if (module == NULL)
+                    goto err_exit;
+                shallow_copy = PyObject_GetAttrString(module, "copy");
+                Py_DECREF(module);
+                if (shallow_copy == NULL)
+                    goto err_exit;
+            }
+            key = PyLong_FromVoidPtr(v);
+            if (key == NULL)
+                goto err_exit;
+            ret = PyDict_Contains(memo, key);
+            if (ret == 0) {
+                c = PyObject_CallFunctionObjArgs(shallow_copy, v, NULL);
+                if (c == NULL && PyErr_ExceptionMatches(PyExc_TypeError)) {
+                    /* not copyable, share the iterator */
+                    PyErr_Clear();
+                    Py_INCREF(v);
+                    c = v;
+                }
+                ret = c == NULL ? -1 : PyDict_SetItem(memo, key, c);
+                Py_XDECREF(c);
+            }
+            Py_DECREF(key);
+            if (ret < 0)
+                goto err_exit;
+        }
+    }
+
+    res = PyList_New(n);
+    if (res == NULL)
+        goto err_exit;
+    for (i = 0; i < n; i++) {
+        f = (PyFrameObject *) PyList_GET_ITEM(frames, i);
+        if (PyFrame_Check(f))
+            /* without a copy and without copied iterators, share all */
+            fnew = frame_clone(f, copy == NULL && PyDict_GET_SIZE(memo) == 0 ?
+                               NULL : memo, copy);
+        else
+            fnew = slp_clone_frame(f);
+        if (fnew == NULL) {
+            Py_CLEAR(res);
+            goto err_exit;
+        }
+        PyList_SET_ITEM(res, i, (PyObject *) fnew);
+    }
+err_exit:
+    Py_XDECREF(shallow_copy);
+    Py_DECREF(memo);
+    return res;
+}
+
 MAKE_WRAPPERTYPE(PyFrame_Type, frame, "frame", frameobject_reduce, frame_new, frame_setstate)
 
 static int init_frametype(PyObject * mod)
 {
     return slp_register_execute(&PyCFrame_Type, "channel_seq_callback",
                              slp_channel_seq_callback, SLP_REF_INVALID_EXEC(slp_channel_seq_callback))
+        || slp_register_execute(&PyCFrame_Type, "channel_send_many_callback",
+                             slp_channel_send_many_callback, SLP_REF_INVALID_EXEC(slp_channel_send_many_callback))
+        || slp_register_execute(&PyCFrame_Type, "channel_receive_many_callback",
+                             slp_channel_receive_many_callback, SLP_REF_INVALID_EXEC(slp_channel_receive_many_callback))
         || slp_register_execute(&PyCFrame_Type, "slp_tp_init_callback",
                              slp_tp_init_callback, SLP_REF_INVALID_EXEC(slp_tp_init_callback))
         || init_type(&wrap_PyFrame_Type, initchain, mod);
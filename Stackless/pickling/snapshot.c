@@ -0,0 +1,2417 @@
+/******************************************************
+
+  Native tasklet snapshots
+
+ ******************************************************/
+
+#include "Python.h"
+#ifdef STACKLESS
+
+#include "compile.h"
+#include "marshal.h"
+
+#include "pycore_stackless.h"
+#include "pycore_slp_prickelpit.h"
+
+/*
+ * stackless.snapshot() serializes a list of tasklets without the generic
+ * __reduce__ machinery for frames. The tasklets still reduce themselves,
+ * but the frames of type PyFrame_Type get written as compact records:
+ * the code object, globals, locals, the block stack and the value stack
+ * are stored as numbers. Other frames (i.e. C frames) and all other
+ * objects end up in a table of objects, that gets pickled. The code
+ * objects of the frames get marshalled once and are shared by number.
+ *
+ * Snapshots form chains. stackless.snapshot() makes a chain of a single
+ * snapshot, a stackless.checkpointer makes a chain of many snapshots.
+ * The first snapshot of a chain (generation 1) is complete, each further
+ * snapshot is a delta: a frame, that did not change since the previous
+ * snapshot of the chain, is not written again. Its record refers to the
+ * record of the generation, that stored the frame. A frame is unchanged,
+ * if it is the same frame object with the same f_lasti, f_iblock,
+ * f_executing and the same objects in f_localsplus up to f_stacktop.
+ * The checkpointer remembers these values, because PyFrameObject has no
+ * room for a generation stamp. The values don't show in place mutations:
+ * a loop, that appends to a local list and parks at the same call every
+ * time, looks unchanged. Therefore a frame only gets referenced, if it and
+ * the next newer frame are unchanged. Then the frame is still suspended in
+ * the same call and can't have executed. The topmost frame of a tasklet,
+ * that ran since the previous snapshot (see PyTaskletObject.nswitches),
+ * always gets written. The frame of a generator is an object of the table
+ * like the C frames, because the generator pickles it too. A generator
+ * frame is never unchanged, its caller may have resumed it many times.
+ * Only the oldest frames of a tasklet, up to the first frame, that gets
+ * written, get referenced.
+ *
+ * The objects of the tables have numbers, that are unique in a chain.
+ * If a delta stores an object again, the new copy gets the old number and
+ * replaces the older copy for all frames. An object, that is referenced
+ * only by unchanged frames, gets restored from the generation, that
+ * stored it last.
+ *
+ * Layout of a snapshot (varint: unsigned LEB128, signed values zigzag
+ * encoded):
+ *
+ *   "SLPS" varint(version) varint(magic number of the interpreter)
+ *   chain id (SNAPSHOT_CHAIN_ID_SIZE bytes) varint(generation)
+ *   varint(number of object numbers in the chain)
+ *   varint(number of the first code object)
+ *   varint(size) marshal(tuple of the code objects new in this generation)
+ *   varint(size) pickle(tuple of (callable, args) to create the tasklets)
+ *   varint(n) n * varint(number of the tasklet in the chain)
+ *   varint(m) m * varint(object number)
+ *   varint(number of out-of-band buffers of the object table)
+ *   varint(size) pickle(tuple of the m objects)
+ *   per tasklet: varint(state) varint(number of frames)
+ *                frame records, the oldest frame first
+ *
+ * The frames of a snapshot are numbered in this order. The record of a
+ * frame is either
+ *
+ *   SNAPSHOT_FRAME_OBJECT varint(frame)
+ *
+ * or
+ *
+ *   SNAPSHOT_FRAME_STORED varint(generation) varint(frame number) varint(n)
+ *
+ * for n frames, that the given generation stored with consecutive numbers
+ * beginning with frame number, or
+ *
+ *   SNAPSHOT_FRAME_NATIVE varint(code) varint(globals) optional(locals)
+ *   optional(f_trace) signed(f_lasti) signed(f_lineno) signed(f_executing)
+ *   varint(f_iblock) f_iblock * signed(b_type, b_handler, b_level)
+ *   varint(n) n * optional(f_localsplus[i])
+ *
+ * where code is the number of a code object, all other objects are given
+ * by object number and optional(x) is 0 for NULL and 1 + number of x
+ * otherwise. The state of a tasklet is the state from
+ * tasklet.__reduce_ex__() with None instead of the list of frames.
+ *
+ * The pickle of the object table refers to the tasklets of the snapshot
+ * and to the code objects of the chain by persistent id. Therefore a
+ * tasklet in the local variables of another tasklet, in a channel or in
+ * tempval gets restored exactly once.
+ *
+ * If snapshot() gets a buffer callback, the object table gets pickled with
+ * protocol 5 and the exact bytes, bytearray, array.array and memoryview
+ * objects get persistent ids, that contain a pickle.PickleBuffer of the
+ * object. The pickler offers these buffers to the callback and the
+ * callback decides, which buffers go out-of-band. restore() takes the
+ * out-of-band buffers of all snapshots of the chain, the oldest first. If
+ * a buffer still exports the memory of an object of the right type, the
+ * restored frames get this object without a copy.
+ */
+
+#define SNAPSHOT_MAGIC "SLPS"
+#define SNAPSHOT_MAGIC_SIZE 4
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_CHAIN_ID_SIZE 8
+
+#define SNAPSHOT_FRAME_NATIVE 0
+#define SNAPSHOT_FRAME_OBJECT 1
+#define SNAPSHOT_FRAME_STORED 2
+
+/* the index of the list of frames in the state of a tasklet */
+#define SNAPSHOT_STATE_FRAMES 3
+
+#define PERSISTENT_TASKLET(number) (2 * (number))
+#define PERSISTENT_CODE(number) (2 * (number) + 1)
+
+/* the kinds of objects with a persistent id (kind, buffer, ...) */
+#define PERSISTENT_BYTES 0
+#define PERSISTENT_BYTEARRAY 1
+#define PERSISTENT_ARRAY 2
+#define PERSISTENT_MEMORYVIEW 3
+
+/* output buffer */
+
+typedef struct {
+    unsigned char *buf;
+    Py_ssize_t len;
+    Py_ssize_t allocated;
+} snapshot_buffer;
+
+static int
+buffer_grow(snapshot_buffer *b, Py_ssize_t n)
+{
+    Py_ssize_t allocated;
+    unsigned char *buf;
+
+    if (b->len + n <= b->allocated)
+        return 0;
+    if (b->len > (PY_SSIZE_T_MAX - 256) / 2 - n) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    allocated = (b->len + n) * 2 + 256;
+    buf = PyMem_Realloc(b->buf, allocated);
+    if (buf == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    b->buf = buf;
+    b->allocated = allocated;
+    return 0;
+}
+
+static int
+write_varint(snapshot_buffer *b, size_t value)
+{
+    if (b->allocated - b->len < 10 && buffer_grow(b, 10))
+        return -1;
+    do {
+        unsigned char c = value & 0x7f;
+
+        value >>= 7;
+        b->buf[b->len++] = value ? c | 0x80 : c;
+    } while (value);
+    return 0;
+}
+
+static int
+write_signed(snapshot_buffer *b, Py_ssize_t value)
+{
+    return write_varint(b, value < 0 ? ((size_t)~value << 1) | 1 : (size_t)value << 1);
+}
+
+static int
+write_raw(snapshot_buffer *b, const void *data, Py_ssize_t size)
+{
+    if (buffer_grow(b, size))
+        return -1;
+    memcpy(b->buf + b->len, data, size);
+    b->len += size;
+    return 0;
+}
+
+static int
+write_bytes(snapshot_buffer *b, PyObject *bytes)
+{
+    Py_ssize_t size = PyBytes_GET_SIZE(bytes);
+
+    if (write_varint(b, size))
+        return -1;
+    return write_raw(b, PyBytes_AS_STRING(bytes), size);
+}
+
+/* dictionaries {id(obj): number} */
+
+/* Return the number of obj, -1 if there is none or -2 on error. */
+static Py_ssize_t
+id_get(PyObject *ids, PyObject *obj)
+{
+    PyObject *key, *value;
+
+    key = PyLong_FromVoidPtr(obj);
+    if (key == NULL)
+        return -2;
+    value = PyDict_GetItemWithError(ids, key);
+    Py_DECREF(key);
+    if (value == NULL)
+        return PyErr_Occurred() ? -2 : -1;
+    return PyLong_AsSsize_t(value);
+}
+
+static int
+id_set(PyObject *ids, PyObject *obj, Py_ssize_t number)
+{
+    PyObject *key, *value;
+    int ret = -1;
+
+    key = PyLong_FromVoidPtr(obj);
+    if (key == NULL)
+        return -1;
+    value = PyLong_FromSsize_t(number);
+    if (value != NULL) {
+        ret = PyDict_SetItem(ids, key, value);
+        Py_DECREF(value);
+    }
+    Py_DECREF(key);
+    return ret;
+}
+
+static int
+id_del(PyObject *ids, PyObject *obj)
+{
+    PyObject *key;
+    int ret;
+
+    key = PyLong_FromVoidPtr(obj);
+    if (key == NULL)
+        return -1;
+    ret = PyDict_DelItem(ids, key);
+    Py_DECREF(key);
+    return ret;
+}
+
+/******************************************************
+
+  The checkpointer
+
+ ******************************************************/
+
+/* an object, that is referenced by remembered frames */
+typedef struct {
+    PyObject *obj;              /* NULL for a free entry */
+    Py_ssize_t number;          /* the object number or the next free entry */
+    Py_ssize_t count;           /* number of references */
+} checkpoint_object;
+
+/* a frame, that a snapshot stored */
+typedef struct {
+    PyFrameObject *frame;       /* NULL, if the frame can't be referenced */
+    PyObject *globals;
+    Py_ssize_t generation;      /* the snapshot, that stored the frame */
+    Py_ssize_t record;          /* the number of the frame in the snapshot */
+    int lasti;
+    int iblock;
+    int executing;
+    Py_ssize_t nslots;
+    PyObject **slots;           /* f_localsplus up to f_stacktop */
+} checkpoint_frame;
+
+/* the frames of a tasklet, the oldest frame first */
+typedef struct {
+    Py_ssize_t nframes;
+    checkpoint_frame *frames;
+    Py_ssize_t nswitches;       /* PyTaskletObject.nswitches of the snapshot */
+} checkpoint_chain;
+
+typedef struct {
+    PyObject_HEAD
+    unsigned char chain_id[SNAPSHOT_CHAIN_ID_SIZE];
+    Py_ssize_t generation;      /* the generation of the last snapshot */
+    Py_ssize_t nobjects;        /* object numbers handed out */
+    PyObject *tasklets;         /* the tasklets of the chain by number */
+    PyObject *tasklet_ids;      /* {id(tasklet): number} */
+    PyObject *codes;            /* the code objects of the chain by number */
+    PyObject *code_ids;         /* {id(code): number} */
+    PyObject *object_ids;       /* {id(obj): index into objects} */
+    checkpoint_object *objects;
+    Py_ssize_t nentries;
+    Py_ssize_t free_entry;      /* first free entry of objects or -1 */
+    checkpoint_chain *chains;   /* the remembered frames by tasklet number */
+    Py_ssize_t nchains;
+} PyCheckpointerObject;
+
+/* Remember, that a remembered frame references obj. The checkpointer
+ * keeps obj alive, until the last frame forgets it. */
+static int
+registry_incref(PyCheckpointerObject *cp, PyObject *obj, Py_ssize_t number)
+{
+    Py_ssize_t index = id_get(cp->object_ids, obj);
+    checkpoint_object *entry;
+
+    if (index == -2)
+        return -1;
+    if (index >= 0) {
+        cp->objects[index].count++;
+        return 0;
+    }
+    if (cp->free_entry < 0) {
+        Py_ssize_t i, n = cp->nentries * 2 + 16;
+
+        entry = PyMem_Realloc(cp->objects, n * sizeof(checkpoint_object));
+        if (entry == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        cp->objects = entry;
+        for (i = cp->nentries; i < n; i++) {
+            entry[i].obj = NULL;
+            entry[i].number = i + 1 < n ? i + 1 : -1;
+            entry[i].count = 0;
+        }
+        cp->free_entry = cp->nentries;
+        cp->nentries = n;
+    }
+    index = cp->free_entry;
+    if (id_set(cp->object_ids, obj, index))
+        return -1;
+    entry = &cp->objects[index];
+    cp->free_entry = entry->number;
+    Py_INCREF(obj);
+    entry->obj = obj;
+    entry->number = number;
+    entry->count = 1;
+    return 0;
+}
+
+static void
+registry_decref(PyCheckpointerObject *cp, PyObject *obj)
+{
+    Py_ssize_t index = id_get(cp->object_ids, obj);
+    checkpoint_object *entry;
+
+    if (index < 0) {
+        if (index == -2)
+            PyErr_WriteUnraisable((PyObject *)cp);
+        return;
+    }
+    entry = &cp->objects[index];
+    if (--entry->count > 0)
+        return;
+    if (id_del(cp->object_ids, obj))
+        PyErr_WriteUnraisable((PyObject *)cp);
+    entry->number = cp->free_entry;
+    cp->free_entry = index;
+    Py_CLEAR(entry->obj);
+}
+
+/* Return the number of a remembered object, -1 if there is none or -2 on
+ * error. */
+static Py_ssize_t
+registry_number(PyCheckpointerObject *cp, PyObject *obj)
+{
+    Py_ssize_t index;
+
+    if (PyDict_GET_SIZE(cp->object_ids) == 0)
+        return -1;
+    index = id_get(cp->object_ids, obj);
+    if (index < 0)
+        return index;
+    return cp->objects[index].number;
+}
+
+static void
+frame_forget(PyCheckpointerObject *cp, checkpoint_frame *s)
+{
+    Py_ssize_t i;
+
+    if (s->frame == NULL)
+        return;
+    for (i = 0; i < s->nslots; i++) {
+        if (s->slots[i] != NULL)
+            registry_decref(cp, s->slots[i]);
+    }
+    registry_decref(cp, s->globals);
+    PyMem_Free(s->slots);
+    s->slots = NULL;
+    Py_CLEAR(s->frame);
+}
+
+/* Forget the frames of a chain from index start on. */
+static void
+chain_forget(PyCheckpointerObject *cp, checkpoint_chain *chain, Py_ssize_t start)
+{
+    Py_ssize_t i;
+
+    for (i = start; i < chain->nframes; i++)
+        frame_forget(cp, &chain->frames[i]);
+    PyMem_Free(chain->frames);
+    chain->frames = NULL;
+    chain->nframes = 0;
+}
+
+/* Drop all remembered frames and objects without bookkeeping. */
+static void
+checkpointer_forget(PyCheckpointerObject *cp)
+{
+    Py_ssize_t i, j;
+
+    for (i = 0; i < cp->nchains; i++) {
+        checkpoint_chain *chain = &cp->chains[i];
+
+        for (j = 0; j < chain->nframes; j++) {
+            PyMem_Free(chain->frames[j].slots);
+            Py_CLEAR(chain->frames[j].frame);
+        }
+        PyMem_Free(chain->frames);
+    }
+    PyMem_Free(cp->chains);
+    cp->chains = NULL;
+    cp->nchains = 0;
+    for (i = 0; i < cp->nentries; i++)
+        Py_CLEAR(cp->objects[i].obj);
+    PyMem_Free(cp->objects);
+    cp->objects = NULL;
+    cp->nentries = 0;
+    cp->free_entry = -1;
+}
+
+static int
+checkpointer_start_chain(PyCheckpointerObject *cp)
+{
+    cp->generation = 0;
+    cp->nobjects = 0;
+    return _PyOS_URandomNonblock(cp->chain_id, SNAPSHOT_CHAIN_ID_SIZE);
+}
+
+/******************************************************
+
+  Writing a snapshot
+
+ ******************************************************/
+
+typedef struct {
+    PyCheckpointerObject *cp;
+    int remember;               /* remember the frames for the next delta */
+    Py_ssize_t generation;      /* the generation of this snapshot */
+    Py_ssize_t ncodes;          /* code objects of the earlier snapshots */
+    snapshot_buffer out;        /* the tasklet and frame records */
+    PyObject *objects;          /* the object table */
+    PyObject *object_pos;       /* {id(object): index} */
+    Py_ssize_t *numbers;        /* the object numbers of the table */
+    Py_ssize_t allocated;
+    Py_ssize_t records;         /* frames written */
+    Py_ssize_t ntasklets;
+    Py_ssize_t *tasklet_numbers;
+    Py_ssize_t *reused;         /* per tasklet: frames of the old chain */
+    checkpoint_chain *chains;   /* per tasklet: the new chain */
+    unsigned int pickleflags;
+} snapshot_writer;
+
+/* Return the object number of obj, add obj to the table, if it is not
+ * yet there. */
+static Py_ssize_t
+object_number(snapshot_writer *w, PyObject *obj)
+{
+    Py_ssize_t index = id_get(w->object_pos, obj), number;
+
+    if (index >= 0)
+        return w->numbers[index];
+    if (index == -2)
+        return -1;
+    number = registry_number(w->cp, obj);
+    if (number == -2)
+        return -1;
+    if (number == -1)
+        number = w->cp->nobjects++;
+    index = PyList_GET_SIZE(w->objects);
+    if (index == w->allocated) {
+        Py_ssize_t allocated = w->allocated * 2 + 64;
+        Py_ssize_t *numbers = PyMem_Realloc(w->numbers, allocated * sizeof(Py_ssize_t));
+
+        if (numbers == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        w->numbers = numbers;
+        w->allocated = allocated;
+    }
+    if (PyList_Append(w->objects, obj))
+        return -1;
+    if (id_set(w->object_pos, obj, index)) {
+        PyList_SetSlice(w->objects, index, index + 1, NULL);
+        return -1;
+    }
+    w->numbers[index] = number;
+    return number;
+}
+
+static Py_ssize_t
+code_number(snapshot_writer *w, PyCodeObject *code)
+{
+    PyCheckpointerObject *cp = w->cp;
+    Py_ssize_t number = id_get(cp->code_ids, (PyObject *)code);
+
+    if (number != -1)
+        return number < 0 ? -1 : number;
+    number = PyList_GET_SIZE(cp->codes);
+    if (PyList_Append(cp->codes, (PyObject *)code))
+        return -1;
+    if (id_set(cp->code_ids, (PyObject *)code, number)) {
+        PyList_SetSlice(cp->codes, number, number + 1, NULL);
+        return -1;
+    }
+    return number;
+}
+
+static int
+write_object(snapshot_writer *w, PyObject *obj)
+{
+    Py_ssize_t number = object_number(w, obj);
+
+    if (number < 0)
+        return -1;
+    return write_varint(&w->out, number);
+}
+
+static int
+write_optional(snapshot_writer *w, PyObject *obj)
+{
+    Py_ssize_t number;
+
+    if (obj == NULL)
+        return write_varint(&w->out, 0);
+    number = object_number(w, obj);
+    if (number < 0)
+        return -1;
+    return write_varint(&w->out, (size_t)number + 1);
+}
+
+/* Return a copy of the state of a tasklet with another list of frames. */
+static PyObject *
+replace_frames(PyObject *state, PyObject *frames)
+{
+    Py_ssize_t i, n = PyTuple_GET_SIZE(state);
+    PyObject *ret = PyTuple_New(n), *item;
+
+    if (ret == NULL)
+        return NULL;
+    for (i = 0; i < n; i++) {
+        item = i == SNAPSHOT_STATE_FRAMES ? frames : PyTuple_GET_ITEM(state, i);
+        Py_INCREF(item);
+        PyTuple_SET_ITEM(ret, i, item);
+    }
+    return ret;
+}
+
+/* The counterpart of frameobject_reduce() in prickelpit.c */
+static int
+write_frame(snapshot_writer *w, PyFrameObject *f)
+{
+    snapshot_buffer *out = &w->out;
+    PyObject **stacktop = f->f_stacktop;
+    PyObject *trace = f->f_trace;
+    int executing = f->f_executing;
+    Py_ssize_t code, i, n;
+
+    if (stacktop == NULL) {
+        /* frames without a stacktop cannot be run */
+        stacktop = f->f_valuestack;
+        executing = SLP_FRAME_EXECUTING_INVALID;
+    }
+    else if (stacktop < f->f_valuestack)
+        VALUE_ERROR("stack underflow", -1);
+    if (trace == Py_None || !(w->pickleflags & SLP_PICKLEFLAGS_PRESERVE_TRACING_STATE))
+        trace = NULL;
+    code = code_number(w, f->f_code);
+    if (code < 0)
+        return -1;
+    if (write_varint(out, SNAPSHOT_FRAME_NATIVE) ||
+        write_varint(out, code) ||
+        write_object(w, f->f_globals) ||
+        write_optional(w, f->f_locals) ||
+        write_optional(w, trace) ||
+        write_signed(out, f->f_lasti) ||
+        write_signed(out, f->f_lineno) ||
+        write_signed(out, executing) ||
+        write_varint(out, f->f_iblock))
+        return -1;
+    for (i = 0; i < f->f_iblock; i++) {
+        if (write_signed(out, f->f_blockstack[i].b_type) ||
+            write_signed(out, f->f_blockstack[i].b_handler) ||
+            write_signed(out, f->f_blockstack[i].b_level))
+            return -1;
+    }
+    n = stacktop - f->f_localsplus;
+    if (write_varint(out, n))
+        return -1;
+    for (i = 0; i < n; i++) {
+        if (write_optional(w, f->f_localsplus[i]))
+            return -1;
+    }
+    return 0;
+}
+
+/* Frames with locals or a trace function may change without executing. */
+static int
+frame_can_be_referenced(PyFrameObject *f)
+{
+    return f->f_stacktop != NULL && f->f_stacktop >= f->f_valuestack &&
+        f->f_locals == NULL && f->f_trace == NULL;
+}
+
+static int
+frame_unchanged(checkpoint_frame *s, PyFrameObject *f)
+{
+    return s->frame == f && frame_can_be_referenced(f) &&
+        s->lasti == f->f_lasti &&
+        s->iblock == f->f_iblock &&
+        s->executing == f->f_executing &&
+        s->nslots == f->f_stacktop - f->f_localsplus &&
+        memcmp(s->slots, f->f_localsplus, s->nslots * sizeof(PyObject *)) == 0;
+}
+
+/* The number of the oldest frames of a tasklet, that the snapshot can
+ * reference, see the comment at the top of this file. */
+static Py_ssize_t
+frames_reusable(checkpoint_chain *old, PyTaskletObject *task, PyObject *frames)
+{
+    Py_ssize_t i, reusable = 0, n = PyList_GET_SIZE(frames);
+
+    for (i = 0; i < n && i < old->nframes; i++) {
+        PyFrameObject *f = (PyFrameObject *)PyList_GET_ITEM(frames, i);
+
+        if (Py_TYPE(f) != &PyFrame_Type || !frame_unchanged(&old->frames[i], f))
+            break;
+        /* the frame i - 1 is still suspended in the call of f */
+        reusable = i;
+    }
+    if (i == n && task->nswitches == old->nswitches && !PyTasklet_IsCurrent(task))
+        reusable = n;
+    return reusable;
+}
+
+static int
+registry_add(snapshot_writer *w, PyObject *obj)
+{
+    Py_ssize_t number = object_number(w, obj);
+
+    if (number < 0)
+        return -1;
+    return registry_incref(w->cp, obj, number);
+}
+
+/* Remember the frame f, that was just written as record. */
+static int
+frame_remember(snapshot_writer *w, checkpoint_frame *s, PyFrameObject *f)
+{
+    Py_ssize_t i, n;
+
+    if (!frame_can_be_referenced(f))
+        return 0;
+    n = f->f_stacktop - f->f_localsplus;
+    s->slots = PyMem_Malloc(n ? n * sizeof(PyObject *) : 1);
+    if (s->slots == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    memcpy(s->slots, f->f_localsplus, n * sizeof(PyObject *));
+    if (registry_add(w, f->f_globals))
+        goto error;
+    for (i = 0; i < n; i++) {
+        if (s->slots[i] != NULL && registry_add(w, s->slots[i])) {
+            while (i--) {
+                if (s->slots[i] != NULL)
+                    registry_decref(w->cp, s->slots[i]);
+            }
+            registry_decref(w->cp, f->f_globals);
+            goto error;
+        }
+    }
+    Py_INCREF(f);
+    s->frame = f;
+    s->globals = f->f_globals;
+    s->generation = w->generation;
+    s->record = w->records;
+    s->lasti = f->f_lasti;
+    s->iblock = f->f_iblock;
+    s->executing = f->f_executing;
+    s->nslots = n;
+    return 0;
+error:
+    PyMem_Free(s->slots);
+    s->slots = NULL;
+    return -1;
+}
+
+static int
+write_stored(snapshot_writer *w, Py_ssize_t generation, Py_ssize_t record, Py_ssize_t n)
+{
+    return write_varint(&w->out, SNAPSHOT_FRAME_STORED) ||
+        write_varint(&w->out, generation) ||
+        write_varint(&w->out, record) ||
+        write_varint(&w->out, n) ? -1 : 0;
+}
+
+static int
+write_tasklet(snapshot_writer *w, Py_ssize_t index, PyObject *task, PyObject *ctors)
+{
+    _Py_IDENTIFIER(__reduce_ex__);
+    PyCheckpointerObject *cp = w->cp;
+    PyObject *reduced, *ctor = NULL, *state = NULL, *frames;
+    checkpoint_chain *old = NULL, *chain = &w->chains[index];
+    Py_ssize_t i, n, reusable = 0, number = w->tasklet_numbers[index];
+    Py_ssize_t run_generation = 0, run_record = 0, run_length = 0;
+    int ret = -1;
+
+    /* Unless a subclass overrides __reduce_ex__(), reduce the tasklet
+     * without the frame reducer of the _wrap module. It wraps each frame
+     * into a Python object. */
+    if (_PyType_LookupId(Py_TYPE(task), &PyId___reduce_ex__) ==
+        _PyType_LookupId(&PyTasklet_Type, &PyId___reduce_ex__))
+        reduced = slp_tasklet_reduce((PyTaskletObject *)task, 0);
+    else
+        reduced = PyObject_CallMethod(task, "__reduce_ex__", "i", 4);
+    if (reduced == NULL)
+        return -1;
+    if (!PyTuple_Check(reduced) || PyTuple_GET_SIZE(reduced) != 3 ||
+        !PyTuple_Check(PyTuple_GET_ITEM(reduced, 1)) ||
+        !PyTuple_Check(PyTuple_GET_ITEM(reduced, 2)) ||
+        PyTuple_GET_SIZE(PyTuple_GET_ITEM(reduced, 2)) <= SNAPSHOT_STATE_FRAMES ||
+        !PyList_Check(PyTuple_GET_ITEM(PyTuple_GET_ITEM(reduced, 2), SNAPSHOT_STATE_FRAMES))) {
+        PyErr_Format(PyExc_TypeError, "can't snapshot %.200s object: "
+                     "unexpected result of __reduce_ex__()", Py_TYPE(task)->tp_name);
+        goto done;
+    }
+    ctor = PyTuple_GetSlice(reduced, 0, 2);
+    if (ctor == NULL || PyList_Append(ctors, ctor))
+        goto done;
+
+    frames = PyTuple_GET_ITEM(PyTuple_GET_ITEM(reduced, 2), SNAPSHOT_STATE_FRAMES);
+    state = replace_frames(PyTuple_GET_ITEM(reduced, 2), Py_None);
+    n = PyList_GET_SIZE(frames);
+    if (state == NULL || write_object(w, state) || write_varint(&w->out, n))
+        goto done;
+    if (w->remember && n) {
+        chain->frames = PyMem_Calloc(n, sizeof(checkpoint_frame));
+        if (chain->frames == NULL) {
+            PyErr_NoMemory();
+            goto done;
+        }
+        chain->nframes = n;
+        chain->nswitches = ((PyTaskletObject *)task)->nswitches;
+        if (number < cp->nchains && cp->chains[number].nframes) {
+            old = &cp->chains[number];
+            reusable = frames_reusable(old, (PyTaskletObject *)task, frames);
+        }
+    }
+    for (i = 0; i < n; i++, w->records++) {
+        PyObject *f = PyList_GET_ITEM(frames, i);
+
+        if (i < reusable) {
+            checkpoint_frame *s = &old->frames[i];
+
+            /* usually the unchanged frames form a single run */
+            if (run_length && s->generation == run_generation &&
+                s->record == run_record + run_length)
+                run_length++;
+            else {
+                if (run_length && write_stored(w, run_generation, run_record, run_length))
+                    break;
+                run_generation = s->generation;
+                run_record = s->record;
+                run_length = 1;
+            }
+            /* the new chain takes over the remembered frame */
+            chain->frames[i] = *s;
+            w->reused[index] = i + 1;
+            continue;
+        }
+        if (run_length) {
+            if (write_stored(w, run_generation, run_record, run_length))
+                break;
+            run_length = 0;
+        }
+        if (Py_TYPE(f) == &PyFrame_Type && ((PyFrameObject *)f)->f_gen == NULL) {
+            if (write_frame(w, (PyFrameObject *)f))
+                break;
+            if (w->remember && frame_remember(w, &chain->frames[i], (PyFrameObject *)f))
+                break;
+        }
+        else if (Py_TYPE(f) == &PyFrame_Type) {
+            /* The generator pickles its frame with the object table. The
+             * frame reducer gives both the same wrapper. */
+            PyObject *reducer = slp_reduce_frame((PyFrameObject *)f);
+
+            if (reducer == NULL)
+                break;
+            if (write_varint(&w->out, SNAPSHOT_FRAME_OBJECT) ||
+                write_object(w, reducer)) {
+                Py_DECREF(reducer);
+                break;
+            }
+            Py_DECREF(reducer);
+        }
+        else if (write_varint(&w->out, SNAPSHOT_FRAME_OBJECT) ||
+                 write_object(w, f))
+            break;
+    }
+    if (i == n && (run_length == 0 ||
+                   write_stored(w, run_generation, run_record, run_length) == 0))
+        ret = 0;
+done:
+    Py_XDECREF(state);
+    Py_XDECREF(ctor);
+    Py_DECREF(reduced);
+    return ret;
+}
+
+/* After a successful snapshot the new chains replace the old ones. */
+static void
+snapshot_commit(snapshot_writer *w)
+{
+    PyCheckpointerObject *cp = w->cp;
+    Py_ssize_t i;
+
+    cp->generation = w->generation;
+    if (!w->remember)
+        return;
+    for (i = 0; i < w->ntasklets; i++) {
+        /* the first frames moved into the new chain */
+        chain_forget(cp, &cp->chains[w->tasklet_numbers[i]], w->reused[i]);
+    }
+    for (i = 0; i < cp->nchains; i++)
+        chain_forget(cp, &cp->chains[i], 0);
+    for (i = 0; i < w->ntasklets; i++) {
+        cp->chains[w->tasklet_numbers[i]] = w->chains[i];
+        w->chains[i].frames = NULL;
+        w->chains[i].nframes = 0;
+    }
+}
+
+static void
+snapshot_rollback(snapshot_writer *w)
+{
+    PyCheckpointerObject *cp = w->cp;
+    PyObject *type, *value, *traceback, *code;
+    Py_ssize_t i;
+
+    PyErr_Fetch(&type, &value, &traceback);
+    for (i = 0; i < w->ntasklets; i++)
+        chain_forget(cp, &w->chains[i], w->reused[i]);
+    for (i = PyList_GET_SIZE(cp->codes); i-- > w->ncodes; ) {
+        code = PyList_GET_ITEM(cp->codes, i);
+        if (id_del(cp->code_ids, code))
+            PyErr_WriteUnraisable((PyObject *)cp);
+    }
+    if (PyList_SetSlice(cp->codes, w->ncodes, PyList_GET_SIZE(cp->codes), NULL))
+        PyErr_WriteUnraisable((PyObject *)cp);
+    PyErr_Restore(type, value, traceback);
+}
+
+/* memoryview(obj).cast('B').cast(format, shape) */
+static PyObject *
+memoryview_cast(PyObject *obj, PyObject *format, PyObject *shape)
+{
+    PyObject *view, *bytes_view, *ret;
+
+    if ((view = PyMemoryView_FromObject(obj)) == NULL)
+        return NULL;
+    bytes_view = PyObject_CallMethod(view, "cast", "s", "B");
+    Py_DECREF(view);
+    if (bytes_view == NULL)
+        return NULL;
+    ret = PyObject_CallMethod(bytes_view, "cast", "OO", format, shape);
+    Py_DECREF(bytes_view);
+    return ret;
+}
+
+/* The persistent id of a buffer object is (kind, PickleBuffer(obj)),
+ * (kind, PickleBuffer(obj), typecode) for an array or
+ * (kind, PickleBuffer(obj), format, shape) for a memoryview. A repeated
+ * buffer object gets the persistent id (index,), where index counts the
+ * buffer objects of the pickle. */
+static PyObject *
+buffer_persistent_id(PyObject *ids, PyObject *obj)
+{
+    PyObject *buffer_ids = PyTuple_GET_ITEM(ids, 2);
+    PyObject *buffer_objects = PyTuple_GET_ITEM(ids, 3);
+    PyObject *array_type = PyTuple_GET_ITEM(ids, 4);
+    PyObject *buffer, *format = NULL, *shape = NULL, *tmp, *ret = NULL;
+    Py_ssize_t index;
+    int kind;
+
+    if (PyBytes_CheckExact(obj))
+        kind = PERSISTENT_BYTES;
+    else if (PyByteArray_CheckExact(obj))
+        kind = PERSISTENT_BYTEARRAY;
+    else if ((PyObject *)Py_TYPE(obj) == array_type)
+        kind = PERSISTENT_ARRAY;
+    else if (PyMemoryView_Check(obj))
+        kind = PERSISTENT_MEMORYVIEW;
+    else
+        Py_RETURN_NONE;
+    index = id_get(buffer_ids, obj);
+    if (index == -2)
+        return NULL;
+    if (index >= 0)
+        return Py_BuildValue("(n)", index);
+
+    if ((buffer = PyPickleBuffer_FromObject(obj)) == NULL)
+        return NULL;
+    if (kind == PERSISTENT_ARRAY) {
+        if ((format = PyObject_GetAttrString(obj, "typecode")) == NULL)
+            goto done;
+    }
+    else if (kind == PERSISTENT_MEMORYVIEW) {
+        Py_buffer *view = PyMemoryView_GET_BUFFER(obj);
+        Py_ssize_t i;
+
+        format = PyUnicode_FromString(view->format != NULL ? view->format : "B");
+        if (format == NULL || (shape = PyTuple_New(view->ndim)) == NULL)
+            goto done;
+        for (i = 0; i < view->ndim; i++) {
+            if ((tmp = PyLong_FromSsize_t(view->shape[i])) == NULL)
+                goto done;
+            PyTuple_SET_ITEM(shape, i, tmp);
+        }
+        /* fail now, if restore() could not recreate the view */
+        if ((tmp = memoryview_cast(obj, format, shape)) == NULL)
+            goto done;
+        Py_DECREF(tmp);
+    }
+    /* buffer_objects keeps the objects alive, their ids stay unique */
+    index = PyList_GET_SIZE(buffer_objects);
+    if (PyList_Append(buffer_objects, obj) || id_set(buffer_ids, obj, index))
+        goto done;
+    if (shape != NULL)
+        ret = Py_BuildValue("(iOOO)", kind, buffer, format, shape);
+    else if (format != NULL)
+        ret = Py_BuildValue("(iOO)", kind, buffer, format);
+    else
+        ret = Py_BuildValue("(iO)", kind, buffer);
+done:
+    Py_XDECREF(shape);
+    Py_XDECREF(format);
+    Py_DECREF(buffer);
+    return ret;
+}
+
+/* persistent ids for the snapshot tasklets and the code objects */
+
+static PyObject *
+snapshot_persistent_id(PyObject *ids, PyObject *obj)
+{
+    Py_ssize_t number;
+
+    if (PyTasklet_Check(obj))
+        number = id_get(PyTuple_GET_ITEM(ids, 0), obj);
+    else if (PyCode_Check(obj)) {
+        number = id_get(PyTuple_GET_ITEM(ids, 1), obj);
+        if (number >= 0)
+            number = PERSISTENT_CODE(number);
+    }
+    else if (PyTuple_GET_SIZE(ids) > 2)
+        return buffer_persistent_id(ids, obj);
+    else
+        number = -1;
+    if (number == -2)
+        return NULL;
+    if (number == -1)
+        Py_RETURN_NONE;
+    return PyLong_FromSsize_t(number);
+}
+
+static PyMethodDef snapshot_persistent_id_def = {
+    "persistent_id", (PyCFunction)snapshot_persistent_id, METH_O};
+
+/* The buffer callback of the pickler calls the callback of the user and
+ * collects the out-of-band buffers. state is (callback, list). */
+static PyObject *
+snapshot_buffer_callback(PyObject *state, PyObject *buffer)
+{
+    PyObject *in_band;
+    int r;
+
+    in_band = PyObject_CallFunctionObjArgs(PyTuple_GET_ITEM(state, 0), buffer, NULL);
+    if (in_band == NULL)
+        return NULL;
+    r = PyObject_IsTrue(in_band);
+    if (r < 0 || (r == 0 && PyList_Append(PyTuple_GET_ITEM(state, 1), buffer)))
+        Py_CLEAR(in_band);
+    return in_band;
+}
+
+static PyMethodDef snapshot_buffer_callback_def = {
+    "buffer_callback", (PyCFunction)snapshot_buffer_callback, METH_O};
+
+/* Pickle the items of list. The persistent ids are NULL or a tuple
+ * ({id(tasklet): persistent id}, {id(code): code number}), that gets
+ * extended by ({id(obj): index}, [buffer objects], array.array), if
+ * there is a buffer callback. Store the number of out-of-band buffers
+ * in *nbuffers. */
+static PyObject *
+pickle_list(PyObject *list, PyObject *persistent_ids, PyObject *buffer_callback,
+            Py_ssize_t *nbuffers)
+{
+    PyObject *pickle = NULL, *io = NULL, *file = NULL, *pickler = NULL;
+    PyObject *ids = NULL, *oob = NULL, *args = NULL, *kwds = NULL;
+    PyObject *tuple = NULL, *tmp, *ret = NULL;
+
+    if ((pickle = PyImport_ImportModule("pickle")) == NULL ||
+        (io = PyImport_ImportModule("io")) == NULL ||
+        (file = PyObject_CallMethod(io, "BytesIO", NULL)) == NULL ||
+        (args = Py_BuildValue("(Oi)", file, -1)) == NULL)
+        goto done;
+    if (buffer_callback != NULL && buffer_callback != Py_None) {
+        if ((oob = PyList_New(0)) == NULL ||
+            (kwds = PyDict_New()) == NULL ||
+            (tmp = PyTuple_Pack(2, buffer_callback, oob)) == NULL)
+            goto done;
+        buffer_callback = PyCFunction_New(&snapshot_buffer_callback_def, tmp);
+        Py_DECREF(tmp);
+        if (buffer_callback == NULL)
+            goto done;
+        if (PyDict_SetItemString(kwds, "buffer_callback", buffer_callback)) {
+            Py_DECREF(buffer_callback);
+            goto done;
+        }
+        Py_DECREF(buffer_callback);
+        if (persistent_ids != NULL) {
+            if ((tmp = PyImport_ImportModule("array")) == NULL)
+                goto done;
+            ids = Py_BuildValue("(OONNN)", PyTuple_GET_ITEM(persistent_ids, 0),
+                                PyTuple_GET_ITEM(persistent_ids, 1), PyDict_New(),
+                                PyList_New(0), PyObject_GetAttrString(tmp, "array"));
+            Py_DECREF(tmp);
+            if (ids == NULL)
+                goto done;
+            persistent_ids = ids;
+        }
+    }
+    if ((tmp = PyObject_GetAttrString(pickle, "Pickler")) == NULL)
+        goto done;
+    pickler = PyObject_Call(tmp, args, kwds);
+    Py_DECREF(tmp);
+    if (pickler == NULL)
+        goto done;
+    if (persistent_ids != NULL) {
+        tmp = PyCFunction_New(&snapshot_persistent_id_def, persistent_ids);
+        if (tmp == NULL)
+            goto done;
+        if (PyObject_SetAttrString(pickler, "persistent_id", tmp)) {
+            Py_DECREF(tmp);
+            goto done;
+        }
+        Py_DECREF(tmp);
+    }
+    if ((tuple = PyList_AsTuple(list)) == NULL ||
+        (tmp = PyObject_CallMethod(pickler, "dump", "(O)", tuple)) == NULL)
+        goto done;
+    Py_DECREF(tmp);
+    ret = PyObject_CallMethod(file, "getvalue", NULL);
+    if (ret != NULL && !PyBytes_Check(ret)) {
+        Py_CLEAR(ret);
+        PyErr_SetString(PyExc_TypeError, "pickler did not return bytes");
+    }
+    if (nbuffers != NULL)
+        *nbuffers = oob != NULL ? PyList_GET_SIZE(oob) : 0;
+done:
+    Py_XDECREF(tuple);
+    Py_XDECREF(pickler);
+    Py_XDECREF(kwds);
+    Py_XDECREF(args);
+    Py_XDECREF(oob);
+    Py_XDECREF(ids);
+    Py_XDECREF(file);
+    Py_XDECREF(io);
+    Py_XDECREF(pickle);
+    return ret;
+}
+
+/* Number the tasklets and set up the per tasklet arrays of the writer. */
+static int
+snapshot_tasklets(snapshot_writer *w, PyObject *seq, PyObject *tasklet_pids)
+{
+    PyCheckpointerObject *cp = w->cp;
+    Py_ssize_t i, n = PySequence_Fast_GET_SIZE(seq), number;
+
+    w->ntasklets = n;
+    w->tasklet_numbers = PyMem_Malloc((n ? n : 1) * sizeof(Py_ssize_t));
+    w->reused = PyMem_Calloc(n ? n : 1, sizeof(Py_ssize_t));
+    w->chains = PyMem_Calloc(n ? n : 1, sizeof(checkpoint_chain));
+    if (w->tasklet_numbers == NULL || w->reused == NULL || w->chains == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        PyObject *task = PySequence_Fast_GET_ITEM(seq, i);
+
+        if (!PyTasklet_Check(task)) {
+            PyErr_SetString(PyExc_TypeError,
+                            "snapshot() argument must be an iterable of tasklets");
+            return -1;
+        }
+        number = id_get(tasklet_pids, task);
+        if (number >= 0) {
+            PyErr_SetString(PyExc_ValueError, "snapshot() got a tasklet twice");
+            return -1;
+        }
+        if (number == -2)
+            return -1;
+        number = id_get(cp->tasklet_ids, task);
+        if (number == -2)
+            return -1;
+        if (number == -1) {
+            number = PyList_GET_SIZE(cp->tasklets);
+            if (PyList_Append(cp->tasklets, task))
+                return -1;
+            if (id_set(cp->tasklet_ids, task, number)) {
+                PyList_SetSlice(cp->tasklets, number, number + 1, NULL);
+                return -1;
+            }
+        }
+        if (id_set(tasklet_pids, task, PERSISTENT_TASKLET(number)))
+            return -1;
+        w->tasklet_numbers[i] = number;
+    }
+
+    /* make room for the chains of new tasklets now, commit can't fail */
+    n = PyList_GET_SIZE(cp->tasklets);
+    if (w->remember && n > cp->nchains) {
+        checkpoint_chain *chains = PyMem_Realloc(cp->chains, n * sizeof(checkpoint_chain));
+
+        if (chains == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        memset(chains + cp->nchains, 0, (n - cp->nchains) * sizeof(checkpoint_chain));
+        cp->chains = chains;
+        cp->nchains = n;
+    }
+    return 0;
+}
+
+static PyObject *
+checkpointer_snapshot_impl(PyCheckpointerObject *cp, PyObject *tasklets,
+                           PyObject *buffer_callback, int remember)
+{
+    PyThreadState *ts = _PyThreadState_GET();
+    snapshot_writer w;
+    snapshot_buffer head = {NULL, 0, 0};
+    PyObject *seq, *ctors = NULL, *tasklet_pids = NULL, *persistent_ids = NULL;
+    PyObject *new_codes = NULL, *codes = NULL, *ctors_pickle = NULL, *objects_pickle = NULL;
+    PyObject *tmp, *ret = NULL;
+    Py_ssize_t i, n, nbuffers;
+
+    seq = PySequence_Fast(tasklets, "snapshot() argument must be an iterable of tasklets");
+    if (seq == NULL)
+        return NULL;
+    memset(&w, 0, sizeof(w));
+    w.cp = cp;
+    w.remember = remember;
+    w.generation = cp->generation + 1;
+    w.ncodes = PyList_GET_SIZE(cp->codes);
+    w.pickleflags = ts->st.pickleflags;
+    if ((w.objects = PyList_New(0)) == NULL ||
+        (w.object_pos = PyDict_New()) == NULL ||
+        (ctors = PyList_New(0)) == NULL ||
+        (tasklet_pids = PyDict_New()) == NULL ||
+        snapshot_tasklets(&w, seq, tasklet_pids))
+        goto done;
+
+    n = w.ntasklets;
+    if (write_varint(&w.out, n))
+        goto done;
+    for (i = 0; i < n; i++) {
+        if (write_tasklet(&w, i, PySequence_Fast_GET_ITEM(seq, i), ctors))
+            goto done;
+    }
+
+    if ((new_codes = PyList_GetSlice(cp->codes, w.ncodes, PyList_GET_SIZE(cp->codes))) == NULL ||
+        (persistent_ids = PyTuple_Pack(2, tasklet_pids, cp->code_ids)) == NULL ||
+        (ctors_pickle = pickle_list(ctors, NULL, NULL, NULL)) == NULL ||
+        (objects_pickle = pickle_list(w.objects, persistent_ids, buffer_callback,
+                                      &nbuffers)) == NULL)
+        goto done;
+    if ((tmp = PyList_AsTuple(new_codes)) == NULL)
+        goto done;
+    codes = PyMarshal_WriteObjectToString(tmp, Py_MARSHAL_VERSION);
+    Py_DECREF(tmp);
+    if (codes == NULL)
+        goto done;
+
+    if (write_raw(&head, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE) ||
+        write_varint(&head, SNAPSHOT_VERSION) ||
+        write_varint(&head, (size_t)PyImport_GetMagicNumber()) ||
+        write_raw(&head, cp->chain_id, SNAPSHOT_CHAIN_ID_SIZE) ||
+        write_varint(&head, w.generation) ||
+        write_varint(&head, cp->nobjects) ||
+        write_varint(&head, w.ncodes) ||
+        write_bytes(&head, codes) ||
+        write_bytes(&head, ctors_pickle) ||
+        write_varint(&head, n))
+        goto done;
+    for (i = 0; i < n; i++) {
+        if (write_varint(&head, w.tasklet_numbers[i]))
+            goto done;
+    }
+    n = PyList_GET_SIZE(w.objects);
+    if (write_varint(&head, n))
+        goto done;
+    for (i = 0; i < n; i++) {
+        if (write_varint(&head, w.numbers[i]))
+            goto done;
+    }
+    if (write_varint(&head, nbuffers) || write_bytes(&head, objects_pickle))
+        goto done;
+    ret = PyBytes_FromStringAndSize(NULL, head.len + w.out.len);
+    if (ret == NULL)
+        goto done;
+    memcpy(PyBytes_AS_STRING(ret), head.buf, head.len);
+    memcpy(PyBytes_AS_STRING(ret) + head.len, w.out.buf, w.out.len);
+done:
+    if (ret != NULL)
+        snapshot_commit(&w);
+    else if (w.chains != NULL)
+        snapshot_rollback(&w);
+    PyMem_Free(w.chains);
+    PyMem_Free(w.reused);
+    PyMem_Free(w.tasklet_numbers);
+    PyMem_Free(w.numbers);
+    PyMem_Free(head.buf);
+    PyMem_Free(w.out.buf);
+    Py_XDECREF(objects_pickle);
+    Py_XDECREF(ctors_pickle);
+    Py_XDECREF(codes);
+    Py_XDECREF(new_codes);
+    Py_XDECREF(persistent_ids);
+    Py_XDECREF(tasklet_pids);
+    Py_XDECREF(ctors);
+    Py_XDECREF(w.object_pos);
+    Py_XDECREF(w.objects);
+    Py_DECREF(seq);
+    return ret;
+}
+
+/******************************************************
+
+  The checkpointer type
+
+ ******************************************************/
+
+static PyObject *
+checkpointer_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {NULL};
+    PyCheckpointerObject *cp;
+
+    if (args != NULL && !PyArg_ParseTupleAndKeywords(args, kwds, ":checkpointer", kwlist))
+        return NULL;
+    cp = (PyCheckpointerObject *)type->tp_alloc(type, 0);
+    if (cp == NULL)
+        return NULL;
+    cp->free_entry = -1;
+    if ((cp->tasklets = PyList_New(0)) == NULL ||
+        (cp->tasklet_ids = PyDict_New()) == NULL ||
+        (cp->codes = PyList_New(0)) == NULL ||
+        (cp->code_ids = PyDict_New()) == NULL ||
+        (cp->object_ids = PyDict_New()) == NULL ||
+        checkpointer_start_chain(cp)) {
+        Py_DECREF(cp);
+        return NULL;
+    }
+    return (PyObject *)cp;
+}
+
+static int
+checkpointer_traverse(PyCheckpointerObject *cp, visitproc visit, void *arg)
+{
+    Py_ssize_t i, j;
+
+    Py_VISIT(cp->tasklets);
+    Py_VISIT(cp->codes);
+    for (i = 0; i < cp->nentries; i++)
+        Py_VISIT(cp->objects[i].obj);
+    for (i = 0; i < cp->nchains; i++) {
+        for (j = 0; j < cp->chains[i].nframes; j++)
+            Py_VISIT(cp->chains[i].frames[j].frame);
+    }
+    return 0;
+}
+
+static int
+checkpointer_clear(PyCheckpointerObject *cp)
+{
+    checkpointer_forget(cp);
+    Py_CLEAR(cp->tasklets);
+    Py_CLEAR(cp->tasklet_ids);
+    Py_CLEAR(cp->codes);
+    Py_CLEAR(cp->code_ids);
+    Py_CLEAR(cp->object_ids);
+    return 0;
+}
+
+static void
+checkpointer_dealloc(PyCheckpointerObject *cp)
+{
+    PyObject_GC_UnTrack(cp);
+    checkpointer_clear(cp);
+    Py_TYPE(cp)->tp_free((PyObject *)cp);
+}
+
+PyDoc_STRVAR(checkpointer_snapshot__doc__,
+"snapshot(tasklets, buffer_callback=None) -- serialize the given tasklets\n\
+like stackless.snapshot(). The first snapshot is complete. Each further\n\
+snapshot is a delta, that refers to the frames of the earlier snapshots,\n\
+that did not change.");
+
+static PyObject *
+checkpointer_snapshot(PyCheckpointerObject *cp, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"tasklets", "buffer_callback", NULL};
+    PyObject *tasklets, *buffer_callback = Py_None;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O:snapshot", kwlist,
+                                     &tasklets, &buffer_callback))
+        return NULL;
+    if (cp->tasklets == NULL)
+        RUNTIME_ERROR("checkpointer was cleared", NULL);
+    return checkpointer_snapshot_impl(cp, tasklets, buffer_callback, 1);
+}
+
+PyDoc_STRVAR(checkpointer_reset__doc__,
+"reset() -- forget the earlier snapshots and start a new chain.\n\
+The next snapshot is complete.");
+
+static PyObject *
+checkpointer_reset(PyCheckpointerObject *cp, PyObject *unused)
+{
+    if (cp->tasklets == NULL)
+        RUNTIME_ERROR("checkpointer was cleared", NULL);
+    checkpointer_forget(cp);
+    PyDict_Clear(cp->tasklet_ids);
+    PyDict_Clear(cp->code_ids);
+    PyDict_Clear(cp->object_ids);
+    if (PyList_SetSlice(cp->tasklets, 0, PyList_GET_SIZE(cp->tasklets), NULL) ||
+        PyList_SetSlice(cp->codes, 0, PyList_GET_SIZE(cp->codes), NULL) ||
+        checkpointer_start_chain(cp))
+        return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+checkpointer_get_generation(PyCheckpointerObject *cp, void *closure)
+{
+    return PyLong_FromSsize_t(cp->generation);
+}
+
+static PyMethodDef checkpointer_methods[] = {
+    {"snapshot", (PyCFunction)(void(*)(void))checkpointer_snapshot,
+     METH_VARARGS | METH_KEYWORDS,
+     checkpointer_snapshot__doc__},
+    {"reset", (PyCFunction)checkpointer_reset, METH_NOARGS,
+     checkpointer_reset__doc__},
+    {NULL, NULL}
+};
+
+static PyGetSetDef checkpointer_getsetlist[] = {
+    {"generation", (getter)checkpointer_get_generation, NULL,
+     "the generation of the last snapshot, 0 if there is none"},
+    {0}
+};
+
+PyDoc_STRVAR(PyCheckpointer_Type__doc__,
+"checkpointer() -- make incremental snapshots of tasklets.\n\
+The snapshots of a checkpointer form a chain. Pass the earlier\n\
+snapshots of the chain to stackless.restore() to restore a delta.");
+
+PyTypeObject PyCheckpointer_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "_stackless.checkpointer",
+    sizeof(PyCheckpointerObject),
+    0,
+    (destructor)checkpointer_dealloc,           /* tp_dealloc */
+    0,                                          /* tp_print */
+    0,                                          /* tp_getattr */
+    0,                                          /* tp_setattr */
+    0,                                          /* tp_compare */
+    0,                                          /* tp_repr */
+    0,                                          /* tp_as_number */
+    0,                                          /* tp_as_sequence */
+    0,                                          /* tp_as_mapping */
+    0,                                          /* tp_hash */
+    0,                                          /* tp_call */
+    0,                                          /* tp_str */
+    PyObject_GenericGetAttr,                    /* tp_getattro */
+    PyObject_GenericSetAttr,                    /* tp_setattro */
+    0,                                          /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,    /* tp_flags */
+    PyCheckpointer_Type__doc__,                 /* tp_doc */
+    (traverseproc)checkpointer_traverse,        /* tp_traverse */
+    (inquiry)checkpointer_clear,                /* tp_clear */
+    0,                                          /* tp_richcompare */
+    0,                                          /* tp_weaklistoffset */
+    0,                                          /* tp_iter */
+    0,                                          /* tp_iternext */
+    checkpointer_methods,                       /* tp_methods */
+    0,                                          /* tp_members */
+    checkpointer_getsetlist,                    /* tp_getset */
+    0,                                          /* tp_base */
+    0,                                          /* tp_dict */
+    0,                                          /* tp_descr_get */
+    0,                                          /* tp_descr_set */
+    0,                                          /* tp_dictoffset */
+    0,                                          /* tp_init */
+    0,                                          /* tp_alloc */
+    checkpointer_new,                           /* tp_new */
+    PyObject_GC_Del,                            /* tp_free */
+};
+
+PyObject *
+slp_snapshot(PyObject *tasklets, PyObject *buffer_callback)
+{
+    PyObject *cp, *ret;
+
+    cp = checkpointer_new(&PyCheckpointer_Type, NULL, NULL);
+    if (cp == NULL)
+        return NULL;
+    ret = checkpointer_snapshot_impl((PyCheckpointerObject *)cp, tasklets,
+                                     buffer_callback, 0);
+    Py_DECREF(cp);
+    return ret;
+}
+
+/******************************************************
+
+  Restoring a snapshot
+
+ ******************************************************/
+
+/* a snapshot of the chain */
+typedef struct {
+    Py_buffer view;             /* view.obj is NULL until parsed */
+    size_t generation;
+    size_t nobjects;            /* object numbers of the chain */
+    size_t first_code;
+    const unsigned char *codes;
+    size_t codes_size;
+    const unsigned char *ctors;
+    size_t ctors_size;
+    const unsigned char *tasklet_numbers;
+    size_t ntasklets;
+    const unsigned char *numbers;
+    size_t nnumbers;
+    size_t nbuffers;            /* out-of-band buffers of the object table */
+    size_t first_buffer;
+    const unsigned char *objects;
+    size_t objects_size;
+    const unsigned char *records;
+    const unsigned char *end;
+    PyObject *table;            /* the unpickled objects */
+    const unsigned char **offsets;  /* the frame records */
+    size_t nrecords;
+} snapshot_part;
+
+typedef struct {
+    snapshot_part *parts;       /* by generation - 1 */
+    size_t nparts;
+    unsigned char chain_id[SNAPSHOT_CHAIN_ID_SIZE];
+    PyObject *codes;            /* the code objects of the chain by number */
+    PyObject *tasklets;         /* {tasklet number: tasklet} */
+    PyObject **objects;         /* the objects by number */
+    size_t nobjects;
+    PyObject *buffers;          /* the out-of-band buffers or NULL */
+} snapshot_restorer;
+
+typedef struct {
+    const unsigned char *p;
+    const unsigned char *end;
+    snapshot_restorer *restorer;
+} snapshot_reader;
+
+static int
+invalid_snapshot(void)
+{
+    PyErr_SetString(PyExc_ValueError, "invalid snapshot data");
+    return -1;
+}
+
+static int
+read_varint(snapshot_reader *r, size_t *value)
+{
+    size_t v = 0;
+    unsigned int shift = 0;
+    unsigned char c;
+
+    do {
+        if (r->p >= r->end || shift >= 8 * sizeof(size_t))
+            return invalid_snapshot();
+        c = *r->p++;
+        v |= (size_t)(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    *value = v;
+    return 0;
+}
+
+static int
+read_int(snapshot_reader *r, int *value)
+{
+    size_t v;
+    Py_ssize_t s;
+
+    if (read_varint(r, &v))
+        return -1;
+    s = (v & 1) ? ~(Py_ssize_t)(v >> 1) : (Py_ssize_t)(v >> 1);
+    if (s < INT_MIN || s > INT_MAX)
+        return invalid_snapshot();
+    *value = (int)s;
+    return 0;
+}
+
+/* Skip n varints. */
+static int
+skip_varints(snapshot_reader *r, size_t n)
+{
+    size_t value;
+
+    while (n--) {
+        if (read_varint(r, &value))
+            return -1;
+    }
+    return 0;
+}
+
+static int
+read_section(snapshot_reader *r, const unsigned char **start, size_t *size)
+{
+    if (read_varint(r, size))
+        return -1;
+    if (*size > (size_t)(r->end - r->p))
+        return invalid_snapshot();
+    *start = r->p;
+    r->p += *size;
+    return 0;
+}
+
+static int
+read_object(snapshot_reader *r, PyObject **obj)
+{
+    size_t number;
+
+    if (read_varint(r, &number))
+        return -1;
+    if (number >= r->restorer->nobjects || r->restorer->objects[number] == NULL)
+        return invalid_snapshot();
+    *obj = r->restorer->objects[number];
+    return 0;
+}
+
+static int
+read_optional(snapshot_reader *r, PyObject **obj)
+{
+    size_t number;
+
+    if (read_varint(r, &number))
+        return -1;
+    if (number == 0) {
+        *obj = NULL;
+        return 0;
+    }
+    number--;
+    if (number >= r->restorer->nobjects || r->restorer->objects[number] == NULL)
+        return invalid_snapshot();
+    *obj = r->restorer->objects[number];
+    return 0;
+}
+
+/* Parse the head of a snapshot. */
+static int
+part_parse(snapshot_part *part, PyObject *data, unsigned char *chain_id)
+{
+    snapshot_reader r = {NULL, NULL, NULL};
+    size_t version, magic;
+
+    if (PyObject_GetBuffer(data, &part->view, PyBUF_SIMPLE))
+        return -1;
+    r.p = part->view.buf;
+    r.end = r.p + part->view.len;
+    if (part->view.len < SNAPSHOT_MAGIC_SIZE ||
+        memcmp(r.p, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE) != 0)
+        VALUE_ERROR("not a tasklet snapshot", -1);
+    r.p += SNAPSHOT_MAGIC_SIZE;
+    if (read_varint(&r, &version) || read_varint(&r, &magic))
+        return -1;
+    if (version != SNAPSHOT_VERSION) {
+        PyErr_Format(PyExc_ValueError, "unsupported snapshot version %zu", version);
+        return -1;
+    }
+    if (magic != (size_t)PyImport_GetMagicNumber())
+        VALUE_ERROR("snapshot was made by a different version of Python", -1);
+    if (r.end - r.p < SNAPSHOT_CHAIN_ID_SIZE)
+        return invalid_snapshot();
+    memcpy(chain_id, r.p, SNAPSHOT_CHAIN_ID_SIZE);
+    r.p += SNAPSHOT_CHAIN_ID_SIZE;
+    if (read_varint(&r, &part->generation) ||
+        read_varint(&r, &part->nobjects) ||
+        read_varint(&r, &part->first_code) ||
+        read_section(&r, &part->codes, &part->codes_size) ||
+        read_section(&r, &part->ctors, &part->ctors_size) ||
+        read_varint(&r, &part->ntasklets))
+        return -1;
+    part->tasklet_numbers = r.p;
+    if (skip_varints(&r, part->ntasklets) ||
+        read_varint(&r, &part->nnumbers))
+        return -1;
+    part->numbers = r.p;
+    if (skip_varints(&r, part->nnumbers) ||
+        read_varint(&r, &part->nbuffers) ||
+        read_section(&r, &part->objects, &part->objects_size))
+        return -1;
+    if (part->generation == 0 || part->nobjects > (size_t)PY_SSIZE_T_MAX / sizeof(PyObject *))
+        return invalid_snapshot();
+    part->records = r.p;
+    part->end = r.end;
+    return 0;
+}
+
+/* Return 1, if buffer is all of the memory of an object of the given
+ * type, that exports the buffer. */
+static int
+buffer_is_object(Py_buffer *buffer, PyObject *type)
+{
+    Py_buffer view;
+    int ret;
+
+    if (buffer->obj == NULL || (PyObject *)Py_TYPE(buffer->obj) != type)
+        return 0;
+    if (PyObject_GetBuffer(buffer->obj, &view, PyBUF_SIMPLE)) {
+        PyErr_Clear();
+        return 0;
+    }
+    ret = view.buf == buffer->buf && view.len == buffer->len &&
+          view.readonly == buffer->readonly;
+    PyBuffer_Release(&view);
+    return ret;
+}
+
+static PyObject *
+restore_array(PyObject *view, PyObject *typecode)
+{
+    Py_buffer *buffer = PyMemoryView_GET_BUFFER(view);
+    PyObject *array, *array_type, *tmp, *ret = NULL;
+    int same;
+
+    if ((array = PyImport_ImportModule("array")) == NULL)
+        return NULL;
+    array_type = PyObject_GetAttrString(array, "array");
+    Py_DECREF(array);
+    if (array_type == NULL)
+        return NULL;
+    if (buffer_is_object(buffer, array_type)) {
+        if ((tmp = PyObject_GetAttrString(buffer->obj, "typecode")) == NULL)
+            goto done;
+        same = PyObject_RichCompareBool(tmp, typecode, Py_EQ);
+        Py_DECREF(tmp);
+        if (same < 0)
+            goto done;
+        if (same) {
+            ret = buffer->obj;
+            Py_INCREF(ret);
+            goto done;
+        }
+    }
+    if ((ret = PyObject_CallFunctionObjArgs(array_type, typecode, NULL)) == NULL ||
+        (tmp = PyObject_CallMethod(ret, "frombytes", "(O)", view)) == NULL) {
+        Py_CLEAR(ret);
+        goto done;
+    }
+    Py_DECREF(tmp);
+done:
+    Py_DECREF(array_type);
+    return ret;
+}
+
+/* Recreate the object of the persistent id (kind, buffer, ...) or return
+ * the object of the earlier persistent id (index,). loaded is the list of
+ * the recreated objects. */
+static PyObject *
+buffer_persistent_load(PyObject *loaded, PyObject *pid)
+{
+    Py_ssize_t size = PyTuple_GET_SIZE(pid), i;
+    PyObject *view, *obj = NULL;
+    Py_buffer *buffer;
+    int kind;
+
+    if (size == 1) {
+        i = PyLong_AsSsize_t(PyTuple_GET_ITEM(pid, 0));
+        if (i == -1 && PyErr_Occurred())
+            return NULL;
+        if (i < 0 || i >= PyList_GET_SIZE(loaded))
+            VALUE_ERROR("invalid snapshot data: bad persistent id", NULL);
+        obj = PyList_GET_ITEM(loaded, i);
+        Py_INCREF(obj);
+        return obj;
+    }
+    kind = size >= 2 ? _PyLong_AsInt(PyTuple_GET_ITEM(pid, 0)) : -1;
+    if (kind == -1 && PyErr_Occurred())
+        return NULL;
+    if (!(kind == PERSISTENT_BYTES && size == 2) &&
+        !(kind == PERSISTENT_BYTEARRAY && size == 2) &&
+        !(kind == PERSISTENT_ARRAY && size == 3) &&
+        !(kind == PERSISTENT_MEMORYVIEW && size == 4))
+        VALUE_ERROR("invalid snapshot data: bad persistent id", NULL);
+    if ((view = PyMemoryView_FromObject(PyTuple_GET_ITEM(pid, 1))) == NULL)
+        return NULL;
+    buffer = PyMemoryView_GET_BUFFER(view);
+    switch (kind) {
+    case PERSISTENT_BYTES:
+        if (buffer_is_object(buffer, (PyObject *)&PyBytes_Type)) {
+            obj = buffer->obj;
+            Py_INCREF(obj);
+        }
+        else
+            obj = PyBytes_FromObject(view);
+        break;
+    case PERSISTENT_BYTEARRAY:
+        if (buffer_is_object(buffer, (PyObject *)&PyByteArray_Type)) {
+            obj = buffer->obj;
+            Py_INCREF(obj);
+        }
+        else
+            obj = PyByteArray_FromObject(view);
+        break;
+    case PERSISTENT_ARRAY:
+        obj = restore_array(view, PyTuple_GET_ITEM(pid, 2));
+        break;
+    case PERSISTENT_MEMORYVIEW:
+        obj = memoryview_cast(view, PyTuple_GET_ITEM(pid, 2), PyTuple_GET_ITEM(pid, 3));
+        break;
+    }
+    Py_DECREF(view);
+    if (obj != NULL && PyList_Append(loaded, obj))
+        Py_CLEAR(obj);
+    return obj;
+}
+
+static PyObject *
+snapshot_persistent_load(PyObject *persistent, PyObject *pid)
+{
+    PyObject *tasklets = PyTuple_GET_ITEM(persistent, 0);
+    PyObject *codes = PyTuple_GET_ITEM(persistent, 1);
+    PyObject *number, *obj;
+    Py_ssize_t i;
+
+    if (PyTuple_Check(pid))
+        return buffer_persistent_load(PyTuple_GET_ITEM(persistent, 2), pid);
+    i = PyLong_AsSsize_t(pid);
+    if (i == -1 && PyErr_Occurred())
+        return NULL;
+    if (i < 0)
+        VALUE_ERROR("invalid snapshot data: bad persistent id", NULL);
+    if (i & 1) {
+        i >>= 1;
+        if (i >= PyList_GET_SIZE(codes))
+            VALUE_ERROR("invalid snapshot data: bad persistent id", NULL);
+        obj = PyList_GET_ITEM(codes, i);
+        Py_INCREF(obj);
+        return obj;
+    }
+    /* A tasklet of an earlier snapshot, that is not part of this snapshot,
+     * gets restored as a new tasklet. */
+    if ((number = PyLong_FromSsize_t(i >> 1)) == NULL)
+        return NULL;
+    obj = PyDict_GetItemWithError(tasklets, number);
+    if (obj != NULL)
+        Py_INCREF(obj);
+    else if (!PyErr_Occurred()) {
+        obj = PyObject_CallFunctionObjArgs((PyObject *)&PyTasklet_Type, NULL);
+        if (obj != NULL && PyDict_SetItem(tasklets, number, obj))
+            Py_CLEAR(obj);
+    }
+    Py_DECREF(number);
+    return obj;
+}
+
+static PyMethodDef snapshot_persistent_load_def = {
+    "persistent_load", (PyCFunction)snapshot_persistent_load, METH_O};
+
+/* Unpickle a section. The persistent objects are NULL or the tuple
+ * ({tasklet number: tasklet}, [code objects], [recreated buffer objects]),
+ * buffers are NULL or the out-of-band buffers of the section. */
+static PyObject *
+unpickle_section(const unsigned char *start, size_t size, PyObject *persistent,
+                 PyObject *buffers)
+{
+    PyObject *pickle = NULL, *io = NULL, *file = NULL, *unpickler = NULL;
+    PyObject *args = NULL, *kwds = NULL, *section, *tmp, *ret = NULL;
+
+    section = PyMemoryView_FromMemory((char *)start, size, PyBUF_READ);
+    if (section == NULL)
+        return NULL;
+    if ((pickle = PyImport_ImportModule("pickle")) == NULL ||
+        (io = PyImport_ImportModule("io")) == NULL ||
+        (file = PyObject_CallMethod(io, "BytesIO", "(O)", section)) == NULL ||
+        (args = PyTuple_Pack(1, file)) == NULL)
+        goto done;
+    if (buffers != NULL &&
+        ((kwds = PyDict_New()) == NULL ||
+         PyDict_SetItemString(kwds, "buffers", buffers)))
+        goto done;
+    if ((tmp = PyObject_GetAttrString(pickle, "Unpickler")) == NULL)
+        goto done;
+    unpickler = PyObject_Call(tmp, args, kwds);
+    Py_DECREF(tmp);
+    if (unpickler == NULL)
+        goto done;
+    if (persistent != NULL) {
+        tmp = PyCFunction_New(&snapshot_persistent_load_def, persistent);
+        if (tmp == NULL)
+            goto done;
+        if (PyObject_SetAttrString(unpickler, "persistent_load", tmp)) {
+            Py_DECREF(tmp);
+            goto done;
+        }
+        Py_DECREF(tmp);
+    }
+    ret = PyObject_CallMethod(unpickler, "load", NULL);
+    if (ret != NULL && !PyTuple_Check(ret)) {
+        Py_DECREF(ret);
+        ret = NULL;
+        invalid_snapshot();
+    }
+done:
+    Py_XDECREF(unpickler);
+    Py_XDECREF(kwds);
+    Py_XDECREF(args);
+    Py_XDECREF(file);
+    Py_XDECREF(io);
+    Py_XDECREF(pickle);
+    Py_DECREF(section);
+    return ret;
+}
+
+/* Unmarshal the code objects of all snapshots, the oldest first. */
+static int
+restore_codes(snapshot_restorer *R)
+{
+    size_t g;
+    Py_ssize_t i, n;
+
+    for (g = 0; g < R->nparts; g++) {
+        snapshot_part *part = &R->parts[g];
+        PyObject *codes;
+
+        if (part->first_code != (size_t)PyList_GET_SIZE(R->codes))
+            return invalid_snapshot();
+        codes = PyMarshal_ReadObjectFromString((const char *)part->codes,
+                                               part->codes_size);
+        if (codes == NULL)
+            return -1;
+        if (!PyTuple_Check(codes)) {
+            Py_DECREF(codes);
+            return invalid_snapshot();
+        }
+        n = PyTuple_GET_SIZE(codes);
+        for (i = 0; i < n; i++) {
+            if (!PyCode_Check(PyTuple_GET_ITEM(codes, i)) ||
+                PyList_Append(R->codes, PyTuple_GET_ITEM(codes, i))) {
+                Py_DECREF(codes);
+                return PyErr_Occurred() ? -1 : invalid_snapshot();
+            }
+        }
+        Py_DECREF(codes);
+    }
+    return 0;
+}
+
+/* Create the tasklets of the last snapshot. */
+static PyObject *
+restore_tasklets(snapshot_restorer *R)
+{
+    snapshot_part *part = &R->parts[R->nparts - 1];
+    snapshot_reader r = {part->tasklet_numbers, part->end, R};
+    PyObject *ctors, *tasklets = NULL;
+    Py_ssize_t i, n;
+
+    if ((ctors = unpickle_section(part->ctors, part->ctors_size, NULL, NULL)) == NULL)
+        return NULL;
+    n = PyTuple_GET_SIZE(ctors);
+    if ((size_t)n != part->ntasklets) {
+        invalid_snapshot();
+        goto error;
+    }
+    if ((tasklets = PyList_New(n)) == NULL)
+        goto error;
+    for (i = 0; i < n; i++) {
+        PyObject *ctor = PyTuple_GET_ITEM(ctors, i), *task, *key;
+        size_t number;
+        int err;
+
+        if (!PyTuple_Check(ctor) || PyTuple_GET_SIZE(ctor) != 2 ||
+            !PyTuple_Check(PyTuple_GET_ITEM(ctor, 1)) ||
+            read_varint(&r, &number)) {
+            if (!PyErr_Occurred())
+                invalid_snapshot();
+            goto error;
+        }
+        task = PyObject_Call(PyTuple_GET_ITEM(ctor, 0), PyTuple_GET_ITEM(ctor, 1), NULL);
+        if (task == NULL)
+            goto error;
+        PyList_SET_ITEM(tasklets, i, task);
+        if (!PyTasklet_Check(task)) {
+            PyErr_SetString(PyExc_TypeError,
+                            "snapshot contains an object, that is not a tasklet");
+            goto error;
+        }
+        if ((key = PyLong_FromSize_t(number)) == NULL)
+            goto error;
+        err = PyDict_SetItem(R->tasklets, key, task);
+        Py_DECREF(key);
+        if (err)
+            goto error;
+    }
+    if (PyDict_GET_SIZE(R->tasklets) != n) {
+        invalid_snapshot();
+        goto error;
+    }
+    Py_DECREF(ctors);
+    return tasklets;
+error:
+    Py_XDECREF(tasklets);
+    Py_DECREF(ctors);
+    return NULL;
+}
+
+/* Unpickle the object tables, the newest first. A table is only needed,
+ * if it holds the latest copy of an object. Unpickling the latest copies
+ * first matters for objects like channels: a channel inserts a tasklet
+ * only, if no other channel did it before. */
+static int
+restore_objects(snapshot_restorer *R)
+{
+    PyObject *persistent = NULL, *buffers = NULL;
+    size_t g, i, number;
+    int ret = -1;
+
+    R->nobjects = R->parts[R->nparts - 1].nobjects;
+    R->objects = PyMem_Calloc(R->nobjects ? R->nobjects : 1, sizeof(PyObject *));
+    if (R->objects == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    for (g = R->nparts; g-- > 0; ) {
+        snapshot_part *part = &R->parts[g];
+        snapshot_reader r = {part->numbers, part->end, R};
+        int needed = 0;
+
+        for (i = 0; i < part->nnumbers; i++) {
+            if (read_varint(&r, &number))
+                goto done;
+            if (number >= R->nobjects) {
+                invalid_snapshot();
+                goto done;
+            }
+            if (R->objects[number] == NULL)
+                needed = 1;
+        }
+        if (!needed)
+            continue;
+        persistent = Py_BuildValue("(OON)", R->tasklets, R->codes, PyList_New(0));
+        if (persistent == NULL)
+            goto done;
+        if (R->buffers != NULL) {
+            buffers = PyTuple_GetSlice(R->buffers, part->first_buffer,
+                                       part->first_buffer + part->nbuffers);
+            if (buffers == NULL)
+                goto done;
+        }
+        part->table = unpickle_section(part->objects, part->objects_size,
+                                       persistent, buffers);
+        Py_CLEAR(buffers);
+        Py_CLEAR(persistent);
+        if (part->table == NULL)
+            goto done;
+        if ((size_t)PyTuple_GET_SIZE(part->table) != part->nnumbers) {
+            invalid_snapshot();
+            goto done;
+        }
+        r.p = part->numbers;
+        for (i = 0; i < part->nnumbers; i++) {
+            read_varint(&r, &number);
+            if (R->objects[number] == NULL)
+                R->objects[number] = PyTuple_GET_ITEM(part->table, i);
+        }
+    }
+    ret = 0;
+done:
+    Py_XDECREF(persistent);
+    return ret;
+}
+
+/* Skip a native frame record after the kind. */
+static int
+skip_frame(snapshot_reader *r)
+{
+    size_t iblock, n;
+
+    if (skip_varints(r, 7) || read_varint(r, &iblock) ||
+        skip_varints(r, 3 * iblock) || read_varint(r, &n))
+        return -1;
+    return skip_varints(r, n);
+}
+
+/* Find the frame records of an earlier snapshot. */
+static int
+part_index_records(snapshot_part *part, snapshot_restorer *R)
+{
+    snapshot_reader r = {part->records, part->end, R};
+    size_t count, i, j, n, kind, allocated = 0;
+    const unsigned char **offsets;
+
+    if (read_varint(&r, &count))
+        return -1;
+    for (i = 0; i < count; i++) {
+        if (skip_varints(&r, 1) || read_varint(&r, &n))
+            return -1;
+        for (j = 0; j < n; j++) {
+            const unsigned char *offset = r.p;
+            size_t length = 1;
+
+            if (read_varint(&r, &kind))
+                return -1;
+            if (kind == SNAPSHOT_FRAME_NATIVE) {
+                if (skip_frame(&r))
+                    return -1;
+            }
+            else if (kind == SNAPSHOT_FRAME_OBJECT) {
+                if (skip_varints(&r, 1))
+                    return -1;
+            }
+            else if (kind == SNAPSHOT_FRAME_STORED) {
+                if (skip_varints(&r, 2) || read_varint(&r, &length))
+                    return -1;
+                if (length == 0 || length > n - j)
+                    return invalid_snapshot();
+            }
+            else
+                return invalid_snapshot();
+            if (part->nrecords + length > allocated) {
+                allocated = (part->nrecords + length) * 2;
+                offsets = PyMem_Realloc(part->offsets, allocated * sizeof(*offsets));
+                if (offsets == NULL) {
+                    PyErr_NoMemory();
+                    return -1;
+                }
+                part->offsets = offsets;
+            }
+            /* the frames of a run can't be referenced */
+            for (j += length - 1; length--; )
+                part->offsets[part->nrecords++] = offset;
+        }
+    }
+    if (r.p != r.end)
+        return invalid_snapshot();
+    if (part->offsets == NULL)
+        part->offsets = PyMem_Malloc(1);
+    return 0;
+}
+
+/* The counterpart of frame_new() and frame_setstate() in prickelpit.c */
+static PyFrameObject *
+read_frame(snapshot_reader *r)
+{
+    PyThreadState *ts = _PyThreadState_GET();
+    PyObject *code, *globals, *locals, *trace, *value;
+    PyFrameObject *f;
+    size_t index, iblock, n, i;
+    int lasti, lineno, executing;
+
+    if (read_varint(r, &index))
+        return NULL;
+    if (index >= (size_t)PyList_GET_SIZE(r->restorer->codes)) {
+        invalid_snapshot();
+        return NULL;
+    }
+    code = PyList_GET_ITEM(r->restorer->codes, index);
+    if (read_object(r, &globals) ||
+        read_optional(r, &locals) ||
+        read_optional(r, &trace))
+        return NULL;
+    if (!PyDict_Check(globals) || (locals != NULL && !PyDict_Check(locals))) {
+        invalid_snapshot();
+        return NULL;
+    }
+    if (trace != NULL && !PyCallable_Check(trace))
+        TYPE_ERROR("trace must be a function for frame", NULL);
+
+    f = PyFrame_New(ts, (PyCodeObject *)code, globals, globals);
+    if (f == NULL)
+        return NULL;
+    Py_XINCREF(locals);
+    Py_XSETREF(f->f_locals, locals);
+    Py_XINCREF(trace);
+    Py_XSETREF(f->f_trace, trace);
+
+    /* mark this frame as coming from unpickling */
+    Py_INCREF(Py_None);
+    Py_XSETREF(f->f_back, (PyFrameObject *)Py_None);
+
+    if (read_int(r, &lasti) ||
+        read_int(r, &lineno) ||
+        read_int(r, &executing) ||
+        read_varint(r, &iblock))
+        goto error;
+    if (executing < SLP_FRAME_EXECUTING_INVALID ||
+        executing > SLP_FRAME_EXECUTING_YIELD_FROM ||
+        iblock > CO_MAXBLOCKS) {
+        invalid_snapshot();
+        goto error;
+    }
+    f->f_lasti = lasti;
+    f->f_lineno = lineno;
+    f->f_iblock = (int)iblock;
+    for (i = 0; i < CO_MAXBLOCKS; i++) {
+        if (i < iblock) {
+            if (read_int(r, &f->f_blockstack[i].b_type) ||
+                read_int(r, &f->f_blockstack[i].b_handler) ||
+                read_int(r, &f->f_blockstack[i].b_level))
+                goto error;
+        } else {
+            f->f_blockstack[i].b_type =
+            f->f_blockstack[i].b_handler =
+            f->f_blockstack[i].b_level = 0;
+        }
+    }
+
+    if (read_varint(r, &n))
+        goto error;
+    if (n > (size_t)(f->f_code->co_stacksize + (f->f_valuestack - f->f_localsplus))) {
+        invalid_snapshot();
+        goto error;
+    }
+    f->f_stacktop = f->f_localsplus;
+    for (i = 0; i < n; i++) {
+        if (read_optional(r, &value))
+            goto error;
+        Py_XINCREF(value);
+        f->f_localsplus[i] = value;
+        f->f_stacktop++;
+    }
+
+    f->f_executing = executing;
+    return f;
+error:
+    Py_DECREF(f);
+    return NULL;
+}
+
+/* Append at most max frames, that an earlier snapshot stored, to frames. */
+static int
+read_stored_frames(snapshot_reader *r, size_t generation, PyObject *frames, size_t max)
+{
+    snapshot_restorer *R = r->restorer;
+    snapshot_reader stored = {NULL, NULL, R};
+    snapshot_part *part;
+    size_t g, record, length, kind;
+    PyObject *f;
+
+    if (read_varint(r, &g) || read_varint(r, &record) || read_varint(r, &length))
+        return -1;
+    if (g == 0 || g >= generation || length == 0 || length > max)
+        return invalid_snapshot();
+    part = &R->parts[g - 1];
+    if (part->offsets == NULL && part_index_records(part, R))
+        return -1;
+    if (record >= part->nrecords || length > part->nrecords - record)
+        return invalid_snapshot();
+    while (length--) {
+        stored.p = part->offsets[record++];
+        stored.end = part->end;
+        if (read_varint(&stored, &kind))
+            return -1;
+        if (kind != SNAPSHOT_FRAME_NATIVE)
+            return invalid_snapshot();
+        if ((f = (PyObject *)read_frame(&stored)) == NULL)
+            return -1;
+        if (PyList_Append(frames, f)) {
+            Py_DECREF(f);
+            return -1;
+        }
+        Py_DECREF(f);
+    }
+    return 0;
+}
+
+static int
+read_tasklet(snapshot_reader *r, PyObject *task, size_t generation)
+{
+    PyObject *state, *frames, *args, *tmp;
+    size_t i, n;
+
+    if (read_object(r, &state) || read_varint(r, &n))
+        return -1;
+    if (!PyTuple_Check(state) || PyTuple_GET_SIZE(state) <= SNAPSHOT_STATE_FRAMES)
+        return invalid_snapshot();
+    if ((frames = PyList_New(0)) == NULL)
+        return -1;
+    while ((i = PyList_GET_SIZE(frames)) < n) {
+        size_t kind;
+        PyObject *f;
+
+        if (read_varint(r, &kind))
+            goto error;
+        if (kind == SNAPSHOT_FRAME_STORED) {
+            if (read_stored_frames(r, generation, frames, n - i))
+                goto error;
+            continue;
+        }
+        if (kind == SNAPSHOT_FRAME_NATIVE)
+            f = (PyObject *)read_frame(r);
+        else if (kind == SNAPSHOT_FRAME_OBJECT) {
+            if (read_object(r, &f))
+                goto error;
+            Py_INCREF(f);
+        }
+        else {
+            invalid_snapshot();
+            goto error;
+        }
+        if (f == NULL)
+            goto error;
+        if (PyList_Append(frames, f)) {
+            Py_DECREF(f);
+            goto error;
+        }
+        Py_DECREF(f);
+    }
+
+    args = replace_frames(state, frames);
+    Py_DECREF(frames);
+    if (args == NULL)
+        return -1;
+    tmp = PyObject_CallMethod(task, "__setstate__", "(O)", args);
+    Py_DECREF(args);
+    if (tmp == NULL)
+        return -1;
+    Py_DECREF(tmp);
+    return 0;
+error:
+    Py_DECREF(frames);
+    return -1;
+}
+
+/* Parse the snapshot data and the earlier snapshots of its chain. */
+static int
+restore_parse(snapshot_restorer *R, PyObject *data, PyObject *previous)
+{
+    snapshot_part part, *p;
+    unsigned char chain_id[SNAPSHOT_CHAIN_ID_SIZE];
+    PyObject *seq;
+    Py_ssize_t i, n = 0;
+    int ret = -1;
+
+    if (previous == Py_None)
+        seq = PyTuple_New(0);
+    else
+        seq = PySequence_Fast(previous, "restore() argument 'previous' must be "
+                              "an iterable of snapshots");
+    if (seq == NULL)
+        return -1;
+    n = PySequence_Fast_GET_SIZE(seq);
+
+    memset(&part, 0, sizeof(part));
+    if (part_parse(&part, data, R->chain_id)) {
+        if (part.view.obj != NULL)
+            PyBuffer_Release(&part.view);
+        goto done;
+    }
+    if (part.generation != (size_t)n + 1) {
+        PyBuffer_Release(&part.view);
+        if (part.generation > (size_t)n + 1)
+            PyErr_Format(PyExc_ValueError, "restore() needs the %zu earlier "
+                         "snapshots of the chain", part.generation - 1);
+        else
+            PyErr_SetString(PyExc_ValueError, "restore() got snapshots, "
+                            "that are not earlier snapshots of the chain");
+        goto done;
+    }
+    R->parts = PyMem_Calloc(n + 1, sizeof(snapshot_part));
+    if (R->parts == NULL) {
+        PyBuffer_Release(&part.view);
+        PyErr_NoMemory();
+        goto done;
+    }
+    R->nparts = n + 1;
+    R->parts[n] = part;
+
+    for (i = 0; i < n; i++) {
+        memset(&part, 0, sizeof(part));
+        if (part_parse(&part, PySequence_Fast_GET_ITEM(seq, i), chain_id)) {
+            if (part.view.obj != NULL)
+                PyBuffer_Release(&part.view);
+            goto done;
+        }
+        if (part.generation > (size_t)n ||
+            memcmp(chain_id, R->chain_id, SNAPSHOT_CHAIN_ID_SIZE) != 0 ||
+            R->parts[part.generation - 1].view.obj != NULL) {
+            PyBuffer_Release(&part.view);
+            PyErr_SetString(PyExc_ValueError, "restore() got snapshots, "
+                            "that are not earlier snapshots of the chain");
+            goto done;
+        }
+        R->parts[part.generation - 1] = part;
+    }
+    for (i = 0; i < n; i++) {
+        p = &R->parts[i];
+        if (p->nobjects > R->parts[n].nobjects)
+            goto done;
+    }
+    ret = 0;
+done:
+    Py_DECREF(seq);
+    if (ret == 0 || PyErr_Occurred())
+        return ret;
+    return invalid_snapshot();
+}
+
+/* Distribute the out-of-band buffers to the snapshots of the chain. */
+static int
+restore_buffers(snapshot_restorer *R, PyObject *buffers)
+{
+    size_t g, n = 0;
+
+    for (g = 0; g < R->nparts; g++) {
+        R->parts[g].first_buffer = n;
+        n += R->parts[g].nbuffers;
+        if (n > PY_SSIZE_T_MAX)
+            return invalid_snapshot();
+    }
+    if (buffers == Py_None) {
+        if (n != 0)
+            VALUE_ERROR("restore() needs the out-of-band buffers of the snapshots", -1);
+        return 0;
+    }
+    if ((R->buffers = PySequence_Tuple(buffers)) == NULL)
+        return -1;
+    if ((size_t)PyTuple_GET_SIZE(R->buffers) != n) {
+        PyErr_Format(PyExc_ValueError, "restore() got %zd out-of-band buffers, "
+                     "the snapshots have %zu", PyTuple_GET_SIZE(R->buffers), n);
+        return -1;
+    }
+    return 0;
+}
+
+PyObject *
+slp_restore(PyObject *data, PyObject *previous, PyObject *buffers)
+{
+    snapshot_restorer R;
+    snapshot_reader r = {NULL, NULL, &R};
+    snapshot_part *part;
+    PyObject *tasklets = NULL, *ret = NULL;
+    size_t count, g;
+    Py_ssize_t i, n;
+
+    memset(&R, 0, sizeof(R));
+    if ((R.codes = PyList_New(0)) == NULL ||
+        (R.tasklets = PyDict_New()) == NULL ||
+        restore_parse(&R, data, previous) ||
+        restore_buffers(&R, buffers) ||
+        restore_codes(&R) ||
+        (tasklets = restore_tasklets(&R)) == NULL ||
+        restore_objects(&R))
+        goto done;
+
+    /* the records of the last snapshot */
+    part = &R.parts[R.nparts - 1];
+    r.p = part->records;
+    r.end = part->end;
+    if (read_varint(&r, &count))
+        goto done;
+    n = PyList_GET_SIZE(tasklets);
+    if (count != (size_t)n) {
+        invalid_snapshot();
+        goto done;
+    }
+    for (i = 0; i < n; i++) {
+        if (read_tasklet(&r, PyList_GET_ITEM(tasklets, i), part->generation))
+            goto done;
+    }
+    if (r.p != r.end) {
+        invalid_snapshot();
+        goto done;
+    }
+    ret = tasklets;
+    tasklets = NULL;
+done:
+    for (g = 0; g < R.nparts; g++) {
+        part = &R.parts[g];
+        PyMem_Free(part->offsets);
+        Py_XDECREF(part->table);
+        if (part->view.obj != NULL)
+            PyBuffer_Release(&part->view);
+    }
+    PyMem_Free(R.parts);
+    PyMem_Free(R.objects);
+    Py_XDECREF(R.buffers);
+    Py_XDECREF(R.tasklets);
+    Py_XDECREF(R.codes);
+    Py_XDECREF(tasklets);
+    return ret;
+}
+
+#endif
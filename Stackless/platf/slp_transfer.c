@@ -17,20 +17,34 @@
 
 #define __return(x) return (x)
 
+#define _separate (_PyRuntime.st.transfer.separate)
+
+static int slp_separate_save(intptr_t *stackref, intptr_t *stsizediff);
+static void slp_separate_restore(void);
+
 #define SLP_SAVE_STATE(stackref, stsizediff) \
     intptr_t stsizeb; \
     stackref += SLP_STACK_MAGIC; \
-    if (_cstprev != NULL) { \
-        if (slp_cstack_new(_cstprev, (intptr_t *)stackref, _prev) == NULL) __return(-1); \
-        stsizeb = slp_cstack_save(*_cstprev); \
+    if (_separate) { \
+        int sepres = slp_separate_save((intptr_t *)stackref, &stsizeb); \
+        if (sepres <= 0) __return(sepres); \
+    } \
+    else { \
+        if (_cstprev != NULL) { \
+            if (slp_cstack_new(_cstprev, (intptr_t *)stackref, _prev) == NULL) __return(-1); \
+            stsizeb = slp_cstack_save(*_cstprev); \
+        } \
+        else \
+            stsizeb = (_cst->startaddr - (intptr_t *)stackref) * sizeof(intptr_t); \
+        if (_cst == NULL) __return(0); \
+        stsizeb -= Py_SIZE(_cst) * sizeof(intptr_t); \
     } \
-    else \
-        stsizeb = (_cst->startaddr - (intptr_t *)stackref) * sizeof(intptr_t); \
-    if (_cst == NULL) __return(0); \
-    stsizediff = stsizeb - (Py_SIZE(_cst) * sizeof(intptr_t));
+    stsizediff = stsizeb;
 
 #define SLP_RESTORE_STATE() \
-    if (_cst != NULL) { \
+    if (_separate) \
+        slp_separate_restore(); \
+    else if (_cst != NULL) { \
         slp_cstack_restore(_cst); \
     }
 
@@ -75,6 +89,34 @@ or disable the STACKLESS flag.
 **********
 #endif
 
+/*
+ * The separate stack mode requires SLP_CALL_ON_STACK(stackend, func) from
+ * the switch_XXX.h file of the platform and mmap().
+ * Define SLP_NO_SEPARATE_STACKS to disable it.
+ */
+#if defined(SLP_CALL_ON_STACK) && defined(HAVE_MMAP) && \
+    defined(HAVE_SYS_MMAN_H) && !defined(SLP_NO_SEPARATE_STACKS)
+#define SLP_SEPARATE_STACKS
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifdef MAP_STACK
+#define SLP_MAP_STACK MAP_STACK
+#else
+#define SLP_MAP_STACK 0
+#endif
+#ifdef MAP_NORESERVE
+#define SLP_MAP_NORESERVE MAP_NORESERVE
+#else
+#define SLP_MAP_NORESERVE 0
+#endif
+/* Pages of a region get committed on first use only */
+#define SLP_MAP_FLAGS (SLP_MAP_STACK | SLP_MAP_NORESERVE)
+#endif
+
 /* default definitions if not defined in above files */
 
 
@@ -271,7 +313,9 @@ slp_transfer(PyCStackObject **cstprev, PyCStackObject *cst,
     STACKLESS_ASSERT();
     SLP_ASSERT_FRAME_IN_TRANSFER(ts);
 
-    if ((intptr_t *) &ts > ts->st.cstack_base)
+    /* On a separate stack region the stack addresses are unrelated
+     * to the cstack_base of the thread. */
+    if (ts->st.cstack_region == NULL && (intptr_t *) &ts > ts->st.cstack_base)
         return climb_stack_and_transfer(cstprev, cst, prev);
     if (cst == NULL || Py_SIZE(cst) == 0)
         cst = ts->st.initial_stub;
@@ -281,7 +325,8 @@ slp_transfer(PyCStackObject **cstprev, PyCStackObject *cst,
                 "bad thread state in transfer");
             return -1;
         }
-        if (ts->st.cstack_base != cst->startaddr) {
+        if (cst->region != NULL ? cst->region->base != cst->startaddr :
+                ts->st.cstack_base != cst->startaddr) {
             PyErr_SetString(PyExc_SystemError,
                 "bad stack reference in transfer");
             return -1;
@@ -297,6 +342,9 @@ slp_transfer(PyCStackObject **cstprev, PyCStackObject *cst,
     _cstprev = cstprev;
     _cst = cst;
     _prev = prev;
+    _separate = ts->interp->st.enable_separate_stacks ||
+        ts->st.cstack_region != NULL || ts->st.cstack_inplace != NULL ||
+        (cst != NULL && cst->region != NULL);
     result = slp_switch_ptr();
     SLP_ASSERT_FRAME_IN_TRANSFER(ts);
     if (!result) {
@@ -325,6 +373,266 @@ slp_transfer(PyCStackObject **cstprev, PyCStackObject *cst,
     return result;
 }
 
+/*
+ * The separate stack mode
+ *
+ * Usually a hard switch copies the C-state of the previous tasklet from
+ * the stack of the thread into a cstack object and copies the C-state of
+ * the next tasklet back. In the separate stack mode a tasklet, that gets
+ * hard switched, leaves its C-state in place:
+ *
+ * - If the tasklet runs on the stack of the thread, the C-state stays there
+ *   until another C-state needs this part of the stack. Only then the
+ *   C-state gets copied into its cstack object ("inplace").
+ * - If the tasklet runs on a separate stack region, the cstack object
+ *   takes the ownership of the region ("region").
+ *
+ * Resuming a C-state in place only exchanges the stack pointer. If the
+ * next tasklet has no C-state of its own (it starts with the initial stub)
+ * and the stack of the thread is occupied, a fresh separate stack region
+ * is used to run the tasklet dispatcher. If no region can be allocated,
+ * we fall back to copying.
+ */
+
+int
+slp_separate_stacks_available(void)
+{
+#ifdef SLP_SEPARATE_STACKS
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+static void
+slp_region_free(struct _slp_stack_region *region)
+{
+#ifdef SLP_SEPARATE_STACKS
+    munmap(region->mem, region->memsize);
+#endif
+    PyMem_RawFree(region);
+}
+
+static struct _slp_stack_region *
+slp_region_new(void)
+{
+    struct _slp_stack_region *region;
+#ifdef SLP_SEPARATE_STACKS
+    size_t pagesize, memsize;
+    char *mem;
+#endif
+
+    region = _PyRuntime.st.region_cache;
+    if (region != NULL) {
+        _PyRuntime.st.region_cache = region->next;
+        --_PyRuntime.st.region_cachecount;
+        region->next = NULL;
+        return region;
+    }
+#ifndef SLP_SEPARATE_STACKS
+    return NULL;
+#else
+    region = PyMem_RawMalloc(sizeof(*region));
+    if (region == NULL)
+        return NULL;
+    pagesize = (size_t)sysconf(_SC_PAGESIZE);
+    memsize = (SLP_SEPARATE_STACK_SIZE + pagesize - 1) / pagesize * pagesize;
+    memsize += pagesize;  /* the guard page */
+    mem = mmap(NULL, memsize, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | SLP_MAP_FLAGS, -1, 0);
+    if (mem == MAP_FAILED) {
+        PyMem_RawFree(region);
+        return NULL;
+    }
+    if (mprotect(mem, pagesize, PROT_NONE) != 0) {
+        munmap(mem, memsize);
+        PyMem_RawFree(region);
+        return NULL;
+    }
+    region->next = NULL;
+    region->mem = mem;
+    region->memsize = memsize;
+    region->base = (intptr_t *)(mem + memsize);
+    return region;
+#endif
+}
+
+void
+slp_region_release(struct _slp_stack_region *region)
+{
+    assert(region != NULL);
+    if (_PyRuntime.st.region_cachecount < SLP_SEPARATE_STACK_MAXCACHE) {
+        region->next = _PyRuntime.st.region_cache;
+        _PyRuntime.st.region_cache = region;
+        ++_PyRuntime.st.region_cachecount;
+        return;
+    }
+    slp_region_free(region);
+}
+
+/* this function will get called by slp_stacklesseval_fini */
+void
+slp_region_cacheclear(void)
+{
+    struct _slp_stack_region *region;
+
+    while ((region = _PyRuntime.st.region_cache) != NULL) {
+        _PyRuntime.st.region_cache = region->next;
+        slp_region_free(region);
+    }
+    _PyRuntime.st.region_cachecount = 0;
+}
+
+static void
+slp_separate_post_switch(void)
+{
+    if (_PyRuntime.st.transfer.release != NULL) {
+        slp_region_release(_PyRuntime.st.transfer.release);
+        _PyRuntime.st.transfer.release = NULL;
+    }
+}
+
+#ifdef SLP_SEPARATE_STACKS
+static void
+slp_new_stack_entry(void)
+{
+    /* This function runs on top of a fresh separate stack region. It
+     * completes the transfer like the code following slp_switch() in
+     * slp_transfer() and then it runs the tasklet dispatcher, like the
+     * initial stub does. It never returns.
+     */
+    PyThreadState *ts = _PyThreadState_GET();
+    intptr_t probe;
+
+    slp_separate_post_switch();
+    SLP_CSTACK_SET_ROOT(ts, probe);
+    ts->st.nesting_level = ts->st.initial_stub->nesting_level;
+    /* a new entry point into stackless, see slp_tasklet_end() */
+    ts->st.serial_last_jump = ++ts->st.serial;
+    if (ts->st.del_post_switch) {
+        PyObject *tmp;
+        TASKLET_CLAIMVAL(ts->st.current, &tmp);
+        Py_CLEAR(ts->st.del_post_switch);
+        TASKLET_SETVAL_OWN(ts->st.current, tmp);
+    }
+    slp_run_tasklet();
+    Py_FatalError("The tasklet dispatcher returned on a separate stack.");
+}
+#endif
+
+static int
+slp_separate_save(intptr_t *stackref, intptr_t *stsizediff)
+{
+    PyThreadState *ts = _PyThreadState_GET();
+    struct _slp_stack_region *region = ts->st.cstack_region;
+    PyCStackObject *cst = _cst;
+    PyCStackObject *inplace;
+    intptr_t *target;
+
+    /* save the current C-state */
+    if (_cstprev != NULL) {
+        if (region != NULL && cst != NULL) {
+            /* leave the C-state on the region */
+            if (slp_cstack_new_region(_cstprev, stackref, region, _prev) == NULL)
+                return -1;
+            ts->st.cstack_region = NULL;
+        }
+        else if (region != NULL) {
+            /* We don't switch, therefore the C-state will be modified.
+             * And we can't copy it. Record an empty cstack. */
+            if (slp_cstack_new(_cstprev, ts->st.cstack_base, _prev) == NULL)
+                return -1;
+        }
+        else {
+            if (slp_cstack_new(_cstprev, stackref, _prev) == NULL)
+                return -1;
+            if (cst != NULL && ts->interp->st.enable_separate_stacks) {
+                /* defer the copy until the stack of the thread is needed */
+                assert(ts->st.cstack_inplace == NULL);
+                (*_cstprev)->inplace = 1;
+                ts->st.cstack_inplace = *_cstprev;
+            }
+            else
+                slp_cstack_save(*_cstprev);
+        }
+    }
+    else if (region != NULL) {
+        /* abandon the current region, release it after the switch */
+        assert(cst != NULL);
+        assert(_PyRuntime.st.transfer.release == NULL);
+        _PyRuntime.st.transfer.release = region;
+        ts->st.cstack_region = NULL;
+    }
+    if (cst == NULL)
+        return 0;
+
+    /* locate the C-state of the target */
+    if (cst->region != NULL) {
+        target = cst->stackref;
+    }
+    else if (cst->inplace) {
+        assert(ts->st.cstack_inplace == cst);
+        target = cst->startaddr - Py_SIZE(cst);
+    }
+    else {
+        inplace = ts->st.cstack_inplace;
+#ifdef SLP_SEPARATE_STACKS
+        if (inplace != NULL && cst == ts->st.initial_stub &&
+                _cstprev != NULL && ts->interp->st.enable_separate_stacks) {
+            /* The stack of the thread is occupied. Run the dispatcher
+             * on a new region. (Without _cstprev we return to the
+             * original stub, see slp_tasklet_end().) */
+            region = slp_region_new();
+            if (region != NULL) {
+                ts->st.cstack_region = region;
+                SLP_CALL_ON_STACK(region->base, slp_new_stack_entry);
+                /* does not return */
+            }
+        }
+#endif
+        if (inplace != NULL && inplace != cst) {
+            /* evict the C-state from the stack of the thread */
+            slp_cstack_save(inplace);
+            inplace->inplace = 0;
+            ts->st.cstack_inplace = NULL;
+        }
+        target = cst->startaddr - Py_SIZE(cst);
+    }
+    *stsizediff = (char *)target - (char *)stackref;
+    return 1;
+}
+
+static void
+slp_separate_restore(void)
+{
+    PyCStackObject *cst = _cst;
+    PyThreadState *ts = cst->tstate;
+
+    ts->st.cstack_root = cst->cstack_root;
+    slp_separate_post_switch();
+    if (cst->region != NULL) {
+        ts->st.cstack_region = cst->region;
+        cst->region = NULL;
+        Py_SIZE(cst) = 0;  /* there is no stack buffer */
+        ts->st.nesting_level = cst->nesting_level;
+        /* mark task as no longer responsible for cstack instance */
+        cst->task = NULL;
+    }
+    else if (cst->inplace) {
+        ts->st.cstack_inplace = NULL;
+        cst->inplace = 0;
+        ts->st.nesting_level = cst->nesting_level;
+        /* mark task as no longer responsible for cstack instance */
+        cst->task = NULL;
+    }
+    else {
+        /* This must be the last action. The copy overwrites the frame of
+         * slp_switch() and therefore any local variable the compiler
+         * spilled to it, if this function gets inlined. */
+        slp_cstack_restore(cst);
+    }
+}
+
 #ifdef Py_DEBUG
 int
 slp_transfer_return(PyCStackObject *cst)
@@ -136,5 +136,18 @@ slp_switch(void)
     }
 }
 
+/*
+ * Used by the separate stack mode: set the stack pointer to stackend and
+ * call the function func(void). func must not return. Clearing %rbp
+ * terminates the chain of frame pointers for debuggers.
+ */
+#define SLP_CALL_ON_STACK(stackend, func) \
+    __asm__ volatile ( \
+        "movq %0, %%rsp\n\t" \
+        "xorl %%ebp, %%ebp\n\t" \
+        "call *%1\n\t" \
+        "ud2\n\t" \
+        : : "D" (stackend), "S" (func) : "memory")
+
 #undef REGS_CLOBBERED
 #endif
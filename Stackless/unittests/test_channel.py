@@ -321,6 +321,251 @@ class Subclassing(StacklessTestCase):
         self.assertEqual(c.name, name)
 
 
+class TestBuffered(StacklessTestCase):
+    """Test channels with a capacity"""
+
+    def test_default(self):
+        c = stackless.channel()
+        self.assertEqual(c.capacity, 0)
+        c = stackless.channel(capacity=2)
+        self.assertEqual(c.capacity, 2)
+
+    def test_send_without_switch(self):
+        c = stackless.channel(capacity=3)
+        with block_trap():
+            for i in range(3):
+                c.send(i)
+        self.assertEqual(c.balance, 3)
+        self.assertIsNone(c.queue)
+        with block_trap():
+            self.assertEqual([c.receive() for i in range(3)], [0, 1, 2])
+        self.assertEqual(c.balance, 0)
+
+    def test_full_buffer_blocks(self):
+        c = stackless.channel(capacity=2)
+        result = []
+
+        def sender():
+            for i in range(5):
+                c.send(i)
+                result.append(i)
+        t = stackless.tasklet(sender)()
+        t.run()
+        # two values in the buffer, the sender waits with the third value
+        self.assertEqual(result, [0, 1])
+        self.assertEqual(c.balance, 3)
+        self.assertIs(c.queue, t)
+        # a receive moves the value of the waiting sender into the buffer
+        self.assertEqual(c.receive(), 0)
+        self.assertEqual(c.balance, 2)
+        self.assertTrue(t.scheduled)
+        stackless.run()
+        self.assertEqual([c.receive() for i in range(4)], [1, 2, 3, 4])
+        stackless.run()
+        self.assertFalse(t.alive)
+
+    def test_empty_buffer_blocks(self):
+        c = stackless.channel(capacity=2)
+        result = []
+
+        def receiver():
+            result.append(c.receive())
+        stackless.tasklet(receiver)()
+        stackless.run()
+        self.assertEqual(c.balance, -1)
+        # a waiting receiver gets the value directly
+        c.send("value")
+        stackless.run()
+        self.assertEqual(result, ["value"])
+        self.assertEqual(c.balance, 0)
+
+    def test_send_exception(self):
+        c = stackless.channel(capacity=3)
+        c.send(1)
+        c.send_exception(ValueError, "boom")
+        c.send(2)
+        self.assertEqual(c.receive(), 1)
+        self.assertRaisesRegex(ValueError, "boom", c.receive)
+        self.assertEqual(c.receive(), 2)
+
+    def test_close(self):
+        c = stackless.channel(capacity=2)
+        c.send(1)
+        c.close()
+        self.assertTrue(c.closing)
+        self.assertFalse(c.closed)
+        self.assertEqual(list(c), [1])
+        self.assertTrue(c.closed)
+
+    def test_capacity(self):
+        c = stackless.channel()
+        c.capacity = 1
+        c.send(1)
+        c.capacity = 0
+        # the buffered value stays
+        self.assertEqual(c.balance, 1)
+        self.assertEqual(c.receive(), 1)
+        self.assertRaises(ValueError, setattr, c, "capacity", -1)
+        self.assertRaises(TypeError, setattr, c, "capacity", 1.0)
+        self.assertRaises(TypeError, stackless.channel, capacity="1")
+        stackless.tasklet(c.receive)()
+        stackless.run()
+        self.assertRaises(RuntimeError, setattr, c, "capacity", 1)
+        c.send(None)
+
+    def test_select(self):
+        c = stackless.channel(capacity=1)
+        self.assertEqual(stackless.select([(c, 'recv')], 0), None)
+        self.assertEqual(stackless.select([(c, 'send', 1)]), (0, None))
+        self.assertEqual(stackless.select([(c, 'recv')]), (0, 1))
+
+    def test_pickle(self):
+        import pickle
+        c = stackless.channel(capacity=4)
+        c.preference = 1
+        c.send("a")
+        c.send("b")
+        c2 = pickle.loads(pickle.dumps(c))
+        self.assertEqual((c2.capacity, c2.balance, c2.preference), (4, 2, 1))
+        self.assertEqual(list(c.receive() for i in range(2)), ["a", "b"])
+        self.assertEqual(list(c2.receive() for i in range(2)), ["a", "b"])
+        # an unbuffered channel keeps its old pickle format
+        self.assertEqual(len(stackless.channel().__reduce__()[2]), 3)
+
+    def test_thread(self):
+        c = stackless.channel(capacity=2)
+        result = []
+
+        def consumer():
+            for i in range(6):
+                result.append(c.receive())
+        t = threading.Thread(target=consumer)
+        t.start()
+        for i in range(6):
+            c.send(i)
+        t.join()
+        self.assertEqual(result, list(range(6)))
+
+
+class TestBulk(StacklessTestCase):
+    """Test channel.send_many() and channel.receive_many()"""
+
+    def test_send_many_to_receivers(self):
+        c = stackless.channel()
+        result = []
+
+        def receiver():
+            result.append(c.receive())
+        for i in range(3):
+            stackless.tasklet(receiver)()
+        stackless.run()
+        self.assertEqual(c.balance, -3)
+        # all receivers get their value without a switch
+        self.assertEqual(c.send_many(range(3)), 3)
+        self.assertEqual(result, [])
+        self.assertEqual(c.balance, 0)
+        self.assertEqual(stackless.getruncount(), 4)
+        stackless.run()
+        self.assertEqual(result, [0, 1, 2])
+
+    def test_send_many_blocks(self):
+        c = stackless.channel()
+        result = []
+
+        def sender():
+            result.append(c.send_many(range(5)))
+        stackless.tasklet(sender)()
+        stackless.run()
+        self.assertEqual(c.balance, 1)
+        self.assertEqual(c.receive_many(10), [0])
+        self.assertEqual([c.receive() for i in range(4)], [1, 2, 3, 4])
+        stackless.run()
+        self.assertEqual(result, [5])
+
+    def test_send_many_buffered(self):
+        c = stackless.channel(capacity=4)
+        self.assertEqual(c.send_many("abc"), 3)
+        self.assertEqual(c.balance, 3)
+        self.assertEqual(c.receive_many(2), ["a", "b"])
+        self.assertEqual(c.receive_many(2), ["c"])
+
+    def test_receive_many_from_senders(self):
+        c = stackless.channel()
+        for i in range(4):
+            stackless.tasklet(c.send)(i)
+        stackless.run()
+        self.assertEqual(c.receive_many(3), [0, 1, 2])
+        self.assertEqual(c.balance, 1)
+        # the senders are runnable, but not yet run
+        self.assertEqual(stackless.getruncount(), 4)
+        self.assertEqual(c.receive_many(3), [3])
+
+    def test_receive_many_blocks(self):
+        c = stackless.channel(capacity=3)
+        result = []
+
+        def receiver():
+            result.append(c.receive_many(10))
+        stackless.tasklet(receiver)()
+        stackless.run()
+        self.assertEqual(c.balance, -1)
+        c.send_many(range(4))
+        stackless.run()
+        # the receiver takes the buffered values, when it wakes up
+        self.assertEqual(result, [[0, 1, 2, 3]])
+        self.assertEqual(c.balance, 0)
+
+    def test_receive_many_exception(self):
+        c = stackless.channel(capacity=3)
+        c.send(1)
+        c.send_exception(ValueError, "boom")
+        c.send(2)
+        # the exception ends the list
+        self.assertEqual(c.receive_many(3), [1])
+        self.assertRaisesRegex(ValueError, "boom", c.receive_many, 3)
+        self.assertEqual(c.receive_many(3), [2])
+
+    def test_send_many_error(self):
+        c = stackless.channel(capacity=2)
+
+        def values():
+            yield 1
+            raise ZeroDivisionError
+        self.assertRaises(ZeroDivisionError, c.send_many, values())
+        self.assertEqual(c.receive_many(2), [1])
+        self.assertRaises(TypeError, c.send_many, None)
+        self.assertRaises(ValueError, c.receive_many, 0)
+        self.assertRaises(TypeError, c.receive_many, "1")
+
+    def test_select(self):
+        c = stackless.channel()
+        result = []
+
+        def selector():
+            result.append(stackless.select([(c, 'recv')]))
+        stackless.tasklet(selector)()
+        stackless.run()
+        self.assertEqual(c.send_many([1]), 1)
+        stackless.run()
+        self.assertEqual(result, [(0, 1)])
+
+    @unittest.skipUnless(withThreads, "requires thread support")
+    def test_thread(self):
+        c = stackless.channel(capacity=2)
+        result = []
+
+        def thread():
+            result.extend(c.receive_many(10))
+        t = threading.Thread(target=thread)
+        t.start()
+        while c.balance == 0:
+            pass
+        c.send_many(range(3))
+        t.join()
+        self.assertEqual(result, [0, 1, 2])
+        self.assertEqual(c.balance, 0)
+
+
 if __name__ == '__main__':
     if not sys.argv[1:]:
         sys.argv.append('-v')
@@ -1281,6 +1281,101 @@ class TestModule(StacklessTestCase):
         self.assertEqual(type(stackless.threads), list)
 
 
+class TestUnstarted(StacklessTestCase):
+    """A tasklet, that didn't run yet, creates its frame lazily"""
+
+    def test_state(self):
+        args = (1, 2)
+        t = stackless.tasklet(print)(*args)
+        self.assertTrue(t.alive)
+        self.assertTrue(t.scheduled)
+        self.assertIsNone(t.frame)
+        self.assertIn(args, gc.get_referents(t))
+        t.remove()
+        self.assertTrue(t.paused)
+        t.kill()
+        self.assertFalse(t.alive)
+        self.assertNotIn(args, gc.get_referents(t))
+
+    def test_kill(self):
+        result = []
+        t = stackless.tasklet(result.append)(1)
+        t.kill()
+        self.assertFalse(t.alive)
+        stackless.run()
+        self.assertEqual(result, [])
+
+    def test_rebind(self):
+        result = []
+        t = stackless.tasklet(result.append)(1)
+        t.remove()
+        t.bind(result.append, (2,))
+        self.assertTrue(t.alive)
+        t.run()
+        self.assertEqual(result, [2])
+
+    def test_reduce(self):
+        t = stackless.tasklet(print)()
+        t.remove()
+        self.assertTrue(t.__reduce__()[2][3])    # the cframe
+        self.assertTrue(t.alive)
+        self.assertIsNone(t.frame)
+        t.kill()
+
+
+class TestSpawnMany(StacklessTestCase):
+
+    def test_spawn_many(self):
+        result = []
+        tasklets = stackless.spawn_many(lambda *args: result.append(args),
+                                        [(1,), (2, 3), [], iter((4,))])
+        self.assertEqual(len(tasklets), 4)
+        for t in tasklets:
+            self.assertIs(type(t), stackless.tasklet)
+            self.assertTrue(t.alive)
+            self.assertTrue(t.scheduled)
+        self.assertEqual(stackless.getruncount(), 5)
+        stackless.run()
+        self.assertEqual(result, [(1,), (2, 3), (), (4,)])
+
+    def test_empty(self):
+        self.assertEqual(stackless.spawn_many(print, []), [])
+        self.assertEqual(stackless.getruncount(), 1)
+
+    def test_context(self):
+        cvar = contextvars.ContextVar("TestSpawnMany")
+        cvar.set("value")
+        result = []
+        stackless.spawn_many(lambda: result.append(cvar.get()), [()] * 2)
+        stackless.run()
+        self.assertEqual(result, ["value", "value"])
+
+    def test_errors(self):
+        self.assertRaises(TypeError, stackless.spawn_many, None, [()])
+        self.assertRaises(TypeError, stackless.spawn_many, print, None)
+        # nothing gets scheduled
+        self.assertRaises(TypeError, stackless.spawn_many, print, [(), 1])
+        self.assertEqual(stackless.getruncount(), 1)
+
+        def args():
+            yield ()
+            raise ZeroDivisionError
+        self.assertRaises(ZeroDivisionError, stackless.spawn_many, print, args())
+        self.assertEqual(stackless.getruncount(), 1)
+
+    @unittest.skipUnless(withThreads, "requires thread support")
+    def test_thread(self):
+        result = []
+
+        def thread():
+            stackless.spawn_many(result.append, [(1,), (2,)])
+            stackless.run()
+        t = threading.Thread(target=thread)
+        t.start()
+        t.join()
+        self.assertEqual(result, [1, 2])
+
+
 class TestCstate(StacklessTestCase):
     def test_cstate(self):
         self.assertIsInstance(stackless.main.cstate, stackless.cstack)
@@ -1309,6 +1404,139 @@ class TestCstate(StacklessTestCase):
             c = c.next
 
 
+class TestCstackPool(StacklessTestCase):
+    def setUp(self):
+        super(TestCstackPool, self).setUp()
+        limits = stackless.set_cstack_cache_limits(1000, 1 << 24)
+        self.addCleanup(stackless.set_cstack_cache_limits, *limits)
+
+    def hard_switch(self, depth):
+        def task(n):
+            if n:
+                return task(n - 1)
+            stackless.schedule()
+        for i in range(depth):
+            stackless.tasklet(apply_not_stackless)(task, i)
+        stackless.run()
+
+    def test_info(self):
+        info = stackless.get_cstack_cache_info()
+        self.assertEqual(set(info), {"count", "bytes", "maxcount", "maxbytes",
+                                     "hits", "misses", "evictions",
+                                     "classes"})
+        self.assertEqual(info["maxcount"], 1000)
+        self.assertEqual(info["maxbytes"], 1 << 24)
+        self.assertEqual(sum(info["classes"].values()), info["count"])
+
+    def test_limits(self):
+        self.assertEqual(stackless.set_cstack_cache_limits(10, 1 << 20),
+                         (1000, 1 << 24))
+        self.assertRaises(ValueError, stackless.set_cstack_cache_limits, -1, 0)
+        self.assertEqual(stackless.set_cstack_cache_limits(0, 0), (10, 1 << 20))
+        self.hard_switch(10)
+        info = stackless.get_cstack_cache_info()
+        self.assertEqual(info["count"], 0)
+        self.assertEqual(info["bytes"], 0)
+        self.assertEqual(info["classes"], {})
+
+    @unittest.skipIf(hasattr(sys, "gettotalrefcount"),
+                     "the pool is disabled in Py_REF_DEBUG builds")
+    def test_reuse(self):
+        self.hard_switch(20)
+        info1 = stackless.get_cstack_cache_info()
+        self.assertGreater(info1["count"], 0)
+        self.assertLessEqual(info1["count"], 1000)
+        self.hard_switch(20)
+        info2 = stackless.get_cstack_cache_info()
+        self.assertGreater(info2["hits"], info1["hits"])
+
+    @unittest.skipIf(hasattr(sys, "gettotalrefcount"),
+                     "the pool is disabled in Py_REF_DEBUG builds")
+    def test_trim(self):
+        self.hard_switch(20)
+        info1 = stackless.get_cstack_cache_info()
+        stackless.set_cstack_cache_limits(2, 1 << 24)
+        info2 = stackless.get_cstack_cache_info()
+        self.assertEqual(info2["count"], min(info1["count"], 2))
+        self.assertEqual(info2["evictions"] - info1["evictions"],
+                         info1["count"] - info2["count"])
+
+
+class TestCframeCache(StacklessTestCase):
+    # Under soft switching, each resumed generator runs on a cframe. A
+    # tasklet paused in a chain of nested generators holds one cframe per
+    # generator.
+
+    def setUp(self):
+        super(TestCframeCache, self).setUp()
+        if not stackless.enable_softswitch(None):
+            self.skipTest("requires soft switching")
+        limit = stackless.set_cframe_cache_limit(0)
+        self.addCleanup(stackless.set_cframe_cache_limit, limit)
+
+    def nested(self, depth, bottom, unwind=None):
+        if depth:
+            try:
+                for x in self.nested(depth - 1, bottom, unwind):
+                    yield x
+            finally:
+                if unwind is not None:
+                    unwind()
+        else:
+            bottom()
+            yield
+
+    def count(self):
+        return stackless.get_cframe_cache_info()["count"]
+
+    def test_set_limit(self):
+        self.assertEqual(stackless.set_cframe_cache_limit(10), 0)
+        self.assertRaises(ValueError, stackless.set_cframe_cache_limit, -1)
+        self.assertEqual(stackless.get_cframe_cache_info()["maxcount"], 10)
+
+    def test_dying_tasklet(self):
+        # the cframes of a killed tasklet go back to the cache
+        stackless.set_cframe_cache_limit(100)
+
+        def task():
+            for x in self.nested(20, stackless.schedule_remove):
+                pass
+        t = stackless.tasklet(task)()
+        t.run()
+        self.assertTrue(t.paused)
+        info1 = stackless.get_cframe_cache_info()
+        t.kill()
+        info2 = stackless.get_cframe_cache_info()
+        self.assertGreaterEqual(info2["count"] - info1["count"], 20)
+        self.assertEqual(info2["evictions"], info1["evictions"])
+        # and the next tasklet reuses them
+        t = stackless.tasklet(task)()
+        t.run()
+        self.addCleanup(t.kill)
+        info3 = stackless.get_cframe_cache_info()
+        self.assertGreaterEqual(info3["hits"] - info2["hits"], 20)
+
+    def test_limit_in_recursion(self):
+        # releasing a deep chain of cframes never exceeds the limit
+        stackless.set_cframe_cache_limit(5)
+        counts = []
+
+        def sample():
+            counts.append(self.count())
+
+        def task():
+            for x in self.nested(50, sample, sample):
+                stackless.schedule()
+        info1 = stackless.get_cframe_cache_info()
+        stackless.tasklet(task)()
+        stackless.run()
+        info2 = stackless.get_cframe_cache_info()
+        self.assertEqual(len(counts), 51)
+        self.assertEqual(max(counts), 5)
+        self.assertEqual(info2["count"], 5)
+        self.assertGreaterEqual(info2["evictions"] - info1["evictions"], 45)
+
+
 class TestTaskletFinalizer(StacklessTestCase):
     def test_zombie(self):
         loop = True
@@ -1330,6 +1558,23 @@ class TestTaskletFinalizer(StacklessTestCase):
         loop = False
         t.kill()
 
+    def test_recycled(self):
+        # tasklets come from a free list, the finalizer runs for each of them
+        log = []
+
+        def task(i):
+            try:
+                stackless.schedule_remove()
+            finally:
+                log.append(i)
+        for i in range(3):
+            t = stackless.tasklet(apply_not_stackless)(task, i)
+            t.run()
+            self.assertTrue(t.paused)
+            del t
+            gc.collect()
+        self.assertEqual(log, [0, 1, 2])
+
 
 class TestTaskletContext(AsTaskletTestCase):
     cvar = contextvars.ContextVar('TestTaskletContext', default='unset')
@@ -13,6 +13,7 @@ import struct
 import warnings
 import subprocess
 import numbers
+import pickle
 import stackless
 
 from textwrap import dedent
@@ -1484,6 +1485,52 @@ class TestFunctionPickling(StacklessPickleTestCase):
         self.assertIs(type(obj2), type(obj))
 
 
+
+class Link(object):
+    def __init__(self, next):
+        self.next = next
+
+
+class TestDeepObjectGraphs(unittest.TestCase):
+    # The C pickler saves tuples, lists, dicts and reduce values without
+    # recursion. Deep object graphs don't hit the recursion limit.
+    depth = 20000
+
+    def check(self, obj, proto):
+        with self.subTest(proto=proto):
+            self.assertGreater(self.depth, sys.getrecursionlimit())
+            data = pickle.dumps(obj, proto)
+            self.assertEqual(pickle.dumps(pickle.loads(data), proto), data)
+
+    def test_containers(self):
+        obj = None
+        for i in range(self.depth):
+            obj = [(obj,), {i: obj}]
+        for proto in range(pickle.HIGHEST_PROTOCOL + 1):
+            self.check(obj, proto)
+
+    def test_reduce(self):
+        obj = None
+        for i in range(self.depth):
+            obj = Link(obj)
+        for proto in range(pickle.HIGHEST_PROTOCOL + 1):
+            self.check(obj, proto)
+
+    def test_tasklet(self):
+        obj = None
+        for i in range(self.depth):
+            obj = Link([obj])
+
+        def task(obj):
+            stackless.schedule_remove(obj)
+        t = stackless.tasklet(task)(obj)
+        t.run()
+        try:
+            t2 = pickle.loads(pickle.dumps(t))
+            self.assertIsInstance(t2.frame.f_locals["obj"], Link)
+        finally:
+            t.kill()
+
 if __name__ == '__main__':
     if not sys.argv[1:]:
         sys.argv.append('-v')
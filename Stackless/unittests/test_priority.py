@@ -0,0 +1,171 @@
+from __future__ import absolute_import
+
+import unittest
+import stackless
+
+from support import test_main  # @UnusedImport
+from support import StacklessTestCase
+
+
+class TestPriority(StacklessTestCase):
+    """Test the priority and deadline of tasklets"""
+
+    def make_tasklets(self, result, *specs):
+        # specs: (name, priority, deadline)
+        def task(name, count):
+            for i in range(count):
+                result.append(name)
+                stackless.schedule()
+        tasklets = []
+        for name, priority, deadline in specs:
+            t = stackless.tasklet(task)
+            t.priority = priority
+            t.deadline = deadline
+            tasklets.append(t(name, 2))
+        return tasklets
+
+    def test_defaults(self):
+        t = stackless.tasklet()
+        self.assertEqual(t.priority, 0)
+        self.assertIsNone(t.deadline)
+        self.assertEqual(stackless.current.priority, 0)
+
+    def test_attributes(self):
+        t = stackless.tasklet()
+        t.priority = -3
+        self.assertEqual(t.priority, -3)
+        t.deadline = 1.5
+        self.assertEqual(t.deadline, 1.5)
+        t.deadline = 2
+        self.assertEqual(t.deadline, 2.0)
+        t.deadline = None
+        self.assertIsNone(t.deadline)
+        self.assertRaises(TypeError, setattr, t, "priority", 1.0)
+        self.assertRaises(OverflowError, setattr, t, "priority", 2 ** 40)
+        self.assertRaises(TypeError, setattr, t, "deadline", "now")
+        self.assertRaises(ValueError, setattr, t, "deadline", float("nan"))
+        self.assertRaises(TypeError, delattr, t, "priority")
+        self.assertRaises(TypeError, delattr, t, "deadline")
+
+    def test_fifo(self):
+        # equal priorities keep the round robin order
+        result = []
+        self.make_tasklets(result, ("a", 0, None), ("b", 0, None), ("c", 0, None))
+        stackless.run()
+        self.assertEqual(result, list("abcabc"))
+
+    def test_priority_order(self):
+        result = []
+        self.make_tasklets(result, ("low", -1, None), ("mid", 0, None),
+                           ("high", 1, None), ("high2", 1, None))
+        stackless.run()
+        self.assertEqual(result, ["high", "high2", "high", "high2",
+                                  "mid", "mid", "low", "low"])
+
+    def test_deadline_order(self):
+        result = []
+        self.make_tasklets(result, ("none", 0, None), ("late", 0, 20.0),
+                           ("early", 0, 10.0), ("prio", 1, 30.0))
+        stackless.run()
+        self.assertEqual(result, ["prio", "prio", "early", "early",
+                                  "late", "late", "none", "none"])
+
+    def test_schedule_keeps_running(self):
+        # a tasklet of the highest priority keeps running
+        result = []
+        self.make_tasklets(result, ("a", 0, None))
+        stackless.current.priority = 1
+        try:
+            for i in range(3):
+                stackless.schedule()
+            self.assertEqual(result, [])
+        finally:
+            stackless.current.priority = 0
+        stackless.schedule()
+        self.assertEqual(result, ["a"])
+
+    def test_change_priority(self):
+        # changing the priority of a runnable tasklet moves it
+        result = []
+        a, b, c = self.make_tasklets(result, ("a", 0, None), ("b", 0, None),
+                                     ("c", 0, None))
+        c.priority = 1
+        self.assertIs(stackless.current.next, c)
+        # c stays in place, the queue is still sorted
+        c.priority = 0
+        self.assertIs(stackless.current.next, c)
+        b.deadline = 5.0
+        self.assertIs(stackless.current.next, b)
+        stackless.run()
+        self.assertEqual(result, list("bbcaca"))
+
+    def test_run_keeps_order(self):
+        # tasklet.run() switches to the target, but the queue stays sorted
+        result = []
+        self.make_tasklets(result, ("high", 1, None), ("low", -1, None))
+
+        def task():
+            result.append("target")
+        target = stackless.tasklet(task)()
+        target.run()
+        stackless.run()
+        self.assertEqual(result, ["target", "high", "high", "low", "low"])
+
+    def test_channel_wakeup_receiver(self):
+        # a woken receiver of higher priority runs first, even if the
+        # channel prefers the sender
+        result = []
+        channel = stackless.channel()
+        channel.preference = 1
+
+        def receiver():
+            result.append(channel.receive())
+
+        t = stackless.tasklet(receiver)()
+        t.priority = 1
+        t.run()
+        channel.send("value")
+        result.append("sender")
+        self.assertEqual(result, ["value", "sender"])
+
+    def test_channel_wakeup_sender(self):
+        # a sender of higher priority keeps running, even if the channel
+        # prefers the receiver
+        result = []
+        channel = stackless.channel()
+        self.assertEqual(channel.preference, -1)
+
+        def receiver():
+            result.append(channel.receive())
+
+        t = stackless.tasklet(receiver)()
+        t.priority = -1
+        t.run()
+        channel.send("value")
+        result.append("sender")
+        stackless.run()
+        self.assertEqual(result, ["sender", "value"])
+
+    def test_watchdog(self):
+        # a timed run() returns the interrupted tasklet, the run queue
+        # still has the right order
+        result = []
+
+        def busy():
+            for i in range(2):
+                result.append("busy")
+                stackless.schedule()
+            while True:
+                pass
+
+        low = stackless.tasklet(busy)()
+        low.priority = -1
+        self.make_tasklets(result, ("high", 1, None))
+        victim = stackless.run(100, ignore_nesting=True)
+        self.assertIs(victim, low)
+        self.assertEqual(result, ["high", "high", "busy", "busy"])
+        victim.kill()
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,169 @@
+from __future__ import absolute_import
+
+import errno
+import os
+import unittest
+import stackless
+import socket
+import sys
+import threading
+import time
+
+from support import test_main  # @UnusedImport
+from support import StacklessTestCase
+
+
+@unittest.skipUnless(sys.platform.startswith("linux"), "requires epoll")
+class TestReactor(StacklessTestCase):
+    """Test wait_readable() and wait_writable()"""
+
+    def setUp(self):
+        super(TestReactor, self).setUp()
+        self.a, self.b = socket.socketpair()
+        self.addCleanup(self.a.close)
+        self.addCleanup(self.b.close)
+
+    def test_readable(self):
+        result = []
+
+        def reader():
+            result.append(stackless.wait_readable(self.a))
+            result.append(self.a.recv(10))
+
+        def writer():
+            result.append("write")
+            self.b.send(b"data")
+        stackless.tasklet(reader)()
+        stackless.tasklet(writer)()
+        stackless.run()
+        self.assertEqual(result, ["write", True, b"data"])
+
+    def test_writable(self):
+        self.assertIs(stackless.wait_writable(self.a.fileno()), True)
+
+    def test_timeout(self):
+        start = time.monotonic()
+        self.assertIs(stackless.wait_readable(self.a, timeout=0.05), False)
+        self.assertGreaterEqual(time.monotonic() - start, 0.05)
+        # the registration is gone
+        self.b.send(b"x")
+        self.assertIs(stackless.wait_readable(self.a, timeout=10), True)
+
+    def test_ready_before_timeout(self):
+        def writer():
+            stackless.sleep(0.01)
+            self.b.send(b"x")
+        stackless.tasklet(writer)()
+        self.assertIs(stackless.wait_readable(self.a, 10), True)
+
+    def test_one_reader(self):
+        t = stackless.tasklet(stackless.wait_readable)(self.a)
+        self.addCleanup(t.kill)
+        t.run()
+        self.assertTrue(t.alive)
+        self.assertFalse(t.scheduled)
+        self.assertRaisesRegex(RuntimeError, "already waits",
+                               stackless.wait_readable, self.a)
+        # reading and writing are independent
+        self.assertIs(stackless.wait_writable(self.a), True)
+
+    def test_kill(self):
+        t = stackless.tasklet(stackless.wait_readable)(self.a)
+        t.run()
+        t.kill()
+        self.assertFalse(t.alive)
+        self.b.send(b"x")
+        self.assertIs(stackless.wait_readable(self.a, 10), True)
+
+    def test_insert(self):
+        # a waiting tasklet, that runs for some other reason, stops waiting
+        t = stackless.tasklet(stackless.wait_readable)(self.a)
+        t.run()
+        t.insert()
+        stackless.run()
+        self.assertFalse(t.alive)
+        self.assertEqual(t.tempval, None)
+        self.b.send(b"x")
+        self.assertIs(stackless.wait_readable(self.a, 10), True)
+
+    def test_block_trap(self):
+        stackless.current.block_trap = True
+        try:
+            self.assertRaises(RuntimeError, stackless.wait_readable, self.a)
+        finally:
+            stackless.current.block_trap = False
+
+    def test_arguments(self):
+        self.assertRaises(TypeError, stackless.wait_readable, "x")
+        self.assertRaises(ValueError, stackless.wait_readable, -1)
+        self.assertRaises(ValueError, stackless.wait_readable, self.a, -1)
+
+    def test_poll_error(self):
+        # a failing epoll_wait() raises in the scheduling tasklet. A new
+        # thread, to identify the epoll file descriptor of its reactor.
+        def epoll_fds():
+            fds = set()
+            for fd in os.listdir("/proc/self/fd"):
+                try:
+                    if os.readlink("/proc/self/fd/" + fd) == "anon_inode:[eventpoll]":
+                        fds.add(int(fd))
+                except OSError:
+                    pass
+            return fds
+        r, w = os.pipe()
+        self.addCleanup(os.close, r)
+        self.addCleanup(os.close, w)
+        result = []
+
+        def thread():
+            old_fds = epoll_fds()
+            t = stackless.tasklet(stackless.wait_readable)(self.a)
+            t.run()
+            epfd, = epoll_fds() - old_fds
+            saved = os.dup(epfd)
+            os.dup2(r, epfd)
+            try:
+                time.sleep(0.01)
+                stackless.schedule()
+            except OSError as e:
+                result.append(e.errno)
+            finally:
+                os.dup2(saved, epfd)
+                os.close(saved)
+            # the reactor works again
+            self.b.send(b"x")
+            stackless.run()
+            result.append(t.alive)
+        t = threading.Thread(target=thread)
+        t.start()
+        t.join(10)
+        self.assertEqual(result, [errno.EINVAL, False])
+
+    def test_thread_wakeup(self):
+        # a thread, that waits in epoll_wait(), wakes up, if another thread
+        # makes one of its tasklets runnable
+        channel = stackless.channel()
+        result = []
+
+        def reader():
+            result.append(stackless.wait_readable(self.a))
+
+        def receiver():
+            result.append(channel.receive())
+            self.b.send(b"x")
+
+        def thread():
+            stackless.tasklet(reader)()
+            stackless.tasklet(receiver)()
+            stackless.run()
+        t = threading.Thread(target=thread)
+        t.start()
+        time.sleep(0.05)
+        channel.send("value")
+        t.join(10)
+        self.assertFalse(t.is_alive())
+        self.assertEqual(result, ["value", True])
+
+
+if __name__ == '__main__':
+    unittest.main()
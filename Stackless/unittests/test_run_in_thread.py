@@ -0,0 +1,145 @@
+from __future__ import absolute_import
+
+import os
+import unittest
+import stackless
+import threading
+import time
+
+from test import support
+from test.support.script_helper import assert_python_ok
+
+from support import test_main  # @UnusedImport
+from support import StacklessTestCase
+
+
+def double(x, factor=2):
+    return x * factor
+
+
+class TestRunInThread(StacklessTestCase):
+    """Test stackless.run_in_thread()"""
+
+    def test_result(self):
+        self.assertEqual(stackless.run_in_thread(double, 21), 42)
+        self.assertEqual(stackless.run_in_thread(double, 7, factor=3), 21)
+        self.assertNotEqual(stackless.run_in_thread(threading.get_ident),
+                            threading.get_ident())
+
+    def test_exception(self):
+        self.assertRaisesRegex(ValueError, "invalid literal",
+                               stackless.run_in_thread, int, "x")
+
+    def test_arguments(self):
+        self.assertRaises(TypeError, stackless.run_in_thread)
+        self.assertRaises(TypeError, stackless.run_in_thread, None)
+
+    def test_concurrency(self):
+        # the other tasklets run, while the calls block in the workers
+        log = []
+
+        def caller(i):
+            log.append(stackless.run_in_thread(time.sleep, 0.1))
+
+        def ticker():
+            log.append("tick")
+        for i in range(3):
+            stackless.tasklet(caller)(i)
+        stackless.tasklet(ticker)()
+        start = time.monotonic()
+        stackless.run()
+        self.assertLess(time.monotonic() - start, 0.29)
+        self.assertEqual(log, ["tick", None, None, None])
+
+    def test_kill(self):
+        # a killed tasklet abandons the call
+        event = threading.Event()
+        t = stackless.tasklet(stackless.run_in_thread)(event.wait)
+        t.run()
+        self.assertTrue(t.alive)
+        t.kill()
+        self.assertFalse(t.alive)
+        event.set()
+        # the pool continues to work
+        self.assertEqual(stackless.run_in_thread(double, 1), 2)
+
+    def test_block_trap(self):
+        stackless.current.block_trap = True
+        try:
+            self.assertRaises(RuntimeError, stackless.run_in_thread, double, 1)
+        finally:
+            stackless.current.block_trap = False
+
+    def test_thread(self):
+        result = []
+
+        def thread():
+            result.append(stackless.run_in_thread(double, 5))
+        t = threading.Thread(target=thread)
+        t.start()
+        t.join()
+        self.assertEqual(result, [10])
+
+    def test_pool_size(self):
+        self.assertRaises(ValueError, stackless.set_thread_pool_size, 0)
+        # a new interpreter to start without workers
+        script = """if 1:
+            import stackless, threading, time
+            assert stackless.set_thread_pool_size(1) == 8
+            idents = []
+            def caller():
+                idents.append(stackless.run_in_thread(threading.get_ident))
+            for i in range(3):
+                stackless.tasklet(caller)()
+            stackless.run()
+            assert len(set(idents)) == 1, idents
+            """
+        assert_python_ok("-c", script)
+
+    @unittest.skipUnless(os.path.isdir("/proc/self/task"), "needs /proc")
+    def test_pool_shrink(self):
+        # surplus workers exit, when the pool size decreases
+        script = """if 1:
+            import os, stackless, time
+            def nthreads():
+                return len(os.listdir("/proc/self/task"))
+            start = nthreads()
+            stackless.set_thread_pool_size(4)
+            for i in range(4):
+                stackless.tasklet(stackless.run_in_thread)(time.sleep, 0.1)
+            stackless.run()
+            assert nthreads() == start + 4, nthreads()
+            stackless.set_thread_pool_size(1)
+            for i in range(100):
+                if nthreads() == start + 1:
+                    break
+                time.sleep(0.01)
+            assert nthreads() == start + 1, nthreads()
+            # the remaining worker still works
+            assert stackless.run_in_thread(abs, -1) == 1
+            """
+        assert_python_ok("-c", script)
+
+    def test_subinterpreter(self):
+        # the workers exit with the interpreter. A new process, because
+        # only one subinterpreter of a process can import stackless.
+        support.import_module("_testcapi")
+        script = """if 1:
+            import _testcapi
+            code = '''if 1:
+                import stackless, time
+                stackless.set_thread_pool_size(2)
+                for i in range(3):
+                    stackless.tasklet(stackless.run_in_thread)(time.sleep, 0.01)
+                stackless.run()
+                # a worker is busy, when the interpreter ends
+                stackless.tasklet(stackless.run_in_thread)(time.sleep, 0.1)
+                stackless.run(1)
+                '''
+            assert _testcapi.run_in_subinterp(code) == 0
+            """
+        assert_python_ok("-c", script)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,200 @@
+from __future__ import absolute_import
+
+import unittest
+import stackless
+import sys
+import threading
+import time
+import pickle
+
+from support import test_main  # @UnusedImport
+from support import StacklessTestCase
+
+
+class TestSelect(StacklessTestCase):
+    """Test stackless.select()"""
+
+    def test_ready_receive(self):
+        c1, c2 = stackless.channel(), stackless.channel()
+        stackless.tasklet(c2.send)("value")
+        stackless.run()
+        self.assertEqual(stackless.select([(c1, 'recv'), (c2, 'recv')]),
+                         (1, "value"))
+        self.assertEqual(c2.balance, 0)
+
+    def test_ready_send(self):
+        result = []
+        c1, c2 = stackless.channel(), stackless.channel()
+
+        def receiver():
+            result.append(c2.receive())
+        stackless.tasklet(receiver)()
+        stackless.run()
+        self.assertEqual(stackless.select([(c1, 'recv'), (c2, 'send', 42)]),
+                         (1, None))
+        stackless.run()
+        self.assertEqual(result, [42])
+
+    def test_first_ready_wins(self):
+        c1, c2 = stackless.channel(), stackless.channel()
+        stackless.tasklet(c1.send)(1)
+        stackless.tasklet(c2.send)(2)
+        stackless.run()
+        self.assertEqual(stackless.select([(c2, 'recv'), (c1, 'recv')]),
+                         (0, 2))
+        self.assertEqual(stackless.select([(c2, 'recv'), (c1, 'recv')]),
+                         (1, 1))
+
+    def test_block_receive(self):
+        result = []
+        c1, c2, c3 = [stackless.channel() for i in range(3)]
+
+        def selector():
+            result.append(stackless.select([(c1, 'recv'), (c2, 'recv'),
+                                            (c3, 'send', "out")]))
+        t = stackless.tasklet(selector)()
+        stackless.run()
+        self.assertFalse(t.scheduled)
+        self.assertEqual((c1.balance, c2.balance, c3.balance), (-1, -1, 1))
+        c2.send("in")
+        # the select is complete, the other proxies are gone
+        self.assertEqual((c1.balance, c2.balance, c3.balance), (0, 0, 0))
+        stackless.run()
+        self.assertEqual(result, [(1, "in")])
+        self.assertFalse(t.alive)
+
+    def test_block_send(self):
+        result = []
+        c1, c2 = stackless.channel(), stackless.channel()
+
+        def selector():
+            result.append(stackless.select([(c1, 'recv'), (c2, 'send', "out")]))
+        stackless.tasklet(selector)()
+        stackless.run()
+        self.assertEqual(c2.receive(), "out")
+        self.assertEqual(c1.balance, 0)
+        stackless.run()
+        self.assertEqual(result, [(1, None)])
+
+    def test_select_meets_select(self):
+        result = []
+        c = stackless.channel()
+
+        def selector(*cases):
+            result.append(stackless.select(cases))
+        stackless.tasklet(selector)((c, 'recv'))
+        stackless.run()
+        stackless.tasklet(selector)((c, 'send', "value"))
+        stackless.run()
+        self.assertEqual(len(result), 2)
+        self.assertIn((0, None), result)
+        self.assertIn((0, "value"), result)
+
+    def test_send_exception(self):
+        c = stackless.channel()
+        result = []
+
+        def selector():
+            try:
+                stackless.select([(c, 'recv')])
+            except ZeroDivisionError:
+                result.append("caught")
+        stackless.tasklet(selector)()
+        stackless.run()
+        c.send_exception(ZeroDivisionError)
+        stackless.run()
+        self.assertEqual(result, ["caught"])
+
+    def test_timeout(self):
+        c = stackless.channel()
+        self.assertIsNone(stackless.select([(c, 'recv')], timeout=0))
+        start = time.monotonic()
+        self.assertIsNone(stackless.select([(c, 'recv'), (c, 'recv')], 0.02))
+        self.assertGreaterEqual(time.monotonic() - start, 0.02)
+        self.assertEqual(c.balance, 0)
+
+    def test_timeout_not_expired(self):
+        c = stackless.channel()
+        stackless.tasklet(c.send)("value")
+        self.assertEqual(stackless.select([(c, 'recv')], 1000), (0, "value"))
+
+    def test_kill(self):
+        c1, c2 = stackless.channel(), stackless.channel()
+        t = stackless.tasklet(stackless.select)([(c1, 'recv'), (c2, 'recv')])
+        stackless.run()
+        self.assertEqual((c1.balance, c2.balance), (-1, -1))
+        t.kill()
+        self.assertFalse(t.alive)
+        self.assertEqual((c1.balance, c2.balance), (0, 0))
+
+    def test_insert(self):
+        # an insert wakes up the selecting tasklet without a result
+        result = []
+        c = stackless.channel()
+
+        def selector():
+            result.append(stackless.select([(c, 'recv')]))
+        t = stackless.tasklet(selector)()
+        t.run()
+        refcount = sys.getrefcount(t)
+        t.insert()
+        # the proxy still waits, until the tasklet runs
+        c.send("value")
+        stackless.run()
+        self.assertEqual(result, [(0, "value")])
+        self.assertLess(sys.getrefcount(t), refcount)
+
+    def test_deadlock(self):
+        c = stackless.channel()
+        self.assertRaisesRegex(RuntimeError, "Deadlock",
+                               stackless.select, [(c, 'recv')])
+        self.assertEqual(c.balance, 0)
+
+    def test_errors(self):
+        c, d = stackless.channel(), stackless.channel()
+        self.assertRaises(ValueError, stackless.select, [])
+        self.assertRaises(TypeError, stackless.select, None)
+        self.assertRaises(TypeError, stackless.select, [c])
+        self.assertRaises(TypeError, stackless.select, [(None, 'recv')])
+        self.assertRaises(ValueError, stackless.select, [(c, 'read')])
+        self.assertRaises(ValueError, stackless.select, [(c, 'send')])
+        self.assertRaises(ValueError, stackless.select, [(c, 'recv', 1)])
+        self.assertRaises(ValueError, stackless.select,
+                          [(c, 'recv'), (c, 'send', 1)])
+        self.assertRaises(ValueError, stackless.select, [(c, 'recv')], -1)
+        d.close()
+        self.assertRaises(ValueError, stackless.select, [(c, 'recv'), (d, 'recv')])
+        self.assertEqual(c.balance, 0)
+        old = stackless.current.block_trap
+        stackless.current.block_trap = True
+        try:
+            self.assertRaisesRegex(RuntimeError, "blocked",
+                                   stackless.select, [(c, 'recv')])
+        finally:
+            stackless.current.block_trap = old
+
+    def test_pickle_channel(self):
+        c = stackless.channel()
+        t = stackless.tasklet(stackless.select)([(c, 'recv')])
+        stackless.run()
+        self.assertRaisesRegex(RuntimeError, "select", pickle.dumps, c)
+        t.kill()
+
+    def test_thread(self):
+        c1, c2 = stackless.channel(), stackless.channel()
+        result = []
+
+        def thread():
+            result.append(stackless.select([(c1, 'recv'), (c2, 'recv')]))
+        t = threading.Thread(target=thread)
+        t.start()
+        while c2.balance == 0:
+            time.sleep(0.001)
+        c2.send("value")
+        t.join()
+        self.assertEqual(result, [(1, "value")])
+        self.assertEqual(c1.balance, 0)
+
+
+if __name__ == '__main__':
+    unittest.main()
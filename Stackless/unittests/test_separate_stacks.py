@@ -0,0 +1,179 @@
+from __future__ import absolute_import
+
+import unittest
+import threading
+import stackless
+import _stackless
+from _stackless import _test_nostacklesscall as apply_not_stackless
+
+from support import test_main  # @UnusedImport
+from support import StacklessTestCase
+
+
+def separate_stacks_available():
+    try:
+        old = _stackless.enable_separate_stacks(True)
+    except RuntimeError:
+        return False
+    _stackless.enable_separate_stacks(old)
+    return True
+
+
+@unittest.skipUnless(separate_stacks_available(), "requires separate stacks")
+class TestSeparateStacks(StacklessTestCase):
+    """Test the separate stack mode for hard switching.
+
+    The tests run in a new thread. Otherwise the main tasklet of the main
+    thread would end up on a separate stack region.
+    """
+
+    def run_in_thread(self, func, *args):
+        result = []
+
+        def thread_main():
+            old = _stackless.enable_separate_stacks(True)
+            try:
+                result.append(func(*args))
+            except BaseException as e:
+                result.append(e)
+            finally:
+                _stackless.enable_separate_stacks(old)
+        t = threading.Thread(target=thread_main)
+        t.start()
+        t.join()
+        self.assertEqual(len(result), 1)
+        if isinstance(result[0], BaseException):
+            raise result[0]
+        return result[0]
+
+    def test_flag(self):
+        old = _stackless.enable_separate_stacks(None)
+        self.assertIs(old, False)
+        try:
+            self.assertIs(_stackless.enable_separate_stacks(True), False)
+            self.assertIs(_stackless.enable_separate_stacks(None), True)
+        finally:
+            self.assertIs(_stackless.enable_separate_stacks(old), True)
+        self.assertIs(_stackless.enable_separate_stacks(None), old)
+
+    def test_in_place(self):
+        # the C-state of a hard switched tasklet stays in place
+        def task(channel):
+            channel.send(channel.receive() + 1)
+
+        def work():
+            c1 = stackless.channel()
+            c2 = stackless.channel()
+            t1 = stackless.tasklet(apply_not_stackless)(task, c1)
+            t2 = stackless.tasklet(apply_not_stackless)(task, c2)
+            stackless.run()
+            for t in (t1, t2):
+                self.assertGreater(t.nesting_level, 0)
+                self.assertNotEqual(t.cstate.size, 0)
+            # with stack copying both would share the thread stack
+            self.assertNotEqual(t1.cstate.startaddr, t2.cstate.startaddr)
+            c1.send(41)
+            c2.send(1)
+            return c1.receive(), c2.receive()
+        self.assertEqual(self.run_in_thread(work), (42, 2))
+
+    def test_many_tasklets(self):
+        def task(channel, i, depth):
+            if depth:
+                return task(channel, i, depth - 1)
+            for j in range(3):
+                channel.send((i, j))
+
+        def work():
+            channel = stackless.channel()
+            for i in range(20):
+                stackless.tasklet(apply_not_stackless)(task, channel, i, i)
+            result = []
+            for i in range(60):
+                result.append(channel.receive())
+            return result
+        result = self.run_in_thread(work)
+        self.assertEqual(sorted(result),
+                         [(i, j) for i in range(20) for j in range(3)])
+
+    def test_hard_switching_only(self):
+        def task(result, i):
+            for j in range(3):
+                result.append(i)
+                stackless.schedule()
+
+        def work():
+            result = []
+            sw = stackless.enable_softswitch(False)
+            try:
+                for i in range(3):
+                    stackless.tasklet(task)(result, i)
+                stackless.run()
+            finally:
+                stackless.enable_softswitch(sw)
+            return result
+        self.assertEqual(self.run_in_thread(work), [0, 1, 2] * 3)
+
+    def test_trace_cstack_size(self):
+        # a C-state resumed in place restores no bytes of C-stack
+        def task():
+            for i in range(3):
+                stackless.schedule()
+
+        def work():
+            sw = stackless.enable_softswitch(False)
+            stackless.set_trace_buffer(100)
+            try:
+                for i in range(3):
+                    stackless.tasklet(task)()
+                stackless.run()
+                return [e[5] for e in stackless.iter_trace_events()
+                        if e[6] == stackless.TRACE_SWITCH and
+                        e[7] & stackless.TRACE_HARD]
+            finally:
+                stackless.set_trace_buffer(0)
+                stackless.enable_softswitch(sw)
+        sizes = self.run_in_thread(work)
+        self.assertTrue(sizes)
+        self.assertEqual(set(sizes), {0})
+
+    def test_kill(self):
+        killed = []
+
+        def task(channel):
+            try:
+                channel.receive()
+            except TaskletExit:
+                killed.append(True)
+                raise
+
+        def work():
+            channel = stackless.channel()
+            t = stackless.tasklet(apply_not_stackless)(task, channel)
+            t.run()
+            t.kill()
+            return killed, t.alive
+        self.assertEqual(self.run_in_thread(work), ([True], False))
+
+    def test_thread_exit(self):
+        # hard switched tasklets get killed when the thread ends
+        killed = []
+
+        def task(channel):
+            try:
+                channel.receive()
+            except TaskletExit:
+                killed.append(True)
+                raise
+
+        def work():
+            channel = stackless.channel()
+            for i in range(3):
+                stackless.tasklet(apply_not_stackless)(task, channel).run()
+            return channel.balance
+        self.assertEqual(self.run_in_thread(work), -3)
+        self.assertEqual(killed, [True] * 3)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,169 @@
+from __future__ import absolute_import
+
+import unittest
+import stackless
+import sys
+import threading
+import time
+
+from support import test_main  # @UnusedImport
+from support import StacklessTestCase
+
+
+class TestSleep(StacklessTestCase):
+    """Test stackless.sleep() and the timer wheel"""
+
+    def test_order(self):
+        result = []
+
+        def sleeper(name, seconds):
+            stackless.sleep(seconds)
+            result.append(name)
+
+        for name, seconds in [("c", 0.03), ("a", 0.01), ("b", 0.02)]:
+            stackless.tasklet(sleeper)(name, seconds)
+        start = time.monotonic()
+        stackless.run()
+        self.assertGreaterEqual(time.monotonic() - start, 0.03)
+        self.assertEqual(result, ["a", "b", "c"])
+
+    def test_never_early(self):
+        # timers of all levels of the wheel
+        for seconds in (0.001, 0.0105, 0.07, 0.3):
+            start = time.monotonic()
+            stackless.sleep(seconds)
+            self.assertGreaterEqual(time.monotonic() - start, seconds)
+
+    def test_others_run(self):
+        result = []
+
+        def sleeper():
+            stackless.sleep(0.02)
+            result.append("sleeper")
+
+        def worker():
+            for i in range(3):
+                result.append("worker")
+                stackless.schedule()
+
+        stackless.tasklet(sleeper)()
+        stackless.tasklet(worker)()
+        stackless.run()
+        self.assertEqual(result, ["worker"] * 3 + ["sleeper"])
+
+    def test_sleep_zero(self):
+        # sleep(0) is a schedule()
+        result = []
+        stackless.tasklet(result.append)("other")
+        stackless.sleep(0)
+        self.assertEqual(result, ["other"])
+
+    def test_main_sleeps(self):
+        result = []
+
+        def sleeper():
+            stackless.sleep(0.01)
+            result.append("sleeper")
+
+        stackless.tasklet(sleeper)()
+        stackless.sleep(0.03)
+        self.assertEqual(result, ["sleeper"])
+
+    def test_sleeper_keeps_tasklet_alive(self):
+        result = []
+
+        def sleeper():
+            stackless.sleep(0.01)
+            result.append("sleeper")
+
+        stackless.tasklet(sleeper)().run()
+        self.assertEqual(stackless.getruncount(), 1)
+        stackless.run()
+        self.assertEqual(result, ["sleeper"])
+
+    def test_insert_wakes_up(self):
+        # inserting a sleeping tasklet wakes it up early, the timer is gone
+        result = []
+
+        def sleeper():
+            stackless.sleep(1000)
+            result.append("sleeper")
+
+        t = stackless.tasklet(sleeper)()
+        t.run()
+        self.assertTrue(t.paused)
+        refcount = sys.getrefcount(t)
+        t.insert()
+        stackless.run()
+        self.assertEqual(result, ["sleeper"])
+        self.assertLess(sys.getrefcount(t), refcount)
+
+    def test_kill_sleeper(self):
+        t = stackless.tasklet(stackless.sleep)(1000)
+        t.run()
+        start = time.monotonic()
+        t.kill()
+        self.assertFalse(t.alive)
+        stackless.run()
+        self.assertLess(time.monotonic() - start, 100)
+
+    def test_wakeup_after_insert(self):
+        # an expired timer doesn't insert a tasklet twice
+        def sleeper():
+            stackless.sleep(0.01)
+            stackless.schedule()
+
+        t = stackless.tasklet(sleeper)()
+        t.run()
+        t.insert()
+        time.sleep(0.02)
+        stackless.run()
+        self.assertFalse(t.alive)
+
+    def test_errors(self):
+        self.assertRaises(ValueError, stackless.sleep, -1)
+        self.assertRaises(TypeError, stackless.sleep, "1")
+        self.assertRaises(TypeError, stackless.sleep)
+        old = stackless.current.block_trap
+        stackless.current.block_trap = True
+        try:
+            self.assertRaisesRegex(RuntimeError, "blocked",
+                                   stackless.sleep, 0.001)
+        finally:
+            stackless.current.block_trap = old
+
+    def test_thread(self):
+        result = []
+
+        def sleeper(name, seconds):
+            stackless.sleep(seconds)
+            result.append(name)
+
+        def thread():
+            stackless.tasklet(sleeper)("b", 0.02)
+            stackless.tasklet(sleeper)("a", 0.01)
+            stackless.run()
+
+        t = threading.Thread(target=thread)
+        t.start()
+        t.join()
+        self.assertEqual(result, ["a", "b"])
+
+    def test_thread_exit_with_sleeper(self):
+        # a thread ends, while a tasklet sleeps: the timer gets released
+        tasklets = []
+
+        def thread():
+            t = stackless.tasklet(stackless.sleep)(1000)
+            t.run()
+            tasklets.append(t)
+
+        t = threading.Thread(target=thread)
+        t.start()
+        t.join()
+        self.assertEqual(len(tasklets), 1)
+        self.assertEqual(sys.getrefcount(tasklets[0]), 2)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,583 @@
+from __future__ import absolute_import
+
+import array
+import contextvars
+import copy
+import pickle
+import unittest
+import stackless
+
+from support import test_main  # @UnusedImport
+from support import StacklessTestCase
+
+
+results = []
+
+
+def recurse(n, shared):
+    if n:
+        return recurse(n - 1, shared) + n
+    value = stackless.schedule_remove()
+    shared.append(value)
+    return len(shared)
+
+
+def task(n, shared):
+    # the value stack must not hold results.append, otherwise the
+    # list gets copied
+    value = recurse(n, shared)
+    results.append(value)
+
+
+def receiver(n, channel):
+    if n:
+        return receiver(n - 1, channel)
+    value = channel.receive()
+    results.append(value)
+
+
+def holder(other):
+    stackless.schedule_remove()
+    results.append(other)
+
+
+def counter(n, log):
+    if n:
+        return counter(n - 1, log)
+    i = 0
+    while True:
+        i += 1
+        log.append(i)
+        stackless.schedule_remove()
+
+
+def appender(n, items):
+    if n:
+        return appender(n - 1, items)
+    while True:
+        stackless.schedule_remove()
+        items.append(len(items))
+
+
+def parking_generator():
+    while True:
+        stackless.schedule_remove()
+        yield 1
+
+
+def consumer(items):
+    for item in parking_generator():
+        items.append(item)
+
+
+def looper(n, items, log):
+    if n:
+        return looper(n - 1, items, log)
+    for item in items:
+        log.append(item)
+        stackless.schedule_remove()
+
+
+def hold(*values):
+    stackless.schedule_remove()
+    results.append(values)
+
+
+def in_generator():
+    def gen():
+        stackless.schedule_remove()
+        yield 1
+    for i in gen():
+        pass
+
+
+var = contextvars.ContextVar("var")
+
+
+class SubTasklet(stackless.tasklet):
+    def __reduce_ex__(self, protocol):
+        return super().__reduce_ex__(protocol)
+
+
+class SnapshotTestCase(StacklessTestCase):
+    """Kill the tasklets of a test at its end"""
+
+    def setUp(self):
+        super().setUp()
+        del results[:]
+        self.tasklets = []
+        self.log = []
+
+    def tearDown(self):
+        for t in self.tasklets:
+            if t.alive:
+                t.kill()
+        del results[:]
+        super().tearDown()
+
+    def keep(self, *tasklets):
+        self.tasklets.extend(tasklets)
+
+    def spawn(self, func, *args, cls=stackless.tasklet, run=False):
+        t = cls(func)(*args)
+        self.keep(t)
+        if run:
+            stackless.run()
+            self.assertTrue(t.paused)
+        return t
+
+    def restore(self, data, previous=None, buffers=None):
+        restored = stackless.restore(data, previous, buffers)
+        self.keep(*restored)
+        return restored
+
+
+class TestSnapshot(SnapshotTestCase):
+    """Test stackless.snapshot() and stackless.restore()"""
+
+    def paused(self, n=3, count=2, cls=stackless.tasklet):
+        shared = []
+        tasklets = [self.spawn(task, n, shared, cls=cls) for i in range(count)]
+        stackless.run()
+        for t in tasklets:
+            self.assertTrue(t.paused)
+        return tasklets
+
+    def run_restored(self, tasklets):
+        # frames, that were paused with a C state, can't run
+        self.skipUnlessSoftswitching()
+        for t in tasklets:
+            t.insert()
+        stackless.run()
+
+    def test_restore(self):
+        data = stackless.snapshot(self.paused(n=5))
+        self.assertIsInstance(data, bytes)
+        restored = self.restore(data)
+        self.assertEqual(len(restored), 2)
+        for t in restored:
+            self.assertIsInstance(t, stackless.tasklet)
+            self.assertTrue(t.paused)
+            self.assertEqual(t.frame.f_code, recurse.__code__)
+        self.run_restored(restored)
+        self.assertEqual(results, [15 + 1, 15 + 2])
+
+    def test_same_as_pickle(self):
+        tasklets = self.paused()
+        restored = self.restore(stackless.snapshot(tasklets))
+        unpickled = pickle.loads(pickle.dumps(tasklets, -1))
+        self.keep(*unpickled)
+        for t1, t2 in zip(restored, unpickled):
+            f1, f2 = t1.frame, t2.frame
+            while f1 is not None:
+                self.assertEqual(f1.f_code, f2.f_code)
+                self.assertEqual(f1.f_lasti, f2.f_lasti)
+                self.assertEqual(f1.f_lineno, f2.f_lineno)
+                self.assertEqual(f1.f_locals.keys(), f2.f_locals.keys())
+                f1, f2 = f1.f_back, f2.f_back
+            self.assertIsNone(f2)
+
+    def test_shared_objects(self):
+        restored = self.restore(stackless.snapshot(self.paused()))
+        f1, f2 = restored[0].frame, restored[1].frame
+        self.assertIs(f1.f_locals["shared"], f2.f_locals["shared"])
+        self.assertIs(f1.f_globals, globals())
+
+    def test_channel(self):
+        channel = stackless.channel()
+        tasklets = [self.spawn(receiver, 3, channel) for i in range(3)]
+        stackless.run()
+        restored = self.restore(stackless.snapshot(tasklets))
+        channel = restored[0].frame.f_locals["channel"]
+        self.assertIs(restored[2].frame.f_locals["channel"], channel)
+        self.assertEqual(channel.balance, -3)
+        self.assertIs(channel.queue, restored[0])
+        self.skipUnlessSoftswitching()
+        for i in range(3):
+            channel.send(i)
+        self.assertEqual(results, [0, 1, 2])
+
+    def test_tasklet_reference(self):
+        other = self.spawn(task, 2, [])
+        t = self.spawn(holder, other)
+        stackless.run()
+        restored = self.restore(stackless.snapshot([t, other]))
+        self.assertIs(restored[0].frame.f_locals["other"], restored[1])
+
+    def test_unstarted(self):
+        t = self.spawn(task, 4, [])
+        t.remove()
+        restored = self.restore(stackless.snapshot([t]))
+        self.run_restored(restored)  # pauses in schedule_remove()
+        self.run_restored(restored)
+        self.assertEqual(results, [10 + 1])
+
+    def test_subclass(self):
+        restored = self.restore(stackless.snapshot(self.paused(cls=SubTasklet)))
+        self.assertIsInstance(restored[0], SubTasklet)
+        self.run_restored(restored)
+        self.assertEqual(results, [6 + 1, 6 + 2])
+
+    def test_empty(self):
+        self.assertEqual(stackless.restore(stackless.snapshot([])), [])
+
+    def test_errors(self):
+        t = self.paused(count=1)[0]
+        self.assertRaises(TypeError, stackless.snapshot, None)
+        self.assertRaises(TypeError, stackless.snapshot, [t, 1])
+        self.assertRaises(ValueError, stackless.snapshot, [t, t])
+        self.assertRaises(RuntimeError, stackless.snapshot, [stackless.current])
+        self.assertRaises(TypeError, stackless.restore, "SLPS")
+        self.assertRaisesRegex(ValueError, "not a tasklet snapshot",
+                               stackless.restore, b"pickle")
+
+    def test_truncated(self):
+        data = stackless.snapshot(self.paused(count=1))
+        for i in range(len(data) - 1):
+            self.assertRaises(ValueError, stackless.restore, data[:i])
+        self.assertRaises(ValueError, stackless.restore, data + b"\0")
+
+
+class TestCheckpointer(SnapshotTestCase):
+    """Test stackless.checkpointer and the restore of delta snapshots"""
+
+    def spawn_counter(self, n=20):
+        return self.spawn(counter, n, self.log, run=True)
+
+    def step(self, t):
+        t.insert()
+        stackless.run()
+        self.assertTrue(t.paused)
+
+    def frames(self, t):
+        frames = []
+        f = t.frame
+        while f is not None:
+            frames.append(f)
+            f = f.f_back
+        return frames
+
+    def test_generation(self):
+        cp = stackless.checkpointer()
+        self.assertEqual(cp.generation, 0)
+        t = self.spawn_counter()
+        cp.snapshot([t])
+        self.assertEqual(cp.generation, 1)
+        cp.snapshot([t])
+        self.assertEqual(cp.generation, 2)
+
+    def test_first_is_complete(self):
+        t = self.spawn_counter()
+        data = stackless.checkpointer().snapshot([t])
+        self.assertEqual(len(data), len(stackless.snapshot([t])))
+        restored = self.restore(data)
+        self.assertEqual(len(self.frames(restored[0])), 21)
+
+    def test_delta(self):
+        cp = stackless.checkpointer()
+        t = self.spawn_counter()
+        full = cp.snapshot([t])
+        self.step(t)
+        delta = cp.snapshot([t])
+        if stackless.enable_softswitch(None):
+            # frames, that switched hard, have no stacktop and get stored again
+            self.assertLess(len(delta), len(full) // 2)
+        restored = self.restore(delta, [full])
+        frames = self.frames(restored[0])
+        self.assertEqual(len(frames), 21)
+        self.assertEqual(frames[0].f_locals["i"], 2)
+        # the changed frame stored the log again, all frames share it
+        log = frames[0].f_locals["log"]
+        self.assertEqual(log, [1, 2])
+        self.assertIs(frames[-1].f_locals["log"], log)
+        self.assertIs(frames[-1].f_code, frames[1].f_code)
+
+    def test_delta_chain(self):
+        cp = stackless.checkpointer()
+        t = self.spawn_counter()
+        snapshots = [cp.snapshot([t])]
+        for i in range(3):
+            self.step(t)
+            snapshots.append(cp.snapshot([t]))
+        # an unchanged tasklet refers to the earlier generations only
+        snapshots.append(cp.snapshot([t]))
+        if stackless.enable_softswitch(None):
+            self.assertLess(len(snapshots[-1]), len(snapshots[-2]))
+        restored = self.restore(snapshots[-1], reversed(snapshots[:-1]))
+        frames = self.frames(restored[0])
+        self.assertEqual(frames[0].f_locals["i"], 4)
+        self.assertEqual(frames[0].f_locals["log"], [1, 2, 3, 4])
+        self.skipUnlessSoftswitching()
+        restored[0].insert()
+        stackless.run()
+        self.assertEqual(frames[0].f_locals["log"], [1, 2, 3, 4, 5])
+
+    def check_mutated_in_place(self, func, *args):
+        # the loop parks at the same call with the same locals every time
+        cp = stackless.checkpointer()
+        items = []
+        t = self.spawn(func, *args, items, run=True)
+        snapshots = [cp.snapshot([t])]
+        for i in range(3):
+            self.step(t)
+            snapshots.append(cp.snapshot([t]))
+            restored = self.restore(snapshots[-1], reversed(snapshots[:-1]))
+            self.assertEqual(self.frames(restored[0])[-1].f_locals["items"], items)
+        self.assertEqual(len(items), 3)
+        return snapshots
+
+    def test_mutated_in_place(self):
+        snapshots = self.check_mutated_in_place(appender, 3)
+        # the older frames are still referenced
+        if stackless.enable_softswitch(None):
+            self.assertLess(len(snapshots[-1]), len(snapshots[0]))
+
+    def test_mutated_by_generator_caller(self):
+        # the caller resumes the generator frame again and again
+        self.check_mutated_in_place(consumer)
+
+    def test_new_tasklet(self):
+        cp = stackless.checkpointer()
+        t1 = self.spawn_counter()
+        full = cp.snapshot([t1])
+        t2 = self.spawn_counter(3)
+        delta = cp.snapshot([t2, t1])
+        restored = self.restore(delta, [full])
+        self.assertEqual([len(self.frames(t)) for t in restored], [4, 21])
+        self.assertIs(restored[0].frame.f_locals["log"],
+                      restored[1].frame.f_locals["log"])
+
+    def test_reset(self):
+        cp = stackless.checkpointer()
+        t = self.spawn_counter()
+        cp.snapshot([t])
+        cp.reset()
+        self.assertEqual(cp.generation, 0)
+        data = cp.snapshot([t])
+        self.assertEqual(cp.generation, 1)
+        self.assertEqual(len(self.frames(self.restore(data)[0])), 21)
+
+    def test_failed_snapshot(self):
+        cp = stackless.checkpointer()
+        t = self.spawn_counter()
+        full = cp.snapshot([t])
+        self.assertRaises(TypeError, cp.snapshot, [t, None])
+        self.assertRaises(ValueError, cp.snapshot, [t, t])
+        self.assertEqual(cp.generation, 1)
+        delta = cp.snapshot([t])
+        self.assertEqual(len(self.frames(self.restore(delta, [full])[0])), 21)
+
+    def test_errors(self):
+        cp = stackless.checkpointer()
+        t = self.spawn_counter()
+        full = cp.snapshot([t])
+        delta = cp.snapshot([t])
+        other = stackless.checkpointer().snapshot([t])
+        self.assertRaisesRegex(ValueError, "needs the 1 earlier",
+                               stackless.restore, delta)
+        self.assertRaises(ValueError, stackless.restore, delta, [other])
+        self.assertRaises(ValueError, stackless.restore, delta, [delta])
+        self.assertRaises(ValueError, stackless.restore, full, [full])
+        for i in range(len(delta) - 1):
+            self.assertRaises(ValueError, stackless.restore, delta[:i], [full])
+
+
+class TestBuffers(SnapshotTestCase):
+    """Test out-of-band buffers of snapshots"""
+
+    payload = b"0123456789abcdef" * 4096
+
+    def spawn_holder(self, *values):
+        return self.spawn(hold, *values, run=True)
+
+    def values(self, t):
+        return t.frame.f_locals["values"]
+
+    def buffer_objects(self):
+        return (bytes(self.payload), bytearray(self.payload),
+                array.array("i", range(1000)),
+                memoryview(bytearray(self.payload)).cast("i", [128, 128]))
+
+    def test_out_of_band(self):
+        values = self.buffer_objects()
+        buffers = []
+        data = stackless.snapshot([self.spawn_holder(*values)], buffer_callback=buffers.append)
+        self.assertEqual(len(buffers), 4)
+        for buffer in buffers:
+            self.assertIsInstance(buffer, pickle.PickleBuffer)
+        self.assertNotIn(self.payload[:1000], data)
+        self.assertLess(len(data), 1000)
+        restored = self.values(self.restore(data, buffers=buffers)[0])
+        # zero copy
+        for value, original in zip(restored[:3], values):
+            self.assertIs(value, original)
+        self.assertIsNot(restored[3], values[3])
+        values[3][0, 0] = 42
+        self.assertEqual(restored[3][0, 0], 42)
+        self.assertEqual(restored[3].format, "i")
+        self.assertEqual(restored[3].shape, (128, 128))
+        self.assertFalse(restored[3].readonly)
+
+    def test_copy(self):
+        values = self.buffer_objects()
+        buffers = []
+        data = stackless.snapshot([self.spawn_holder(*values)], buffer_callback=buffers.append)
+        copies = [bytearray(buffer) for buffer in buffers]
+        restored = self.values(self.restore(data, buffers=copies)[0])
+        for value, original in zip(restored, values):
+            self.assertIsNot(value, original)
+            self.assertIs(type(value), type(original))
+            self.assertEqual(value, original)
+        self.assertEqual(restored[2].typecode, "i")
+        self.assertEqual(restored[3].shape, (128, 128))
+
+    def test_readonly(self):
+        view = memoryview(self.payload).cast("B", [len(self.payload)])
+        buffers = []
+        data = stackless.snapshot([self.spawn_holder(view)], buffer_callback=buffers.append)
+        restored = self.values(self.restore(data, buffers=[bytearray(self.payload)])[0])
+        self.assertTrue(restored[0].readonly)
+        self.assertEqual(restored[0], view)
+
+    def test_in_band(self):
+        values = self.buffer_objects()
+        t = self.spawn_holder(*values)
+        data = stackless.snapshot([t], buffer_callback=lambda buffer: True)
+        self.assertIn(self.payload[:1000], data)
+        restored = self.values(self.restore(data)[0])
+        for value, original in zip(restored, values):
+            self.assertIsNot(value, original)
+            self.assertEqual(value, original)
+        # without a callback, the objects get pickled as usual
+        self.assertRaises(TypeError, stackless.snapshot, [t])
+
+    def test_shared(self):
+        shared = bytearray(self.payload)
+        t1, t2 = self.spawn_holder(shared, shared), self.spawn_holder(shared)
+        buffers = []
+        data = stackless.snapshot([t1, t2], buffer_callback=buffers.append)
+        self.assertEqual(len(buffers), 1)
+        restored = self.restore(data, buffers=[bytearray(buffers[0])])
+        values = self.values(restored[0]) + self.values(restored[1])
+        self.assertIsNot(values[0], shared)
+        self.assertIs(values[1], values[0])
+        self.assertIs(values[2], values[0])
+
+    def test_checkpointer(self):
+        cp = stackless.checkpointer()
+        t1 = self.spawn_holder(bytearray(self.payload))
+        buffers1, buffers2 = [], []
+        full = cp.snapshot([t1], buffer_callback=buffers1.append)
+        t2 = self.spawn_holder(bytes(self.payload))
+        delta = cp.snapshot([t1, t2], buffer_callback=buffers2.append)
+        self.assertEqual(len(buffers1), 1)
+        restored = self.restore(delta, [full], buffers1 + buffers2)
+        self.assertIs(self.values(restored[0])[0], self.values(t1)[0])
+        self.assertIs(self.values(restored[1])[0], self.values(t2)[0])
+        self.assertRaisesRegex(ValueError, "got %d out-of-band buffers" % len(buffers2),
+                               stackless.restore, delta, [full], buffers2)
+
+    def test_errors(self):
+        t = self.spawn_holder(bytearray(self.payload))
+        buffers = []
+        data = stackless.snapshot([t], buffer_callback=buffers.append)
+        self.assertRaisesRegex(ValueError, "needs the out-of-band buffers",
+                               stackless.restore, data)
+        self.assertRaises(ValueError, stackless.restore, data, None, buffers * 2)
+        self.assertRaises(TypeError, stackless.restore, data, None, 1)
+        self.assertRaises(ValueError, stackless.restore, stackless.snapshot([t]), None, buffers)
+
+        def callback(buffer):
+            1 / 0
+        self.assertRaises(ZeroDivisionError, stackless.snapshot, [t], buffer_callback=callback)
+        view = memoryview(bytearray(self.payload))[::2]
+        self.assertRaises((TypeError, pickle.PicklingError), stackless.snapshot,
+                          [self.spawn_holder(view)], buffer_callback=buffers.append)
+
+
+class TestClone(SnapshotTestCase):
+    """Test tasklet.clone()"""
+
+    def clone(self, t, **kwargs):
+        c = t.clone(**kwargs)
+        self.keep(c)
+        return c
+
+    def step(self, t):
+        # frames, that were paused with a C state, can't run
+        self.skipUnlessSoftswitching()
+        t.insert()
+        stackless.run()
+
+    def test_clone(self):
+        t = self.spawn(looper, 5, "abc", self.log, run=True)
+        c = self.clone(t)
+        self.assertIsNot(c, t)
+        self.assertTrue(c.paused)
+        f1, f2 = t.frame, c.frame
+        while f1 is not None:
+            self.assertIsNot(f1, f2)
+            self.assertIs(f1.f_code, f2.f_code)
+            self.assertIs(f1.f_globals, f2.f_globals)
+            self.assertEqual(f1.f_lasti, f2.f_lasti)
+            self.assertEqual(f1.f_locals, f2.f_locals)
+            f1, f2 = f1.f_back, f2.f_back
+        self.assertIsNone(f2)
+        # the iterator of the for-loop is copied, the log is shared
+        self.step(t)
+        self.step(c)
+        self.step(t)
+        self.assertEqual(self.log, ["a", "b", "b", "c"])
+        self.step(c)
+        self.step(c)
+        self.assertFalse(c.alive)
+        self.assertEqual(self.log, ["a", "b", "b", "c", "c"])
+
+    def test_copy(self):
+        t = self.spawn(looper, 3, [[1], [2]], self.log, run=True)
+        c = self.clone(t, copy=copy.deepcopy)
+        log = c.frame.f_locals["log"]
+        self.assertIsNot(log, self.log)
+        self.assertEqual(log, self.log)
+        # every object is copied once
+        self.assertIs(c.frame.f_back.f_locals["log"], log)
+        self.step(c)
+        self.assertEqual(self.log, [[1]])
+        self.assertEqual(log, [[1], [2]])
+        self.assertIsNot(log[0], self.log[0])
+
+    def test_unstarted(self):
+        t = self.spawn(looper, 2, "ab", self.log)
+        t.remove()
+        c = self.clone(t)
+        self.step(c)
+        self.assertEqual(self.log, ["a"])
+        self.assertTrue(t.alive)
+
+    def test_subclass(self):
+        t = self.spawn(looper, 1, "a", self.log, cls=SubTasklet, run=True)
+        self.assertIsInstance(self.clone(t), SubTasklet)
+
+    def test_context(self):
+        def task():
+            var.set(1)
+            stackless.schedule_remove()
+            self.log.append(var.get())
+        t = self.spawn(task, run=True)
+        c = self.clone(t)
+        self.assertIsNot(c.context_run(contextvars.copy_context),
+                         t.context_run(contextvars.copy_context))
+        self.assertEqual(c.context_run(var.get), 1)
+        self.step(c)
+        self.assertEqual(self.log, [1])
+
+    def test_errors(self):
+        t = self.spawn(looper, 1, "a", self.log, run=True)
+        self.assertRaises(TypeError, t.clone, copy=1)
+        self.assertRaises(RuntimeError, stackless.current.clone)
+        g = self.spawn(in_generator, run=True)
+        self.assertRaisesRegex(RuntimeError, "generator", g.clone)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,118 @@
+from __future__ import absolute_import
+
+import unittest
+import stackless
+import os
+import socket
+import sys
+
+from support import test_main  # @UnusedImport
+from support import StacklessTestCase
+
+
+@unittest.skipUnless(sys.platform.startswith("linux"), "requires epoll")
+class TestTaskletBlocking(StacklessTestCase):
+    """Test socket.settaskletblocking()"""
+
+    def setUp(self):
+        super(TestTaskletBlocking, self).setUp()
+        self.assertFalse(socket.gettaskletblocking())
+        socket.settaskletblocking(True)
+        self.addCleanup(socket.settaskletblocking, False)
+        self.a, self.b = socket.socketpair()
+        self.addCleanup(self.a.close)
+        self.addCleanup(self.b.close)
+
+    def test_flag(self):
+        self.assertIs(socket.gettaskletblocking(), True)
+        socket.settaskletblocking(0)
+        self.assertIs(socket.gettaskletblocking(), False)
+
+    def test_recv(self):
+        # a blocking recv() blocks only the calling tasklet
+        log = []
+
+        def receiver():
+            log.append(self.a.recv(10))
+
+        def sender():
+            log.append("send")
+            self.b.send(b"data")
+        stackless.tasklet(receiver)()
+        stackless.tasklet(sender)()
+        stackless.run()
+        self.assertEqual(log, ["send", b"data"])
+        self.assertTrue(self.a.getblocking())
+        self.assertIsNone(self.a.gettimeout())
+
+    def test_sendall(self):
+        # sendall() waits for the receiver to drain the buffer
+        data = b"x" * (4 * 1024 * 1024)
+        received = []
+
+        def receiver():
+            n = 0
+            while n < len(data):
+                chunk = self.b.recv(65536)
+                n += len(chunk)
+            received.append(n)
+        stackless.tasklet(receiver)()
+        self.a.sendall(data)
+        stackless.run()
+        self.assertEqual(received, [len(data)])
+
+    def test_accept_connect(self):
+        server = socket.socket()
+        self.addCleanup(server.close)
+        server.bind(("127.0.0.1", 0))
+        server.listen()
+        log = []
+
+        def accept():
+            conn, addr = server.accept()
+            with conn:
+                log.append("accept")
+                conn.sendall(conn.recv(10).upper())
+
+        def connect():
+            with socket.create_connection(server.getsockname()) as conn:
+                log.append("connect")
+                conn.sendall(b"hello")
+                log.append(conn.recv(10))
+        stackless.tasklet(accept)()
+        stackless.tasklet(connect)()
+        stackless.run()
+        self.assertEqual(sorted(log[:2]), ["accept", "connect"])
+        self.assertEqual(log[2:], [b"HELLO"])
+
+    def test_timeout(self):
+        self.a.settimeout(0.05)
+        self.assertRaises(socket.timeout, self.a.recv, 1)
+        self.b.send(b"x")
+        self.assertEqual(self.a.recv(1), b"x")
+
+    def test_nonblocking(self):
+        # a non-blocking socket is not affected
+        self.a.setblocking(False)
+        self.assertRaises(BlockingIOError, self.a.recv, 1)
+
+    def test_disable(self):
+        self.b.send(b"x")
+        self.assertEqual(self.a.recv(1), b"x")
+        self.assertFalse(os.get_blocking(self.a.fileno()))
+        socket.settaskletblocking(False)
+        self.b.send(b"y")
+        self.assertEqual(self.a.recv(1), b"y")
+        self.assertTrue(os.get_blocking(self.a.fileno()))
+
+    def test_kill(self):
+        t = stackless.tasklet(self.a.recv)(1)
+        t.run()
+        self.assertTrue(t.alive)
+        t.kill()
+        self.b.send(b"x")
+        self.assertEqual(self.a.recv(1), b"x")
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,128 @@
+from __future__ import absolute_import
+
+import unittest
+import stackless
+import time
+from test.support import captured_stderr
+
+from support import test_main  # @UnusedImport
+from support import StacklessTestCase
+
+
+class TestTaskletStats(StacklessTestCase):
+    """Test the per tasklet accounting"""
+
+    def setUp(self):
+        super(TestTaskletStats, self).setUp()
+        self.addCleanup(stackless.get_tasklet_stats_by_tag, clear=True)
+        self.addCleanup(stackless.enable_tasklet_stats,
+                        stackless.enable_tasklet_stats(True))
+
+    def test_enable(self):
+        self.assertIs(stackless.enable_tasklet_stats(None), True)
+        self.assertIs(stackless.enable_tasklet_stats(False), True)
+        self.assertIs(stackless.enable_tasklet_stats(None), False)
+        self.assertIs(stackless.enable_tasklet_stats(1), False)
+
+    def test_disabled(self):
+        stackless.enable_tasklet_stats(False)
+        t = stackless.tasklet(stackless.schedule)()
+        stackless.run()
+        self.assertEqual(t.stats["switches"], 0)
+        self.assertEqual(t.stats["run_time"], 0.0)
+
+    def test_keys(self):
+        t = stackless.tasklet()
+        self.assertEqual(set(t.stats), {"run_time", "blocked_time",
+                                        "switches", "soft_switches",
+                                        "hard_switches"})
+        self.assertEqual(t.stats["switches"], 0)
+
+    def test_switches(self):
+        def func():
+            for i in range(3):
+                stackless.schedule()
+        t = stackless.tasklet(func)()
+        stackless.tasklet(func)()
+        stackless.run()
+        stats = t.stats
+        self.assertEqual(stats["switches"], 4)
+        self.assertEqual(stats["switches"],
+                         stats["soft_switches"] + stats["hard_switches"])
+        if stackless.enable_softswitch(None):
+            self.assertGreater(stats["soft_switches"], 0)
+        else:
+            self.assertEqual(stats["soft_switches"], 0)
+
+    def test_run_time(self):
+        def busy():
+            end = time.monotonic() + 0.02
+            while time.monotonic() < end:
+                pass
+        t1 = stackless.tasklet(busy)()
+        t2 = stackless.tasklet(stackless.schedule)()
+        stackless.run()
+        self.assertGreaterEqual(t1.stats["run_time"], 0.015)
+        self.assertLess(t2.stats["run_time"], 0.015)
+
+    def test_current(self):
+        # the running timeslice of the current tasklet counts
+        stats = stackless.current.stats
+        time.sleep(0.01)
+        self.assertGreaterEqual(stackless.current.stats["run_time"] -
+                                stats["run_time"], 0.005)
+
+    def test_blocked_time(self):
+        c = stackless.channel()
+        t = stackless.tasklet(c.receive)()
+        stackless.run()
+        time.sleep(0.02)
+        self.assertGreaterEqual(t.stats["blocked_time"], 0.015)
+        c.send(None)
+        blocked_time = t.stats["blocked_time"]
+        time.sleep(0.01)
+        self.assertEqual(t.stats["blocked_time"], blocked_time)
+        self.assertLess(t.stats["run_time"], blocked_time)
+
+    def test_blocked_while_disabled(self):
+        c = stackless.channel()
+        t = stackless.tasklet(c.receive)()
+        stackless.run()
+        stackless.enable_tasklet_stats(False)
+        time.sleep(0.02)
+        stackless.enable_tasklet_stats(True)
+        c.send(None)
+        self.assertLess(t.stats["blocked_time"], 0.015)
+
+    def test_tag(self):
+        def func():
+            stackless.schedule()
+        tasklets = [stackless.tasklet(func)() for i in range(3)]
+        tasklets[0].stats_tag = "a"
+        tasklets[1].stats_tag = "a"
+        tasklets[2].stats_tag = ("b", 1)
+        self.assertIsNone(stackless.tasklet().stats_tag)
+        self.assertEqual(stackless.get_tasklet_stats_by_tag(), {})
+        stackless.run()
+        stats = stackless.get_tasklet_stats_by_tag()
+        self.assertEqual(set(stats), {"a", ("b", 1)})
+        self.assertEqual(stats["a"]["tasklets"], 2)
+        self.assertEqual(stats["a"]["switches"], 4)
+        self.assertEqual(stats[("b", 1)]["tasklets"], 1)
+        self.assertAlmostEqual(stats["a"]["run_time"],
+                               tasklets[0].stats["run_time"] +
+                               tasklets[1].stats["run_time"])
+        self.assertEqual(len(stackless.get_tasklet_stats_by_tag(clear=True)), 2)
+        self.assertEqual(stackless.get_tasklet_stats_by_tag(), {})
+
+    def test_unhashable_tag(self):
+        t = stackless.tasklet(lambda: None)()
+        t.stats_tag = []
+        with captured_stderr() as stderr:
+            stackless.run()
+        self.assertFalse(t.alive)
+        self.assertIn("TypeError", stderr.getvalue())
+        self.assertEqual(stackless.get_tasklet_stats_by_tag(), {})
+
+if __name__ == '__main__':
+    unittest.main()
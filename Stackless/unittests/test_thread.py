@@ -652,6 +652,130 @@ class TestThreadLocalStorage(StacklessTestCase):
         self.assertTrue(deleted.is_set())
 
 
+@unittest.skipUnless(withThreads, "requires thread support")
+class TestWorkStealing(StacklessTestCase):
+
+    def setUp(self):
+        super(TestWorkStealing, self).setUp()
+        self.addCleanup(stackless.enable_work_stealing,
+                        stackless.enable_work_stealing(None))
+
+    def run_worker(self):
+        info = []
+
+        def worker():
+            stackless.run()
+            info.append(stackless.get_work_stealing_info())
+        t = threading.Thread(target=worker, name="worker")
+        t.start()
+        t.join()
+        self.assertEqual(len(info), 1)
+        return info[0]
+
+    def test_flag(self):
+        self.assertIs(stackless.enable_work_stealing(None), False)
+        self.assertIs(stackless.enable_work_stealing(True), False)
+        self.assertIs(stackless.enable_work_stealing(None), True)
+        self.assertIs(stackless.enable_work_stealing(False), True)
+
+    def test_info(self):
+        info = stackless.get_work_stealing_info()
+        self.assertEqual(set(info), {"attempts", "steals", "stolen", "lost"})
+        self.assertEqual(info,
+                         stackless.get_work_stealing_info(thread.get_ident()))
+
+    def test_disabled(self):
+        result = []
+        stackless.tasklet(result.append)(1)
+        info = self.run_worker()
+        self.assertEqual(info["attempts"], 0)
+        self.assertEqual(result, [])
+        stackless.run()
+        self.assertEqual(result, [1])
+
+    def test_steal(self):
+        result = []
+
+        def task(i):
+            result.append((i, thread.get_ident()))
+            stackless.schedule()
+
+        for i in range(8):
+            stackless.tasklet(task)(i)
+        lost = stackless.get_work_stealing_info()["lost"]
+        stackless.enable_work_stealing(True)
+        info = self.run_worker()
+        self.assertEqual(stackless.getruncount(), 1)
+        self.assertEqual(sorted(i for i, _ in result), list(range(8)))
+        self.assertEqual(len(set(tid for _, tid in result)), 1)
+        self.assertNotEqual(result[0][1], thread.get_ident())
+        self.assertEqual(info["stolen"], 8)
+        self.assertGreater(info["steals"], 0)
+        self.assertEqual(stackless.get_work_stealing_info()["lost"] - lost, 8)
+
+    def test_no_steal_with_cstate(self):
+        result = []
+
+        def task():
+            stackless.schedule()
+            result.append(thread.get_ident())
+
+        t = stackless.tasklet(apply_not_stackless)(task)
+        t.run()
+        self.assertTrue(t.alive)
+        self.assertGreater(t.nesting_level, 0)
+        stackless.enable_work_stealing(True)
+        info = self.run_worker()
+        self.assertGreater(info["attempts"], 0)
+        self.assertEqual(info["stolen"], 0)
+        stackless.run()
+        self.assertEqual(result, [thread.get_ident()])
+
+
+class TestCrossThreadChannel(StacklessTestCase):
+    """Channel operations with a partner in another thread"""
+
+    def test_send_no_switch(self):
+        # a send to a receiver in another thread doesn't switch tasklets
+        c = stackless.channel()
+        result = []
+        t = threading.Thread(target=lambda: result.append(c.receive()))
+        t.start()
+        while c.balance == 0:
+            time.sleep(0.001)
+        other = stackless.tasklet(result.append)("other")
+        c.send("value")
+        self.assertEqual(c.balance, 0)
+        self.assertTrue(other.scheduled)
+        t.join()
+        stackless.run()
+        self.assertEqual(result, ["value", "other"])
+
+    def test_receive_exception(self):
+        c = stackless.channel()
+        t = threading.Thread(target=c.send_exception, args=(ZeroDivisionError,))
+        t.start()
+        while c.balance == 0:
+            time.sleep(0.001)
+        self.assertRaises(ZeroDivisionError, c.receive)
+        t.join()
+
+    def test_ping_pong(self):
+        a, b = stackless.channel(), stackless.channel()
+
+        def echo():
+            for i in range(1000):
+                b.send(a.receive())
+        t = threading.Thread(target=echo)
+        t.start()
+        result = []
+        for i in range(1000):
+            a.send(i)
+            result.append(b.receive())
+        t.join()
+        self.assertEqual(result, list(range(1000)))
+
+
 if __name__ == '__main__':
     if not sys.argv[1:]:
         sys.argv.append('-v')
@@ -0,0 +1,117 @@
+from __future__ import absolute_import
+
+import unittest
+import stackless
+import threading
+import io
+import json
+import struct
+
+from support import test_main  # @UnusedImport
+from support import StacklessTestCase
+
+
+class TestTraceBuffer(StacklessTestCase):
+    """Test the scheduler event ring buffer"""
+
+    def setUp(self):
+        super(TestTraceBuffer, self).setUp()
+        self.addCleanup(stackless.set_trace_buffer, 0)
+
+    def events(self, kind=None):
+        return [e for e in stackless.iter_trace_events()
+                if kind is None or e[6] == kind]
+
+    def test_disabled(self):
+        self.assertEqual(stackless.set_trace_buffer(0), 0)
+        stackless.tasklet(lambda: None)()
+        stackless.run()
+        self.assertEqual(stackless.get_trace_buffer(), b"")
+
+    def test_size(self):
+        self.assertEqual(stackless.set_trace_buffer(10), 0)
+        self.assertEqual(stackless.set_trace_buffer(20), 10)
+        self.assertEqual(stackless.set_trace_buffer(0), 20)
+        self.assertRaises(ValueError, stackless.set_trace_buffer, -1)
+        self.assertRaises(TypeError, stackless.set_trace_buffer, "1")
+
+    def test_switch(self):
+        t = stackless.tasklet(lambda: None)()
+        stackless.set_trace_buffer(100)
+        stackless.run()
+        events = self.events(stackless.TRACE_SWITCH)
+        main = id(stackless.main)
+        self.assertEqual([(e[2], e[3]) for e in events],
+                         [(main, id(t)), (id(t), main)])
+        times = [e[0] for e in events]
+        self.assertEqual(times, sorted(times))
+        self.assertEqual(len(stackless.get_trace_buffer()),
+                         2 * struct.calcsize(stackless.TRACE_EVENT_FORMAT))
+
+    def test_hard_switch(self):
+        stackless.tasklet(stackless.schedule)()
+        stackless.set_trace_buffer(100)
+        stackless.run()
+        for e in self.events(stackless.TRACE_SWITCH):
+            if e[7] & stackless.TRACE_HARD:
+                self.assertGreater(e[5], 0)
+            else:
+                self.assertEqual(e[5], 0)
+        if not stackless.enable_softswitch(None):
+            self.assertTrue(any(e[7] & stackless.TRACE_HARD
+                                for e in self.events(stackless.TRACE_SWITCH)))
+
+    def test_channel(self):
+        c = stackless.channel()
+        t = stackless.tasklet(c.send)("value")
+        stackless.set_trace_buffer(100)
+        stackless.run()
+        c.receive()
+        send, receive = (self.events(stackless.TRACE_SEND),
+                         self.events(stackless.TRACE_RECEIVE))
+        self.assertEqual([e[2] for e in send], [id(t)])
+        self.assertEqual([e[2] for e in receive], [id(stackless.main)])
+        self.assertEqual([e[4] for e in send + receive], [id(c)] * 2)
+        self.assertEqual(send[0][7], stackless.TRACE_WILLBLOCK)
+        self.assertEqual(receive[0][7], 0)
+
+    def test_ring(self):
+        stackless.set_trace_buffer(3)
+        for i in range(5):
+            stackless.schedule()
+            stackless.tasklet(lambda: None)()
+            stackless.run()
+        events = self.events()
+        self.assertEqual(len(events), 3)
+        # the buffer keeps the most recent events
+        self.assertEqual(events[-1][3], id(stackless.main))
+
+    def test_thread(self):
+        stackless.set_trace_buffer(100)
+
+        def thread():
+            stackless.tasklet(lambda: None)()
+            stackless.run()
+        t = threading.Thread(target=thread)
+        t.start()
+        t.join()
+        self.assertEqual({e[1] for e in self.events()}, {t.ident})
+
+    def test_chrome_trace(self):
+        c = stackless.channel()
+        stackless.tasklet(c.send)(None)
+        stackless.set_trace_buffer(100)
+        stackless.run()
+        c.receive()
+        f = io.StringIO()
+        stackless.write_chrome_trace(f)
+        events = json.loads(f.getvalue())["traceEvents"]
+        phases = [e["ph"] for e in events]
+        self.assertEqual(phases.count("B"), phases.count("E"))
+        self.assertEqual(phases.count("i"), 2)
+        self.assertEqual({e["name"] for e in events if e["ph"] == "i"},
+                         {"send", "receive"})
+
+
+if __name__ == '__main__':
+    unittest.main()
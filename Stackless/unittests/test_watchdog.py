@@ -1,6 +1,7 @@
 from __future__ import absolute_import
 import sys
 import random
+import time
 import unittest
 import stackless
 
@@ -631,6 +632,90 @@ class TestNewWatchdog(StacklessTestCase):
         self._test_schedule_deeper(False)
 
 
+class TestWallclockWatchdog(StacklessTestCase):
+    """Test the timeslice in microseconds, see run(wallclock=True)
+
+    Hard switched tasklets run at nesting level 1, therefore the
+    tests use ignore_nesting.
+    """
+
+    def test_slow_opcodes(self):
+        # few, but slow opcodes don't delay the interrupt
+        count = [0]
+
+        def slow():
+            while True:
+                time.sleep(0.002)
+                count[0] += 1
+        t = stackless.tasklet(slow)()
+        start = time.monotonic()
+        victim = stackless.run(1000, wallclock=True, ignore_nesting=True)
+        self.assertIs(victim, t)
+        self.assertLess(time.monotonic() - start, 0.5)
+        self.assertLess(count[0], 20)
+        t.kill()
+
+    def test_fast_opcodes(self):
+        # many fast opcodes don't exhaust a long timeslice
+        def fast():
+            for i in range(20000):
+                i = i
+        t = stackless.tasklet(fast)()
+        self.assertIsNone(stackless.run(10 * 1000 * 1000, wallclock=True, ignore_nesting=True))
+        self.assertFalse(t.alive)
+
+    def test_timeslice_per_tasklet(self):
+        # each switch starts a new timeslice
+        def worker():
+            for i in range(5):
+                time.sleep(0.001)
+                stackless.schedule()
+        tasklets = [stackless.tasklet(worker)() for i in range(3)]
+        self.assertIsNone(stackless.run(500 * 1000, wallclock=True, ignore_nesting=True))
+        self.assertFalse(any(t.alive for t in tasklets))
+
+    def test_totaltimeout(self):
+        def worker():
+            while True:
+                stackless.schedule()
+        tasklets = [stackless.tasklet(worker)() for i in range(2)]
+        start = time.monotonic()
+        victim = stackless.run(20 * 1000, wallclock=True, totaltimeout=True,
+                               ignore_nesting=True)
+        self.assertIn(victim, tasklets)
+        self.assertGreaterEqual(time.monotonic() - start, 0.015)
+        for t in tasklets:
+            t.kill()
+
+    def test_soft(self):
+        def slow():
+            while True:
+                time.sleep(0.002)
+                stackless.schedule()
+        t = stackless.tasklet(slow)()
+        self.assertIsNone(stackless.run(1000, wallclock=True, soft=True,
+                                        ignore_nesting=True))
+        self.assertTrue(t.scheduled)
+        t.kill()
+
+    def test_nested_run_keeps_timeslice(self):
+        # an inner run() with a timeout doesn't change the watchdog
+        def inner():
+            stackless.run(10 * 1000 * 1000, wallclock=True, ignore_nesting=True)
+            self.fail("not interrupted")
+
+        def slow():
+            while True:
+                time.sleep(0.002)
+        t1 = stackless.tasklet(inner)()
+        t2 = stackless.tasklet(slow)()
+        victim = stackless.run(1000, wallclock=True, totaltimeout=True,
+                               ignore_nesting=True)
+        self.assertIn(victim, (t1, t2))
+        t1.kill()
+        t2.kill()
+
+
 if __name__ == '__main__':
     if not sys.argv[1:]:
         sys.argv.append('-v')